@@ -495,6 +495,8 @@ static void eel_canvas_queue_resize(EelCanvas *canvas) {
     gtk_widget_queue_resize(GTK_WIDGET(canvas));
 }
 
+static void group_index_invalidate(EelCanvasGroup *group);
+
 /* Convenience function to reorder items in a group's child list.  This puts the
  * specified link after the "before" link. Returns TRUE if the list was changed.
  */
@@ -504,6 +506,7 @@ static gboolean put_item_after(GList *link, GList *before) {
   if (link == before) return FALSE;
 
   parent = EEL_CANVAS_GROUP(EEL_CANVAS_ITEM(link->data)->parent);
+  group_index_invalidate(parent);
 
   if (before == NULL) {
     if (link == parent->item_list) return FALSE;
@@ -1210,6 +1213,243 @@ static void eel_canvas_group_get_property(GObject *gobject, guint param_id,
   }
 }
 
+/* Groups with fewer children than this are simply walked in full. */
+#define GROUP_INDEX_MIN_ITEMS 64
+
+/* Size in pixels of the square cells of the spatial index. */
+#define GROUP_INDEX_CELL_SIZE 256
+
+/* Children covering more cells than this are not filed in the cells but
+ * tested for every query, e.g. backgrounds spanning the whole canvas.
+ */
+#define GROUP_INDEX_MAX_ITEM_CELLS 16
+
+/* A uniform grid over the children's pixel bounds. The cells hold the
+ * children's positions in the stacking order, so that the result of a
+ * query can be sorted back into drawing order. Adding, removing or
+ * restacking children rebuilds it, a child whose bounds change is moved
+ * between the cells.
+ */
+struct _EelCanvasGroupIndex {
+  GPtrArray *items;
+  GHashTable *cells;
+  GArray *large_items;
+  /* The GroupIndexSpans the children are filed under, by position */
+  GArray *spans;
+};
+
+/* The cells a child is filed in */
+typedef struct {
+  int cx1, cy1, cx2, cy2;
+  gboolean large;
+} GroupIndexSpan;
+
+static gpointer group_index_cell_key(int cx, int cy) {
+  /* Cells that alias each other only produce extra candidates, the
+   * callers always check the exact bounds.
+   */
+  return GUINT_TO_POINTER(((guint)(cy & 0xffff) << 16) | (guint)(cx & 0xffff));
+}
+
+static int group_index_cell(double coordinate) {
+  return (int)floor(coordinate / GROUP_INDEX_CELL_SIZE);
+}
+
+static void group_index_invalidate(EelCanvasGroup *group) {
+  struct _EelCanvasGroupIndex *index;
+
+  index = group->index;
+  if (index == NULL) return;
+
+  g_ptr_array_free(index->items, TRUE);
+  g_hash_table_destroy(index->cells);
+  g_array_free(index->large_items, TRUE);
+  g_array_free(index->spans, TRUE);
+  g_free(index);
+
+  group->index = NULL;
+}
+
+static void group_index_span_for_item(EelCanvasItem *item,
+                                      GroupIndexSpan *span) {
+  span->cx1 = group_index_cell(item->x1);
+  span->cy1 = group_index_cell(item->y1);
+  span->cx2 = group_index_cell(item->x2);
+  span->cy2 = group_index_cell(item->y2);
+  span->large = (gint64)(span->cx2 - span->cx1 + 1) *
+                    (span->cy2 - span->cy1 + 1) >
+                GROUP_INDEX_MAX_ITEM_CELLS;
+}
+
+static void group_index_file(struct _EelCanvasGroupIndex *index,
+                             guint position, const GroupIndexSpan *span) {
+  GArray *cell;
+  int cx, cy;
+
+  if (span->large) {
+    g_array_append_val(index->large_items, position);
+    return;
+  }
+
+  for (cy = span->cy1; cy <= span->cy2; cy++) {
+    for (cx = span->cx1; cx <= span->cx2; cx++) {
+      cell = g_hash_table_lookup(index->cells, group_index_cell_key(cx, cy));
+      if (cell == NULL) {
+        cell = g_array_new(FALSE, FALSE, sizeof(guint));
+        g_hash_table_insert(index->cells, group_index_cell_key(cx, cy), cell);
+      }
+      g_array_append_val(cell, position);
+    }
+  }
+}
+
+/* Removes position from list, the order of the positions doesn't matter */
+static void group_index_remove_position(GArray *list, guint position) {
+  guint i;
+
+  for (i = 0; i < list->len; i++) {
+    if (g_array_index(list, guint, i) == position) {
+      g_array_remove_index_fast(list, i);
+      return;
+    }
+  }
+}
+
+static void group_index_unfile(struct _EelCanvasGroupIndex *index,
+                               guint position, const GroupIndexSpan *span) {
+  GArray *cell;
+  gpointer key;
+  int cx, cy;
+
+  if (span->large) {
+    group_index_remove_position(index->large_items, position);
+    return;
+  }
+
+  for (cy = span->cy1; cy <= span->cy2; cy++) {
+    for (cx = span->cx1; cx <= span->cx2; cx++) {
+      key = group_index_cell_key(cx, cy);
+      cell = g_hash_table_lookup(index->cells, key);
+      if (cell == NULL) continue;
+
+      group_index_remove_position(cell, position);
+      if (cell->len == 0) g_hash_table_remove(index->cells, key);
+    }
+  }
+}
+
+/* Files the child at position under its new bounds, touching only the
+ * cells it leaves and enters.
+ */
+static void group_index_move(struct _EelCanvasGroupIndex *index,
+                             guint position) {
+  GroupIndexSpan *span, new_span;
+
+  span = &g_array_index(index->spans, GroupIndexSpan, position);
+  group_index_span_for_item(g_ptr_array_index(index->items, position),
+                            &new_span);
+
+  if (new_span.cx1 == span->cx1 && new_span.cy1 == span->cy1 &&
+      new_span.cx2 == span->cx2 && new_span.cy2 == span->cy2)
+    return;
+
+  group_index_unfile(index, position, span);
+  group_index_file(index, position, &new_span);
+  *span = new_span;
+}
+
+static struct _EelCanvasGroupIndex *group_index_get(EelCanvasGroup *group) {
+  struct _EelCanvasGroupIndex *index;
+  EelCanvasItem *child;
+  GroupIndexSpan span;
+  GList *list;
+  guint position;
+
+  if (group->index != NULL) return group->index;
+
+  if (g_list_nth(group->item_list, GROUP_INDEX_MIN_ITEMS - 1) == NULL)
+    return NULL;
+
+  index = g_new0(struct _EelCanvasGroupIndex, 1);
+  index->items = g_ptr_array_new();
+  index->cells = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                       (GDestroyNotify)g_array_unref);
+  index->large_items = g_array_new(FALSE, FALSE, sizeof(guint));
+  index->spans = g_array_new(FALSE, FALSE, sizeof(GroupIndexSpan));
+
+  for (list = group->item_list; list; list = list->next) {
+    child = list->data;
+    position = index->items->len;
+    g_ptr_array_add(index->items, child);
+
+    group_index_span_for_item(child, &span);
+    g_array_append_val(index->spans, span);
+    group_index_file(index, position, &span);
+  }
+
+  group->index = index;
+
+  return index;
+}
+
+static int compare_positions(gconstpointer a, gconstpointer b) {
+  guint pa, pb;
+
+  pa = *(const guint *)a;
+  pb = *(const guint *)b;
+
+  return (pa > pb) - (pa < pb);
+}
+
+/* Returns the children that may overlap the given pixel rectangle, bottom
+ * to top, or NULL if the group has no index and has to be walked in full.
+ */
+static GPtrArray *group_index_query(EelCanvasGroup *group, int x1, int y1,
+                                    int x2, int y2) {
+  struct _EelCanvasGroupIndex *index;
+  GPtrArray *result;
+  GArray *positions, *cell;
+  guint i, last;
+  int cx, cy, cx1, cy1, cx2, cy2;
+
+  index = group_index_get(group);
+  if (index == NULL) return NULL;
+
+  cx1 = group_index_cell(x1);
+  cy1 = group_index_cell(y1);
+  cx2 = group_index_cell(x2);
+  cy2 = group_index_cell(y2);
+
+  /* A query covering more cells than there are children gains nothing. */
+  if ((gint64)(cx2 - cx1 + 1) * (cy2 - cy1 + 1) > index->items->len)
+    return NULL;
+
+  positions = g_array_new(FALSE, FALSE, sizeof(guint));
+  g_array_append_vals(positions, index->large_items->data,
+                      index->large_items->len);
+
+  for (cy = cy1; cy <= cy2; cy++) {
+    for (cx = cx1; cx <= cx2; cx++) {
+      cell = g_hash_table_lookup(index->cells, group_index_cell_key(cx, cy));
+      if (cell != NULL) g_array_append_vals(positions, cell->data, cell->len);
+    }
+  }
+
+  g_array_sort(positions, compare_positions);
+
+  result = g_ptr_array_sized_new(positions->len);
+  last = G_MAXUINT;
+  for (i = 0; i < positions->len; i++) {
+    if (g_array_index(positions, guint, i) == last) continue;
+    last = g_array_index(positions, guint, i);
+    g_ptr_array_add(result, g_ptr_array_index(index->items, last));
+  }
+
+  g_array_free(positions, TRUE);
+
+  return result;
+}
+
 /* Destroy handler for canvas groups */
 static void eel_canvas_group_destroy(EelCanvasItem *object) {
   EelCanvasGroup *group;
@@ -1228,6 +1468,8 @@ static void eel_canvas_group_destroy(EelCanvasItem *object) {
     eel_canvas_item_destroy(child);
   }
 
+  group_index_invalidate(group);
+
   if (EEL_CANVAS_ITEM_CLASS(group_parent_class)->destroy)
     (*EEL_CANVAS_ITEM_CLASS(group_parent_class)->destroy)(object);
 }
@@ -1239,6 +1481,8 @@ static void eel_canvas_group_update(EelCanvasItem *item, double i2w_dx,
   GList *list;
   EelCanvasItem *i;
   double bbox_x0, bbox_y0, bbox_x1, bbox_y1;
+  double old_x1, old_y1, old_x2, old_y2;
+  guint position;
   gboolean first = TRUE;
 
   group = EEL_CANVAS_GROUP(item);
@@ -1250,12 +1494,24 @@ static void eel_canvas_group_update(EelCanvasItem *item, double i2w_dx,
   bbox_x1 = 0;
   bbox_y1 = 0;
 
-  for (list = group->item_list; list; list = list->next) {
+  position = 0;
+  for (list = group->item_list; list; list = list->next, position++) {
     i = list->data;
 
+    old_x1 = i->x1;
+    old_y1 = i->y1;
+    old_x2 = i->x2;
+    old_y2 = i->y2;
+
     eel_canvas_item_invoke_update(i, i2w_dx + group->xpos, i2w_dy + group->ypos,
                                   flags);
 
+    /* The index is in stacking order, as long as there is one */
+    if (group->index != NULL &&
+        (i->x1 != old_x1 || i->y1 != old_y1 || i->x2 != old_x2 ||
+         i->y2 != old_y2))
+      group_index_move(group->index, position);
+
     if (first) {
       first = FALSE;
       bbox_x0 = i->x1;
@@ -1343,12 +1599,26 @@ static void eel_canvas_group_draw(EelCanvasItem *item, cairo_t *cr,
                                   cairo_region_t *region) {
   EelCanvasGroup *group;
   GList *list;
+  GPtrArray *candidates;
+  cairo_rectangle_int_t extents;
   EelCanvasItem *child = NULL;
+  guint i;
 
   group = EEL_CANVAS_GROUP(item);
 
-  for (list = group->item_list; list; list = list->next) {
-    child = list->data;
+  cairo_region_get_extents(region, &extents);
+  candidates =
+      group_index_query(group, extents.x, extents.y,
+                        extents.x + extents.width, extents.y + extents.height);
+
+  list = group->item_list;
+  for (i = 0; candidates != NULL ? i < candidates->len : list != NULL; i++) {
+    if (candidates != NULL) {
+      child = g_ptr_array_index(candidates, i);
+    } else {
+      child = list->data;
+      list = list->next;
+    }
 
     if ((child->flags & EEL_CANVAS_ITEM_MAPPED) &&
         (EEL_CANVAS_ITEM_GET_CLASS(child)->draw)) {
@@ -1364,6 +1634,8 @@ static void eel_canvas_group_draw(EelCanvasItem *item, cairo_t *cr,
         EEL_CANVAS_ITEM_GET_CLASS(child)->draw(child, cr, region);
     }
   }
+
+  if (candidates != NULL) g_ptr_array_free(candidates, TRUE);
 }
 
 /* Point handler for canvas groups */
@@ -1376,8 +1648,10 @@ static double eel_canvas_group_point(EelCanvasItem *item, double x, double y,
   int has_point;
   EelCanvasGroup *group;
   GList *list;
+  GPtrArray *candidates;
   EelCanvasItem *point_item;
   EelCanvasItem *child = NULL;
+  guint i;
 
   group = EEL_CANVAS_GROUP(item);
 
@@ -1394,8 +1668,16 @@ static double eel_canvas_group_point(EelCanvasItem *item, double x, double y,
 
   dist = 0.0; /* keep gcc happy */
 
-  for (list = group->item_list; list; list = list->next) {
-    child = list->data;
+  candidates = group_index_query(group, x1, y1, x2, y2);
+
+  list = group->item_list;
+  for (i = 0; candidates != NULL ? i < candidates->len : list != NULL; i++) {
+    if (candidates != NULL) {
+      child = g_ptr_array_index(candidates, i);
+    } else {
+      child = list->data;
+      list = list->next;
+    }
 
     if ((child->x1 > x2) || (child->y1 > y2) || (child->x2 < x1) ||
         (child->y2 < y1))
@@ -1418,6 +1700,8 @@ static double eel_canvas_group_point(EelCanvasItem *item, double x, double y,
     }
   }
 
+  if (candidates != NULL) g_ptr_array_free(candidates, TRUE);
+
   return best;
 }
 
@@ -1504,6 +1788,8 @@ static void eel_canvas_group_bounds(EelCanvasItem *item, double *x1, double *y1,
 static void group_add(EelCanvasGroup *group, EelCanvasItem *item) {
   g_object_ref_sink(item);
 
+  group_index_invalidate(group);
+
   if (!group->item_list) {
     group->item_list = g_list_append(group->item_list, item);
     group->item_list_end = group->item_list;
@@ -1553,6 +1839,8 @@ static void group_remove(EelCanvasGroup *group, EelCanvasItem *item) {
       if (children == group->item_list_end)
         group->item_list_end = children->prev;
 
+      group_index_invalidate(group);
+
       group->item_list = g_list_remove_link(group->item_list, children);
       g_list_free(children);
       break;
@@ -1814,6 +2102,82 @@ static void eel_canvas_init(EelCanvas *canvas) {
 
   canvas->need_repick = TRUE;
   canvas->doing_update = FALSE;
+
+  canvas->dirty_rects = g_array_new(FALSE, FALSE, sizeof(GdkRectangle));
+}
+
+/* Maximum number of separate rectangles invalidated per frame */
+#define MAX_DIRTY_RECTS 16
+
+/* Two dirty rectangles are merged if their union wastes at most this many
+ * pixels that neither of them covers.
+ */
+#define DIRTY_RECT_MERGE_SLACK (64 * 64)
+
+static gint64 rect_area(const GdkRectangle *rect) {
+  return (gint64)rect->width * rect->height;
+}
+
+static gint64 rect_union_waste(const GdkRectangle *a, const GdkRectangle *b) {
+  GdkRectangle u;
+
+  gdk_rectangle_union(a, b, &u);
+  return rect_area(&u) - rect_area(a) - rect_area(b);
+}
+
+static void queue_dirty_rect(EelCanvas *canvas, const GdkRectangle *rect) {
+  GdkRectangle *dirty, *best;
+  gint64 waste, best_waste;
+  guint i;
+
+  best = NULL;
+  best_waste = G_MAXINT64;
+
+  for (i = 0; i < canvas->dirty_rects->len; i++) {
+    dirty = &g_array_index(canvas->dirty_rects, GdkRectangle, i);
+
+    waste = rect_union_waste(dirty, rect);
+    if (waste <= DIRTY_RECT_MERGE_SLACK) {
+      gdk_rectangle_union(dirty, rect, dirty);
+      return;
+    }
+
+    if (waste < best_waste) {
+      best = dirty;
+      best_waste = waste;
+    }
+  }
+
+  if (canvas->dirty_rects->len < MAX_DIRTY_RECTS) {
+    g_array_append_vals(canvas->dirty_rects, rect, 1);
+  } else {
+    /* Out of slots, grow the rectangle that grows the least. */
+    gdk_rectangle_union(best, rect, best);
+  }
+}
+
+static void flush_dirty_rects(EelCanvas *canvas) {
+  GdkWindow *bin_window;
+  cairo_region_t *region;
+
+  if (canvas->dirty_rects == NULL || canvas->dirty_rects->len == 0) return;
+
+  bin_window = gtk_layout_get_bin_window(GTK_LAYOUT(canvas));
+  if (bin_window != NULL) {
+    region = cairo_region_create_rectangles(
+        (cairo_rectangle_int_t *)canvas->dirty_rects->data,
+        canvas->dirty_rects->len);
+    gdk_window_invalidate_region(bin_window, region, FALSE);
+    cairo_region_destroy(region);
+  }
+
+  canvas->frame_dirty_rects += canvas->dirty_rects->len;
+  g_array_set_size(canvas->dirty_rects, 0);
+}
+
+static void before_paint_callback(GdkFrameClock *frame_clock,
+                                  EelCanvas *canvas) {
+  flush_dirty_rects(canvas);
 }
 
 /* Convenience function to remove the idle handler of a canvas */
@@ -1866,6 +2230,8 @@ static void eel_canvas_destroy(GtkWidget *object) {
 
   shutdown_transients(canvas);
 
+  g_clear_pointer(&canvas->dirty_rects, g_array_unref);
+
   if (GTK_WIDGET_CLASS(canvas_parent_class)->destroy)
     (*GTK_WIDGET_CLASS(canvas_parent_class)->destroy)(object);
 }
@@ -1950,6 +2316,11 @@ static void eel_canvas_realize(GtkWidget *widget) {
   /* Create our own temporary pixmap gc and realize all the items */
 
   (*EEL_CANVAS_ITEM_GET_CLASS(canvas->root)->realize)(canvas->root);
+
+  /* Redraw requests are collected and flushed once per frame */
+  canvas->before_paint_id =
+      g_signal_connect(gtk_widget_get_frame_clock(widget), "before-paint",
+                       G_CALLBACK(before_paint_callback), canvas);
 }
 
 /* Unrealize handler for the canvas */
@@ -1962,6 +2333,13 @@ static void eel_canvas_unrealize(GtkWidget *widget) {
 
   shutdown_transients(canvas);
 
+  if (canvas->before_paint_id != 0) {
+    g_signal_handler_disconnect(gtk_widget_get_frame_clock(widget),
+                                canvas->before_paint_id);
+    canvas->before_paint_id = 0;
+  }
+  if (canvas->dirty_rects != NULL) g_array_set_size(canvas->dirty_rects, 0);
+
   /* Unrealize items and parent widget */
 
   (*EEL_CANVAS_ITEM_GET_CLASS(canvas->root)->unrealize)(canvas->root);
@@ -2545,11 +2923,28 @@ static cairo_region_t *eel_cairo_get_clip_region(cairo_t *cr) {
   return region;
 }
 
+/* Adds a frame that took draw_time microseconds to the frame counters */
+static void update_frame_stats(EelCanvas *canvas, gint64 draw_time) {
+  EelCanvasFrameStats *stats;
+
+  stats = &canvas->frame_stats;
+  stats->n_frames++;
+  stats->n_redraw_requests += canvas->frame_redraw_requests;
+  stats->n_dirty_rects += canvas->frame_dirty_rects;
+  stats->draw_time += draw_time;
+  stats->max_draw_time = MAX(stats->max_draw_time, draw_time);
+
+  stats->last_redraw_requests = canvas->frame_redraw_requests;
+  stats->last_dirty_rects = canvas->frame_dirty_rects;
+  stats->last_draw_time = draw_time;
+}
+
 /* Expose handler for the canvas */
 static gboolean eel_canvas_draw(GtkWidget *widget, cairo_t *cr) {
   EelCanvas *canvas = EEL_CANVAS(widget);
   GdkWindow *bin_window;
   cairo_region_t *region;
+  gint64 draw_start;
 
   if (!gdk_cairo_get_clip_rectangle(cr, NULL)) return FALSE;
 
@@ -2567,6 +2962,8 @@ static gboolean eel_canvas_draw(GtkWidget *widget, cairo_t *cr) {
     return FALSE;
   }
 
+  draw_start = g_get_monotonic_time();
+
 #if defined VERBOSE
   g_print("Draw\n");
 #endif
@@ -2596,6 +2993,10 @@ static gboolean eel_canvas_draw(GtkWidget *widget, cairo_t *cr) {
   if (canvas->root->flags & EEL_CANVAS_ITEM_MAPPED)
     EEL_CANVAS_ITEM_GET_CLASS(canvas->root)->draw(canvas->root, cr, region);
 
+  update_frame_stats(canvas, g_get_monotonic_time() - draw_start);
+  canvas->frame_redraw_requests = 0;
+  canvas->frame_dirty_rects = 0;
+
   /* Chain up to get exposes on child widgets */
   cairo_restore(cr);
 
@@ -2947,6 +3348,34 @@ void eel_canvas_update_now(EelCanvas *canvas) {
   do_update(canvas);
 }
 
+/**
+ * eel_canvas_get_frame_stats:
+ * @canvas: A canvas.
+ * @stats: Return value for the counters.
+ *
+ * Gets how many frames the canvas drew, how many redraw requests and
+ * invalidated rectangles they had and how long drawing them took.
+ **/
+void eel_canvas_get_frame_stats(EelCanvas *canvas,
+                                EelCanvasFrameStats *stats) {
+  g_return_if_fail(EEL_IS_CANVAS(canvas));
+  g_return_if_fail(stats != NULL);
+
+  *stats = canvas->frame_stats;
+}
+
+/**
+ * eel_canvas_reset_frame_stats:
+ * @canvas: A canvas.
+ *
+ * Sets the frame counters of the canvas back to zero.
+ **/
+void eel_canvas_reset_frame_stats(EelCanvas *canvas) {
+  g_return_if_fail(EEL_IS_CANVAS(canvas));
+
+  memset(&canvas->frame_stats, 0, sizeof(canvas->frame_stats));
+}
+
 /**
  * eel_canvas_get_item_at:
  * @canvas: A canvas.
@@ -3000,6 +3429,7 @@ static void eel_canvas_request_update_real(EelCanvas *canvas) {
 void eel_canvas_request_redraw(EelCanvas *canvas, int x1, int y1, int x2,
                                int y2) {
   GdkRectangle bbox;
+  GdkFrameClock *frame_clock;
 
   g_return_if_fail(EEL_IS_CANVAS(canvas));
 
@@ -3011,8 +3441,20 @@ void eel_canvas_request_redraw(EelCanvas *canvas, int x1, int y1, int x2,
   bbox.width = x2 - x1;
   bbox.height = y2 - y1;
 
-  gdk_window_invalidate_rect(gtk_layout_get_bin_window(GTK_LAYOUT(canvas)),
-                             &bbox, FALSE);
+  frame_clock = gtk_widget_get_frame_clock(GTK_WIDGET(canvas));
+  if (frame_clock == NULL || canvas->before_paint_id == 0 ||
+      canvas->dirty_rects == NULL) {
+    gdk_window_invalidate_rect(gtk_layout_get_bin_window(GTK_LAYOUT(canvas)),
+                               &bbox, FALSE);
+    return;
+  }
+
+  canvas->frame_redraw_requests++;
+  if (canvas->dirty_rects->len == 0)
+    gdk_frame_clock_request_phase(frame_clock,
+                                  GDK_FRAME_CLOCK_PHASE_BEFORE_PAINT);
+
+  queue_dirty_rect(canvas, &bbox);
 }
 
 /**
@@ -67,6 +67,21 @@ typedef struct _EelCanvasItemClass EelCanvasItemClass;
 typedef struct _EelCanvasGroup EelCanvasGroup;
 typedef struct _EelCanvasGroupClass EelCanvasGroupClass;
 
+/* Counters of the frames a canvas drew, see eel_canvas_get_frame_stats() */
+typedef struct {
+  guint n_frames;
+  guint64 n_redraw_requests;
+  guint64 n_dirty_rects;
+  /* In microseconds */
+  gint64 draw_time;
+  gint64 max_draw_time;
+
+  /* Of the last frame */
+  guint last_redraw_requests;
+  guint last_dirty_rects;
+  gint64 last_draw_time;
+} EelCanvasFrameStats;
+
 /* EelCanvasItem - base item class for canvas items
  *
  * All canvas items are derived from EelCanvasItem.  The only information a
@@ -326,6 +341,11 @@ struct _EelCanvasGroup {
   /* Children of the group */
   GList *item_list;
   GList *item_list_end;
+
+  /* Spatial index of the children's bounds, built on demand for large
+   * groups and dropped whenever the children change. Private.
+   */
+  struct _EelCanvasGroupIndex *index;
 };
 
 struct _EelCanvasGroupClass {
@@ -394,6 +414,17 @@ struct _EelCanvas {
   /* Tolerance distance for picking items */
   int close_enough;
 
+  /* Rectangles waiting to be invalidated in the next frame's before-paint
+   * phase, merged into at most a few cairo_rectangle_int_t's.
+   */
+  GArray *dirty_rects;
+  gulong before_paint_id;
+
+  /* Counted for the frame being prepared */
+  guint frame_redraw_requests;
+  guint frame_dirty_rects;
+  EelCanvasFrameStats frame_stats;
+
   /* Whether the canvas should center the canvas in the middle of
    * the window if the scroll region is smaller than the window */
   unsigned int center_scroll_region : 1;
@@ -477,6 +508,12 @@ void eel_canvas_get_scroll_offsets(EelCanvas *canvas, int *cx, int *cy);
  */
 void eel_canvas_update_now(EelCanvas *canvas);
 
+/* Gets the counters of the frames drawn since the canvas was created or
+ * the counters were reset.
+ */
+void eel_canvas_get_frame_stats(EelCanvas *canvas, EelCanvasFrameStats *stats);
+void eel_canvas_reset_frame_stats(EelCanvas *canvas);
+
 /* Returns the item that is at the specified position in world coordinates, or
  * NULL if no item is there.
  */
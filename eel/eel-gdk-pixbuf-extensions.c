@@ -36,6 +36,11 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "eel-debug.h"
 #include "eel-gdk-extensions.h"
@@ -240,131 +245,292 @@ void eel_gdk_pixbuf_unref_if_not_null(GdkPixbuf *pixbuf_or_null) {
   }
 }
 
-GdkPixbuf *eel_gdk_pixbuf_scale_down(GdkPixbuf *pixbuf, int dest_width,
-                                     int dest_height) {
-  int source_width, source_height;
-  int s_y1, s_x2;
-  int s_yfrac;
-  int dx, dx_frac, dy, dy_frac;
-  div_t ddx, ddy;
-  int x, y;
-  int r, g, b, a;
-  int n_pixels;
+/* The box filter below runs one stripe of destination rows per thread once
+ * the source has at least this many pixels for each thread.
+ */
+#define SCALE_DOWN_PIXELS_PER_THREAD (2 * 1024 * 1024)
+#define SCALE_DOWN_MAX_THREADS 8
+
+typedef struct {
+  const guchar *src_pixels;
+  int source_rowstride;
   gboolean has_alpha;
-  guchar *dest, *src, *xsrc, *src_pixels;
-  GdkPixbuf *dest_pixbuf;
-  int pixel_stride;
-  int source_rowstride, dest_rowstride;
 
-  if (dest_width == 0 || dest_height == 0) {
-    return NULL;
+  /* Source column and row at which each destination pixel starts, plus
+   * the end of the last one.
+   */
+  const int *x_bounds;
+  const int *y_bounds;
+  int dest_width;
+
+  guchar *dest_pixels;
+  int dest_rowstride;
+  gboolean to_surface;
+
+  int first_row;
+  int end_row;
+} ScaleDownStripe;
+
+/* Splits length source pixels into dest_length boxes, the same way the box
+ * filter always did: Bresenham steps starting half a step in.
+ */
+static int *compute_box_bounds(int length, int dest_length) {
+  int *bounds;
+  div_t d;
+  int i, frac;
+
+  bounds = g_new(int, dest_length + 1);
+  d = div(length, dest_length);
+
+  bounds[0] = 0;
+  frac = -dest_length / 2;
+  for (i = 1; i <= dest_length; i++) {
+    bounds[i] = bounds[i - 1] + d.quot;
+    frac += d.rem;
+    if (frac > 0) {
+      bounds[i]++;
+      frac -= dest_length;
+    }
   }
 
-  source_width = gdk_pixbuf_get_width(pixbuf);
-  source_height = gdk_pixbuf_get_height(pixbuf);
+  return bounds;
+}
 
-  g_assert(source_width >= dest_width);
-  g_assert(source_height >= dest_height);
+/* Adds the alpha weighted samples and the alpha of n RGBA pixels to sums.
+ * The sums are meant to wrap around like the int sums they replace.
+ */
+static inline void accumulate_alpha_span(const guchar *src, int n,
+                                         guint32 *sums) {
+#ifdef __SSE2__
+  __m128i acc, zero, keep_rgb, one_alpha, pixel, weights;
+  guint32 bytes;
+  int x;
+
+  acc = _mm_loadu_si128((const __m128i *)sums);
+  zero = _mm_setzero_si128();
+  keep_rgb = _mm_set_epi16(0, 0, 0, 0, 0, -1, -1, -1);
+  one_alpha = _mm_set_epi16(0, 0, 0, 0, 1, 0, 0, 0);
+
+  for (x = 0; x < n; x++) {
+    memcpy(&bytes, src, sizeof(bytes));
+    pixel = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+
+    /* (a, a, a, 1) times (r, g, b, a) */
+    weights = _mm_shufflelo_epi16(pixel, _MM_SHUFFLE(3, 3, 3, 3));
+    weights = _mm_or_si128(_mm_and_si128(weights, keep_rgb), one_alpha);
+    pixel = _mm_mullo_epi16(pixel, weights);
+
+    acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(pixel, zero));
+    src += 4;
+  }
 
-  ddx = div(source_width, dest_width);
-  dx = ddx.quot;
-  dx_frac = ddx.rem;
+  _mm_storeu_si128((__m128i *)sums, acc);
+#else
+  int x;
 
-  ddy = div(source_height, dest_height);
-  dy = ddy.quot;
-  dy_frac = ddy.rem;
+  for (x = 0; x < n; x++) {
+    sums[0] += src[3] * src[0];
+    sums[1] += src[3] * src[1];
+    sums[2] += src[3] * src[2];
+    sums[3] += src[3];
+    src += 4;
+  }
+#endif
+}
 
-  has_alpha = gdk_pixbuf_get_has_alpha(pixbuf);
-  source_rowstride = gdk_pixbuf_get_rowstride(pixbuf);
-  src_pixels = gdk_pixbuf_get_pixels(pixbuf);
+static inline void accumulate_span(const guchar *src, int n, guint32 *sums) {
+  int x;
 
-  dest_pixbuf =
-      gdk_pixbuf_new(GDK_COLORSPACE_RGB, has_alpha, 8, dest_width, dest_height);
-  dest = gdk_pixbuf_get_pixels(dest_pixbuf);
-  dest_rowstride = gdk_pixbuf_get_rowstride(dest_pixbuf);
+  for (x = 0; x < n; x++) {
+    sums[0] += *src++;
+    sums[1] += *src++;
+    sums[2] += *src++;
+  }
+}
 
-  pixel_stride = (has_alpha) ? 4 : 3;
+/* Premultiplies exactly like gdk_cairo_surface_create_from_pixbuf() */
+static inline guint32 premultiply(guint32 sample, guint32 alpha) {
+  guint32 t;
 
-  s_y1 = 0;
-  s_yfrac = -dest_height / 2;
-  while (s_y1 < source_height) {
-    int s_x1, s_y2;
-    int s_xfrac;
+  t = sample * alpha + 0x80;
+  return ((t >> 8) + t) >> 8;
+}
 
-    s_y2 = s_y1 + dy;
-    s_yfrac += dy_frac;
-    if (s_yfrac > 0) {
-      s_y2++;
-      s_yfrac -= dest_height;
-    }
+static gpointer scale_down_stripe(gpointer data) {
+  ScaleDownStripe *stripe;
+  guint32 *sums, *column_sums;
+  const guchar *src_row;
+  guchar *dest;
+  guint32 *dest_argb;
+  int pixel_stride, n_pixels;
+  int r, g, b, a;
+  int i, x, y;
 
-    s_x1 = 0;
-    s_xfrac = -dest_width / 2;
-    while (s_x1 < source_width) {
-      s_x2 = s_x1 + dx;
-      s_xfrac += dx_frac;
-      if (s_xfrac > 0) {
-        s_x2++;
-        s_xfrac -= dest_width;
-      }
+  stripe = data;
+  pixel_stride = stripe->has_alpha ? 4 : 3;
 
-      /* Average block of [x1,x2[ x [y1,y2[ and store in dest */
-      r = g = b = a = 0;
-      n_pixels = 0;
-
-      src = src_pixels + s_y1 * source_rowstride + s_x1 * pixel_stride;
-      for (y = s_y1; y < s_y2; y++) {
-        xsrc = src;
-        if (has_alpha) {
-          for (x = 0; x < s_x2 - s_x1; x++) {
-            n_pixels++;
-
-            r += xsrc[3] * xsrc[0];
-            g += xsrc[3] * xsrc[1];
-            b += xsrc[3] * xsrc[2];
-            a += xsrc[3];
-            xsrc += 4;
-          }
+  /* Four sums per destination column, filled a whole source row at a time
+   * so that the source is read sequentially.
+   */
+  sums = g_new(guint32, stripe->dest_width * 4);
+
+  for (i = stripe->first_row; i < stripe->end_row; i++) {
+    memset(sums, 0, stripe->dest_width * 4 * sizeof(guint32));
+
+    for (y = stripe->y_bounds[i]; y < stripe->y_bounds[i + 1]; y++) {
+      src_row = stripe->src_pixels + (gsize)y * stripe->source_rowstride;
+
+      for (x = 0; x < stripe->dest_width; x++) {
+        if (stripe->has_alpha) {
+          accumulate_alpha_span(src_row + stripe->x_bounds[x] * 4,
+                                stripe->x_bounds[x + 1] - stripe->x_bounds[x],
+                                sums + x * 4);
         } else {
-          for (x = 0; x < s_x2 - s_x1; x++) {
-            n_pixels++;
-            r += *xsrc++;
-            g += *xsrc++;
-            b += *xsrc++;
-          }
+          accumulate_span(src_row + stripe->x_bounds[x] * 3,
+                          stripe->x_bounds[x + 1] - stripe->x_bounds[x],
+                          sums + x * 4);
         }
-        src += source_rowstride;
       }
+    }
 
-      if (has_alpha) {
+    dest = stripe->dest_pixels + (gsize)i * stripe->dest_rowstride;
+    dest_argb = (guint32 *)dest;
+
+    for (x = 0; x < stripe->dest_width; x++) {
+      column_sums = sums + x * 4;
+      n_pixels = (stripe->x_bounds[x + 1] - stripe->x_bounds[x]) *
+                 (stripe->y_bounds[i + 1] - stripe->y_bounds[i]);
+
+      r = g = b = a = 0;
+      if (stripe->has_alpha) {
+        a = (gint32)column_sums[3];
         if (a != 0) {
-          *dest++ = r / a;
-          *dest++ = g / a;
-          *dest++ = b / a;
-          *dest++ = a / n_pixels;
-        } else {
-          *dest++ = 0;
-          *dest++ = 0;
-          *dest++ = 0;
-          *dest++ = 0;
+          r = (guchar)((gint32)column_sums[0] / a);
+          g = (guchar)((gint32)column_sums[1] / a);
+          b = (guchar)((gint32)column_sums[2] / a);
+          a = (guchar)(a / n_pixels);
         }
       } else {
+        a = 0xff;
         if (n_pixels != 0) {
-          *dest++ = r / n_pixels;
-          *dest++ = g / n_pixels;
-          *dest++ = b / n_pixels;
-        } else {
-          *dest++ = 0;
-          *dest++ = 0;
-          *dest++ = 0;
+          r = (guchar)((gint32)column_sums[0] / n_pixels);
+          g = (guchar)((gint32)column_sums[1] / n_pixels);
+          b = (guchar)((gint32)column_sums[2] / n_pixels);
         }
       }
 
-      s_x1 = s_x2;
+      if (stripe->to_surface) {
+        dest_argb[x] = ((guint32)a << 24) | (premultiply(r, a) << 16) |
+                       (premultiply(g, a) << 8) | premultiply(b, a);
+      } else {
+        *dest++ = r;
+        *dest++ = g;
+        *dest++ = b;
+        if (pixel_stride == 4) {
+          *dest++ = a;
+        }
+      }
     }
-    s_y1 = s_y2;
-    dest += dest_rowstride - dest_width * pixel_stride;
   }
 
+  g_free(sums);
+
+  return NULL;
+}
+
+static void scale_down_into(GdkPixbuf *pixbuf, int dest_width,
+                            int dest_height, guchar *dest_pixels,
+                            int dest_rowstride, gboolean to_surface) {
+  ScaleDownStripe stripes[SCALE_DOWN_MAX_THREADS];
+  GThread *threads[SCALE_DOWN_MAX_THREADS];
+  int *x_bounds, *y_bounds;
+  int source_width, source_height;
+  gint64 n_source_pixels;
+  int n_stripes, i;
+
+  source_width = gdk_pixbuf_get_width(pixbuf);
+  source_height = gdk_pixbuf_get_height(pixbuf);
+
+  g_assert(source_width >= dest_width);
+  g_assert(source_height >= dest_height);
+
+  x_bounds = compute_box_bounds(source_width, dest_width);
+  y_bounds = compute_box_bounds(source_height, dest_height);
+
+  n_source_pixels = (gint64)source_width * source_height;
+  n_stripes = n_source_pixels / SCALE_DOWN_PIXELS_PER_THREAD;
+  n_stripes = MIN(n_stripes, (int)g_get_num_processors());
+  n_stripes = CLAMP(n_stripes, 1, MIN(SCALE_DOWN_MAX_THREADS, dest_height));
+
+  for (i = 0; i < n_stripes; i++) {
+    stripes[i].src_pixels = gdk_pixbuf_get_pixels(pixbuf);
+    stripes[i].source_rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    stripes[i].has_alpha = gdk_pixbuf_get_has_alpha(pixbuf);
+    stripes[i].x_bounds = x_bounds;
+    stripes[i].y_bounds = y_bounds;
+    stripes[i].dest_width = dest_width;
+    stripes[i].dest_pixels = dest_pixels;
+    stripes[i].dest_rowstride = dest_rowstride;
+    stripes[i].to_surface = to_surface;
+    stripes[i].first_row = (gint64)dest_height * i / n_stripes;
+    stripes[i].end_row = (gint64)dest_height * (i + 1) / n_stripes;
+  }
+
+  /* The calling thread does the first stripe itself */
+  for (i = 1; i < n_stripes; i++) {
+    threads[i] = g_thread_new("eel-scale-down", scale_down_stripe, &stripes[i]);
+  }
+  scale_down_stripe(&stripes[0]);
+  for (i = 1; i < n_stripes; i++) {
+    g_thread_join(threads[i]);
+  }
+
+  g_free(x_bounds);
+  g_free(y_bounds);
+}
+
+GdkPixbuf *eel_gdk_pixbuf_scale_down(GdkPixbuf *pixbuf, int dest_width,
+                                     int dest_height) {
+  GdkPixbuf *dest_pixbuf;
+
+  if (dest_width == 0 || dest_height == 0) {
+    return NULL;
+  }
+
+  dest_pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB,
+                               gdk_pixbuf_get_has_alpha(pixbuf), 8, dest_width,
+                               dest_height);
+
+  scale_down_into(pixbuf, dest_width, dest_height,
+                  gdk_pixbuf_get_pixels(dest_pixbuf),
+                  gdk_pixbuf_get_rowstride(dest_pixbuf), FALSE);
+
   return dest_pixbuf;
 }
+
+/* Gives the same pixels as gdk_cairo_surface_create_from_pixbuf() on the
+ * result of eel_gdk_pixbuf_scale_down(), without the intermediate pixbuf.
+ */
+cairo_surface_t *eel_gdk_pixbuf_scale_down_to_surface(GdkPixbuf *pixbuf,
+                                                      int dest_width,
+                                                      int dest_height) {
+  cairo_surface_t *surface;
+
+  if (dest_width == 0 || dest_height == 0) {
+    return NULL;
+  }
+
+  surface =
+      cairo_image_surface_create(CAIRO_FORMAT_ARGB32, dest_width, dest_height);
+  if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+    return surface;
+  }
+
+  cairo_surface_flush(surface);
+  scale_down_into(pixbuf, dest_width, dest_height,
+                  cairo_image_surface_get_data(surface),
+                  cairo_image_surface_get_stride(surface), TRUE);
+  cairo_surface_mark_dirty(surface);
+
+  return surface;
+}
@@ -60,4 +60,9 @@ void eel_gdk_pixbuf_unref_if_not_null(GdkPixbuf *pixbuf_or_null);
 GdkPixbuf *eel_gdk_pixbuf_scale_down(GdkPixbuf *pixbuf, int dest_width,
                                      int dest_height);
 
+/* Same, straight into a premultiplied CAIRO_FORMAT_ARGB32 surface */
+cairo_surface_t *eel_gdk_pixbuf_scale_down_to_surface(GdkPixbuf *pixbuf,
+                                                      int dest_width,
+                                                      int dest_height);
+
 #endif /* EEL_GDK_PIXBUF_EXTENSIONS_H */
@@ -35,6 +35,14 @@
 
 #include "eel-glib-extensions.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define EEL_X86_KERNELS 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define EEL_NEON_KERNELS 1
+#include <arm_neon.h>
+#endif
+
 /* shared utility to create a new pixbuf from the passed-in one */
 
 static GdkPixbuf *create_new_pixbuf(GdkPixbuf *src) {
@@ -60,9 +68,484 @@ static guchar lighten_component(guchar cur_value) {
   return (guchar)new_value;
 }
 
+/* Pixel kernels. Each one processes a single row of 8-bit samples with
+ * n_channels samples per pixel; alpha_index is the position of the alpha
+ * sample within a pixel, or -1 if there is none. The vectorized versions
+ * hand the pixels that do not fill a whole vector to the scalar ones and
+ * produce exactly the same output.
+ */
+
+typedef struct {
+  void (*lighten_row)(const guchar *src, guchar *dest, int width,
+                      int n_channels, int alpha_index);
+  void (*darken_row)(const guchar *src, guchar *dest, int width,
+                     int n_channels, int negalpha, int alpha);
+  void (*colorize_row)(const guchar *src, guchar *dest, int width,
+                       int n_channels, int red, int green, int blue);
+} PixelKernels;
+
+static void lighten_row_scalar(const guchar *src, guchar *dest, int width,
+                               int n_channels, int alpha_index) {
+  int i, c;
+
+  for (i = 0; i < width; i++) {
+    for (c = 0; c < n_channels; c++) {
+      if (c == alpha_index) {
+        *dest++ = *src++;
+      } else {
+        *dest++ = lighten_component(*src++);
+      }
+    }
+  }
+}
+
+/* The color samples are always the first three, alpha is the fourth. */
+static void darken_row_scalar(const guchar *src, guchar *dest, int width,
+                              int n_channels, int negalpha, int alpha) {
+  guchar intensity;
+  guchar r, g, b;
+  int i;
+
+  for (i = 0; i < width; i++) {
+    r = *src++;
+    g = *src++;
+    b = *src++;
+    intensity = (r * 77 + g * 150 + b * 28) >> 8;
+    *dest++ = (negalpha * intensity + alpha * r) >> 8;
+    *dest++ = (negalpha * intensity + alpha * g) >> 8;
+    *dest++ = (negalpha * intensity + alpha * b) >> 8;
+    if (n_channels == 4) {
+      *dest++ = *src++;
+    }
+  }
+}
+
+static void colorize_row_scalar(const guchar *src, guchar *dest, int width,
+                                int n_channels, int red, int green, int blue) {
+  int i;
+
+  for (i = 0; i < width; i++) {
+    *dest++ = (*src++ * red) >> 8;
+    *dest++ = (*src++ * green) >> 8;
+    *dest++ = (*src++ * blue) >> 8;
+    if (n_channels == 4) {
+      *dest++ = *src++;
+    }
+  }
+}
+
+static const PixelKernels scalar_kernels = {
+    lighten_row_scalar, darken_row_scalar, colorize_row_scalar};
+
+#ifdef EEL_X86_KERNELS
+
+/* Three-channel rows are only vectorized for lightening, which treats all
+ * samples alike; 16 bytes are not a whole number of RGB pixels.
+ */
+
+__attribute__((target("sse2"))) static void lighten_row_sse2(
+    const guchar *src, guchar *dest, int width, int n_channels,
+    int alpha_index) {
+  __m128i keep, bump, low_bits, v, lightened;
+  int n_bytes, i;
+
+  n_bytes = width * n_channels;
+  keep = n_channels == 4
+             ? _mm_set1_epi32((int)(0xffu << (alpha_index * 8)))
+             : _mm_setzero_si128();
+  bump = _mm_set1_epi8(24);
+  low_bits = _mm_set1_epi8(0x1f);
+
+  /* 16 bytes are a whole number of pixels for four channels, and for
+   * three channels every sample is treated the same.
+   */
+  for (i = 0; i + 16 <= n_bytes; i += 16) {
+    v = _mm_loadu_si128((const __m128i *)(src + i));
+    lightened = _mm_adds_epu8(_mm_adds_epu8(v, bump),
+                              _mm_and_si128(_mm_srli_epi16(v, 3), low_bits));
+    lightened = _mm_or_si128(_mm_and_si128(keep, v),
+                             _mm_andnot_si128(keep, lightened));
+    _mm_storeu_si128((__m128i *)(dest + i), lightened);
+  }
+
+  if (n_channels == 3) {
+    for (; i < n_bytes; i++) {
+      dest[i] = lighten_component(src[i]);
+    }
+  } else {
+    lighten_row_scalar(src + i, dest + i, (n_bytes - i) / 4, 4, alpha_index);
+  }
+}
+
+/* Darkens two pixels held as 16-bit lanes; the alpha lanes of the result
+ * are garbage and have to be replaced by the caller.
+ */
+__attribute__((target("sse2"))) static inline __m128i darken_pixels_sse2(
+    __m128i pixels, __m128i weights, __m128i factors) {
+  __m128i sums, intensity, out_lo, out_hi;
+
+  /* r * 77 + g * 150 and b * 28 of each pixel, then summed */
+  sums = _mm_madd_epi16(pixels, weights);
+  sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(2, 3, 0, 1)));
+  intensity = _mm_srli_epi32(sums, 8);
+  intensity = _mm_shufflelo_epi16(intensity, _MM_SHUFFLE(0, 0, 0, 0));
+  intensity = _mm_shufflehi_epi16(intensity, _MM_SHUFFLE(0, 0, 0, 0));
+
+  /* negalpha * intensity + alpha * sample, for each sample */
+  out_lo = _mm_madd_epi16(_mm_unpacklo_epi16(intensity, pixels), factors);
+  out_hi = _mm_madd_epi16(_mm_unpackhi_epi16(intensity, pixels), factors);
+
+  return _mm_packs_epi32(_mm_srli_epi32(out_lo, 8), _mm_srli_epi32(out_hi, 8));
+}
+
+__attribute__((target("sse2"))) static void darken_row_sse2(
+    const guchar *src, guchar *dest, int width, int n_channels, int negalpha,
+    int alpha) {
+  __m128i zero, keep, weights, factors, v, lo, hi, result;
+  int i;
+
+  if (n_channels != 4) {
+    darken_row_scalar(src, dest, width, n_channels, negalpha, alpha);
+    return;
+  }
+
+  zero = _mm_setzero_si128();
+  keep = _mm_set1_epi32((int)0xff000000u);
+  weights = _mm_set_epi16(0, 28, 150, 77, 0, 28, 150, 77);
+  factors = _mm_set1_epi32((alpha << 16) | negalpha);
+
+  for (i = 0; i + 4 <= width; i += 4) {
+    v = _mm_loadu_si128((const __m128i *)(src + i * 4));
+    lo = darken_pixels_sse2(_mm_unpacklo_epi8(v, zero), weights, factors);
+    hi = darken_pixels_sse2(_mm_unpackhi_epi8(v, zero), weights, factors);
+    result = _mm_packus_epi16(lo, hi);
+    result =
+        _mm_or_si128(_mm_and_si128(keep, v), _mm_andnot_si128(keep, result));
+    _mm_storeu_si128((__m128i *)(dest + i * 4), result);
+  }
+
+  darken_row_scalar(src + i * 4, dest + i * 4, width - i, 4, negalpha, alpha);
+}
+
+__attribute__((target("sse2"))) static void colorize_row_sse2(
+    const guchar *src, guchar *dest, int width, int n_channels, int red,
+    int green, int blue) {
+  __m128i zero, factors, v, lo, hi;
+  int i;
+
+  if (n_channels != 4) {
+    colorize_row_scalar(src, dest, width, n_channels, red, green, blue);
+    return;
+  }
+
+  /* alpha * 256 >> 8 leaves the alpha samples untouched */
+  zero = _mm_setzero_si128();
+  factors = _mm_set_epi16(256, blue, green, red, 256, blue, green, red);
+
+  for (i = 0; i + 4 <= width; i += 4) {
+    v = _mm_loadu_si128((const __m128i *)(src + i * 4));
+    lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), factors),
+                        8);
+    hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), factors),
+                        8);
+    _mm_storeu_si128((__m128i *)(dest + i * 4), _mm_packus_epi16(lo, hi));
+  }
+
+  colorize_row_scalar(src + i * 4, dest + i * 4, width - i, 4, red, green,
+                      blue);
+}
+
+static const PixelKernels sse2_kernels = {lighten_row_sse2, darken_row_sse2,
+                                          colorize_row_sse2};
+
+/* The AVX2 versions do the same as the SSE2 ones on each 128-bit half. */
+
+__attribute__((target("avx2"))) static void lighten_row_avx2(
+    const guchar *src, guchar *dest, int width, int n_channels,
+    int alpha_index) {
+  __m256i keep, bump, low_bits, v, lightened;
+  int n_bytes, i;
+
+  n_bytes = width * n_channels;
+  keep = n_channels == 4
+             ? _mm256_set1_epi32((int)(0xffu << (alpha_index * 8)))
+             : _mm256_setzero_si256();
+  bump = _mm256_set1_epi8(24);
+  low_bits = _mm256_set1_epi8(0x1f);
+
+  for (i = 0; i + 32 <= n_bytes; i += 32) {
+    v = _mm256_loadu_si256((const __m256i *)(src + i));
+    lightened =
+        _mm256_adds_epu8(_mm256_adds_epu8(v, bump),
+                         _mm256_and_si256(_mm256_srli_epi16(v, 3), low_bits));
+    lightened = _mm256_blendv_epi8(lightened, v, keep);
+    _mm256_storeu_si256((__m256i *)(dest + i), lightened);
+  }
+
+  if (n_channels == 3) {
+    for (; i < n_bytes; i++) {
+      dest[i] = lighten_component(src[i]);
+    }
+  } else {
+    lighten_row_sse2(src + i, dest + i, (n_bytes - i) / 4, 4, alpha_index);
+  }
+}
+
+__attribute__((target("avx2"))) static inline __m256i darken_pixels_avx2(
+    __m256i pixels, __m256i weights, __m256i factors) {
+  __m256i sums, intensity, out_lo, out_hi;
+
+  sums = _mm256_madd_epi16(pixels, weights);
+  sums = _mm256_add_epi32(sums,
+                          _mm256_shuffle_epi32(sums, _MM_SHUFFLE(2, 3, 0, 1)));
+  intensity = _mm256_srli_epi32(sums, 8);
+  intensity = _mm256_shufflelo_epi16(intensity, _MM_SHUFFLE(0, 0, 0, 0));
+  intensity = _mm256_shufflehi_epi16(intensity, _MM_SHUFFLE(0, 0, 0, 0));
+
+  out_lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(intensity, pixels), factors);
+  out_hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(intensity, pixels), factors);
+
+  return _mm256_packs_epi32(_mm256_srli_epi32(out_lo, 8),
+                            _mm256_srli_epi32(out_hi, 8));
+}
+
+__attribute__((target("avx2"))) static void darken_row_avx2(
+    const guchar *src, guchar *dest, int width, int n_channels, int negalpha,
+    int alpha) {
+  __m256i zero, keep, weights, factors, v, lo, hi, result;
+  int i;
+
+  if (n_channels != 4) {
+    darken_row_scalar(src, dest, width, n_channels, negalpha, alpha);
+    return;
+  }
+
+  zero = _mm256_setzero_si256();
+  keep = _mm256_set1_epi32((int)0xff000000u);
+  weights = _mm256_set_epi16(0, 28, 150, 77, 0, 28, 150, 77, 0, 28, 150, 77,
+                             0, 28, 150, 77);
+  factors = _mm256_set1_epi32((alpha << 16) | negalpha);
+
+  for (i = 0; i + 8 <= width; i += 8) {
+    v = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+    lo = darken_pixels_avx2(_mm256_unpacklo_epi8(v, zero), weights, factors);
+    hi = darken_pixels_avx2(_mm256_unpackhi_epi8(v, zero), weights, factors);
+    result = _mm256_blendv_epi8(_mm256_packus_epi16(lo, hi), v, keep);
+    _mm256_storeu_si256((__m256i *)(dest + i * 4), result);
+  }
+
+  darken_row_sse2(src + i * 4, dest + i * 4, width - i, 4, negalpha, alpha);
+}
+
+__attribute__((target("avx2"))) static void colorize_row_avx2(
+    const guchar *src, guchar *dest, int width, int n_channels, int red,
+    int green, int blue) {
+  __m256i zero, factors, v, lo, hi;
+  int i;
+
+  if (n_channels != 4) {
+    colorize_row_scalar(src, dest, width, n_channels, red, green, blue);
+    return;
+  }
+
+  zero = _mm256_setzero_si256();
+  factors = _mm256_set_epi16(256, blue, green, red, 256, blue, green, red, 256,
+                             blue, green, red, 256, blue, green, red);
+
+  for (i = 0; i + 8 <= width; i += 8) {
+    v = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+    lo = _mm256_srli_epi16(
+        _mm256_mullo_epi16(_mm256_unpacklo_epi8(v, zero), factors), 8);
+    hi = _mm256_srli_epi16(
+        _mm256_mullo_epi16(_mm256_unpackhi_epi8(v, zero), factors), 8);
+    _mm256_storeu_si256((__m256i *)(dest + i * 4),
+                        _mm256_packus_epi16(lo, hi));
+  }
+
+  colorize_row_sse2(src + i * 4, dest + i * 4, width - i, 4, red, green, blue);
+}
+
+static const PixelKernels avx2_kernels = {lighten_row_avx2, darken_row_avx2,
+                                          colorize_row_avx2};
+
+#endif /* EEL_X86_KERNELS */
+
+#ifdef EEL_NEON_KERNELS
+
+static void lighten_row_neon(const guchar *src, guchar *dest, int width,
+                             int n_channels, int alpha_index) {
+  uint8x16_t keep, bump, v, lightened;
+  int n_bytes, i;
+
+  n_bytes = width * n_channels;
+  keep = n_channels == 4
+             ? vreinterpretq_u8_u32(vdupq_n_u32(0xffu << (alpha_index * 8)))
+             : vdupq_n_u8(0);
+  bump = vdupq_n_u8(24);
+
+  for (i = 0; i + 16 <= n_bytes; i += 16) {
+    v = vld1q_u8(src + i);
+    lightened = vqaddq_u8(vqaddq_u8(v, bump), vshrq_n_u8(v, 3));
+    vst1q_u8(dest + i, vbslq_u8(keep, v, lightened));
+  }
+
+  if (n_channels == 3) {
+    for (; i < n_bytes; i++) {
+      dest[i] = lighten_component(src[i]);
+    }
+  } else {
+    lighten_row_scalar(src + i, dest + i, (n_bytes - i) / 4, 4, alpha_index);
+  }
+}
+
+static void darken_row_neon(const guchar *src, guchar *dest, int width,
+                            int n_channels, int negalpha, int alpha) {
+  uint8x8_t intensity;
+  uint16x8_t sum, base;
+  uint8x8x4_t pixels;
+  int i, c;
+
+  for (i = 0; i + 8 <= width; i += 8) {
+    if (n_channels == 4) {
+      pixels = vld4_u8(src + i * 4);
+    } else {
+      uint8x8x3_t rgb = vld3_u8(src + i * 3);
+      pixels.val[0] = rgb.val[0];
+      pixels.val[1] = rgb.val[1];
+      pixels.val[2] = rgb.val[2];
+    }
+
+    sum = vmull_u8(pixels.val[0], vdup_n_u8(77));
+    sum = vmlal_u8(sum, pixels.val[1], vdup_n_u8(150));
+    sum = vmlal_u8(sum, pixels.val[2], vdup_n_u8(28));
+    intensity = vshrn_n_u16(sum, 8);
+
+    base = vmull_u8(intensity, vdup_n_u8(negalpha));
+    for (c = 0; c < 3; c++) {
+      pixels.val[c] =
+          vshrn_n_u16(vmlal_u8(base, pixels.val[c], vdup_n_u8(alpha)), 8);
+    }
+
+    if (n_channels == 4) {
+      vst4_u8(dest + i * 4, pixels);
+    } else {
+      uint8x8x3_t rgb = {{pixels.val[0], pixels.val[1], pixels.val[2]}};
+      vst3_u8(dest + i * 3, rgb);
+    }
+  }
+
+  darken_row_scalar(src + i * n_channels, dest + i * n_channels, width - i,
+                    n_channels, negalpha, alpha);
+}
+
+static void colorize_row_neon(const guchar *src, guchar *dest, int width,
+                              int n_channels, int red, int green, int blue) {
+  uint8x8x4_t pixels;
+  uint8x8_t factors[3];
+  int i, c;
+
+  factors[0] = vdup_n_u8(red);
+  factors[1] = vdup_n_u8(green);
+  factors[2] = vdup_n_u8(blue);
+
+  for (i = 0; i + 8 <= width; i += 8) {
+    if (n_channels == 4) {
+      pixels = vld4_u8(src + i * 4);
+    } else {
+      uint8x8x3_t rgb = vld3_u8(src + i * 3);
+      pixels.val[0] = rgb.val[0];
+      pixels.val[1] = rgb.val[1];
+      pixels.val[2] = rgb.val[2];
+    }
+
+    for (c = 0; c < 3; c++) {
+      pixels.val[c] = vshrn_n_u16(vmull_u8(pixels.val[c], factors[c]), 8);
+    }
+
+    if (n_channels == 4) {
+      vst4_u8(dest + i * 4, pixels);
+    } else {
+      uint8x8x3_t rgb = {{pixels.val[0], pixels.val[1], pixels.val[2]}};
+      vst3_u8(dest + i * 3, rgb);
+    }
+  }
+
+  colorize_row_scalar(src + i * n_channels, dest + i * n_channels, width - i,
+                      n_channels, red, green, blue);
+}
+
+static const PixelKernels neon_kernels = {lighten_row_neon, darken_row_neon,
+                                          colorize_row_neon};
+
+#endif /* EEL_NEON_KERNELS */
+
+/* Set by eel_graphic_effects_force_kernels() */
+static const PixelKernels *forced_kernels = NULL;
+
+/* Picks the best kernels the CPU we run on supports, once. */
+static const PixelKernels *get_pixel_kernels(void) {
+  static const PixelKernels *kernels = NULL;
+  static gsize initialized = 0;
+
+  if (forced_kernels != NULL) {
+    return forced_kernels;
+  }
+
+  if (g_once_init_enter(&initialized)) {
+    kernels = &scalar_kernels;
+#if defined(EEL_X86_KERNELS)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      kernels = &avx2_kernels;
+    } else if (__builtin_cpu_supports("sse2")) {
+      kernels = &sse2_kernels;
+    }
+#elif defined(EEL_NEON_KERNELS)
+    kernels = &neon_kernels;
+#endif
+    g_once_init_leave(&initialized, 1);
+  }
+
+  return kernels;
+}
+
+gboolean eel_graphic_effects_force_kernels(EelPixelKernels kernels) {
+  switch (kernels) {
+    case EEL_PIXEL_KERNELS_BEST:
+      forced_kernels = NULL;
+      return TRUE;
+    case EEL_PIXEL_KERNELS_SCALAR:
+      forced_kernels = &scalar_kernels;
+      return TRUE;
+#if defined(EEL_X86_KERNELS)
+    case EEL_PIXEL_KERNELS_SSE2:
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("sse2")) {
+        forced_kernels = &sse2_kernels;
+        return TRUE;
+      }
+      return FALSE;
+    case EEL_PIXEL_KERNELS_AVX2:
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2")) {
+        forced_kernels = &avx2_kernels;
+        return TRUE;
+      }
+      return FALSE;
+#elif defined(EEL_NEON_KERNELS)
+    case EEL_PIXEL_KERNELS_NEON:
+      forced_kernels = &neon_kernels;
+      return TRUE;
+#endif
+    default:
+      return FALSE;
+  }
+}
+
 GdkPixbuf *eel_create_spotlight_pixbuf(GdkPixbuf *src) {
   GdkPixbuf *dest;
-  int i, j;
+  const PixelKernels *kernels;
+  int i;
   int width, height, has_alpha, src_row_stride, dst_row_stride;
   guchar *target_pixels, *original_pixels;
 
@@ -85,32 +568,90 @@ GdkPixbuf *eel_create_spotlight_pixbuf(GdkPixbuf *src) {
   target_pixels = gdk_pixbuf_get_pixels(dest);
   original_pixels = gdk_pixbuf_get_pixels(src);
 
-  for (i = 0; i < height; i++) {
-    guchar *pixsrc, *pixdest;
+  kernels = get_pixel_kernels();
 
-    pixdest = target_pixels + i * dst_row_stride;
-    pixsrc = original_pixels + i * src_row_stride;
-    for (j = 0; j < width; j++) {
-      *pixdest++ = lighten_component(*pixsrc++);
-      *pixdest++ = lighten_component(*pixsrc++);
-      *pixdest++ = lighten_component(*pixsrc++);
-      if (has_alpha) {
-        *pixdest++ = *pixsrc++;
-      }
-    }
+  for (i = 0; i < height; i++) {
+    kernels->lighten_row(original_pixels + i * src_row_stride,
+                         target_pixels + i * dst_row_stride, width,
+                         has_alpha ? 4 : 3, has_alpha ? 3 : -1);
   }
   return dest;
 }
 
+/* Lightens a translucent premultiplied sample the way a round trip through
+ * an unpremultiplied pixbuf does.
+ */
+static guint32 lighten_premultiplied_sample(guint32 sample, guint32 alpha) {
+  guint32 t;
+
+  sample = lighten_component((sample * 255 + alpha / 2) / alpha);
+  t = sample * alpha + 0x80;
+  return ((t >> 8) + t) >> 8;
+}
+
 cairo_surface_t *eel_create_spotlight_surface(cairo_surface_t *src, int scale) {
-  GdkPixbuf *pixbuf;
+  GdkPixbuf *pixbuf, *spotlight;
   cairo_surface_t *dest;
+  const PixelKernels *kernels;
+  int width, height, src_stride, dest_stride;
+  guchar *src_data, *dest_data;
+  guint32 *src_row, *dest_row, pixel, alpha;
+  int i, j;
+
+  width = cairo_image_surface_get_width(src);
+  height = cairo_image_surface_get_height(src);
+
+  if (cairo_image_surface_get_format(src) != CAIRO_FORMAT_ARGB32) {
+    pixbuf = gdk_pixbuf_get_from_surface(src, 0, 0, width, height);
+    spotlight = eel_create_spotlight_pixbuf(pixbuf);
+    dest = gdk_cairo_surface_create_from_pixbuf(spotlight, scale, NULL);
+    g_object_unref(spotlight);
+    g_object_unref(pixbuf);
+
+    return dest;
+  }
+
+  /* Work on the premultiplied samples directly. That is exact for opaque
+   * pixels; the translucent ones are redone through unpremultiplied values.
+   */
+  dest = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+  cairo_surface_set_device_scale(dest, scale, scale);
+
+  cairo_surface_flush(src);
+  src_data = cairo_image_surface_get_data(src);
+  src_stride = cairo_image_surface_get_stride(src);
+  dest_data = cairo_image_surface_get_data(dest);
+  dest_stride = cairo_image_surface_get_stride(dest);
+
+  kernels = get_pixel_kernels();
+
+  for (i = 0; i < height; i++) {
+    src_row = (guint32 *)(src_data + i * src_stride);
+    dest_row = (guint32 *)(dest_data + i * dest_stride);
+
+    kernels->lighten_row((guchar *)src_row, (guchar *)dest_row, width, 4,
+                         G_BYTE_ORDER == G_LITTLE_ENDIAN ? 3 : 0);
+
+    for (j = 0; j < width; j++) {
+      pixel = src_row[j];
+      alpha = pixel >> 24;
+      if (alpha == 0xff) {
+        continue;
+      }
+
+      if (alpha == 0) {
+        dest_row[j] = 0;
+      } else {
+        dest_row[j] =
+            (alpha << 24) |
+            (lighten_premultiplied_sample((pixel >> 16) & 0xff, alpha) << 16) |
+            (lighten_premultiplied_sample((pixel >> 8) & 0xff, alpha) << 8) |
+            lighten_premultiplied_sample(pixel & 0xff, alpha);
+      }
+    }
+  }
 
-  pixbuf =
-      gdk_pixbuf_get_from_surface(src, 0, 0, cairo_image_surface_get_width(src),
-                                  cairo_image_surface_get_height(src));
-  dest = gdk_cairo_surface_create_from_pixbuf(pixbuf, scale, NULL);
-  g_object_unref(pixbuf);
+  cairo_surface_mark_dirty(dest);
 
   return dest;
 }
@@ -122,15 +663,14 @@ cairo_surface_t *eel_create_spotlight_surface(cairo_surface_t *src, int scale) {
 
 GdkPixbuf *eel_create_darkened_pixbuf(GdkPixbuf *src, int saturation,
                                       int darken) {
-  gint i, j;
+  gint i;
   gint width, height, src_row_stride, dest_row_stride;
   gboolean has_alpha;
   guchar *target_pixels, *original_pixels;
-  guchar intensity;
   guchar alpha;
   guchar negalpha;
-  guchar r, g, b;
   GdkPixbuf *dest;
+  const PixelKernels *kernels;
 
   g_return_val_if_fail(gdk_pixbuf_get_colorspace(src) == GDK_COLORSPACE_RGB,
                        NULL);
@@ -151,25 +691,20 @@ GdkPixbuf *eel_create_darkened_pixbuf(GdkPixbuf *src, int saturation,
   target_pixels = gdk_pixbuf_get_pixels(dest);
   original_pixels = gdk_pixbuf_get_pixels(src);
 
-  for (i = 0; i < height; i++) {
-    guchar *pixsrc, *pixdest;
+  negalpha = ((255 - saturation) * darken) >> 8;
+  alpha = (saturation * darken) >> 8;
 
-    pixdest = target_pixels + i * dest_row_stride;
-    pixsrc = original_pixels + i * src_row_stride;
-    for (j = 0; j < width; j++) {
-      r = *pixsrc++;
-      g = *pixsrc++;
-      b = *pixsrc++;
-      intensity = (r * 77 + g * 150 + b * 28) >> 8;
-      negalpha = ((255 - saturation) * darken) >> 8;
-      alpha = (saturation * darken) >> 8;
-      *pixdest++ = (negalpha * intensity + alpha * r) >> 8;
-      *pixdest++ = (negalpha * intensity + alpha * g) >> 8;
-      *pixdest++ = (negalpha * intensity + alpha * b) >> 8;
-      if (has_alpha) {
-        *pixdest++ = *pixsrc++;
-      }
-    }
+  /* The vector kernels rely on the factors adding up to at most 255 */
+  if (saturation >= 0 && saturation <= 255 && darken >= 0 && darken <= 255) {
+    kernels = get_pixel_kernels();
+  } else {
+    kernels = &scalar_kernels;
+  }
+
+  for (i = 0; i < height; i++) {
+    kernels->darken_row(original_pixels + i * src_row_stride,
+                        target_pixels + i * dest_row_stride, width,
+                        has_alpha ? 4 : 3, negalpha, alpha);
   }
   return dest;
 }
@@ -178,11 +713,12 @@ GdkPixbuf *eel_create_darkened_pixbuf(GdkPixbuf *src, int saturation,
  * the passed in color */
 
 GdkPixbuf *eel_create_colorized_pixbuf(GdkPixbuf *src, GdkRGBA *color) {
-  int i, j;
+  int i;
   int width, height, has_alpha, src_row_stride, dst_row_stride;
   guchar *target_pixels;
   guchar *original_pixels;
   GdkPixbuf *dest;
+  const PixelKernels *kernels;
 
   gint red_value, green_value, blue_value;
 
@@ -209,20 +745,19 @@ GdkPixbuf *eel_create_colorized_pixbuf(GdkPixbuf *src, GdkRGBA *color) {
   target_pixels = gdk_pixbuf_get_pixels(dest);
   original_pixels = gdk_pixbuf_get_pixels(src);
 
-  for (i = 0; i < height; i++) {
-    guchar *pixdest;
-    guchar *pixsrc;
+  /* Colors out of range wrap around in the scalar code only */
+  if (red_value >= 0 && red_value <= 255 && green_value >= 0 &&
+      green_value <= 255 && blue_value >= 0 && blue_value <= 255) {
+    kernels = get_pixel_kernels();
+  } else {
+    kernels = &scalar_kernels;
+  }
 
-    pixdest = target_pixels + i * dst_row_stride;
-    pixsrc = original_pixels + i * src_row_stride;
-    for (j = 0; j < width; j++) {
-      *pixdest++ = (*pixsrc++ * red_value) >> 8;
-      *pixdest++ = (*pixsrc++ * green_value) >> 8;
-      *pixdest++ = (*pixsrc++ * blue_value) >> 8;
-      if (has_alpha) {
-        *pixdest++ = *pixsrc++;
-      }
-    }
+  for (i = 0; i < height; i++) {
+    kernels->colorize_row(original_pixels + i * src_row_stride,
+                          target_pixels + i * dst_row_stride, width,
+                          has_alpha ? 4 : 3, red_value, green_value,
+                          blue_value);
   }
   return dest;
 }
@@ -55,4 +55,18 @@ GdkPixbuf *eel_embed_image_in_frame(GdkPixbuf *source_image,
                                     int top_offset, int right_offset,
                                     int bottom_offset);
 
+/* For testing only: the pixel kernels the effects use, the best ones the
+ * CPU supports unless forced otherwise
+ */
+typedef enum {
+  EEL_PIXEL_KERNELS_BEST,
+  EEL_PIXEL_KERNELS_SCALAR,
+  EEL_PIXEL_KERNELS_SSE2,
+  EEL_PIXEL_KERNELS_AVX2,
+  EEL_PIXEL_KERNELS_NEON
+} EelPixelKernels;
+
+/* returns FALSE if the kernels are not available on this CPU */
+gboolean eel_graphic_effects_force_kernels(EelPixelKernels kernels);
+
 #endif /* EEL_GRAPHIC_EFFECTS_H */
@@ -35,6 +35,7 @@
 
 #include "caja-extensions.h"
 #include "caja-module.h"
+#include "caja-search-directory-file.h"
 
 static GList *get_builtin_columns(void) {
   GList *columns;
@@ -164,6 +165,21 @@ static GList *get_trash_columns(void) {
   return caja_column_list_copy(columns);
 }
 
+static GList *get_search_columns(void) {
+  static GList *columns = NULL;
+
+  if (columns == NULL) {
+    columns = g_list_append(
+        columns,
+        g_object_new(CAJA_TYPE_COLUMN, "name", "search_relevance", "attribute",
+                     "search_relevance", "label", _("Relevance"),
+                     "description", _("How well the file matches the search"),
+                     NULL));
+  }
+
+  return caja_column_list_copy(columns);
+}
+
 GList *caja_get_common_columns(void) {
   static GList *columns = NULL;
 
@@ -178,6 +194,7 @@ GList *caja_get_all_columns(void) {
   GList *columns = NULL;
 
   columns = g_list_concat(caja_get_common_columns(), get_trash_columns());
+  columns = g_list_concat(columns, get_search_columns());
 
   return columns;
 }
@@ -189,6 +206,8 @@ GList *caja_get_columns_for_file(CajaFile *file) {
 
   if (file != NULL && caja_file_is_in_trash(file)) {
     columns = g_list_concat(columns, get_trash_columns());
+  } else if (file != NULL && CAJA_IS_SEARCH_DIRECTORY_FILE(file)) {
+    columns = g_list_concat(columns, get_search_columns());
   }
 
   return columns;
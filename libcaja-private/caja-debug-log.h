@@ -30,6 +30,10 @@
 #define CAJA_DEBUG_LOG_DOMAIN_USER "USER" /* always enabled */
 #define CAJA_DEBUG_LOG_DOMAIN_ASYNC \
   "async" /* when asynchronous notifications come in */
+#define CAJA_DEBUG_LOG_DOMAIN_THUMBNAILS \
+  "thumbnails" /* thumbnail generation throughput */
+#define CAJA_DEBUG_LOG_DOMAIN_RENDERING \
+  "rendering" /* frames drawn by the icon views */
 #define CAJA_DEBUG_LOG_DOMAIN_GLOG \
   "GLog" /* used for GLog messages; don't use it yourself */
 
@@ -42,6 +42,8 @@
 #include "caja-marshal.h"
 #include "caja-metadata.h"
 #include "caja-signaller.h"
+#include "caja-thumbnail-cache.h"
+#include "caja-thumbnails.h"
 
 /* turn this on to see messages about each load_directory call: */
 #if 0
@@ -80,8 +82,22 @@ struct ThumbnailState {
   CajaDirectory *directory;
   GCancellable *cancellable;
   CajaFile *file;
-  gboolean trying_original;
   gboolean tried_original;
+
+  /* What the loading thread works from. It gets its own copies so it
+     doesn't have to look at the file. */
+  GFile *original_location;
+  char *thumbnail_path;
+  int max_thumbnail_size;
+  /* The thumbnail size the view needs, if it is larger than normal */
+  char *uri;
+  int wanted_size;
+  time_t mtime;
+
+  /* Set by the loading thread: the size of the thumbnail it read, and
+     whether it found a larger one that is out of date */
+  int thumbnail_size;
+  gboolean found_stale;
 };
 
 struct MountState {
@@ -3286,12 +3302,50 @@ static void link_info_start(CajaDirectory *directory, CajaFile *file,
   g_object_unref(location);
 }
 
+/* Has the thumbnail of size made, unless it was asked for already since
+   the file changed */
+static void thumbnail_request_size(CajaFile *file, int size) {
+  if (file->details->thumbnail_requested_size < size &&
+      !file->details->is_thumbnailing && caja_can_thumbnail(file)) {
+    caja_create_thumbnail(file, size);
+  }
+}
+
+/* If the view wants a larger thumbnail than there is, have it made. The
+   one we have is shown meanwhile. */
+static void thumbnail_request_larger(CajaFile *file, int loaded_size) {
+  int wanted_size;
+
+  wanted_size = file->details->thumbnail_wanted_size;
+  if (loaded_size != 0 && loaded_size < wanted_size) {
+    thumbnail_request_size(file, wanted_size);
+  }
+}
+
+static void thumbnail_done_from_cache(CajaDirectory *directory,
+                                      CajaFile *file,
+                                      CajaThumbnailCacheEntry *entry,
+                                      gboolean tried_original) {
+  file->details->thumbnail_is_up_to_date = TRUE;
+  file->details->thumbnail_tried_original = (tried_original != FALSE);
+  if (file->details->thumbnail) {
+    caja_thumbnail_cache_entry_unref(file->details->thumbnail);
+  }
+  file->details->thumbnail = entry;
+  file->details->thumbnail_mtime = caja_thumbnail_cache_entry_get_mtime(entry);
+
+  thumbnail_request_larger(file, caja_thumbnail_cache_entry_get_size(entry));
+
+  caja_directory_async_state_changed(directory);
+}
+
 static void thumbnail_done(CajaDirectory *directory, CajaFile *file,
-                           GdkPixbuf *pixbuf, gboolean tried_original) {
+                           GdkPixbuf *pixbuf, gboolean tried_original,
+                           int size) {
   file->details->thumbnail_is_up_to_date = TRUE;
   file->details->thumbnail_tried_original = (tried_original != FALSE);
   if (file->details->thumbnail) {
-    g_object_unref(file->details->thumbnail);
+    caja_thumbnail_cache_entry_unref(file->details->thumbnail);
     file->details->thumbnail = NULL;
   }
   if (pixbuf) {
@@ -3309,8 +3363,17 @@ static void thumbnail_done(CajaDirectory *directory, CajaFile *file,
     }
 
     if (thumb_mtime == 0 || thumb_mtime == file->details->mtime) {
-      file->details->thumbnail = g_object_ref(pixbuf);
+      char *uri;
+
+      uri = caja_file_get_uri(file);
+      file->details->thumbnail = caja_thumbnail_cache_insert(
+          uri, pixbuf, thumb_mtime, tried_original, size);
       file->details->thumbnail_mtime = thumb_mtime;
+      g_free(uri);
+
+      if (!tried_original) {
+        thumbnail_request_larger(file, size);
+      }
     } else {
       g_free(file->details->thumbnail_path);
       file->details->thumbnail_path = NULL;
@@ -3340,11 +3403,12 @@ static void thumbnail_stop(CajaDirectory *directory) {
 }
 
 static void thumbnail_got_pixbuf(CajaDirectory *directory, CajaFile *file,
-                                 GdkPixbuf *pixbuf, gboolean tried_original) {
+                                 GdkPixbuf *pixbuf, gboolean tried_original,
+                                 int size) {
   caja_directory_ref(directory);
 
   caja_file_ref(file);
-  thumbnail_done(directory, file, pixbuf, tried_original);
+  thumbnail_done(directory, file, pixbuf, tried_original, size);
   caja_file_changed(file);
   caja_file_unref(file);
 
@@ -3357,6 +3421,11 @@ static void thumbnail_got_pixbuf(CajaDirectory *directory, CajaFile *file,
 
 static void thumbnail_state_free(ThumbnailState *state) {
   g_object_unref(state->cancellable);
+  if (state->original_location != NULL) {
+    g_object_unref(state->original_location);
+  }
+  g_free(state->thumbnail_path);
+  g_free(state->uri);
   g_free(state);
 }
 
@@ -3370,9 +3439,7 @@ static void thumbnail_loader_size_prepared(GdkPixbufLoader *loader, int width,
 
   aspect_ratio = ((double)width) / height;
 
-  /* cf. caja_file_get_icon() */
-  max_thumbnail_size =
-      CAJA_ICON_SIZE_LARGEST * cached_thumbnail_size / CAJA_ICON_SIZE_STANDARD;
+  max_thumbnail_size = GPOINTER_TO_INT(user_data);
   if (MAX(width, height) > max_thumbnail_size) {
     if (width > height) {
       width = max_thumbnail_size;
@@ -3386,8 +3453,8 @@ static void thumbnail_loader_size_prepared(GdkPixbufLoader *loader, int width,
   }
 }
 
-static GdkPixbuf *get_pixbuf_for_content(goffset file_len,
-                                         char *file_contents) {
+static GdkPixbuf *get_pixbuf_for_content(goffset file_len, char *file_contents,
+                                         int max_thumbnail_size) {
   gboolean res;
   GdkPixbuf *pixbuf, *pixbuf2;
   GdkPixbufLoader *loader;
@@ -3396,7 +3463,8 @@ static GdkPixbuf *get_pixbuf_for_content(goffset file_len,
 
   loader = gdk_pixbuf_loader_new();
   g_signal_connect(loader, "size-prepared",
-                   G_CALLBACK(thumbnail_loader_size_prepared), NULL);
+                   G_CALLBACK(thumbnail_loader_size_prepared),
+                   GINT_TO_POINTER(max_thumbnail_size));
 
   /* For some reason we have to write in chunks, or gdk-pixbuf fails */
   res = TRUE;
@@ -3423,60 +3491,171 @@ static GdkPixbuf *get_pixbuf_for_content(goffset file_len,
   return pixbuf;
 }
 
-static void thumbnail_read_callback(GObject *source_object, GAsyncResult *res,
+static GdkPixbuf *load_thumbnail_pixbuf(GFile *location,
+                                        int max_thumbnail_size,
+                                        GCancellable *cancellable) {
+  GdkPixbuf *pixbuf;
+  char *file_contents;
+  gsize file_size;
+
+  if (!g_file_load_contents(location, cancellable, &file_contents, &file_size,
+                            NULL, NULL)) {
+    return NULL;
+  }
+
+  pixbuf =
+      get_pixbuf_for_content(file_size, file_contents, max_thumbnail_size);
+  g_free(file_contents);
+
+  return pixbuf;
+}
+
+/* Whether the thumbnail was made from the file as it was at mtime. cf.
+   thumbnail_done(). */
+static gboolean thumbnail_is_current(GdkPixbuf *pixbuf, time_t mtime) {
+  const char *thumb_mtime_str;
+
+  thumb_mtime_str = gdk_pixbuf_get_option(pixbuf, "tEXt::Thumb::MTime");
+
+  return thumb_mtime_str == NULL || atol(thumb_mtime_str) == 0 ||
+         atol(thumb_mtime_str) == mtime;
+}
+
+/* Loads the thumbnail of exactly size, if there is one made from the file
+   as it is now. caja_thumbnail_find_path() doesn't look at the dates. */
+static GdkPixbuf *load_sized_thumbnail(ThumbnailState *state, int size,
+                                       GCancellable *cancellable) {
+  GdkPixbuf *pixbuf;
+  GFile *location;
+  char *path;
+  int found_size;
+
+  path = caja_thumbnail_find_path(state->uri, size, &found_size);
+  if (path == NULL) {
+    return NULL;
+  }
+
+  pixbuf = NULL;
+  if (found_size == size) {
+    location = g_file_new_for_path(path);
+    pixbuf = load_thumbnail_pixbuf(
+        location, MAX(state->max_thumbnail_size, size), cancellable);
+    g_object_unref(location);
+
+    if (pixbuf != NULL && !thumbnail_is_current(pixbuf, state->mtime)) {
+      state->found_stale = TRUE;
+      g_clear_object(&pixbuf);
+    }
+  }
+  g_free(path);
+
+  return pixbuf;
+}
+
+/* Reads and decodes the thumbnail in a thread, so the main loop only has
+   to hand the finished pixbuf to the file. */
+static void thumbnail_load_thread(GTask *task, gpointer source_object,
+                                  gpointer task_data,
+                                  GCancellable *cancellable) {
+  ThumbnailState *state;
+  static const int larger_sizes[] = {CAJA_THUMBNAIL_SIZE_LARGE,
+                                     CAJA_THUMBNAIL_SIZE_XLARGE};
+  GdkPixbuf *pixbuf;
+  GFile *location;
+  int size;
+  int i;
+
+  state = task_data;
+  pixbuf = NULL;
+
+  if (state->original_location != NULL) {
+    pixbuf = load_thumbnail_pixbuf(state->original_location,
+                                   state->max_thumbnail_size, cancellable);
+  }
+
+  /* The thumbnail info only knows about one size, look for the larger
+     ones ourselves: the wanted size or above first, then the ones between
+     it and the normal size. The normal one is the thumbnail path. */
+  if (state->wanted_size > CAJA_THUMBNAIL_SIZE_NORMAL) {
+    for (i = 0; pixbuf == NULL && i < (int)G_N_ELEMENTS(larger_sizes) &&
+                !g_cancellable_is_cancelled(cancellable);
+         i++) {
+      if (larger_sizes[i] >= state->wanted_size) {
+        pixbuf = load_sized_thumbnail(state, larger_sizes[i], cancellable);
+        size = larger_sizes[i];
+      }
+    }
+    for (i = G_N_ELEMENTS(larger_sizes) - 1;
+         pixbuf == NULL && i >= 0 && !g_cancellable_is_cancelled(cancellable);
+         i--) {
+      if (larger_sizes[i] < state->wanted_size) {
+        pixbuf = load_sized_thumbnail(state, larger_sizes[i], cancellable);
+        size = larger_sizes[i];
+      }
+    }
+    if (pixbuf != NULL) {
+      state->thumbnail_size = size;
+    }
+  }
+
+  if (pixbuf == NULL && state->thumbnail_path != NULL &&
+      !g_cancellable_is_cancelled(cancellable)) {
+    size = caja_thumbnail_get_size_for_path(state->thumbnail_path);
+    location = g_file_new_for_path(state->thumbnail_path);
+    pixbuf = load_thumbnail_pixbuf(
+        location, MAX(state->max_thumbnail_size, size), cancellable);
+    if (pixbuf != NULL) {
+      state->thumbnail_size = size;
+    }
+    g_object_unref(location);
+  }
+
+  g_task_return_pointer(task, pixbuf, g_object_unref);
+}
+
+static void thumbnail_load_callback(GObject *source_object, GAsyncResult *res,
                                     gpointer user_data) {
   ThumbnailState *state;
-  gsize file_size;
-  char *file_contents;
-  gboolean result;
   CajaDirectory *directory;
   GdkPixbuf *pixbuf;
 
   state = user_data;
+  pixbuf = g_task_propagate_pointer(G_TASK(res), NULL);
 
   if (state->directory == NULL) {
     /* Operation was cancelled. Bail out */
+    if (pixbuf != NULL) {
+      g_object_unref(pixbuf);
+    }
     thumbnail_state_free(state);
     return;
   }
 
   directory = caja_directory_ref(state->directory);
 
-  result = g_file_load_contents_finish(G_FILE(source_object), res,
-                                       &file_contents, &file_size, NULL, NULL);
+  state->directory->details->thumbnail_state = NULL;
+  async_job_end(state->directory, "thumbnail");
 
-  pixbuf = NULL;
-  if (result) {
-    pixbuf = get_pixbuf_for_content(file_size, file_contents);
-    g_free(file_contents);
-  }
+  thumbnail_got_pixbuf(state->directory, state->file, pixbuf,
+                       state->tried_original, state->thumbnail_size);
 
-  if (pixbuf == NULL && state->trying_original) {
-    GFile *location;
-
-    state->trying_original = FALSE;
-
-    location = g_file_new_for_path(state->file->details->thumbnail_path);
-    g_file_load_contents_async(location, state->cancellable,
-                               thumbnail_read_callback, state);
-    g_object_unref(location);
-  } else {
-    state->directory->details->thumbnail_state = NULL;
-    async_job_end(state->directory, "thumbnail");
-
-    thumbnail_got_pixbuf(state->directory, state->file, pixbuf,
-                         state->tried_original);
-
-    thumbnail_state_free(state);
+  /* What was shown instead of the out of date thumbnail is smaller, have
+     it made again */
+  if (state->found_stale) {
+    thumbnail_request_size(state->file, state->wanted_size);
   }
 
+  thumbnail_state_free(state);
+
   caja_directory_unref(directory);
 }
 
 static void thumbnail_start(CajaDirectory *directory, CajaFile *file,
                             gboolean *doing_io) {
-  GFile *location;
   ThumbnailState *state;
+  GTask *task;
+  CajaThumbnailCacheEntry *entry;
+  char *uri;
 
   if (directory->details->thumbnail_state != NULL) {
     *doing_io = TRUE;
@@ -3488,7 +3667,24 @@ static void thumbnail_start(CajaDirectory *directory, CajaFile *file,
   }
   *doing_io = TRUE;
 
+  /* Another window, or an earlier visit to this folder, may have left
+     the thumbnail in the cache already */
+  uri = caja_file_get_uri(file);
+  entry = caja_thumbnail_cache_lookup(uri, file->details->mtime,
+                                      file->details->thumbnail_wants_original,
+                                      file->details->thumbnail_wanted_size);
+  if (entry != NULL) {
+    g_free(uri);
+    caja_file_ref(file);
+    thumbnail_done_from_cache(directory, file, entry,
+                              file->details->thumbnail_wants_original);
+    caja_file_changed(file);
+    caja_file_unref(file);
+    return;
+  }
+
   if (!async_job_start(directory, "thumbnail")) {
+    g_free(uri);
     return;
   }
 
@@ -3496,20 +3692,25 @@ static void thumbnail_start(CajaDirectory *directory, CajaFile *file,
   state->directory = directory;
   state->file = file;
   state->cancellable = g_cancellable_new();
+  state->uri = uri;
+  state->wanted_size = file->details->thumbnail_wanted_size;
+  state->mtime = file->details->mtime;
 
   if (file->details->thumbnail_wants_original) {
     state->tried_original = TRUE;
-    state->trying_original = TRUE;
-    location = caja_file_get_location(file);
-  } else {
-    location = g_file_new_for_path(file->details->thumbnail_path);
+    state->original_location = caja_file_get_location(file);
   }
+  state->thumbnail_path = g_strdup(file->details->thumbnail_path);
+  /* cf. caja_file_get_icon() */
+  state->max_thumbnail_size =
+      CAJA_ICON_SIZE_LARGEST * cached_thumbnail_size / CAJA_ICON_SIZE_STANDARD;
 
   directory->details->thumbnail_state = state;
 
-  g_file_load_contents_async(location, state->cancellable,
-                             thumbnail_read_callback, state);
-  g_object_unref(location);
+  task = g_task_new(NULL, state->cancellable, thumbnail_load_callback, state);
+  g_task_set_task_data(task, state, NULL);
+  g_task_run_in_thread(task, thumbnail_load_thread);
+  g_object_unref(task);
 }
 
 static void mount_stop(CajaDirectory *directory) {
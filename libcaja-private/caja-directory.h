@@ -61,12 +61,18 @@ G_BEGIN_DECLS
 typedef struct CajaFile CajaFile;
 #endif
 
+/* CajaDirectory is defined both here and in caja-file.h. */
+#ifndef CAJA_DIRECTORY_DEFINED
+#define CAJA_DIRECTORY_DEFINED
+typedef struct CajaDirectory CajaDirectory;
+#endif
+
 typedef struct _CajaDirectoryPrivate CajaDirectoryPrivate;
 
-typedef struct {
+struct CajaDirectory {
   GObject object;
   CajaDirectoryPrivate *details;
-} CajaDirectory;
+};
 
 typedef void (*CajaDirectoryCallback)(CajaDirectory *directory, GList *files,
                                       gpointer callback_data);
@@ -31,6 +31,7 @@
 #include "caja-directory.h"
 #include "caja-file.h"
 #include "caja-monitor.h"
+#include "caja-thumbnail-cache.h"
 #include "caja-undostack-manager.h"
 
 #define CAJA_FILE_LARGE_TOP_LEFT_TEXT_MAXIMUM_CHARACTERS_PER_LINE 80
@@ -105,8 +106,13 @@ struct _CajaFilePrivate {
   GIcon *icon;
 
   char *thumbnail_path;
-  GdkPixbuf *thumbnail;
+  /* The pixels live in the thumbnail cache, which may drop them */
+  CajaThumbnailCacheEntry *thumbnail;
   time_t thumbnail_mtime;
+  /* The thumbnail size the views need, 0 while the normal one does, and
+     the largest size asked of the thumbnailer since the file changed */
+  int thumbnail_wanted_size;
+  int thumbnail_requested_size;
 
   GList *mime_list; /* If this is a directory, the list of MIME types in it. */
   char *top_left_text;
@@ -61,6 +61,7 @@
 #include "caja-file-operations.h"
 #include "caja-file-private.h"
 #include "caja-file-utilities.h"
+#include "caja-filename-index.h"
 #include "caja-global-preferences.h"
 #include "caja-lib-self-check-functions.h"
 #include "caja-link.h"
@@ -69,6 +70,7 @@
 #include "caja-saved-search-file.h"
 #include "caja-search-directory-file.h"
 #include "caja-search-directory.h"
+#include "caja-search-predicate.h"
 #include "caja-signaller.h"
 #include "caja-thumbnails.h"
 #include "caja-ui-utilities.h"
@@ -127,7 +129,7 @@ static GQuark attribute_name_q, attribute_size_q, attribute_size_on_disk_q,
     attribute_permissions_q, attribute_selinux_context_q,
     attribute_octal_permissions_q, attribute_owner_q, attribute_group_q,
     attribute_uri_q, attribute_where_q, attribute_link_target_q,
-    attribute_volume_q, attribute_free_space_q;
+    attribute_volume_q, attribute_free_space_q, attribute_search_relevance_q;
 
 static void caja_file_info_iface_init(CajaFileInfoIface *iface);
 static char *caja_file_get_owner_as_string(CajaFile *file,
@@ -730,7 +732,7 @@ static void finalize(GObject *object) {
   g_free(file->details->compare_by_emblem_cache);
 
   if (file->details->thumbnail) {
-    g_object_unref(file->details->thumbnail);
+    caja_thumbnail_cache_entry_unref(file->details->thumbnail);
   }
   if (file->details->mount) {
     g_signal_handlers_disconnect_by_func(file->details->mount,
@@ -2209,6 +2211,9 @@ static gboolean update_info_internal(CajaFile *file, GFileInfo *info,
     if (file->details->thumbnail == NULL) {
       file->details->thumbnail_is_up_to_date = FALSE;
     }
+    if (file->details->mtime != mtime) {
+      file->details->thumbnail_requested_size = 0;
+    }
 
     changed = TRUE;
   }
@@ -3123,6 +3128,31 @@ static gchar *caja_file_get_extension_as_string(CajaFile *file) {
   return g_strdup("");
 }
 
+/* Only the search directory the files are hits of knows their relevance */
+static int compare_by_search_relevance(CajaFile *file_1, CajaFile *file_2,
+                                       CajaDirectory *directory) {
+  int relevance_1, relevance_2;
+
+  if (directory == NULL || !CAJA_IS_SEARCH_DIRECTORY(directory)) {
+    return 0;
+  }
+
+  relevance_1 = caja_search_directory_get_relevance(
+      CAJA_SEARCH_DIRECTORY(directory), file_1);
+  relevance_2 = caja_search_directory_get_relevance(
+      CAJA_SEARCH_DIRECTORY(directory), file_2);
+
+  /* The most relevant ones come first */
+  if (relevance_1 > relevance_2) {
+    return -1;
+  }
+  if (relevance_1 < relevance_2) {
+    return +1;
+  }
+
+  return 0;
+}
+
 static int caja_file_compare_for_sort_internal(CajaFile *file_1,
                                                CajaFile *file_2,
                                                gboolean directories_first,
@@ -3169,6 +3199,22 @@ static int caja_file_compare_for_sort_internal(CajaFile *file_1,
 int caja_file_compare_for_sort(CajaFile *file_1, CajaFile *file_2,
                                CajaFileSortType sort_type,
                                gboolean directories_first, gboolean reversed) {
+  return caja_file_compare_for_sort_in_directory(
+      file_1, file_2, sort_type, NULL, directories_first, reversed);
+}
+
+/**
+ * caja_file_compare_for_sort_in_directory:
+ * @directory: The directory the files are shown for, or %NULL
+ *
+ * Like caja_file_compare_for_sort(), for the files of @directory. Sorting
+ * by relevance compares how well they match the search of @directory.
+ **/
+int caja_file_compare_for_sort_in_directory(CajaFile *file_1, CajaFile *file_2,
+                                            CajaFileSortType sort_type,
+                                            CajaDirectory *directory,
+                                            gboolean directories_first,
+                                            gboolean reversed) {
   int result;
 
   if (file_1 == file_2) {
@@ -3256,6 +3302,15 @@ int caja_file_compare_for_sort(CajaFile *file_1, CajaFile *file_2,
           result = compare_by_full_path(file_1, file_2);
         }
         break;
+      case CAJA_FILE_SORT_BY_SEARCH_RELEVANCE:
+        result = compare_by_search_relevance(file_1, file_2, directory);
+        if (result == 0) {
+          result = compare_by_display_name(file_1, file_2);
+        }
+        if (result == 0) {
+          result = compare_by_full_path(file_1, file_2);
+        }
+        break;
       default:
         g_return_val_if_reached(0);
     }
@@ -3319,6 +3374,11 @@ int caja_file_compare_for_sort_by_attribute_q(CajaFile *file_1,
     return caja_file_compare_for_sort(file_1, file_2,
                                       CAJA_FILE_SORT_BY_EXTENSION,
                                       directories_first, reversed);
+  } else if (attribute == attribute_search_relevance_q) {
+    /* Without the search directory all hits rank the same */
+    return caja_file_compare_for_sort(file_1, file_2,
+                                      CAJA_FILE_SORT_BY_SEARCH_RELEVANCE,
+                                      directories_first, reversed);
   }
 
   /* it is a normal attribute, compare by strings */
@@ -3348,6 +3408,22 @@ int caja_file_compare_for_sort_by_attribute_q(CajaFile *file_1,
   return result;
 }
 
+/* Like caja_file_compare_for_sort_by_attribute_q(), for the files of
+ * directory, see caja_file_compare_for_sort_in_directory().
+ */
+int caja_file_compare_for_sort_by_attribute_q_in_directory(
+    CajaFile *file_1, CajaFile *file_2, GQuark attribute,
+    CajaDirectory *directory, gboolean directories_first, gboolean reversed) {
+  if (attribute == attribute_search_relevance_q) {
+    return caja_file_compare_for_sort_in_directory(
+        file_1, file_2, CAJA_FILE_SORT_BY_SEARCH_RELEVANCE, directory,
+        directories_first, reversed);
+  }
+
+  return caja_file_compare_for_sort_by_attribute_q(
+      file_1, file_2, attribute, directories_first, reversed);
+}
+
 int caja_file_compare_for_sort_by_attribute(CajaFile *file_1, CajaFile *file_2,
                                             const char *attribute,
                                             gboolean directories_first,
@@ -4169,12 +4245,18 @@ CajaIconInfo *caja_file_get_icon(CajaFile *file, int size, int scale,
           size * scale * cached_thumbnail_size / CAJA_ICON_SIZE_STANDARD;
     }
 
-    if (file->details->thumbnail) {
-      int w, h, s;
+    /* If the cache dropped the thumbnail to stay in budget, the generic
+       icon is shown until caja_file_reload_dropped_thumbnail() loads it
+       again */
+    if (file->details->thumbnail != NULL &&
+        !caja_thumbnail_cache_entry_is_evicted(file->details->thumbnail)) {
+      int w, h, s, thumbnail_size, wanted_size;
       double thumb_scale;
       GdkPixbuf *raw_pixbuf;
+      gboolean is_image;
 
-      raw_pixbuf = g_object_ref(file->details->thumbnail);
+      raw_pixbuf = g_object_ref(
+          caja_thumbnail_cache_entry_get_pixbuf(file->details->thumbnail));
 
       w = gdk_pixbuf_get_width(raw_pixbuf);
       h = gdk_pixbuf_get_height(raw_pixbuf);
@@ -4191,30 +4273,40 @@ CajaIconInfo *caja_file_get_icon(CajaFile *file, int size, int scale,
         thumb_scale = (double)CAJA_ICON_SIZE_SMALLEST / s;
       }
 
-      scaled_pixbuf =
-          gdk_pixbuf_scale_simple(raw_pixbuf, MAX(w * thumb_scale, 1),
-                                  MAX(h * thumb_scale, 1), GDK_INTERP_BILINEAR);
-
       /* Render frames only for thumbnails of non-image files
-         and for images with no alpha channel. */
-      gboolean is_image = file->details->mime_type &&
-                          (strncmp(file->details->mime_type, "image/", 6) == 0);
-      if (!is_image || !gdk_pixbuf_get_has_alpha(raw_pixbuf)) {
-        caja_ui_frame_image(&scaled_pixbuf);
-      }
+         and for images with no alpha channel. The cache keeps the
+         result, so views showing it at the same size share it. */
+      is_image = file->details->mime_type &&
+                 (strncmp(file->details->mime_type, "image/", 6) == 0);
+      scaled_pixbuf = caja_thumbnail_cache_entry_get_scaled(
+          file->details->thumbnail, MAX(w * thumb_scale, 1),
+          MAX(h * thumb_scale, 1),
+          !is_image || !gdk_pixbuf_get_has_alpha(raw_pixbuf));
 
       g_object_unref(raw_pixbuf);
 
-      /* Don't scale up if more than 25%, then read the original
-         image instead. We don't want to compare to exactly 100%,
+      /* Don't scale up if more than 25%, then load the next larger
+         thumbnail size instead, and beyond the largest one read the
+         original image. We don't want to compare to exactly 100%,
          since the zoom level 150% gives thumbnails at 144, which is
-         ok to scale up from 128. */
-      if (modified_size > 128 * 1.25 * scale &&
-          !file->details->thumbnail_wants_original &&
-          caja_can_thumbnail_internally(file)) {
-        /* Invalidate if we resize upward */
-        file->details->thumbnail_wants_original = TRUE;
-        caja_file_invalidate_attributes(file, CAJA_FILE_ATTRIBUTE_THUMBNAIL);
+         ok to scale up from 128. A thumbnail smaller than its size
+         already shows the whole image. */
+      thumbnail_size =
+          caja_thumbnail_cache_entry_get_size(file->details->thumbnail);
+      if (thumbnail_size != 0 && modified_size > thumbnail_size * 1.25 &&
+          s >= thumbnail_size) {
+        wanted_size = caja_thumbnail_size_for_pixels(modified_size / 1.25);
+        if (wanted_size > thumbnail_size &&
+            wanted_size > file->details->thumbnail_wanted_size) {
+          /* Invalidate if we resize upward */
+          file->details->thumbnail_wanted_size = wanted_size;
+          caja_file_invalidate_attributes(file, CAJA_FILE_ATTRIBUTE_THUMBNAIL);
+        } else if (wanted_size == thumbnail_size &&
+                   !file->details->thumbnail_wants_original &&
+                   caja_can_thumbnail_internally(file)) {
+          file->details->thumbnail_wants_original = TRUE;
+          caja_file_invalidate_attributes(file, CAJA_FILE_ATTRIBUTE_THUMBNAIL);
+        }
       }
 
       icon = caja_icon_info_new_for_pixbuf(scaled_pixbuf, scale);
@@ -4224,7 +4316,10 @@ CajaIconInfo *caja_file_get_icon(CajaFile *file, int size, int scale,
                file->details->can_read && !file->details->is_thumbnailing &&
                !file->details->thumbnailing_failed) {
       if (caja_can_thumbnail(file)) {
-        caja_create_thumbnail(file);
+        /* Make the size the view needs right away */
+        file->details->thumbnail_wanted_size =
+            caja_thumbnail_size_for_pixels(modified_size / 1.25);
+        caja_create_thumbnail(file, file->details->thumbnail_wanted_size);
       }
     }
   }
@@ -4831,14 +4926,28 @@ static void set_attributes_callback(GObject *source_object,
                                     GAsyncResult *result,
                                     gpointer callback_data) {
   CajaFileOperation *op;
+  GFileInfo *attributes;
   GError *error;
   gboolean res;
 
   op = callback_data;
 
   error = NULL;
-  res =
-      g_file_set_attributes_finish(G_FILE(source_object), result, NULL, &error);
+  attributes = NULL;
+  res = g_file_set_attributes_finish(G_FILE(source_object), result,
+                                     &attributes, &error);
+
+  if (attributes != NULL) {
+    if (g_file_info_get_attribute_status(attributes,
+                                         G_FILE_ATTRIBUTE_XATTR_XDG_TAGS) ==
+        G_FILE_ATTRIBUTE_STATUS_SET) {
+      caja_filename_index_tags_written(
+          G_FILE(source_object),
+          g_file_info_get_attribute_string(attributes,
+                                           G_FILE_ATTRIBUTE_XATTR_XDG_TAGS));
+    }
+    g_object_unref(attributes);
+  }
 
   if (res) {
     g_file_query_info_async(G_FILE(source_object), CAJA_FILE_DEFAULT_ATTRIBUTES,
@@ -6035,6 +6144,11 @@ char *caja_file_get_string_attribute_q(CajaFile *file, GQuark attribute_q) {
   if (attribute_q == attribute_free_space_q) {
     return caja_file_get_volume_free_space(file);
   }
+  if (attribute_q == attribute_search_relevance_q) {
+    /* Known to the search directory only, see
+       caja_file_get_string_attribute_with_default_in_directory_q() */
+    return NULL;
+  }
 
   extension_attribute = NULL;
 
@@ -6152,6 +6266,23 @@ char *caja_file_get_string_attribute_with_default_q(CajaFile *file,
   return g_strdup(_("unknown"));
 }
 
+/* Like caja_file_get_string_attribute_with_default_q(), for the files of
+ * directory: the relevance is how well the file matches the search of
+ * directory.
+ */
+char *caja_file_get_string_attribute_with_default_in_directory_q(
+    CajaFile *file, GQuark attribute_q, CajaDirectory *directory) {
+  if (attribute_q == attribute_search_relevance_q && directory != NULL &&
+      CAJA_IS_SEARCH_DIRECTORY(directory)) {
+    /* Translators: how well a file matches a search, in percent */
+    return g_strdup_printf(_("%d%%"),
+                           caja_search_directory_get_relevance(
+                               CAJA_SEARCH_DIRECTORY(directory), file));
+  }
+
+  return caja_file_get_string_attribute_with_default_q(file, attribute_q);
+}
+
 char *caja_file_get_string_attribute_with_default(CajaFile *file,
                                                   const char *attribute_name) {
   return caja_file_get_string_attribute_with_default_q(
@@ -7299,6 +7430,20 @@ void caja_file_set_has_open_window(CajaFile *file, gboolean has_open_window) {
   }
 }
 
+void caja_file_reload_dropped_thumbnail(CajaFile *file) {
+  g_return_if_fail(CAJA_IS_FILE(file));
+
+  if (file->details->thumbnail == NULL ||
+      !caja_thumbnail_cache_entry_is_evicted(file->details->thumbnail)) {
+    return;
+  }
+
+  caja_thumbnail_cache_entry_unref(file->details->thumbnail);
+  file->details->thumbnail = NULL;
+  file->details->thumbnail_is_up_to_date = FALSE;
+  caja_file_invalidate_attributes(file, CAJA_FILE_ATTRIBUTE_THUMBNAIL);
+}
+
 gboolean caja_file_is_thumbnailing(CajaFile *file) {
   g_return_val_if_fail(CAJA_IS_FILE(file), FALSE);
 
@@ -7480,6 +7625,14 @@ CajaFileSortType caja_file_get_default_sort_type(CajaFile *file,
   CajaFileSortType retval;
   gboolean is_download, is_trash, res;
 
+  if (file != NULL && CAJA_IS_SEARCH_DIRECTORY_FILE(file)) {
+    /* The best hits first */
+    if (reversed != NULL) {
+      *reversed = FALSE;
+    }
+    return CAJA_FILE_SORT_BY_SEARCH_RELEVANCE;
+  }
+
   retval = CAJA_FILE_SORT_NONE;
   is_download = is_trash = FALSE;
   res = get_attributes_for_default_sort_type(file, &is_download, &is_trash);
@@ -7504,6 +7657,13 @@ const gchar *caja_file_get_default_sort_attribute(CajaFile *file,
   const gchar *retval;
   gboolean is_download, is_trash, res;
 
+  if (file != NULL && CAJA_IS_SEARCH_DIRECTORY_FILE(file)) {
+    if (reversed != NULL) {
+      *reversed = FALSE;
+    }
+    return g_quark_to_string(attribute_search_relevance_q);
+  }
+
   retval = NULL;
   is_download = is_trash = FALSE;
   res = get_attributes_for_default_sort_type(file, &is_download, &is_trash);
@@ -7832,6 +7992,7 @@ static void caja_file_class_init(CajaFileClass *class) {
   attribute_date_accessed_q = g_quark_from_static_string("date_accessed");
   attribute_emblems_q = g_quark_from_static_string("emblems");
   attribute_extension_q = g_quark_from_static_string("extension");
+  attribute_search_relevance_q = g_quark_from_static_string("search_relevance");
   attribute_mime_type_q = g_quark_from_static_string("mime_type");
   attribute_size_detail_q = g_quark_from_static_string("size_detail");
   attribute_size_on_disk_detail_q =
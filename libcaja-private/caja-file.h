@@ -44,6 +44,12 @@ G_BEGIN_DECLS
 typedef struct CajaFile CajaFile;
 #endif
 
+/* CajaDirectory is defined both here and in caja-directory.h. */
+#ifndef CAJA_DIRECTORY_DEFINED
+#define CAJA_DIRECTORY_DEFINED
+typedef struct CajaDirectory CajaDirectory;
+#endif
+
 #define CAJA_TYPE_FILE caja_file_get_type()
 #define CAJA_FILE(obj) \
   (G_TYPE_CHECK_INSTANCE_CAST((obj), CAJA_TYPE_FILE, CajaFile))
@@ -67,7 +73,8 @@ typedef enum {
   CAJA_FILE_SORT_BY_EMBLEMS,
   CAJA_FILE_SORT_BY_TRASHED_TIME,
   CAJA_FILE_SORT_BY_SIZE_ON_DISK,
-  CAJA_FILE_SORT_BY_EXTENSION
+  CAJA_FILE_SORT_BY_EXTENSION,
+  CAJA_FILE_SORT_BY_SEARCH_RELEVANCE
 } CajaFileSortType;
 
 typedef enum {
@@ -344,6 +351,8 @@ char *caja_file_get_string_attribute_with_default(CajaFile *file,
                                                   const char *attribute_name);
 char *caja_file_get_string_attribute_with_default_q(CajaFile *file,
                                                     GQuark attribute_q);
+char *caja_file_get_string_attribute_with_default_in_directory_q(
+    CajaFile *file, GQuark attribute_q, CajaDirectory *directory);
 char *caja_file_fit_modified_date_as_string(
     CajaFile *file, int width, CajaWidthMeasureCallback measure_callback,
     CajaTruncateCallback truncate_callback, void *measure_truncate_context);
@@ -363,6 +372,11 @@ const gchar *caja_file_get_default_sort_attribute(CajaFile *file,
 int caja_file_compare_for_sort(CajaFile *file_1, CajaFile *file_2,
                                CajaFileSortType sort_type,
                                gboolean directories_first, gboolean reversed);
+int caja_file_compare_for_sort_in_directory(CajaFile *file_1, CajaFile *file_2,
+                                            CajaFileSortType sort_type,
+                                            CajaDirectory *directory,
+                                            gboolean directories_first,
+                                            gboolean reversed);
 int caja_file_compare_for_sort_by_attribute(CajaFile *file_1, CajaFile *file_2,
                                             const char *attribute,
                                             gboolean directories_first,
@@ -372,6 +386,9 @@ int caja_file_compare_for_sort_by_attribute_q(CajaFile *file_1,
                                               GQuark attribute,
                                               gboolean directories_first,
                                               gboolean reversed);
+int caja_file_compare_for_sort_by_attribute_q_in_directory(
+    CajaFile *file_1, CajaFile *file_2, GQuark attribute,
+    CajaDirectory *directory, gboolean directories_first, gboolean reversed);
 gboolean caja_file_is_date_sort_attribute_q(GQuark attribute);
 
 int caja_file_compare_display_name(CajaFile *file_1, const char *pattern);
@@ -410,6 +427,9 @@ void caja_file_set_has_open_window(CajaFile *file, gboolean has_open_window);
 
 /* Thumbnailing handling */
 gboolean caja_file_is_thumbnailing(CajaFile *file);
+/* Loads the thumbnail of file again if the thumbnail cache dropped it. For
+   the views to call on the files they show, caja_file_get_icon() doesn't. */
+void caja_file_reload_dropped_thumbnail(CajaFile *file);
 
 /* Convenience functions for dealing with a list of CajaFile objects that each
  * have a ref. These are just convenient names for functions that work on lists
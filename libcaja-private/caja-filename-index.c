@@ -0,0 +1,1658 @@
+/*
+   caja-filename-index.c: Index of the file names in chosen folders.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include <config.h>
+
+#include "caja-filename-index.h"
+
+#include <eel/eel-debug.h>
+#include <gio/gio.h>
+#include <string.h>
+
+#include "caja-debug-log.h"
+#include "caja-global-preferences.h"
+#include "caja-search-predicate.h"
+
+#define INDEX_FILE_NAME "filename-index"
+#define INDEX_MAGIC "CAJAFNI2"
+/* Written in native byte order, this tells whether it was the same */
+#define INDEX_BYTE_ORDER_MARK 0x01020304
+
+/* Leave Caja alone while it starts up and opens its first windows */
+#define INDEX_START_DELAY_SECS 30
+
+/* How often all folders are checked for changes the monitors missed */
+#define INDEX_RECHECK_INTERVAL_SECS (15 * 60)
+
+/* Changes reported by the monitors are gathered this long before the
+   folders are read again */
+#define INDEX_CHANGE_DELAY_SECS 2
+
+/* Changes are saved this long after they were made */
+#define INDEX_SAVE_DELAY_SECS 60
+
+/* Monitors are a limited resource of the system, so only this many
+   folders are followed, the ones nearest the top first */
+#define INDEX_MAX_MONITORS 1024
+
+#define INDEX_NO_ENTRY G_MAXUINT32
+
+#define ENTRY_DIRECTORY (1 << 0)
+#define ENTRY_DELETED (1 << 1)
+
+#define INDEX_ATTRIBUTES                                                    \
+  G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME \
+                                 "," G_FILE_ATTRIBUTE_STANDARD_TYPE         \
+                                 "," G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN     \
+                                 "," G_FILE_ATTRIBUTE_XATTR_XDG_TAGS
+
+#define INDEX_MTIME_ATTRIBUTES \
+  G_FILE_ATTRIBUTE_TIME_MODIFIED "," G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC
+
+typedef struct {
+  guint32 parent;
+  guint32 first_child;
+  guint32 next_sibling;
+  guint32 flags;
+  /* Of folders, when they were read last. 0 to read them again. */
+  guint64 mtime;
+  /* The file name, or the whole path for the indexed folders */
+  char *name;
+  /* The display name normalized and in lower case */
+  char *key;
+  /* The tags of the file folded like the key, NULL if it has none */
+  char **tags;
+} IndexEntry;
+
+typedef struct {
+  /* IndexEntry. The indexed folders come first, and parents always come
+     before their children. */
+  GArray *entries;
+  guint n_roots;
+  /* Trigrams of the keys to GArrays of the ids of the entries with them in
+     their key, in ascending order */
+  GHashTable *trigrams;
+  /* Folded tags to GArrays of the ids of the live entries with them. It
+     isn't saved, the tags of the entries are. */
+  GHashTable *tags;
+} FilenameIndex;
+
+typedef struct {
+  char *name;
+  char *key;
+  char **tags;
+  gboolean is_directory;
+} ChildInfo;
+
+typedef struct {
+  guint32 id;
+  char *path;
+  guint64 mtime;
+
+  /* Found in the thread */
+  gboolean gone;
+  guint64 new_mtime;
+  GPtrArray *children; /* ChildInfo, NULL if unchanged */
+} FolderCheck;
+
+typedef struct {
+  char **roots;
+  gboolean rebuild;
+  /* The index the folders belong to */
+  guint generation;
+
+  /* Folders to check, or NULL to load or build the index */
+  GPtrArray *checks;
+
+  FilenameIndex *index;
+} IndexJob;
+
+static FilenameIndex *filename_index = NULL;
+/* Changes with every index that replaces the one before */
+static guint index_generation = 0;
+static char **index_roots = NULL;
+static GCancellable *index_cancellable = NULL;
+
+/* Set while a job runs in a thread */
+static gboolean index_busy = FALSE;
+static gboolean rebuild_wanted = FALSE;
+static gboolean load_wanted = FALSE;
+static gboolean recheck_all_wanted = FALSE;
+/* Like recheck_all_wanted, but the folders are read even if they didn't
+   change, since changing the tags of a file doesn't change its folder */
+static gboolean reread_all_wanted = FALSE;
+/* Ids of folders to read again */
+static GHashTable *folders_to_recheck = NULL;
+
+static guint start_timeout_id = 0;
+static guint recheck_timeout_id = 0;
+static guint change_timeout_id = 0;
+static guint save_timeout_id = 0;
+static gboolean index_dirty = FALSE;
+
+/* Ids of followed folders to their GFileMonitor */
+static GHashTable *index_monitors = NULL;
+
+static void run_next_job(void);
+
+static char *make_key(const char *display_name) {
+  char *normalized, *key;
+
+  /* cf. visit_directory() of the simple search engine */
+  normalized = g_utf8_normalize(display_name, -1, G_NORMALIZE_NFD);
+  if (normalized == NULL) {
+    return g_strdup("");
+  }
+  key = g_utf8_strdown(normalized, -1);
+  g_free(normalized);
+
+  return key;
+}
+
+/* Returns the tags of the extended attribute escaped, folded like the keys,
+ * or NULL if there are none.
+ */
+static char **make_tags(const char *escaped) {
+  GPtrArray *tags;
+  GString *text;
+  char **split, *normalized;
+  const char *p;
+  int i;
+
+  if (escaped == NULL) {
+    return NULL;
+  }
+
+  /* cf. unescape_tags() of the search predicate */
+  text = g_string_new(NULL);
+  for (p = escaped; *p != '\0'; p++) {
+    if (p[0] == '\\' && p[1] == 'x' && g_ascii_isxdigit(p[2]) &&
+        g_ascii_isxdigit(p[3])) {
+      g_string_append_c(text, g_ascii_xdigit_value(p[2]) << 4 |
+                                  g_ascii_xdigit_value(p[3]));
+      p += 3;
+    } else {
+      g_string_append_c(text, *p);
+    }
+  }
+
+  tags = g_ptr_array_new();
+  split = g_strsplit(text->str, ",", -1);
+  for (i = 0; split[i] != NULL; i++) {
+    /* tags that aren't UTF-8 never match */
+    normalized = g_utf8_normalize(split[i], -1, G_NORMALIZE_NFD);
+    if (normalized == NULL) {
+      continue;
+    }
+    g_ptr_array_add(tags, g_utf8_strdown(normalized, -1));
+    g_free(normalized);
+  }
+  g_strfreev(split);
+  g_string_free(text, TRUE);
+
+  if (tags->len == 0) {
+    g_ptr_array_free(tags, TRUE);
+    return NULL;
+  }
+  g_ptr_array_add(tags, NULL);
+
+  return (char **)g_ptr_array_free(tags, FALSE);
+}
+
+static gboolean tags_equal(char **tags, char **other_tags) {
+  if (tags == NULL || other_tags == NULL) {
+    return tags == other_tags;
+  }
+
+  return g_strv_equal((const char *const *)tags,
+                      (const char *const *)other_tags);
+}
+
+static inline guint32 make_trigram(const char *text) {
+  return (guint32)(guchar)text[0] << 16 | (guint32)(guchar)text[1] << 8 |
+         (guint32)(guchar)text[2];
+}
+
+static void free_id_array(gpointer data) { g_array_free(data, TRUE); }
+
+static FilenameIndex *filename_index_new(void) {
+  FilenameIndex *index;
+
+  index = g_new0(FilenameIndex, 1);
+  index->entries = g_array_new(FALSE, FALSE, sizeof(IndexEntry));
+  index->trigrams =
+      g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free_id_array);
+  index->tags =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_id_array);
+
+  return index;
+}
+
+static void filename_index_free(FilenameIndex *index) {
+  IndexEntry *entry;
+  guint i;
+
+  for (i = 0; i < index->entries->len; i++) {
+    entry = &g_array_index(index->entries, IndexEntry, i);
+    g_free(entry->name);
+    g_free(entry->key);
+    g_strfreev(entry->tags);
+  }
+  g_array_free(index->entries, TRUE);
+  g_hash_table_destroy(index->trigrams);
+  g_hash_table_destroy(index->tags);
+  g_free(index);
+}
+
+static inline IndexEntry *get_entry(FilenameIndex *index, guint32 id) {
+  return &g_array_index(index->entries, IndexEntry, id);
+}
+
+static gboolean is_live_folder(FilenameIndex *index, guint32 id) {
+  IndexEntry *entry;
+
+  if (id >= index->entries->len) {
+    return FALSE;
+  }
+  entry = get_entry(index, id);
+
+  return (entry->flags & (ENTRY_DIRECTORY | ENTRY_DELETED)) == ENTRY_DIRECTORY;
+}
+
+static void add_trigrams(FilenameIndex *index, guint32 id, const char *key) {
+  GArray *ids;
+  guint32 trigram;
+  gsize i, len;
+
+  len = strlen(key);
+  for (i = 0; i + 3 <= len; i++) {
+    trigram = make_trigram(key + i);
+    ids = g_hash_table_lookup(index->trigrams, GUINT_TO_POINTER(trigram));
+    if (ids == NULL) {
+      ids = g_array_new(FALSE, FALSE, sizeof(guint32));
+      g_hash_table_insert(index->trigrams, GUINT_TO_POINTER(trigram), ids);
+    }
+    /* the same trigram twice in a name */
+    if (ids->len == 0 || g_array_index(ids, guint32, ids->len - 1) != id) {
+      g_array_append_val(ids, id);
+    }
+  }
+}
+
+static void add_tag_ids(FilenameIndex *index, guint32 id) {
+  GArray *ids;
+  char **tags;
+  int i;
+
+  tags = get_entry(index, id)->tags;
+  for (i = 0; tags != NULL && tags[i] != NULL; i++) {
+    ids = g_hash_table_lookup(index->tags, tags[i]);
+    if (ids == NULL) {
+      ids = g_array_new(FALSE, FALSE, sizeof(guint32));
+      g_hash_table_insert(index->tags, g_strdup(tags[i]), ids);
+    }
+    /* the same tag twice on a file */
+    if (ids->len == 0 || g_array_index(ids, guint32, ids->len - 1) != id) {
+      g_array_append_val(ids, id);
+    }
+  }
+}
+
+static void remove_tag_ids(FilenameIndex *index, guint32 id) {
+  GArray *ids;
+  char **tags;
+  guint j;
+  int i;
+
+  tags = get_entry(index, id)->tags;
+  for (i = 0; tags != NULL && tags[i] != NULL; i++) {
+    ids = g_hash_table_lookup(index->tags, tags[i]);
+    if (ids == NULL) {
+      continue;
+    }
+    for (j = 0; j < ids->len; j++) {
+      if (g_array_index(ids, guint32, j) == id) {
+        g_array_remove_index_fast(ids, j);
+        break;
+      }
+    }
+    if (ids->len == 0) {
+      g_hash_table_remove(index->tags, tags[i]);
+    }
+  }
+}
+
+/* Gives the entry id the tags, which it takes */
+static void set_entry_tags(FilenameIndex *index, guint32 id, char **tags) {
+  IndexEntry *entry;
+
+  remove_tag_ids(index, id);
+  entry = get_entry(index, id);
+  g_strfreev(entry->tags);
+  entry->tags = tags;
+  add_tag_ids(index, id);
+}
+
+static guint32 add_entry(FilenameIndex *index, guint32 parent, char *name,
+                         char *key, char **tags, guint32 flags) {
+  IndexEntry entry;
+  guint32 id;
+
+  id = index->entries->len;
+
+  entry.parent = parent;
+  entry.first_child = INDEX_NO_ENTRY;
+  entry.next_sibling = INDEX_NO_ENTRY;
+  entry.flags = flags;
+  entry.mtime = 0;
+  entry.name = name;
+  entry.key = key;
+  entry.tags = tags;
+
+  if (parent != INDEX_NO_ENTRY) {
+    entry.next_sibling = get_entry(index, parent)->first_child;
+    get_entry(index, parent)->first_child = id;
+  }
+
+  g_array_append_val(index->entries, entry);
+  add_trigrams(index, id, key);
+  add_tag_ids(index, id);
+
+  return id;
+}
+
+static void child_info_free(gpointer data) {
+  ChildInfo *child;
+
+  child = data;
+  g_free(child->name);
+  g_free(child->key);
+  g_strfreev(child->tags);
+  g_free(child);
+}
+
+static guint64 get_mtime(GFileInfo *info) {
+  return g_file_info_get_attribute_uint64(info,
+                                          G_FILE_ATTRIBUTE_TIME_MODIFIED) *
+             G_USEC_PER_SEC +
+         g_file_info_get_attribute_uint32(info,
+                                          G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+}
+
+/* Returns the time folder was modified, or 0 if it is gone */
+static guint64 query_folder_mtime(GFile *folder, GCancellable *cancellable) {
+  GFileInfo *info;
+  guint64 mtime;
+
+  info = g_file_query_info(folder, INDEX_MTIME_ATTRIBUTES,
+                           G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, cancellable,
+                           NULL);
+  if (info == NULL) {
+    return 0;
+  }
+  mtime = get_mtime(info);
+  g_object_unref(info);
+
+  /* a folder from 1970 is still there */
+  return MAX(mtime, 1);
+}
+
+/* Returns the ChildInfos of the files in folder that get indexed */
+static GPtrArray *list_folder(GFile *folder, GCancellable *cancellable) {
+  GFileEnumerator *enumerator;
+  GFileInfo *info;
+  GPtrArray *children;
+  ChildInfo *child;
+
+  children = g_ptr_array_new_with_free_func(child_info_free);
+
+  /* Don't follow symlinks, they may lead back up */
+  enumerator = g_file_enumerate_children(folder, INDEX_ATTRIBUTES,
+                                         G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                         cancellable, NULL);
+  if (enumerator == NULL) {
+    return children;
+  }
+
+  while ((info = g_file_enumerator_next_file(enumerator, cancellable, NULL)) !=
+         NULL) {
+    if (!g_file_info_get_is_hidden(info) &&
+        g_file_info_get_display_name(info) != NULL) {
+      child = g_new(ChildInfo, 1);
+      child->name = g_strdup(g_file_info_get_name(info));
+      child->key = make_key(g_file_info_get_display_name(info));
+      child->tags = make_tags(g_file_info_get_attribute_string(
+          info, G_FILE_ATTRIBUTE_XATTR_XDG_TAGS));
+      child->is_directory =
+          g_file_info_get_file_type(info) == G_FILE_TYPE_DIRECTORY;
+      g_ptr_array_add(children, child);
+    }
+    g_object_unref(info);
+  }
+  g_object_unref(enumerator);
+
+  return children;
+}
+
+static char *get_entry_path(FilenameIndex *index, guint32 id) {
+  GArray *ids;
+  GString *path;
+  IndexEntry *entry;
+  guint i;
+
+  ids = g_array_new(FALSE, FALSE, sizeof(guint32));
+  for (; id != INDEX_NO_ENTRY; id = get_entry(index, id)->parent) {
+    g_array_append_val(ids, id);
+  }
+
+  path = g_string_new(NULL);
+  for (i = ids->len; i > 0; i--) {
+    entry = get_entry(index, g_array_index(ids, guint32, i - 1));
+    if (path->len > 0 && path->str[path->len - 1] != G_DIR_SEPARATOR) {
+      g_string_append_c(path, G_DIR_SEPARATOR);
+    }
+    g_string_append(path, entry->name);
+  }
+  g_array_free(ids, TRUE);
+
+  return g_string_free(path, FALSE);
+}
+
+static guint32 find_child(FilenameIndex *index, guint32 parent,
+                          const char *name, gsize name_len) {
+  IndexEntry *entry;
+  guint32 id;
+
+  for (id = get_entry(index, parent)->first_child; id != INDEX_NO_ENTRY;
+       id = entry->next_sibling) {
+    entry = get_entry(index, id);
+    if (strncmp(entry->name, name, name_len) == 0 &&
+        entry->name[name_len] == '\0') {
+      return id;
+    }
+  }
+
+  return INDEX_NO_ENTRY;
+}
+
+/* Returns the id of the indexed folder at path */
+static guint32 find_folder(FilenameIndex *index, const char *path) {
+  IndexEntry *root;
+  const char *rest, *end;
+  guint32 id;
+  gsize root_len;
+  guint i;
+
+  for (i = 0; i < index->n_roots; i++) {
+    root = get_entry(index, i);
+    root_len = strlen(root->name);
+    if (strncmp(path, root->name, root_len) != 0) {
+      continue;
+    }
+
+    rest = path + root_len;
+    if (*rest != '\0' && *rest != G_DIR_SEPARATOR &&
+        root->name[root_len - 1] != G_DIR_SEPARATOR) {
+      continue;
+    }
+
+    id = i;
+    while (id != INDEX_NO_ENTRY) {
+      while (*rest == G_DIR_SEPARATOR) {
+        rest++;
+      }
+      if (*rest == '\0') {
+        return is_live_folder(index, id) ? id : INDEX_NO_ENTRY;
+      }
+      end = strchr(rest, G_DIR_SEPARATOR);
+      if (end == NULL) {
+        end = rest + strlen(rest);
+      }
+      id = find_child(index, id, rest, end - rest);
+      rest = end;
+    }
+  }
+
+  return INDEX_NO_ENTRY;
+}
+
+static void stop_monitoring(guint32 id) {
+  if (index_monitors != NULL) {
+    g_hash_table_remove(index_monitors, GUINT_TO_POINTER(id));
+  }
+}
+
+/* Marks id and everything below it deleted, and unlinks it from its
+ * parent. Their trigrams stay until the index is saved, their tags go.
+ */
+static void delete_entry(FilenameIndex *index, guint32 id) {
+  IndexEntry *entry, *parent;
+  GArray *stack;
+  guint32 *link, child;
+
+  entry = get_entry(index, id);
+  if (entry->parent != INDEX_NO_ENTRY) {
+    parent = get_entry(index, entry->parent);
+    for (link = &parent->first_child; *link != INDEX_NO_ENTRY;
+         link = &get_entry(index, *link)->next_sibling) {
+      if (*link == id) {
+        *link = entry->next_sibling;
+        break;
+      }
+    }
+  }
+
+  stack = g_array_new(FALSE, FALSE, sizeof(guint32));
+  g_array_append_val(stack, id);
+  while (stack->len > 0) {
+    child = g_array_index(stack, guint32, stack->len - 1);
+    g_array_set_size(stack, stack->len - 1);
+
+    entry = get_entry(index, child);
+    if (entry->flags & ENTRY_DIRECTORY) {
+      stop_monitoring(child);
+    }
+    remove_tag_ids(index, child);
+    entry->flags |= ENTRY_DELETED;
+    g_clear_pointer(&entry->key, g_free);
+    g_clear_pointer(&entry->tags, g_strfreev);
+
+    for (child = entry->first_child; child != INDEX_NO_ENTRY;
+         child = get_entry(index, child)->next_sibling) {
+      g_array_append_val(stack, child);
+    }
+  }
+  g_array_free(stack, TRUE);
+}
+
+static void add_children(FilenameIndex *index, guint32 parent,
+                         GPtrArray *children, GQueue *new_folders) {
+  ChildInfo *child;
+  guint32 id;
+  guint i;
+
+  for (i = 0; i < children->len; i++) {
+    child = g_ptr_array_index(children, i);
+    id = add_entry(index, parent, g_steal_pointer(&child->name),
+                   g_steal_pointer(&child->key),
+                   g_steal_pointer(&child->tags),
+                   child->is_directory ? ENTRY_DIRECTORY : 0);
+    if (child->is_directory) {
+      g_queue_push_tail(new_folders, GUINT_TO_POINTER(id));
+    }
+  }
+}
+
+static FilenameIndex *filename_index_build(char **roots,
+                                           GCancellable *cancellable) {
+  FilenameIndex *index;
+  GQueue folders = G_QUEUE_INIT;
+  GPtrArray *children;
+  GFile *folder;
+  char *path;
+  guint32 id;
+  guint i;
+
+  index = filename_index_new();
+
+  for (i = 0; roots[i] != NULL; i++) {
+    /* the search location itself is never a hit */
+    id = add_entry(index, INDEX_NO_ENTRY, g_strdup(roots[i]), g_strdup(""),
+                   NULL, ENTRY_DIRECTORY);
+    g_queue_push_tail(&folders, GUINT_TO_POINTER(id));
+  }
+  index->n_roots = i;
+
+  /* Breadth first, so the folders nearest the top get the first ids */
+  while (!g_queue_is_empty(&folders) &&
+         !g_cancellable_is_cancelled(cancellable)) {
+    id = GPOINTER_TO_UINT(g_queue_pop_head(&folders));
+
+    path = get_entry_path(index, id);
+    folder = g_file_new_for_path(path);
+    g_free(path);
+
+    get_entry(index, id)->mtime = query_folder_mtime(folder, cancellable);
+    children = list_folder(folder, cancellable);
+    add_children(index, id, children, &folders);
+    g_ptr_array_free(children, TRUE);
+
+    g_object_unref(folder);
+  }
+  g_queue_clear(&folders);
+
+  return index;
+}
+
+static void append_uint32(GString *string, guint32 value) {
+  g_string_append_len(string, (const char *)&value, sizeof(value));
+}
+
+static void append_string(GString *string, const char *value) {
+  guint32 len;
+
+  len = strlen(value);
+  append_uint32(string, len);
+  g_string_append_len(string, value, len);
+}
+
+static void append_strv(GString *string, char **value) {
+  guint32 i, n;
+
+  n = value != NULL ? g_strv_length(value) : 0;
+  append_uint32(string, n);
+  for (i = 0; i < n; i++) {
+    append_string(string, value[i]);
+  }
+}
+
+/* Leaves out the deleted entries */
+static GBytes *filename_index_serialize(FilenameIndex *index) {
+  GHashTableIter iter;
+  gpointer key, value;
+  IndexEntry *entry;
+  GString *string;
+  guint32 *new_ids, n_live, n_ids, id;
+  GArray *ids;
+  guint i;
+  gsize count_offset;
+
+  new_ids = g_new(guint32, index->entries->len);
+  n_live = 0;
+  for (i = 0; i < index->entries->len; i++) {
+    new_ids[i] = get_entry(index, i)->flags & ENTRY_DELETED ? INDEX_NO_ENTRY
+                                                            : n_live++;
+  }
+
+  string = g_string_new(INDEX_MAGIC);
+  append_uint32(string, INDEX_BYTE_ORDER_MARK);
+  append_uint32(string, index->n_roots);
+  append_uint32(string, n_live);
+
+  for (i = 0; i < index->entries->len; i++) {
+    entry = get_entry(index, i);
+    if (entry->flags & ENTRY_DELETED) {
+      continue;
+    }
+    append_uint32(string, entry->parent == INDEX_NO_ENTRY
+                              ? INDEX_NO_ENTRY
+                              : new_ids[entry->parent]);
+    append_uint32(string, entry->flags);
+    g_string_append_len(string, (const char *)&entry->mtime,
+                        sizeof(entry->mtime));
+    append_string(string, entry->name);
+    append_string(string, entry->key);
+    append_strv(string, entry->tags);
+  }
+
+  append_uint32(string, g_hash_table_size(index->trigrams));
+  g_hash_table_iter_init(&iter, index->trigrams);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    ids = value;
+    append_uint32(string, GPOINTER_TO_UINT(key));
+
+    /* the count is known once the deleted ones are skipped */
+    count_offset = string->len;
+    append_uint32(string, 0);
+    n_ids = 0;
+    for (i = 0; i < ids->len; i++) {
+      id = new_ids[g_array_index(ids, guint32, i)];
+      if (id != INDEX_NO_ENTRY) {
+        append_uint32(string, id);
+        n_ids++;
+      }
+    }
+    memcpy(string->str + count_offset, &n_ids, sizeof(n_ids));
+  }
+
+  g_free(new_ids);
+
+  return g_string_free_to_bytes(string);
+}
+
+static gboolean read_data(const guchar **p, const guchar *end, gpointer data,
+                          gsize len) {
+  if ((gsize)(end - *p) < len) {
+    return FALSE;
+  }
+  memcpy(data, *p, len);
+  *p += len;
+
+  return TRUE;
+}
+
+static gboolean read_uint32(const guchar **p, const guchar *end,
+                            guint32 *value) {
+  return read_data(p, end, value, sizeof(*value));
+}
+
+static gboolean read_string(const guchar **p, const guchar *end,
+                            char **value) {
+  guint32 len;
+
+  if (!read_uint32(p, end, &len) || (gsize)(end - *p) < len) {
+    return FALSE;
+  }
+  *value = g_strndup((const char *)*p, len);
+  *p += len;
+
+  return TRUE;
+}
+
+/* An empty list is read as NULL */
+static gboolean read_strv(const guchar **p, const guchar *end,
+                          char ***value) {
+  guint32 n, i;
+
+  *value = NULL;
+  /* each string takes its length at least */
+  if (!read_uint32(p, end, &n) || (gsize)(end - *p) / sizeof(guint32) < n) {
+    return FALSE;
+  }
+  if (n == 0) {
+    return TRUE;
+  }
+
+  *value = g_new0(char *, n + 1);
+  for (i = 0; i < n; i++) {
+    if (!read_string(p, end, &(*value)[i])) {
+      g_clear_pointer(value, g_strfreev);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Returns NULL if there is no saved index of roots, or it can't be read */
+static FilenameIndex *filename_index_load(const char *filename,
+                                          char **roots) {
+  FilenameIndex *index;
+  IndexEntry entry, *parent;
+  GMappedFile *file;
+  const guchar *p, *end;
+  guint32 mark, n_roots, n_entries, n_trigrams, trigram, n_ids, id, i, j;
+  GArray *ids;
+
+  file = g_mapped_file_new(filename, FALSE, NULL);
+  if (file == NULL) {
+    return NULL;
+  }
+
+  p = (const guchar *)g_mapped_file_get_contents(file);
+  end = p + g_mapped_file_get_length(file);
+
+  index = filename_index_new();
+
+  if ((gsize)(end - p) < strlen(INDEX_MAGIC) ||
+      memcmp(p, INDEX_MAGIC, strlen(INDEX_MAGIC)) != 0) {
+    goto fail;
+  }
+  p += strlen(INDEX_MAGIC);
+
+  if (!read_uint32(&p, end, &mark) || mark != INDEX_BYTE_ORDER_MARK ||
+      !read_uint32(&p, end, &n_roots) ||
+      n_roots != g_strv_length(roots) || !read_uint32(&p, end, &n_entries) ||
+      n_entries < n_roots) {
+    goto fail;
+  }
+  index->n_roots = n_roots;
+
+  for (i = 0; i < n_entries; i++) {
+    entry.first_child = INDEX_NO_ENTRY;
+    entry.next_sibling = INDEX_NO_ENTRY;
+    entry.name = NULL;
+    entry.key = NULL;
+    entry.tags = NULL;
+    if (!read_uint32(&p, end, &entry.parent) ||
+        !read_uint32(&p, end, &entry.flags) ||
+        !read_data(&p, end, &entry.mtime, sizeof(entry.mtime)) ||
+        !read_string(&p, end, &entry.name) ||
+        !read_string(&p, end, &entry.key) ||
+        !read_strv(&p, end, &entry.tags)) {
+      g_free(entry.name);
+      g_free(entry.key);
+      goto fail;
+    }
+    g_array_append_val(index->entries, entry);
+    add_tag_ids(index, i);
+
+    /* The roots must be the folders of the setting, and everything else
+       below something that comes before it */
+    if (i < n_roots ? entry.parent != INDEX_NO_ENTRY ||
+                          strcmp(entry.name, roots[i]) != 0
+                    : entry.parent >= i ||
+                          !is_live_folder(index, entry.parent) ||
+                          (entry.flags & ENTRY_DELETED)) {
+      goto fail;
+    }
+    if (entry.parent != INDEX_NO_ENTRY) {
+      parent = get_entry(index, entry.parent);
+      get_entry(index, i)->next_sibling = parent->first_child;
+      parent->first_child = i;
+    }
+  }
+
+  if (!read_uint32(&p, end, &n_trigrams)) {
+    goto fail;
+  }
+  for (i = 0; i < n_trigrams; i++) {
+    if (!read_uint32(&p, end, &trigram) || !read_uint32(&p, end, &n_ids) ||
+        (gsize)(end - p) / sizeof(guint32) < n_ids) {
+      goto fail;
+    }
+    ids = g_array_sized_new(FALSE, FALSE, sizeof(guint32), n_ids);
+    g_hash_table_insert(index->trigrams, GUINT_TO_POINTER(trigram), ids);
+    for (j = 0; j < n_ids; j++) {
+      read_uint32(&p, end, &id);
+      if (id >= n_entries) {
+        goto fail;
+      }
+      g_array_append_val(ids, id);
+    }
+  }
+
+  g_mapped_file_unref(file);
+
+  return index;
+
+fail:
+  caja_debug_log(FALSE, CAJA_DEBUG_LOG_DOMAIN_USER,
+                 "file name index %s can't be used, building it again",
+                 filename);
+  filename_index_free(index);
+  g_mapped_file_unref(file);
+
+  return NULL;
+}
+
+static char *get_index_filename(void) {
+  return g_build_filename(g_get_user_cache_dir(), "caja", INDEX_FILE_NAME,
+                          NULL);
+}
+
+static void save_bytes(GBytes *bytes) {
+  char *filename, *dirname;
+  GError *error = NULL;
+
+  filename = get_index_filename();
+  dirname = g_path_get_dirname(filename);
+  g_mkdir_with_parents(dirname, 0700);
+
+  if (!g_file_set_contents(filename, g_bytes_get_data(bytes, NULL),
+                           g_bytes_get_size(bytes), &error)) {
+    g_warning("Can't save the file name index: %s", error->message);
+    g_error_free(error);
+  }
+
+  g_free(dirname);
+  g_free(filename);
+}
+
+static void save_thread(GTask *task, gpointer source_object,
+                        gpointer task_data, GCancellable *cancellable) {
+  save_bytes(task_data);
+}
+
+static void save_index(void) {
+  GTask *task;
+
+  if (save_timeout_id != 0) {
+    g_source_remove(save_timeout_id);
+    save_timeout_id = 0;
+  }
+  if (filename_index == NULL || !index_dirty) {
+    return;
+  }
+  index_dirty = FALSE;
+
+  task = g_task_new(NULL, NULL, NULL, NULL);
+  g_task_set_task_data(task, filename_index_serialize(filename_index),
+                       (GDestroyNotify)g_bytes_unref);
+  g_task_run_in_thread(task, save_thread);
+  g_object_unref(task);
+}
+
+static gboolean save_timeout_callback(gpointer user_data) {
+  save_timeout_id = 0;
+  save_index();
+  return FALSE;
+}
+
+static void mark_dirty(void) {
+  index_dirty = TRUE;
+  if (save_timeout_id == 0) {
+    save_timeout_id = g_timeout_add_seconds_full(
+        G_PRIORITY_LOW, INDEX_SAVE_DELAY_SECS, save_timeout_callback, NULL,
+        NULL);
+  }
+}
+
+static gboolean change_timeout_callback(gpointer user_data) {
+  change_timeout_id = 0;
+  run_next_job();
+  return FALSE;
+}
+
+static void recheck_folder(guint32 id) {
+  g_hash_table_add(folders_to_recheck, GUINT_TO_POINTER(id));
+  if (change_timeout_id == 0) {
+    change_timeout_id = g_timeout_add_seconds_full(
+        G_PRIORITY_LOW, INDEX_CHANGE_DELAY_SECS, change_timeout_callback, NULL,
+        NULL);
+  }
+}
+
+static void monitor_changed_callback(GFileMonitor *monitor, GFile *file,
+                                     GFile *other_file,
+                                     GFileMonitorEvent event_type,
+                                     gpointer user_data) {
+  IndexEntry *entry;
+  GFile *folder;
+  char *path;
+  guint32 id;
+
+  id = GPOINTER_TO_UINT(user_data);
+
+  switch (event_type) {
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_DELETED:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+    case G_FILE_MONITOR_EVENT_MOVED_OUT:
+    case G_FILE_MONITOR_EVENT_RENAMED:
+      /* The folder is read again, which catches the deleted folder too */
+      if (filename_index != NULL && is_live_folder(filename_index, id)) {
+        get_entry(filename_index, id)->mtime = 0;
+        recheck_folder(id);
+      }
+      break;
+    case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
+      /* Maybe the tags changed. Those of the folder itself are read with
+         its parent. */
+      if (filename_index == NULL || !is_live_folder(filename_index, id)) {
+        break;
+      }
+      entry = get_entry(filename_index, id);
+      path = get_entry_path(filename_index, id);
+      folder = g_file_new_for_path(path);
+      if (g_file_equal(file, folder)) {
+        id = entry->parent;
+      }
+      g_object_unref(folder);
+      g_free(path);
+
+      if (id != INDEX_NO_ENTRY) {
+        get_entry(filename_index, id)->mtime = 0;
+        recheck_folder(id);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+static void start_monitoring(guint32 id) {
+  GFileMonitor *monitor;
+  GFile *folder;
+  char *path;
+
+  if (g_hash_table_size(index_monitors) >= INDEX_MAX_MONITORS ||
+      g_hash_table_contains(index_monitors, GUINT_TO_POINTER(id))) {
+    return;
+  }
+
+  path = get_entry_path(filename_index, id);
+  folder = g_file_new_for_path(path);
+  monitor = g_file_monitor_directory(folder, G_FILE_MONITOR_WATCH_MOVES, NULL,
+                                     NULL);
+  if (monitor != NULL) {
+    g_signal_connect(monitor, "changed", G_CALLBACK(monitor_changed_callback),
+                     GUINT_TO_POINTER(id));
+    g_hash_table_insert(index_monitors, GUINT_TO_POINTER(id), monitor);
+  }
+  g_object_unref(folder);
+  g_free(path);
+}
+
+static void start_monitoring_all(void) {
+  guint32 id;
+
+  g_hash_table_remove_all(index_monitors);
+
+  for (id = 0; id < filename_index->entries->len &&
+               g_hash_table_size(index_monitors) < INDEX_MAX_MONITORS;
+       id++) {
+    if (is_live_folder(filename_index, id)) {
+      start_monitoring(id);
+    }
+  }
+}
+
+/* Brings the children of the folder id in line with what was found */
+static void apply_check(FolderCheck *check) {
+  GHashTable *old_children;
+  GHashTableIter iter;
+  IndexEntry *entry;
+  ChildInfo *child;
+  GQueue new_folders = G_QUEUE_INIT;
+  gpointer old_id;
+  guint32 id;
+  guint i;
+
+  if (!is_live_folder(filename_index, check->id)) {
+    return;
+  }
+
+  if (check->gone) {
+    if (check->id >= filename_index->n_roots) {
+      delete_entry(filename_index, check->id);
+    } else {
+      /* The indexed folders themselves stay, they may be on a disk that
+         comes back */
+      while ((id = get_entry(filename_index, check->id)->first_child) !=
+             INDEX_NO_ENTRY) {
+        delete_entry(filename_index, id);
+      }
+      get_entry(filename_index, check->id)->mtime = 0;
+    }
+    mark_dirty();
+    return;
+  }
+
+  entry = get_entry(filename_index, check->id);
+  entry->mtime = check->new_mtime;
+  if (check->children == NULL) {
+    return;
+  }
+
+  old_children = g_hash_table_new(g_str_hash, g_str_equal);
+  for (id = entry->first_child; id != INDEX_NO_ENTRY;
+       id = get_entry(filename_index, id)->next_sibling) {
+    g_hash_table_insert(old_children, get_entry(filename_index, id)->name,
+                        GUINT_TO_POINTER(id));
+  }
+
+  for (i = 0; i < check->children->len; i++) {
+    child = g_ptr_array_index(check->children, i);
+    if (g_hash_table_lookup_extended(old_children, child->name, NULL,
+                                     &old_id)) {
+      id = GPOINTER_TO_UINT(old_id);
+      g_hash_table_remove(old_children, child->name);
+      if (((get_entry(filename_index, id)->flags & ENTRY_DIRECTORY) != 0) ==
+              child->is_directory &&
+          g_strcmp0(get_entry(filename_index, id)->key, child->key) == 0) {
+        if (!tags_equal(get_entry(filename_index, id)->tags, child->tags)) {
+          set_entry_tags(filename_index, id, g_steal_pointer(&child->tags));
+          mark_dirty();
+        }
+        continue;
+      }
+      /* something else by the same name */
+      delete_entry(filename_index, id);
+    }
+
+    id = add_entry(filename_index, check->id, g_steal_pointer(&child->name),
+                   g_steal_pointer(&child->key),
+                   g_steal_pointer(&child->tags),
+                   child->is_directory ? ENTRY_DIRECTORY : 0);
+    if (child->is_directory) {
+      g_queue_push_tail(&new_folders, GUINT_TO_POINTER(id));
+    }
+    mark_dirty();
+  }
+
+  /* what is left is gone */
+  g_hash_table_iter_init(&iter, old_children);
+  while (g_hash_table_iter_next(&iter, NULL, &old_id)) {
+    delete_entry(filename_index, GPOINTER_TO_UINT(old_id));
+    mark_dirty();
+  }
+  g_hash_table_destroy(old_children);
+
+  /* The new folders have to be read too */
+  while (!g_queue_is_empty(&new_folders)) {
+    id = GPOINTER_TO_UINT(g_queue_pop_head(&new_folders));
+    start_monitoring(id);
+    recheck_folder(id);
+  }
+}
+
+static void folder_check_free(gpointer data) {
+  FolderCheck *check;
+
+  check = data;
+  g_free(check->path);
+  if (check->children != NULL) {
+    g_ptr_array_free(check->children, TRUE);
+  }
+  g_free(check);
+}
+
+static void index_job_free(IndexJob *job) {
+  g_strfreev(job->roots);
+  if (job->checks != NULL) {
+    g_ptr_array_free(job->checks, TRUE);
+  }
+  if (job->index != NULL) {
+    filename_index_free(job->index);
+  }
+  g_free(job);
+}
+
+static void check_folders(IndexJob *job, GCancellable *cancellable) {
+  FolderCheck *check;
+  GFile *folder;
+  guint i;
+
+  for (i = 0; i < job->checks->len; i++) {
+    if (g_cancellable_is_cancelled(cancellable)) {
+      return;
+    }
+
+    check = g_ptr_array_index(job->checks, i);
+    folder = g_file_new_for_path(check->path);
+
+    check->new_mtime = query_folder_mtime(folder, cancellable);
+    if (check->new_mtime == 0) {
+      check->gone = !g_cancellable_is_cancelled(cancellable);
+    } else if (check->new_mtime != check->mtime) {
+      check->children = list_folder(folder, cancellable);
+    }
+
+    g_object_unref(folder);
+  }
+}
+
+static void index_job_thread(GTask *task, gpointer source_object,
+                             gpointer task_data, GCancellable *cancellable) {
+  IndexJob *job;
+  char *filename;
+  GBytes *bytes;
+
+  job = task_data;
+
+  if (job->checks != NULL) {
+    check_folders(job, cancellable);
+    return;
+  }
+
+  filename = get_index_filename();
+  if (!job->rebuild) {
+    job->index = filename_index_load(filename, job->roots);
+  }
+  if (job->index == NULL) {
+    job->index = filename_index_build(job->roots, cancellable);
+    if (!g_cancellable_is_cancelled(cancellable)) {
+      bytes = filename_index_serialize(job->index);
+      save_bytes(bytes);
+      g_bytes_unref(bytes);
+    }
+  }
+  g_free(filename);
+}
+
+static void index_job_callback(GObject *source_object, GAsyncResult *res,
+                               gpointer user_data) {
+  IndexJob *job;
+  gboolean loaded;
+  guint i;
+
+  job = g_task_get_task_data(G_TASK(res));
+
+  if (g_cancellable_is_cancelled(g_task_get_cancellable(G_TASK(res)))) {
+    return;
+  }
+  index_busy = FALSE;
+
+  if (job->index != NULL) {
+    loaded = !job->rebuild;
+
+    if (filename_index != NULL) {
+      filename_index_free(filename_index);
+    }
+    filename_index = g_steal_pointer(&job->index);
+    index_generation++;
+    index_dirty = FALSE;
+    g_hash_table_remove_all(folders_to_recheck);
+
+    caja_debug_log(FALSE, CAJA_DEBUG_LOG_DOMAIN_USER,
+                   "file name index has %u entries",
+                   filename_index->entries->len);
+
+    start_monitoring_all();
+    /* Catch up with what changed while Caja wasn't running */
+    recheck_all_wanted = loaded;
+    /* a new index read everything */
+    if (!loaded) {
+      reread_all_wanted = FALSE;
+    }
+  } else if (job->checks != NULL && job->generation == index_generation) {
+    for (i = 0; i < job->checks->len; i++) {
+      apply_check(g_ptr_array_index(job->checks, i));
+    }
+  }
+
+  run_next_job();
+}
+
+static FolderCheck *folder_check_new(guint32 id) {
+  FolderCheck *check;
+
+  check = g_new0(FolderCheck, 1);
+  check->id = id;
+  check->path = get_entry_path(filename_index, id);
+  check->mtime = get_entry(filename_index, id)->mtime;
+
+  return check;
+}
+
+static void run_job(IndexJob *job) {
+  GTask *task;
+
+  index_busy = TRUE;
+  job->roots = g_strdupv(index_roots);
+  job->generation = index_generation;
+
+  task = g_task_new(NULL, index_cancellable, index_job_callback, NULL);
+  g_task_set_task_data(task, job, (GDestroyNotify)index_job_free);
+  g_task_run_in_thread(task, index_job_thread);
+  g_object_unref(task);
+}
+
+static void run_next_job(void) {
+  GHashTableIter iter;
+  gpointer key;
+  FolderCheck *check;
+  IndexJob *job;
+  guint32 id;
+
+  if (index_busy || index_roots == NULL || index_roots[0] == NULL) {
+    return;
+  }
+
+  if (rebuild_wanted || load_wanted) {
+    job = g_new0(IndexJob, 1);
+    job->rebuild = rebuild_wanted;
+    rebuild_wanted = FALSE;
+    load_wanted = FALSE;
+    run_job(job);
+    return;
+  }
+
+  if (filename_index == NULL) {
+    return;
+  }
+
+  if (recheck_all_wanted || reread_all_wanted) {
+    job = g_new0(IndexJob, 1);
+    job->checks = g_ptr_array_new_with_free_func(folder_check_free);
+    for (id = 0; id < filename_index->entries->len; id++) {
+      if (is_live_folder(filename_index, id)) {
+        check = folder_check_new(id);
+        if (reread_all_wanted) {
+          check->mtime = 0;
+        }
+        g_ptr_array_add(job->checks, check);
+      }
+    }
+    recheck_all_wanted = FALSE;
+    reread_all_wanted = FALSE;
+    g_hash_table_remove_all(folders_to_recheck);
+    run_job(job);
+    return;
+  }
+
+  if (g_hash_table_size(folders_to_recheck) > 0) {
+    job = g_new0(IndexJob, 1);
+    job->checks = g_ptr_array_new_with_free_func(folder_check_free);
+    g_hash_table_iter_init(&iter, folders_to_recheck);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+      id = GPOINTER_TO_UINT(key);
+      if (is_live_folder(filename_index, id)) {
+        g_ptr_array_add(job->checks, folder_check_new(id));
+      }
+    }
+    g_hash_table_remove_all(folders_to_recheck);
+    run_job(job);
+  }
+}
+
+static gboolean recheck_timeout_callback(gpointer user_data) {
+  recheck_all_wanted = TRUE;
+  run_next_job();
+  return TRUE;
+}
+
+static void stop_jobs(void) {
+  if (index_cancellable != NULL) {
+    g_cancellable_cancel(index_cancellable);
+    g_clear_object(&index_cancellable);
+  }
+  index_busy = FALSE;
+  index_cancellable = g_cancellable_new();
+}
+
+static void read_roots(void) {
+  GPtrArray *roots;
+  char **folders;
+  GFile *file;
+  char *path;
+  int i;
+
+  roots = g_ptr_array_new();
+  folders = g_settings_get_strv(caja_preferences,
+                                CAJA_PREFERENCES_SEARCH_INDEX_FOLDERS);
+  for (i = 0; folders[i] != NULL; i++) {
+    file = g_file_parse_name(folders[i]);
+    path = g_file_get_path(file);
+    if (path != NULL) {
+      g_ptr_array_add(roots, path);
+    }
+    g_object_unref(file);
+  }
+  g_strfreev(folders);
+  g_ptr_array_add(roots, NULL);
+
+  g_strfreev(index_roots);
+  index_roots = (char **)g_ptr_array_free(roots, FALSE);
+}
+
+static void folders_changed_callback(gpointer user_data) {
+  char **old_roots;
+
+  old_roots = g_strdupv(index_roots);
+  read_roots();
+  if (g_strv_equal((const char *const *)old_roots,
+                   (const char *const *)index_roots)) {
+    g_strfreev(old_roots);
+    return;
+  }
+  g_strfreev(old_roots);
+
+  stop_jobs();
+  g_hash_table_remove_all(index_monitors);
+  g_hash_table_remove_all(folders_to_recheck);
+  g_clear_pointer(&filename_index, filename_index_free);
+  index_generation++;
+  index_dirty = FALSE;
+
+  /* the saved index is of the old folders */
+  reread_all_wanted = FALSE;
+  rebuild_wanted = TRUE;
+  run_next_job();
+}
+
+static gboolean start_timeout_callback(gpointer user_data) {
+  start_timeout_id = 0;
+  load_wanted = TRUE;
+  run_next_job();
+  return FALSE;
+}
+
+static void filename_index_shutdown(void) {
+  GBytes *bytes;
+
+  if (start_timeout_id != 0) {
+    g_source_remove(start_timeout_id);
+  }
+  if (recheck_timeout_id != 0) {
+    g_source_remove(recheck_timeout_id);
+  }
+  if (change_timeout_id != 0) {
+    g_source_remove(change_timeout_id);
+  }
+  if (save_timeout_id != 0) {
+    g_source_remove(save_timeout_id);
+  }
+
+  g_signal_handlers_disconnect_by_func(caja_preferences,
+                                       G_CALLBACK(folders_changed_callback),
+                                       NULL);
+
+  g_cancellable_cancel(index_cancellable);
+  g_clear_object(&index_cancellable);
+
+  if (filename_index != NULL && index_dirty) {
+    bytes = filename_index_serialize(filename_index);
+    save_bytes(bytes);
+    g_bytes_unref(bytes);
+  }
+
+  g_clear_pointer(&index_monitors, g_hash_table_destroy);
+  g_clear_pointer(&folders_to_recheck, g_hash_table_destroy);
+  g_clear_pointer(&filename_index, filename_index_free);
+  g_clear_pointer(&index_roots, g_strfreev);
+}
+
+void caja_filename_index_start(void) {
+  static gboolean started = FALSE;
+
+  if (started) {
+    return;
+  }
+  started = TRUE;
+
+  index_cancellable = g_cancellable_new();
+  index_monitors =
+      g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                            (GDestroyNotify)g_object_unref);
+  folders_to_recheck = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+  read_roots();
+  g_signal_connect_swapped(caja_preferences,
+                           "changed::" CAJA_PREFERENCES_SEARCH_INDEX_FOLDERS,
+                           G_CALLBACK(folders_changed_callback), NULL);
+
+  start_timeout_id = g_timeout_add_seconds_full(
+      G_PRIORITY_LOW, INDEX_START_DELAY_SECS, start_timeout_callback, NULL,
+      NULL);
+  recheck_timeout_id = g_timeout_add_seconds_full(
+      G_PRIORITY_LOW, INDEX_RECHECK_INTERVAL_SECS, recheck_timeout_callback,
+      NULL, NULL);
+
+  eel_debug_call_at_shutdown(filename_index_shutdown);
+}
+
+gboolean caja_filename_index_is_enabled(void) {
+  return index_roots != NULL && index_roots[0] != NULL;
+}
+
+static guint32 find_folder_for_uri(const char *uri) {
+  char *path;
+  guint32 id;
+
+  if (filename_index == NULL) {
+    return INDEX_NO_ENTRY;
+  }
+
+  path = g_filename_from_uri(uri, NULL, NULL);
+  if (path == NULL) {
+    return INDEX_NO_ENTRY;
+  }
+  id = find_folder(filename_index, path);
+  g_free(path);
+
+  return id;
+}
+
+gboolean caja_filename_index_covers(const char *uri) {
+  return find_folder_for_uri(uri) != INDEX_NO_ENTRY;
+}
+
+static gboolean entry_matches(FilenameIndex *index, guint32 id,
+                              guint32 folder, char **words, char **tags) {
+  IndexEntry *entry;
+  int i;
+
+  entry = get_entry(index, id);
+  if (entry->flags & ENTRY_DELETED || id == folder) {
+    return FALSE;
+  }
+
+  for (i = 0; words[i] != NULL; i++) {
+    if (strstr(entry->key, words[i]) == NULL) {
+      return FALSE;
+    }
+  }
+
+  for (i = 0; tags != NULL && tags[i] != NULL; i++) {
+    if (entry->tags == NULL ||
+        !g_strv_contains((const char *const *)entry->tags, tags[i])) {
+      return FALSE;
+    }
+  }
+
+  /* below folder? Parents come first, so nothing before it can be. */
+  for (; id != INDEX_NO_ENTRY && id > folder;
+       id = get_entry(index, id)->parent) {
+  }
+
+  return id == folder;
+}
+
+static GList *add_hit(GList *hits, FilenameIndex *index, guint32 id) {
+  char *path, *uri;
+
+  path = get_entry_path(index, id);
+  uri = g_filename_to_uri(path, NULL, NULL);
+  g_free(path);
+
+  return uri != NULL ? g_list_prepend(hits, uri) : hits;
+}
+
+GList *caja_filename_index_search(const char *uri, char **words,
+                                  char **tags) {
+  GArray *ids, *shortest;
+  GList *hits;
+  gboolean has_tags;
+  guint32 folder, id;
+  gsize len, j;
+  guint i;
+
+  folder = find_folder_for_uri(uri);
+  if (folder == INDEX_NO_ENTRY) {
+    return NULL;
+  }
+
+  /* Only the entries with the rarest tag, or else the rarest trigram of the
+     words, can match. An empty array means some tag or trigram isn't there
+     at all. */
+  shortest = NULL;
+  has_tags = tags != NULL && tags[0] != NULL;
+  for (i = 0; has_tags && tags[i] != NULL; i++) {
+    ids = g_hash_table_lookup(filename_index->tags, tags[i]);
+    if (ids == NULL) {
+      return NULL;
+    }
+    if (shortest == NULL || ids->len < shortest->len) {
+      shortest = ids;
+    }
+  }
+  for (i = 0; !has_tags && words[i] != NULL; i++) {
+    len = strlen(words[i]);
+    for (j = 0; j + 3 <= len; j++) {
+      ids = g_hash_table_lookup(filename_index->trigrams,
+                                GUINT_TO_POINTER(make_trigram(words[i] + j)));
+      if (ids == NULL) {
+        return NULL;
+      }
+      if (shortest == NULL || ids->len < shortest->len) {
+        shortest = ids;
+      }
+    }
+  }
+
+  hits = NULL;
+  if (shortest != NULL) {
+    for (i = 0; i < shortest->len; i++) {
+      id = g_array_index(shortest, guint32, i);
+      if (id > folder &&
+          entry_matches(filename_index, id, folder, words, tags)) {
+        hits = add_hit(hits, filename_index, id);
+      }
+    }
+  } else {
+    /* no word is long enough to have a trigram */
+    for (id = folder + 1; id < filename_index->entries->len; id++) {
+      if (entry_matches(filename_index, id, folder, words, tags)) {
+        hits = add_hit(hits, filename_index, id);
+      }
+    }
+  }
+
+  return hits;
+}
+
+void caja_filename_index_rebuild(void) {
+  if (!caja_filename_index_is_enabled()) {
+    return;
+  }
+
+  caja_debug_log(FALSE, CAJA_DEBUG_LOG_DOMAIN_USER,
+                 "rebuilding the file name index");
+
+  /* The running job is of the index that gets replaced */
+  stop_jobs();
+  g_hash_table_remove_all(folders_to_recheck);
+  recheck_all_wanted = FALSE;
+  reread_all_wanted = FALSE;
+  load_wanted = FALSE;
+  rebuild_wanted = TRUE;
+  run_next_job();
+}
+
+void caja_filename_index_check(void) {
+  if (!caja_filename_index_is_enabled()) {
+    return;
+  }
+
+  caja_debug_log(FALSE, CAJA_DEBUG_LOG_DOMAIN_USER,
+                 "reading all folders of the file name index again");
+
+  /* Waits for the index if it isn't loaded yet */
+  reread_all_wanted = TRUE;
+  run_next_job();
+}
+
+void caja_filename_index_tags_written(GFile *file, const char *tags) {
+  GFile *parent;
+  char *path, *name;
+  guint32 folder, id;
+
+  if (filename_index == NULL) {
+    return;
+  }
+
+  parent = g_file_get_parent(file);
+  path = parent != NULL ? g_file_get_path(parent) : NULL;
+  folder = path != NULL ? find_folder(filename_index, path) : INDEX_NO_ENTRY;
+  if (folder != INDEX_NO_ENTRY) {
+    name = g_file_get_basename(file);
+    id = find_child(filename_index, folder, name, strlen(name));
+    if (id != INDEX_NO_ENTRY) {
+      set_entry_tags(filename_index, id, make_tags(tags));
+      mark_dirty();
+    }
+    g_free(name);
+  }
+  g_free(path);
+  if (parent != NULL) {
+    g_object_unref(parent);
+  }
+}
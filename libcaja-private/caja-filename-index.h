@@ -0,0 +1,56 @@
+/*
+   caja-filename-index.h: Index of the file names in chosen folders.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef CAJA_FILENAME_INDEX_H
+#define CAJA_FILENAME_INDEX_H
+
+#include <gio/gio.h>
+
+/* Keeps an index of the names and tags of the files in the folders of the
+   search-index-folders setting. It is loaded from disk, or built in the
+   background the first time, and then follows the changes reported by
+   file monitors and found by checking the folders now and then. */
+void caja_filename_index_start(void);
+
+/* Whether there are folders to index */
+gboolean caja_filename_index_is_enabled(void);
+
+/* Whether the index is loaded and has the folder at uri in it */
+gboolean caja_filename_index_covers(const char *uri);
+
+/* Returns the uris of the files below the folder at uri whose names
+   contain all of words and that have all of tags, which may be NULL. The
+   words and tags have to be normalized and in lower case like the simple
+   search engine does it. Hidden files aren't indexed. */
+GList *caja_filename_index_search(const char *uri, char **words,
+                                  char **tags);
+
+/* Throws the index away and builds it again */
+void caja_filename_index_rebuild(void);
+
+/* Reads all indexed folders again and brings the index in line with them.
+   Changing the tags of a file doesn't change its folder, so tags changed
+   in folders without a monitor are only found this way. */
+void caja_filename_index_check(void);
+
+/* Tells the index that Caja set the tags of file, as the escaped value of
+   the extended attribute, so that it doesn't wait for a monitor */
+void caja_filename_index_tags_written(GFile *file, const char *tags);
+
+#endif /* CAJA_FILENAME_INDEX_H */
@@ -61,6 +61,10 @@ G_BEGIN_DECLS
 #define CAJA_PREFERENCES_CONFIRM_MOVE_TO_TRASH "confirm-move-to-trash"
 #define CAJA_PREFERENCES_ENABLE_DELETE "enable-delete"
 
+/* Search options */
+#define CAJA_PREFERENCES_SEARCH_CONTENT_MAX_SIZE "search-content-max-size"
+#define CAJA_PREFERENCES_SEARCH_INDEX_FOLDERS "search-index-folders"
+
 /* Desktop options */
 #define CAJA_PREFERENCES_DESKTOP_IS_HOME_DIR "desktop-is-home-dir"
 #define CAJA_PREFERENCES_SHOW_NOTIFICATIONS "show-notifications"
@@ -183,6 +187,12 @@ typedef enum {
 #define CAJA_PREFERENCES_SHOW_DIRECTORY_ITEM_COUNTS "show-directory-item-counts"
 #define CAJA_PREFERENCES_SHOW_IMAGE_FILE_THUMBNAILS "show-image-thumbnails"
 #define CAJA_PREFERENCES_IMAGE_FILE_THUMBNAIL_LIMIT "thumbnail-limit"
+#define CAJA_PREFERENCES_THUMBNAIL_WORKERS "thumbnail-workers"
+#define CAJA_PREFERENCES_THUMBNAIL_CACHE_SIZE "thumbnail-cache-size"
+#define CAJA_PREFERENCES_THUMBNAIL_PREGENERATE_FOLDERS \
+  "thumbnail-pregenerate-folders"
+#define CAJA_PREFERENCES_THUMBNAIL_PREGENERATE_ON_BATTERY \
+  "thumbnail-pregenerate-on-battery"
 #define CAJA_PREFERENCES_PREVIEW_SOUND "preview-sound"
 
 typedef enum {
@@ -33,6 +33,7 @@
 #include <atk/atknoopobject.h>
 #include <eel/eel-accessibility.h>
 #include <eel/eel-art-extensions.h>
+#include <eel/eel-debug.h>
 #include <eel/eel-gdk-extensions.h>
 #include <eel/eel-gdk-pixbuf-extensions.h>
 #include <eel/eel-glib-extensions.h>
@@ -93,6 +94,10 @@ struct _CajaIconCanvasItemPrivate {
   double x, y;
   GdkPixbuf *pixbuf;
   cairo_surface_t *rendered_surface;
+  /* Size of the image in device pixels, also known while the item is
+   * dormant and does not hold on to the pixbuf. */
+  int image_width;
+  int image_height;
   GList *emblem_pixbufs;
   char *editable_text;   /* Text that can be modified by a renaming function */
   char *additional_text; /* Text that cannot be modifed, such as file size, etc.
@@ -143,6 +148,9 @@ struct _CajaIconCanvasItemPrivate {
 
   guint is_visible : 1;
 
+  /* Far out of view in a huge container; only the geometry is kept. */
+  guint is_dormant : 1;
+
   GdkRectangle embedded_text_rect;
   char *embedded_text;
 
@@ -459,7 +467,7 @@ static void caja_icon_canvas_item_get_property(GObject *object,
 
 static void get_scaled_icon_size(CajaIconCanvasItem *item, gint *width,
                                  gint *height) {
-  GdkPixbuf *pixbuf = NULL;
+  gint image_width = 0, image_height = 0;
   gint scale = 1;
 
   if (item != NULL) {
@@ -467,13 +475,12 @@ static void get_scaled_icon_size(CajaIconCanvasItem *item, gint *width,
 
     canvas = EEL_CANVAS_ITEM(item)->canvas;
     scale = gtk_widget_get_scale_factor(GTK_WIDGET(canvas));
-    pixbuf = item->details->pixbuf;
+    image_width = item->details->image_width;
+    image_height = item->details->image_height;
   }
 
-  if (width)
-    *width = (pixbuf == NULL) ? 0 : (gdk_pixbuf_get_width(pixbuf) / scale);
-  if (height)
-    *height = (pixbuf == NULL) ? 0 : (gdk_pixbuf_get_height(pixbuf) / scale);
+  if (width) *width = image_width / scale;
+  if (height) *height = image_height / scale;
 }
 
 cairo_surface_t *caja_icon_canvas_item_get_drag_surface(
@@ -522,12 +529,14 @@ cairo_surface_t *caja_icon_canvas_item_get_drag_surface(
 
   cr = cairo_create(surface);
 
-  drag_surface = gdk_cairo_surface_create_from_pixbuf(
-      item->details->pixbuf, gtk_widget_get_scale_factor(GTK_WIDGET(canvas)),
-      gtk_widget_get_window(GTK_WIDGET(canvas)));
-  gtk_render_icon_surface(context, cr, drag_surface, item_offset_x,
-                          item_offset_y);
-  cairo_surface_destroy(drag_surface);
+  if (item->details->pixbuf != NULL) {
+    drag_surface = gdk_cairo_surface_create_from_pixbuf(
+        item->details->pixbuf, gtk_widget_get_scale_factor(GTK_WIDGET(canvas)),
+        gtk_widget_get_window(GTK_WIDGET(canvas)));
+    gtk_render_icon_surface(context, cr, drag_surface, item_offset_x,
+                            item_offset_y);
+    cairo_surface_destroy(drag_surface);
+  }
 
   get_scaled_icon_size(item, &pix_width, &pix_height);
 
@@ -562,11 +571,29 @@ cairo_surface_t *caja_icon_canvas_item_get_drag_surface(
 void caja_icon_canvas_item_set_image(CajaIconCanvasItem *item,
                                      GdkPixbuf *image) {
   CajaIconCanvasItemPrivate *details;
+  int width, height;
 
   g_return_if_fail(CAJA_IS_ICON_CANVAS_ITEM(item));
   g_return_if_fail(image == NULL || pixbuf_is_acceptable(image));
 
   details = item->details;
+  width = image != NULL ? gdk_pixbuf_get_width(image) : 0;
+  height = image != NULL ? gdk_pixbuf_get_height(image) : 0;
+
+  /* A dormant item has no pixbuf, so it is compared by size instead */
+  if (details->is_dormant) {
+    /* Only remember the size, the image is set again when the item
+     * wakes up.
+     */
+    if (details->image_width != width || details->image_height != height) {
+      details->image_width = width;
+      details->image_height = height;
+      caja_icon_canvas_item_invalidate_bounds_cache(item);
+      eel_canvas_item_request_update(EEL_CANVAS_ITEM(item));
+    }
+    return;
+  }
+
   if (details->pixbuf == image) {
     return;
   }
@@ -583,6 +610,8 @@ void caja_icon_canvas_item_set_image(CajaIconCanvasItem *item,
   }
 
   details->pixbuf = image;
+  details->image_width = width;
+  details->image_height = height;
 
   caja_icon_canvas_item_invalidate_bounds_cache(item);
   eel_canvas_item_request_update(EEL_CANVAS_ITEM(item));
@@ -965,9 +994,46 @@ static void prepare_pango_layout_for_draw(CajaIconCanvasItem *item,
   }
 }
 
+/* Key of the container's label metrics cache: the label text plus
+ * everything prepare_pango_layout_for_draw() and create_label_layout()
+ * take into account. The font is not part of it, the container drops
+ * the cache whenever the font changes.
+ */
+static char *get_label_metrics_key(CajaIconCanvasItem *item) {
+  CajaIconCanvasItemPrivate *details;
+  CajaIconContainer *container;
+  const char *editable_text, *additional_text;
+  double max_text_width;
+  gboolean unlimited_height;
+
+  details = item->details;
+  container = CAJA_ICON_CONTAINER(EEL_CANVAS_ITEM(item)->canvas);
+
+  editable_text = details->editable_text != NULL ? details->editable_text : "";
+  additional_text =
+      details->additional_text != NULL ? details->additional_text : "";
+
+  max_text_width = caja_icon_canvas_item_get_max_text_width(item);
+  unlimited_height =
+      details->is_highlighted_for_selection ||
+      details->is_highlighted_for_drop ||
+      details->is_highlighted_as_keyboard_focus || details->entire_text;
+
+  return g_strdup_printf(
+      "%d %d %d %d %d %d %d %" G_GSIZE_FORMAT ":%s%s",
+      container->details->zoom_level,
+      max_text_width < 0 ? -1 : (int)floor(max_text_width),
+      caja_icon_container_get_max_layout_lines(container), unlimited_height,
+      IS_COMPACT_VIEW(container), container->details->label_position,
+      caja_icon_container_is_layout_rtl(container), strlen(editable_text),
+      editable_text, additional_text);
+}
+
 static void measure_label_text(CajaIconCanvasItem *item) {
   CajaIconCanvasItemPrivate *details;
   CajaIconContainer *container;
+  CajaIconLabelMetrics metrics;
+  char *key;
   gint editable_height, editable_height_for_layout,
       editable_height_for_entire_text, editable_width, editable_dx;
   gint additional_height, additional_width, additional_dx;
@@ -1008,6 +1074,21 @@ static void measure_label_text(CajaIconCanvasItem *item) {
   return;
 #endif
 
+  container = CAJA_ICON_CONTAINER(EEL_CANVAS_ITEM(item)->canvas);
+
+  /* Icons with the same label share the measurement. */
+  key = get_label_metrics_key(item);
+  if (caja_icon_container_lookup_label_metrics(container, key, &metrics)) {
+    details->text_width = metrics.text_width;
+    details->text_dx = metrics.text_dx;
+    details->text_height = metrics.text_height;
+    details->text_height_for_layout = metrics.text_height_for_layout;
+    details->text_height_for_entire_text = metrics.text_height_for_entire_text;
+    details->editable_text_height = metrics.editable_text_height;
+    g_free(key);
+    return;
+  }
+
   editable_width = 0;
   editable_height = 0;
   editable_height_for_layout = 0;
@@ -1017,7 +1098,6 @@ static void measure_label_text(CajaIconCanvasItem *item) {
   additional_height = 0;
   additional_dx = 0;
 
-  container = CAJA_ICON_CONTAINER(EEL_CANVAS_ITEM(item)->canvas);
   editable_layout = NULL;
   additional_layout = NULL;
 
@@ -1086,6 +1166,15 @@ static void measure_label_text(CajaIconCanvasItem *item) {
   /* extra to make it look nicer */
   details->text_width += TEXT_BACK_PADDING_X * 2;
 
+  metrics.text_width = details->text_width;
+  metrics.text_dx = details->text_dx;
+  metrics.text_height = details->text_height;
+  metrics.text_height_for_layout = details->text_height_for_layout;
+  metrics.text_height_for_entire_text = details->text_height_for_entire_text;
+  metrics.editable_text_height = details->editable_text_height;
+  caja_icon_container_store_label_metrics(container, key, &metrics);
+  g_free(key);
+
   if (editable_layout) {
     g_object_unref(editable_layout);
   }
@@ -1276,6 +1365,39 @@ void caja_icon_canvas_item_set_is_visible(CajaIconCanvasItem *item,
   }
 }
 
+/* A dormant item drops its image, rendered surface and text layouts, but
+ * keeps its size, so that it can still be laid out, selected and hit tested
+ * without being drawn. The container sets the image again when the item gets
+ * close to the visible area.
+ */
+void caja_icon_canvas_item_set_dormant(CajaIconCanvasItem *item,
+                                       gboolean dormant) {
+  CajaIconCanvasItemPrivate *details;
+
+  g_return_if_fail(CAJA_IS_ICON_CANVAS_ITEM(item));
+
+  details = item->details;
+  if (details->is_dormant == (dormant != FALSE)) {
+    return;
+  }
+
+  details->is_dormant = (dormant != FALSE);
+
+  if (dormant) {
+    g_clear_object(&details->pixbuf);
+    g_clear_pointer(&details->rendered_surface, cairo_surface_destroy);
+    g_clear_object(&details->editable_text_layout);
+    g_clear_object(&details->additional_text_layout);
+    g_clear_object(&details->embedded_text_layout);
+  }
+}
+
+gboolean caja_icon_canvas_item_is_dormant(CajaIconCanvasItem *item) {
+  g_return_val_if_fail(CAJA_IS_ICON_CANVAS_ITEM(item), FALSE);
+
+  return item->details->is_dormant;
+}
+
 void caja_icon_canvas_item_invalidate_label(CajaIconCanvasItem *item) {
   caja_icon_canvas_item_invalidate_label_size(item);
 
@@ -1501,21 +1623,252 @@ static void draw_pixbuf(GdkPixbuf *pixbuf, cairo_t *cr, int x, int y) {
   cairo_restore(cr);
 }
 
-/* shared code to highlight or dim the passed-in pixbuf */
-static cairo_surface_t *real_map_surface(CajaIconCanvasItem *icon_item) {
-  EelCanvas *canvas;
-  GdkPixbuf *temp_pixbuf, *old_pixbuf;
-  GdkRGBA color;
-  GdkRGBA *c;
+/* Surfaces with the prelight and selection effects applied are shared
+ * by all the icons through a cache, so that hovering or selecting icons
+ * again does not redo the effects. Most icons of a folder share their
+ * pixbuf with others, too. Plain surfaces are not cached, the item already
+ * has its pixbuf.
+ *
+ * The entries are keyed by an id given to the source pixbuf rather than by
+ * the pixbuf itself, so that they don't keep it alive and a new pixbuf at
+ * the same address doesn't find them. They go away with the pixbuf, in an
+ * idle as pixbufs may be finalized in other threads.
+ */
+#define EFFECT_CACHE_MAX_BYTES (32 * 1024 * 1024)
+
+typedef enum {
+  ICON_EFFECT_SPOTLIGHT = 1 << 0,
+  ICON_EFFECT_AUDIO_EMBLEM = 1 << 1,
+  ICON_EFFECT_COLORIZE = 1 << 2
+} IconEffects;
+
+typedef struct {
+  guint pixbuf_id;
+  IconEffects effects;
+  guint32 color;
+  int scale;
+
   cairo_surface_t *surface;
+  gsize size;
+  GList link;
+  /* In the list of the entries with the same pixbuf_id */
+  GList id_link;
+} EffectCacheEntry;
 
-  temp_pixbuf = icon_item->details->pixbuf;
-  canvas = EEL_CANVAS_ITEM(icon_item)->canvas;
+static GHashTable *effect_cache = NULL;
+/* Maps pixbuf ids to the lists of their entries */
+static GHashTable *effect_cache_by_id = NULL;
+static GQueue effect_cache_lru = G_QUEUE_INIT;
+static gsize effect_cache_size = 0;
+static GQuark effect_cache_id_quark = 0;
+static guint effect_cache_last_id = 0;
 
-  g_object_ref(temp_pixbuf);
+/* The ids of finalized pixbufs, waiting for the main thread */
+static GMutex forgotten_ids_mutex;
+static GArray *forgotten_ids = NULL;
+static guint forget_ids_idle_id = 0;
 
-  if (icon_item->details->is_prelit ||
-      icon_item->details->is_highlighted_for_clipboard) {
+static guint effect_cache_entry_hash(gconstpointer key) {
+  const EffectCacheEntry *entry = key;
+
+  return entry->pixbuf_id ^ (entry->effects << 24) ^ entry->color ^
+         (entry->scale << 28);
+}
+
+static gboolean effect_cache_entry_equal(gconstpointer a, gconstpointer b) {
+  const EffectCacheEntry *entry_a = a;
+  const EffectCacheEntry *entry_b = b;
+
+  return entry_a->pixbuf_id == entry_b->pixbuf_id &&
+         entry_a->effects == entry_b->effects &&
+         entry_a->color == entry_b->color && entry_a->scale == entry_b->scale;
+}
+
+static void effect_cache_entry_free(EffectCacheEntry *entry) {
+  gpointer id;
+  GList *entries;
+
+  g_queue_unlink(&effect_cache_lru, &entry->link);
+  effect_cache_size -= entry->size;
+
+  id = GUINT_TO_POINTER(entry->pixbuf_id);
+  entries = g_hash_table_lookup(effect_cache_by_id, id);
+  entries = g_list_remove_link(entries, &entry->id_link);
+  if (entries == NULL) {
+    g_hash_table_remove(effect_cache_by_id, id);
+  } else {
+    g_hash_table_insert(effect_cache_by_id, id, entries);
+  }
+
+  cairo_surface_destroy(entry->surface);
+  g_free(entry);
+}
+
+static void destroy_effect_cache(void) {
+  g_mutex_lock(&forgotten_ids_mutex);
+  if (forget_ids_idle_id != 0) {
+    g_source_remove(forget_ids_idle_id);
+    forget_ids_idle_id = 0;
+  }
+  g_clear_pointer(&forgotten_ids, g_array_unref);
+  g_mutex_unlock(&forgotten_ids_mutex);
+
+  g_clear_pointer(&effect_cache, g_hash_table_destroy);
+  g_clear_pointer(&effect_cache_by_id, g_hash_table_destroy);
+}
+
+static gboolean forget_ids_at_idle(gpointer data) {
+  GArray *ids;
+  GList *entries;
+  guint i;
+
+  g_mutex_lock(&forgotten_ids_mutex);
+  ids = forgotten_ids;
+  forgotten_ids = NULL;
+  forget_ids_idle_id = 0;
+  g_mutex_unlock(&forgotten_ids_mutex);
+
+  if (ids == NULL) {
+    return G_SOURCE_REMOVE;
+  }
+
+  for (i = 0; effect_cache != NULL && i < ids->len; i++) {
+    while ((entries = g_hash_table_lookup(
+                effect_cache_by_id,
+                GUINT_TO_POINTER(g_array_index(ids, guint, i)))) != NULL) {
+      g_hash_table_remove(effect_cache, entries->data);
+    }
+  }
+
+  g_array_unref(ids);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Called when a pixbuf with an id is finalized, in any thread */
+static void forget_effect_pixbuf_id(gpointer data) {
+  guint id;
+
+  id = GPOINTER_TO_UINT(data);
+
+  g_mutex_lock(&forgotten_ids_mutex);
+  if (forgotten_ids == NULL) {
+    forgotten_ids = g_array_new(FALSE, FALSE, sizeof(guint));
+  }
+  g_array_append_val(forgotten_ids, id);
+  if (forget_ids_idle_id == 0) {
+    forget_ids_idle_id = g_idle_add(forget_ids_at_idle, NULL);
+  }
+  g_mutex_unlock(&forgotten_ids_mutex);
+}
+
+/* Returns the id of pixbuf, giving it one if create is TRUE, or 0 */
+static guint get_effect_pixbuf_id(GdkPixbuf *pixbuf, gboolean create) {
+  guint id;
+
+  if (effect_cache_id_quark == 0) {
+    effect_cache_id_quark =
+        g_quark_from_static_string("caja-icon-effect-cache-id");
+  }
+
+  id = GPOINTER_TO_UINT(
+      g_object_get_qdata(G_OBJECT(pixbuf), effect_cache_id_quark));
+  if (id == 0 && create) {
+    if (++effect_cache_last_id == 0) {
+      effect_cache_last_id++;
+    }
+    id = effect_cache_last_id;
+    g_object_set_qdata_full(G_OBJECT(pixbuf), effect_cache_id_quark,
+                            GUINT_TO_POINTER(id), forget_effect_pixbuf_id);
+  }
+
+  return id;
+}
+
+static cairo_surface_t *lookup_effect_surface(GdkPixbuf *pixbuf,
+                                              IconEffects effects,
+                                              guint32 color, int scale) {
+  EffectCacheEntry key, *entry;
+
+  if (effect_cache == NULL) {
+    return NULL;
+  }
+
+  key.pixbuf_id = get_effect_pixbuf_id(pixbuf, FALSE);
+  if (key.pixbuf_id == 0) {
+    return NULL;
+  }
+  key.effects = effects;
+  key.color = color;
+  key.scale = scale;
+
+  entry = g_hash_table_lookup(effect_cache, &key);
+  if (entry == NULL) {
+    return NULL;
+  }
+
+  g_queue_unlink(&effect_cache_lru, &entry->link);
+  g_queue_push_head_link(&effect_cache_lru, &entry->link);
+
+  return cairo_surface_reference(entry->surface);
+}
+
+/* surface has to be an image surface, so that it can be shared by all
+ * windows
+ */
+static void store_effect_surface(GdkPixbuf *pixbuf, IconEffects effects,
+                                 guint32 color, int scale,
+                                 cairo_surface_t *surface) {
+  EffectCacheEntry *entry;
+
+  if (effect_cache == NULL) {
+    effect_cache = g_hash_table_new_full(
+        effect_cache_entry_hash, effect_cache_entry_equal,
+        (GDestroyNotify)effect_cache_entry_free, NULL);
+    effect_cache_by_id = g_hash_table_new(NULL, NULL);
+    eel_debug_call_at_shutdown(destroy_effect_cache);
+  }
+
+  entry = g_new0(EffectCacheEntry, 1);
+  entry->pixbuf_id = get_effect_pixbuf_id(pixbuf, TRUE);
+  entry->effects = effects;
+  entry->color = color;
+  entry->scale = scale;
+  entry->surface = cairo_surface_reference(surface);
+  entry->link.data = entry;
+  entry->id_link.data = entry;
+  entry->size = (gsize)cairo_image_surface_get_height(surface) *
+                cairo_image_surface_get_stride(surface);
+
+  g_hash_table_replace(effect_cache, entry, entry);
+  g_queue_push_head_link(&effect_cache_lru, &entry->link);
+  g_hash_table_insert(
+      effect_cache_by_id, GUINT_TO_POINTER(entry->pixbuf_id),
+      g_list_concat(&entry->id_link,
+                    g_hash_table_lookup(effect_cache_by_id,
+                                        GUINT_TO_POINTER(entry->pixbuf_id))));
+  effect_cache_size += entry->size;
+
+  while (effect_cache_size > EFFECT_CACHE_MAX_BYTES &&
+         effect_cache_lru.length > 1) {
+    g_hash_table_remove(effect_cache, effect_cache_lru.tail->data);
+  }
+}
+
+static guint32 pack_effect_color(const GdkRGBA *color) {
+  return (eel_round(color->red * 255) & 0xff) << 16 |
+         (eel_round(color->green * 255) & 0xff) << 8 |
+         (eel_round(color->blue * 255) & 0xff);
+}
+
+/* shared code to highlight or dim the passed-in pixbuf */
+static GdkPixbuf *create_effect_pixbuf(GdkPixbuf *pixbuf, IconEffects effects,
+                                       GdkRGBA *color) {
+  GdkPixbuf *temp_pixbuf, *old_pixbuf;
+
+  temp_pixbuf = g_object_ref(pixbuf);
+
+  if (effects & ICON_EFFECT_SPOTLIGHT) {
     old_pixbuf = temp_pixbuf;
 
     temp_pixbuf = eel_create_spotlight_pixbuf(temp_pixbuf);
@@ -1531,7 +1884,7 @@ static cairo_surface_t *real_map_surface(CajaIconCanvasItem *icon_item) {
      * indicate that */
     /* audio is the only kind of previewing right now, so this code isn't as
      * general as it could be */
-    if (icon_item->details->is_active) {
+    if (effects & ICON_EFFECT_AUDIO_EMBLEM) {
       char *audio_filename;
       GdkPixbuf *audio_pixbuf;
       int emblem_size;
@@ -1561,6 +1914,39 @@ static cairo_surface_t *real_map_surface(CajaIconCanvasItem *icon_item) {
     }
   }
 
+  if (effects & ICON_EFFECT_COLORIZE) {
+    old_pixbuf = temp_pixbuf;
+    temp_pixbuf = eel_create_colorized_pixbuf(temp_pixbuf, color);
+
+    g_object_unref(old_pixbuf);
+  }
+
+  return temp_pixbuf;
+}
+
+static cairo_surface_t *real_map_surface(CajaIconCanvasItem *icon_item) {
+  EelCanvas *canvas;
+  GdkPixbuf *temp_pixbuf;
+  GdkRGBA color;
+  GdkRGBA *c;
+  IconEffects effects;
+  guint32 packed_color;
+  int scale;
+  cairo_surface_t *surface;
+
+  canvas = EEL_CANVAS_ITEM(icon_item)->canvas;
+
+  effects = 0;
+  packed_color = 0;
+
+  if (icon_item->details->is_prelit ||
+      icon_item->details->is_highlighted_for_clipboard) {
+    effects |= ICON_EFFECT_SPOTLIGHT;
+    if (icon_item->details->is_active) {
+      effects |= ICON_EFFECT_AUDIO_EMBLEM;
+    }
+  }
+
   if (icon_item->details->is_highlighted_for_selection ||
       icon_item->details->is_highlighted_for_drop) {
     GtkStyleContext *style;
@@ -1578,17 +1964,33 @@ static cairo_surface_t *real_map_surface(CajaIconCanvasItem *icon_item) {
     color = *c;
     gdk_rgba_free(c);
 
-    old_pixbuf = temp_pixbuf;
-    temp_pixbuf = eel_create_colorized_pixbuf(temp_pixbuf, &color);
+    effects |= ICON_EFFECT_COLORIZE;
+    packed_color = pack_effect_color(&color);
+  }
 
-    g_object_unref(old_pixbuf);
+  scale = gtk_widget_get_scale_factor(GTK_WIDGET(canvas));
+
+  if (effects == 0) {
+    return gdk_cairo_surface_create_from_pixbuf(
+        icon_item->details->pixbuf, scale,
+        gtk_widget_get_window(GTK_WIDGET(canvas)));
+  }
+
+  surface = lookup_effect_surface(icon_item->details->pixbuf, effects,
+                                  packed_color, scale);
+  if (surface != NULL) {
+    return surface;
   }
 
-  surface = gdk_cairo_surface_create_from_pixbuf(
-      temp_pixbuf, gtk_widget_get_scale_factor(GTK_WIDGET(canvas)),
-      gtk_widget_get_window(GTK_WIDGET(canvas)));
+  /* Not made for a window, other windows may use it too */
+  temp_pixbuf =
+      create_effect_pixbuf(icon_item->details->pixbuf, effects, &color);
+  surface = gdk_cairo_surface_create_from_pixbuf(temp_pixbuf, scale, NULL);
   g_object_unref(temp_pixbuf);
 
+  store_effect_surface(icon_item->details->pixbuf, effects, packed_color,
+                       scale, surface);
+
   return surface;
 }
 
@@ -1604,7 +2006,7 @@ static cairo_surface_t *map_surface(CajaIconCanvasItem *icon_item) {
             icon_item->details->is_highlighted_for_drop &&
         icon_item->details->rendered_is_highlighted_for_clipboard ==
             icon_item->details->is_highlighted_for_clipboard &&
-        (icon_item->details->is_highlighted_for_selection &&
+        (!icon_item->details->is_highlighted_for_selection ||
          icon_item->details->rendered_is_focused ==
              gtk_widget_has_focus(
                  GTK_WIDGET(EEL_CANVAS_ITEM(icon_item)->canvas))))) {
@@ -2882,7 +3284,7 @@ static gint caja_icon_canvas_item_accessible_get_offset_at_point(
   item = CAJA_ICON_CANVAS_ITEM(
       atk_gobject_accessible_get_object(ATK_GOBJECT_ACCESSIBLE(text)));
 
-  if (item->details->pixbuf) {
+  if (item->details->image_height > 0) {
     get_scaled_icon_size(item, NULL, &height);
     y -= height;
   }
@@ -2983,7 +3385,7 @@ static void caja_icon_canvas_item_accessible_get_character_extents(
   item = CAJA_ICON_CANVAS_ITEM(
       atk_gobject_accessible_get_object(ATK_GOBJECT_ACCESSIBLE(text)));
 
-  if (item->details->pixbuf) {
+  if (item->details->image_height > 0) {
     get_scaled_icon_size(item, NULL, &pix_height);
     pos_y += pix_height;
   }
@@ -114,6 +114,9 @@ void caja_icon_canvas_item_update_bounds(CajaIconCanvasItem *item,
                                          double i2w_dx, double i2w_dy);
 void caja_icon_canvas_item_set_is_visible(CajaIconCanvasItem *item,
                                           gboolean visible);
+void caja_icon_canvas_item_set_dormant(CajaIconCanvasItem *item,
+                                       gboolean dormant);
+gboolean caja_icon_canvas_item_is_dormant(CajaIconCanvasItem *item);
 /* whether the entire label text must be visible at all times */
 void caja_icon_canvas_item_set_entire_text(CajaIconCanvasItem *icon_item,
                                            gboolean entire_text);
@@ -100,6 +100,16 @@
 
 #define STANDARD_ICON_GRID_WIDTH 155
 
+/* Containers with more icons than this only keep the images and text
+ * layouts of the icons within VIRTUAL_RESIDENT_PAGES pages of the visible
+ * area; the others become dormant canvas items that only know their size.
+ */
+#define VIRTUAL_ICON_THRESHOLD 1000
+#define VIRTUAL_RESIDENT_PAGES 1
+
+/* Number of distinct label measurements kept per container. */
+#define LABEL_CACHE_SIZE 4096
+
 /* Desktop layout mode defines */
 #define DESKTOP_PAD_HORIZONTAL 10
 #define DESKTOP_PAD_VERTICAL 10
@@ -185,6 +195,7 @@ static GList *caja_icon_container_get_selected_icons(
 static void caja_icon_container_update_visible_icons(
     CajaIconContainer *container);
 static void reveal_icon(CajaIconContainer *container, CajaIcon *icon);
+static void finish_deferred_layout(CajaIconContainer *container);
 
 static void caja_icon_container_set_rtl_positions(CajaIconContainer *container);
 static double get_mirror_x_position(CajaIconContainer *container,
@@ -278,6 +289,13 @@ static void icon_set_position(CajaIcon *icon, double x, double y) {
   int x1, x2, y1, y2;
   EelDRect icon_bounds;
 
+  /* Icons added to the horizontal auto-layout are only shown once
+   * they get a position, see finish_adding_icon().
+   */
+  if (!(EEL_CANVAS_ITEM(icon->item)->flags & EEL_CANVAS_ITEM_VISIBLE)) {
+    eel_canvas_item_show(EEL_CANVAS_ITEM(icon->item));
+  }
+
   if (icon->x == x && icon->y == y) {
     return;
   }
@@ -614,6 +632,10 @@ static void reveal_icon(CajaIconContainer *container, CajaIcon *icon) {
   GtkAdjustment *hadj, *vadj;
   EelIRect bounds;
 
+  if (!icon_is_positioned(icon)) {
+    finish_deferred_layout(container);
+  }
+
   if (!icon_is_positioned(icon)) {
     set_pending_icon_to_reveal(container, icon);
     return;
@@ -942,6 +964,11 @@ void caja_icon_container_update_scroll_region(CajaIconContainer *container) {
   get_all_icon_bounds(container, &x1, &y1, &x2, &y2,
                       BOUNDS_USAGE_FOR_ENTIRE_ITEM);
 
+  /* Leave room for the icons that have not been laid out yet. */
+  if (container->details->layout_deferred) {
+    y2 = MAX(y2, container->details->layout_deferred_bottom);
+  }
+
   /* Add border at the "end"of the layout (i.e. after the icons), to
    * ensure we get some space when scrolled to the end.
    * For horizontal layouts, we add a bottom border.
@@ -1109,37 +1136,23 @@ static void lay_down_one_column(CajaIconContainer *container, GList *line_start,
   }
 }
 
-static void lay_down_icons_horizontal(CajaIconContainer *container,
-                                      GList *icons, double start_y) {
-  GList *p, *line_start;
+static void get_horizontal_layout_params(CajaIconContainer *container,
+                                         GList *icons,
+                                         CajaIconLayoutParams *params) {
+  GList *p;
   CajaIcon *icon;
-  double canvas_width, y;
-  EelDRect bounds;
   EelDRect icon_bounds;
   EelDRect text_bounds;
-  double max_height_above, max_height_below;
-  double line_width;
-  gboolean gridded_layout;
-  double grid_width;
-  double max_text_width, max_icon_width;
-  int icon_width;
-  int i;
+  double max_text_width;
   GtkAllocation allocation;
-  GArray *positions;
-  IconPositions *position = NULL;
-
-  g_assert(CAJA_IS_ICON_CONTAINER(container));
-
-  if (icons == NULL) {
-    return;
-  }
 
-  positions = g_array_new(FALSE, FALSE, sizeof(IconPositions));
   gtk_widget_get_allocation(GTK_WIDGET(container), &allocation);
 
-  /* Lay out icons a line at a time. */
-  canvas_width = CANVAS_WIDTH(container, allocation);
-  max_icon_width = max_text_width = 0.0;
+  params->canvas_width = CANVAS_WIDTH(container, allocation);
+  params->max_icon_width = max_text_width = 0.0;
+  params->gridded = !caja_icon_container_is_tighter_layout(container);
+  params->is_rtl = caja_icon_container_is_layout_rtl(container);
+  params->label_position = container->details->label_position;
 
   if (container->details->label_position == CAJA_ICON_LABEL_POSITION_BESIDE) {
     /* Would it be worth caching these bounds for the next loop? */
@@ -1147,34 +1160,76 @@ static void lay_down_icons_horizontal(CajaIconContainer *container,
       icon = p->data;
 
       icon_bounds = caja_icon_canvas_item_get_icon_rectangle(icon->item);
-      max_icon_width =
-          MAX(max_icon_width, ceil(icon_bounds.x1 - icon_bounds.x0));
+      params->max_icon_width =
+          MAX(params->max_icon_width, ceil(icon_bounds.x1 - icon_bounds.x0));
 
       text_bounds = caja_icon_canvas_item_get_text_rectangle(icon->item, TRUE);
       max_text_width =
           MAX(max_text_width, ceil(text_bounds.x1 - text_bounds.x0));
     }
 
-    grid_width =
-        max_icon_width + max_text_width + ICON_PAD_LEFT + ICON_PAD_RIGHT;
+    params->grid_width = params->max_icon_width + max_text_width +
+                         ICON_PAD_LEFT + ICON_PAD_RIGHT;
   } else {
     int num_columns;
 
-    num_columns = floor(canvas_width / STANDARD_ICON_GRID_WIDTH);
+    num_columns = floor(params->canvas_width / STANDARD_ICON_GRID_WIDTH);
     num_columns = fmax(num_columns, 1);
     /* Minimum of one column */
-    grid_width = canvas_width / num_columns - 1;
+    params->grid_width = params->canvas_width / num_columns - 1;
     /* -1 prevents jitter */
   }
+}
+
+static gboolean layout_params_equal(const CajaIconLayoutParams *a,
+                                    const CajaIconLayoutParams *b) {
+  return a->canvas_width == b->canvas_width &&
+         a->grid_width == b->grid_width &&
+         a->max_icon_width == b->max_icon_width && a->gridded == b->gridded &&
+         a->is_rtl == b->is_rtl && a->label_position == b->label_position;
+}
 
-  gridded_layout = !caja_icon_container_is_tighter_layout(container);
+static void append_layout_line(GArray *lines, guint first_index,
+                               guint n_icons, double y) {
+  CajaIconLayoutLine line;
 
-  line_width =
-      container->details->label_position == CAJA_ICON_LABEL_POSITION_BESIDE
-          ? ICON_PAD_LEFT
-          : 0;
+  line.first_index = first_index;
+  line.n_icons = n_icons;
+  line.y = y;
+  g_array_append_val(lines, line);
+}
+
+/* Lays out the icons starting at @icons, which must be the first icon of a
+ * line, with the top of that line at *@y. Stops after the first complete
+ * line that ends below @horizon, as long as the icon at @defer_from has been
+ * reached. Returns the first icon that was not laid out, or NULL.
+ *
+ * If @lines is not NULL, each laid out line is appended to it, and the icons
+ * are marked as laid out at their position in the list, counting from @index.
+ */
+static GList *lay_down_icons_horizontal_lines(
+    CajaIconContainer *container, GList *icons, guint index, double *y,
+    const CajaIconLayoutParams *params, double horizon, guint defer_from,
+    GArray *lines) {
+  GList *p, *line_start;
+  CajaIcon *icon;
+  EelDRect bounds;
+  EelDRect icon_bounds;
+  EelDRect text_bounds;
+  double max_height_above, max_height_below;
+  double line_width, line_y;
+  int icon_width;
+  int i;
+  GArray *positions;
+  IconPositions *position = NULL;
+
+  positions = g_array_new(FALSE, FALSE, sizeof(IconPositions));
+
+  line_width = params->label_position == CAJA_ICON_LABEL_POSITION_BESIDE
+                   ? ICON_PAD_LEFT
+                   : 0;
   line_start = icons;
-  y = start_y + CONTAINER_PAD_TOP;
+  line_y = *y;
   i = 0;
 
   max_height_above = 0;
@@ -1192,8 +1247,9 @@ static void lay_down_icons_horizontal(CajaIconContainer *container,
     icon_bounds = caja_icon_canvas_item_get_icon_rectangle(icon->item);
     text_bounds = caja_icon_canvas_item_get_text_rectangle(icon->item, TRUE);
 
-    if (gridded_layout) {
-      icon_width = ceil((bounds.x1 - bounds.x0) / grid_width) * grid_width;
+    if (params->gridded) {
+      icon_width = ceil((bounds.x1 - bounds.x0) / params->grid_width) *
+                   params->grid_width;
 
     } else {
       icon_width = (bounds.x1 - bounds.x0) + ICON_PAD_RIGHT +
@@ -1206,33 +1262,41 @@ static void lay_down_icons_horizontal(CajaIconContainer *container,
 
     /* If this icon doesn't fit, it's time to lay out the line that's queued up.
      */
-    if (line_start != p && line_width + icon_width >= canvas_width) {
-      if (container->details->label_position ==
-          CAJA_ICON_LABEL_POSITION_BESIDE) {
-        y += ICON_PAD_TOP;
+    if (line_start != p && line_width + icon_width >= params->canvas_width) {
+      if (params->label_position == CAJA_ICON_LABEL_POSITION_BESIDE) {
+        *y += ICON_PAD_TOP;
       } else {
         /* Advance to the baseline. */
-        y += ICON_PAD_TOP + max_height_above;
+        *y += ICON_PAD_TOP + max_height_above;
       }
 
-      lay_down_one_line(container, line_start, p, y, max_height_above,
+      lay_down_one_line(container, line_start, p, *y, max_height_above,
                         positions, FALSE);
 
-      if (container->details->label_position ==
-          CAJA_ICON_LABEL_POSITION_BESIDE) {
-        y += max_height_above + max_height_below + ICON_PAD_BOTTOM;
+      if (params->label_position == CAJA_ICON_LABEL_POSITION_BESIDE) {
+        *y += max_height_above + max_height_below + ICON_PAD_BOTTOM;
       } else {
         /* Advance to next line. */
-        y += max_height_below + ICON_PAD_BOTTOM;
+        *y += max_height_below + ICON_PAD_BOTTOM;
+      }
+
+      if (lines != NULL) {
+        append_layout_line(lines, index, i, line_y);
       }
+      index += i;
 
-      line_width =
-          container->details->label_position == CAJA_ICON_LABEL_POSITION_BESIDE
-              ? ICON_PAD_LEFT
-              : 0;
+      line_width = params->label_position == CAJA_ICON_LABEL_POSITION_BESIDE
+                       ? ICON_PAD_LEFT
+                       : 0;
       line_start = p;
+      line_y = *y;
       i = 0;
 
+      /* The rest is far out of view, leave it for later. */
+      if (index >= defer_from && *y > horizon) {
+        break;
+      }
+
       max_height_above = height_above;
       max_height_below = height_below;
     } else {
@@ -1244,15 +1308,20 @@ static void lay_down_icons_horizontal(CajaIconContainer *container,
       }
     }
 
+    if (lines != NULL) {
+      icon->layout_index = index + i;
+      icon->layout_dirty = FALSE;
+    }
+
     g_array_set_size(positions, i + 1);
     position = &g_array_index(positions, IconPositions, i++);
     position->width = icon_width;
     position->height = icon_bounds.y1 - icon_bounds.y0;
 
-    if (container->details->label_position == CAJA_ICON_LABEL_POSITION_BESIDE) {
-      if (gridded_layout) {
-        position->x_offset = max_icon_width + ICON_PAD_LEFT + ICON_PAD_RIGHT -
-                             (icon_bounds.x1 - icon_bounds.x0);
+    if (params->label_position == CAJA_ICON_LABEL_POSITION_BESIDE) {
+      if (params->gridded) {
+        position->x_offset = params->max_icon_width + ICON_PAD_LEFT +
+                             ICON_PAD_RIGHT - (icon_bounds.x1 - icon_bounds.x0);
       } else {
         position->x_offset = icon_width - ((icon_bounds.x1 - icon_bounds.x0) +
                                            (text_bounds.x1 - text_bounds.x0));
@@ -1268,22 +1337,221 @@ static void lay_down_icons_horizontal(CajaIconContainer *container,
   }
 
   /* Lay down that last line of icons. */
-  if (line_start != NULL) {
-    if (container->details->label_position == CAJA_ICON_LABEL_POSITION_BESIDE) {
-      y += ICON_PAD_TOP;
+  if (p == NULL && i > 0) {
+    if (params->label_position == CAJA_ICON_LABEL_POSITION_BESIDE) {
+      *y += ICON_PAD_TOP;
     } else {
       /* Advance to the baseline. */
-      y += ICON_PAD_TOP + max_height_above;
+      *y += ICON_PAD_TOP + max_height_above;
     }
 
-    lay_down_one_line(container, line_start, NULL, y, max_height_above,
+    lay_down_one_line(container, line_start, NULL, *y, max_height_above,
                       positions, TRUE);
 
     /* Advance to next line. */
-    y += max_height_below + ICON_PAD_BOTTOM;
+    *y += max_height_below + ICON_PAD_BOTTOM;
+
+    if (lines != NULL) {
+      append_layout_line(lines, index, i, line_y);
+    }
   }
 
   g_array_free(positions, TRUE);
+
+  return p;
+}
+
+static void lay_down_icons_horizontal(CajaIconContainer *container,
+                                      GList *icons, double start_y) {
+  CajaIconLayoutParams params;
+  double y;
+
+  g_assert(CAJA_IS_ICON_CONTAINER(container));
+
+  if (icons == NULL) {
+    return;
+  }
+
+  /* Lay out icons a line at a time. */
+  get_horizontal_layout_params(container, icons, &params);
+  y = start_y + CONTAINER_PAD_TOP;
+  lay_down_icons_horizontal_lines(container, icons, 0, &y, &params,
+                                  G_MAXDOUBLE, G_MAXUINT, NULL);
+}
+
+/* Forget the cached lines, so that the next auto-layout starts from
+ * scratch. Needed whenever icons may have been moved by something other
+ * than the incremental layout itself.
+ */
+static void invalidate_incremental_layout(CajaIconContainer *container) {
+  if (container->details->layout_lines != NULL) {
+    g_array_set_size(container->details->layout_lines, 0);
+  }
+  container->details->layout_n_icons = 0;
+  container->details->layout_deferred = FALSE;
+}
+
+static double get_layout_horizon(CajaIconContainer *container) {
+  GtkAdjustment *vadj;
+  GtkAllocation allocation;
+  double x, y;
+
+  vadj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(container));
+  gtk_widget_get_allocation(GTK_WIDGET(container), &allocation);
+
+  /* Lay out one extra page below the visible area, so that scrolling
+   * down a bit doesn't have to wait for the layout.
+   */
+  x = 0;
+  y = gtk_adjustment_get_value(vadj) + 2 * allocation.height;
+  eel_canvas_c2w(EEL_CANVAS(container), x, y, &x, &y);
+
+  return y;
+}
+
+/* Re-flows the horizontal auto-layout starting at the first line that
+ * contains an icon that was added, removed, resized or moved in the sort
+ * order since the last layout. Lines far below @horizon are skipped until
+ * they get scrolled into range, as long as none of their icons has a
+ * position yet.
+ */
+static void lay_down_icons_horizontal_incremental(CajaIconContainer *container,
+                                                  double horizon) {
+  CajaIconContainerDetails *details;
+  CajaIconLayoutParams params;
+  CajaIconLayoutLine *line;
+  GArray *lines;
+  GList *p, *rest;
+  CajaIcon *icon;
+  guint i, n_laid, first, first_line, lo, hi, remaining;
+  double y, line_height;
+
+  details = container->details;
+
+  if (details->layout_lines == NULL) {
+    details->layout_lines =
+        g_array_new(FALSE, FALSE, sizeof(CajaIconLayoutLine));
+  }
+  lines = details->layout_lines;
+
+  if (details->icons == NULL) {
+    invalidate_incremental_layout(container);
+    return;
+  }
+
+  get_horizontal_layout_params(container, details->icons, &params);
+  if (!layout_params_equal(&params, &details->layout_params)) {
+    invalidate_incremental_layout(container);
+    details->layout_params = params;
+  }
+
+  /* Find the first icon that is not where the last layout left it. */
+  n_laid = details->layout_n_icons;
+  for (p = details->icons, i = 0; p != NULL && i < n_laid; p = p->next, i++) {
+    icon = p->data;
+    if (icon->layout_dirty || icon->layout_index != i) {
+      break;
+    }
+  }
+  first = i;
+
+  if (p == NULL && first == n_laid && !details->layout_deferred) {
+    /* Nothing changed. */
+    return;
+  }
+
+  /* Find the line to start re-flowing at. */
+  if (first >= n_laid) {
+    if (details->layout_deferred && p != NULL) {
+      /* Continue after the last complete line. */
+      first_line = lines->len;
+    } else {
+      first_line = lines->len > 0 ? lines->len - 1 : 0;
+    }
+  } else {
+    lo = 0;
+    hi = lines->len - 1;
+    while (lo < hi) {
+      guint mid = (lo + hi + 1) / 2;
+
+      if (g_array_index(lines, CajaIconLayoutLine, mid).first_index <= first) {
+        lo = mid;
+      } else {
+        hi = mid - 1;
+      }
+    }
+    first_line = lo;
+
+    /* If the change is at the start of a line, the line before it may
+     * become the last one, which shows the entire text of its labels.
+     */
+    if (first_line > 0 &&
+        g_array_index(lines, CajaIconLayoutLine, first_line).first_index ==
+            first) {
+      first_line--;
+    }
+  }
+
+  if (first_line < lines->len) {
+    line = &g_array_index(lines, CajaIconLayoutLine, first_line);
+    first = line->first_index;
+    y = line->y;
+  } else {
+    first = n_laid;
+    y = lines->len > 0 ? details->layout_next_y : CONTAINER_PAD_TOP;
+  }
+  g_array_set_size(lines, first_line);
+
+  /* Only icons that never had a position may be left for later, the
+   * others would keep showing at their old place.
+   */
+  p = g_list_nth(details->icons, MAX(first, n_laid));
+  for (; p != NULL; p = p->next) {
+    if (icon_is_positioned(p->data)) {
+      horizon = G_MAXDOUBLE;
+      break;
+    }
+  }
+
+  rest = lay_down_icons_horizontal_lines(
+      container, g_list_nth(details->icons, first), first, &y, &params,
+      horizon, n_laid, lines);
+
+  details->layout_next_y = y;
+  details->layout_deferred = rest != NULL;
+
+  if (lines->len > 0) {
+    line = &g_array_index(lines, CajaIconLayoutLine, lines->len - 1);
+    details->layout_n_icons = line->first_index + line->n_icons;
+  } else {
+    details->layout_n_icons = 0;
+  }
+
+  if (details->layout_deferred) {
+    /* Estimate where the icons that were not laid out will end, so
+     * that the scroll region has the right size already.
+     */
+    line = &g_array_index(lines, CajaIconLayoutLine, lines->len - 1);
+    line_height = y - line->y;
+    remaining = g_list_length(rest);
+    details->layout_deferred_bottom =
+        y + ceil((double)remaining / MAX(line->n_icons, 1)) * line_height;
+  }
+}
+
+/* Lays out the icons that were skipped because they were out of view. */
+static void finish_deferred_layout(CajaIconContainer *container) {
+  if (!container->details->layout_deferred) {
+    return;
+  }
+
+  lay_down_icons_horizontal_incremental(container, G_MAXDOUBLE);
+
+  if (caja_icon_container_is_layout_rtl(container)) {
+    caja_icon_container_set_rtl_positions(container);
+  }
+
+  caja_icon_container_update_scroll_region(container);
 }
 
 static void get_max_icon_dimensions(GList *icon_start, GList *icon_end,
@@ -1801,6 +2069,10 @@ static void caja_icon_container_set_rtl_positions(
     double x;
 
     icon = l->data;
+    if (!icon_is_positioned(icon)) {
+      continue;
+    }
+
     x = get_mirror_x_position(container, icon, icon->saved_ltr_x);
     icon_set_position(icon, x, icon->y);
   }
@@ -2020,7 +2292,15 @@ static void redo_layout_internal(CajaIconContainer *container) {
   if (container->details->auto_layout &&
       container->details->drag_state != DRAG_STATE_STRETCH) {
     resort(container);
-    lay_down_icons(container, container->details->icons, 0);
+    if (caja_icon_container_is_layout_vertical(container)) {
+      invalidate_incremental_layout(container);
+      lay_down_icons(container, container->details->icons, 0);
+    } else {
+      lay_down_icons_horizontal_incremental(container,
+                                            get_layout_horizon(container));
+    }
+  } else if (!container->details->auto_layout) {
+    invalidate_incremental_layout(container);
   }
 
   if (caja_icon_container_is_layout_rtl(container)) {
@@ -2113,11 +2393,99 @@ static gboolean button_event_modifies_selection(GdkEventButton *event) {
   return (event->state & (GDK_CONTROL_MASK | GDK_SHIFT_MASK)) != 0;
 }
 
-/* invalidate the cached label sizes for all the icons */
+typedef struct {
+  char *key;
+  CajaIconLabelMetrics metrics;
+  GList link;
+} LabelCacheEntry;
+
+static void label_cache_entry_free(LabelCacheEntry *entry) {
+  g_free(entry->key);
+  g_free(entry);
+}
+
+static void clear_label_cache(CajaIconContainer *container) {
+  CajaIconContainerDetails *details;
+
+  details = container->details;
+
+  if (details->label_cache == NULL) {
+    return;
+  }
+
+  /* The entries are owned by the hash table, the queue only links them. */
+  g_queue_init(&details->label_cache_lru);
+  g_hash_table_remove_all(details->label_cache);
+}
+
+gboolean caja_icon_container_lookup_label_metrics(
+    CajaIconContainer *container, const char *key,
+    CajaIconLabelMetrics *metrics) {
+  CajaIconContainerDetails *details;
+  LabelCacheEntry *entry;
+
+  details = container->details;
+
+  if (details->label_cache == NULL) {
+    return FALSE;
+  }
+
+  entry = g_hash_table_lookup(details->label_cache, key);
+  if (entry == NULL) {
+    return FALSE;
+  }
+
+  g_queue_unlink(&details->label_cache_lru, &entry->link);
+  g_queue_push_head_link(&details->label_cache_lru, &entry->link);
+
+  *metrics = entry->metrics;
+  return TRUE;
+}
+
+void caja_icon_container_store_label_metrics(
+    CajaIconContainer *container, const char *key,
+    const CajaIconLabelMetrics *metrics) {
+  CajaIconContainerDetails *details;
+  LabelCacheEntry *entry;
+  GList *oldest;
+
+  details = container->details;
+
+  if (details->label_cache == NULL) {
+    details->label_cache =
+        g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                              (GDestroyNotify)label_cache_entry_free);
+  }
+
+  entry = g_hash_table_lookup(details->label_cache, key);
+  if (entry != NULL) {
+    g_queue_unlink(&details->label_cache_lru, &entry->link);
+  } else {
+    if (details->label_cache_lru.length >= LABEL_CACHE_SIZE) {
+      oldest = g_queue_pop_tail_link(&details->label_cache_lru);
+      g_hash_table_remove(details->label_cache,
+                          ((LabelCacheEntry *)oldest->data)->key);
+    }
+
+    entry = g_new0(LabelCacheEntry, 1);
+    entry->key = g_strdup(key);
+    entry->link.data = entry;
+    g_hash_table_insert(details->label_cache, entry->key, entry);
+  }
+
+  entry->metrics = *metrics;
+  g_queue_push_head_link(&details->label_cache_lru, &entry->link);
+}
+
+/* invalidate the cached label sizes for all the icons; the shared label
+ * cache stays valid, as its keys cover the zoom level and label geometry
+ */
 static void invalidate_label_sizes(CajaIconContainer *container) {
   GList *p;
   CajaIcon *icon = NULL;
 
+  invalidate_incremental_layout(container);
+
   for (p = container->details->icons; p != NULL; p = p->next) {
     icon = p->data;
 
@@ -2125,11 +2493,15 @@ static void invalidate_label_sizes(CajaIconContainer *container) {
   }
 }
 
-/* invalidate the entire labels (i.e. their attributes) for all the icons */
-static void invalidate_labels(CajaIconContainer *container) {
+/* invalidate the label layouts of all the icons, e.g. for the font size
+ * of a new zoom level; like the sizes, the shared label cache stays valid
+ */
+static void invalidate_label_layouts(CajaIconContainer *container) {
   GList *p;
   CajaIcon *icon = NULL;
 
+  invalidate_incremental_layout(container);
+
   for (p = container->details->icons; p != NULL; p = p->next) {
     icon = p->data;
 
@@ -2137,6 +2509,12 @@ static void invalidate_labels(CajaIconContainer *container) {
   }
 }
 
+/* invalidate the entire labels (i.e. their attributes) for all the icons */
+static void invalidate_labels(CajaIconContainer *container) {
+  clear_label_cache(container);
+  invalidate_label_layouts(container);
+}
+
 static gboolean select_range(CajaIconContainer *container, CajaIcon *icon1,
                              CajaIcon *icon2, gboolean unselect_outside_range) {
   gboolean selection_changed;
@@ -2442,6 +2820,8 @@ static void start_rubberbanding(CajaIconContainer *container,
   details = container->details;
   band_info = &details->rubberband_info;
 
+  finish_deferred_layout(container);
+
   g_signal_emit(container, signals[BAND_SELECT_STARTED], 0);
 
   for (p = details->icons; p != NULL; p = p->next) {
@@ -2541,6 +2921,9 @@ static CajaIcon *find_best_icon(CajaIconContainer *container,
   GList *p;
   CajaIcon *best, *candidate;
 
+  /* Keyboard navigation compares the positions of all icons. */
+  finish_deferred_layout(container);
+
   best = NULL;
   for (p = container->details->icons; p != NULL; p = p->next) {
     candidate = p->data;
@@ -2561,6 +2944,8 @@ static CajaIcon *find_best_selected_icon(CajaIconContainer *container,
   GList *p;
   CajaIcon *best, *candidate;
 
+  finish_deferred_layout(container);
+
   best = NULL;
   for (p = container->details->icons; p != NULL; p = p->next) {
     candidate = p->data;
@@ -3564,6 +3949,14 @@ static void finalize(GObject *object) {
 
   g_free(details->font);
 
+  if (details->label_cache != NULL) {
+    g_hash_table_destroy(details->label_cache);
+  }
+
+  if (details->layout_lines != NULL) {
+    g_array_free(details->layout_lines, TRUE);
+  }
+
   if (details->a11y_item_action_queue != NULL) {
     while (!g_queue_is_empty(details->a11y_item_action_queue)) {
       g_free(g_queue_pop_head(details->a11y_item_action_queue));
@@ -5383,6 +5776,7 @@ static void caja_icon_container_init(CajaIconContainer *container) {
   details = g_new0(CajaIconContainerDetails, 1);
 
   details->icon_set = g_hash_table_new(g_direct_hash, g_direct_equal);
+  g_queue_init(&details->label_cache_lru);
   details->layout_timestamp = UNDEFINED_TIME;
 
   details->zoom_level = CAJA_ZOOM_LEVEL_STANDARD;
@@ -5625,6 +6019,8 @@ void caja_icon_container_clear(CajaIconContainer *container) {
   g_hash_table_destroy(details->icon_set);
   details->icon_set = g_hash_table_new(g_direct_hash, g_direct_equal);
 
+  invalidate_incremental_layout(container);
+
   caja_icon_container_update_scroll_region(container);
 }
 
@@ -5721,6 +6117,7 @@ void caja_icon_container_scroll_to_icon(CajaIconContainer *container,
   /* We need to force a relayout now if there are updates queued
    * since we need the final positions */
   caja_icon_container_layout_now(container);
+  finish_deferred_layout(container);
 
   l = container->details->icons;
   while (l != NULL) {
@@ -5952,13 +6349,53 @@ static void caja_icon_container_stop_monitor_top_left(
 }
 
 static void caja_icon_container_prioritize_thumbnailing(
-    CajaIconContainer *container, CajaIcon *icon) {
+    CajaIconContainer *container, CajaIcon *icon, guint distance) {
   CajaIconContainerClass *klass;
 
   klass = CAJA_ICON_CONTAINER_GET_CLASS(container);
   g_assert(klass->prioritize_thumbnailing != NULL);
 
-  klass->prioritize_thumbnailing(container, icon->data);
+  klass->prioritize_thumbnailing(container, icon->data, distance);
+}
+
+/* How many viewport pages the range [start, end] is away from the visible
+ * range [min, max], 0 if it overlaps it.
+ */
+static guint get_viewport_distance(double start, double end, double min,
+                                   double max) {
+  double gap;
+
+  if (end >= min && start <= max) {
+    return 0;
+  }
+
+  gap = end < min ? min - end : start - max;
+  return 1 + (guint)MIN(gap / MAX(max - min, 1.0), G_MAXUINT16);
+}
+
+/* Gives a dormant icon its image back. The text of dormant icons is kept up
+ * to date, so it only needs to be laid out again if the item, image and
+ * text, got a different size in the meantime, e.g. after zooming.
+ */
+static void wake_icon(CajaIconContainer *container, CajaIcon *icon) {
+  double old_x1, old_y1, old_x2, old_y2;
+  double new_x1, new_y1, new_x2, new_y2;
+  gboolean layout_dirty;
+
+  layout_dirty = icon->layout_dirty;
+  caja_icon_canvas_item_get_bounds_for_layout(icon->item, &old_x1, &old_y1,
+                                              &old_x2, &old_y2);
+  caja_icon_canvas_item_set_dormant(icon->item, FALSE);
+  caja_icon_container_update_icon(container, icon);
+  caja_icon_canvas_item_get_bounds_for_layout(icon->item, &new_x1, &new_y1,
+                                              &new_x2, &new_y2);
+
+  if (new_x2 - new_x1 != old_x2 - old_x1 ||
+      new_y2 - new_y1 != old_y2 - old_y1) {
+    schedule_redo_layout(container);
+  } else {
+    icon->layout_dirty = layout_dirty;
+  }
 }
 
 static void caja_icon_container_update_visible_icons(
@@ -5966,9 +6403,11 @@ static void caja_icon_container_update_visible_icons(
   GtkAdjustment *vadj, *hadj;
   double min_y, max_y;
   double min_x, max_x;
+  double page_x, page_y;
   double x0, y0, x1, y1;
   GList *node;
-  gboolean visible;
+  gboolean visible, resident, virtualized;
+  guint distance;
   GtkAllocation allocation;
   CajaIcon *icon = NULL;
 
@@ -5985,11 +6424,16 @@ static void caja_icon_container_update_visible_icons(
   eel_canvas_c2w(EEL_CANVAS(container), min_x, min_y, &min_x, &min_y);
   eel_canvas_c2w(EEL_CANVAS(container), max_x, max_y, &max_x, &max_y);
 
-  /* Do the iteration in reverse to get the render-order from top to
-   * bottom for the prioritized thumbnails.
+  virtualized = g_hash_table_size(container->details->icon_set) >
+            VIRTUAL_ICON_THRESHOLD;
+  page_x = VIRTUAL_RESIDENT_PAGES * (max_x - min_x);
+  page_y = VIRTUAL_RESIDENT_PAGES * (max_y - min_y);
+
+  /* Thumbnails are made nearest to the visible icons first, so icons
+   * scrolled past fall behind the ones scrolled to. Icons at the same
+   * distance keep the render-order from top to bottom.
    */
-  for (node = g_list_last(container->details->icons); node != NULL;
-       node = node->prev) {
+  for (node = container->details->icons; node != NULL; node = node->next) {
     icon = node->data;
 
     if (icon_is_positioned(icon)) {
@@ -5999,17 +6443,24 @@ static void caja_icon_container_update_visible_icons(
       eel_canvas_item_i2w(EEL_CANVAS_ITEM(icon->item)->parent, &x1, &y1);
 
       if (caja_icon_container_is_layout_vertical(container)) {
-        visible = x1 >= min_x && x0 <= max_x;
+        distance = get_viewport_distance(x0, x1, min_x, max_x);
+        resident = x1 >= min_x - page_x && x0 <= max_x + page_x;
       } else {
-        visible = y1 >= min_y && y0 <= max_y;
+        distance = get_viewport_distance(y0, y1, min_y, max_y);
+        resident = y1 >= min_y - page_y && y0 <= max_y + page_y;
       }
+      visible = distance == 0;
 
-      if (visible) {
-        caja_icon_canvas_item_set_is_visible(icon->item, TRUE);
-        caja_icon_container_prioritize_thumbnailing(container, icon);
-      } else {
-        caja_icon_canvas_item_set_is_visible(icon->item, FALSE);
+      if (caja_icon_canvas_item_is_dormant(icon->item)) {
+        if (resident || !virtualized) {
+          wake_icon(container, icon);
+        }
+      } else if (!resident && virtualized) {
+        caja_icon_canvas_item_set_dormant(icon->item, TRUE);
       }
+
+      caja_icon_canvas_item_set_is_visible(icon->item, visible);
+      caja_icon_container_prioritize_thumbnailing(container, icon, distance);
     }
   }
 }
@@ -6017,6 +6468,20 @@ static void caja_icon_container_update_visible_icons(
 static void handle_vadjustment_changed(GtkAdjustment *adjustment,
                                        CajaIconContainer *container) {
   if (!caja_icon_container_is_layout_vertical(container)) {
+    if (container->details->layout_deferred) {
+      double horizon;
+
+      /* Lay out the icons that are being scrolled into range. */
+      horizon = get_layout_horizon(container);
+      if (container->details->layout_next_y < horizon) {
+        lay_down_icons_horizontal_incremental(container, horizon);
+        if (caja_icon_container_is_layout_rtl(container)) {
+          caja_icon_container_set_rtl_positions(container);
+        }
+        caja_icon_container_update_scroll_region(container);
+      }
+    }
+
     caja_icon_container_update_visible_icons(container);
   }
 }
@@ -6028,6 +6493,32 @@ static void handle_hadjustment_changed(GtkAdjustment *adjustment,
   }
 }
 
+static void update_icon_text(CajaIconContainer *container, CajaIcon *icon) {
+  char *editable_text, *additional_text;
+
+  caja_icon_container_get_icon_text(container, icon->data, &editable_text,
+                                    &additional_text, FALSE);
+
+  /* If name of icon being renamed was changed from elsewhere, end renaming
+   * mode. Alternatively, we could replace the characters in the editable text
+   * widget with the new name, but that could cause timing problems if the user
+   * just happened to be typing at that moment.
+   */
+  if (icon == get_icon_being_renamed(container) &&
+      g_strcmp0(editable_text,
+                caja_icon_canvas_item_get_editable_text(icon->item)) != 0) {
+    end_renaming_mode(container, FALSE);
+  }
+
+  eel_canvas_item_set(EEL_CANVAS_ITEM(icon->item), "editable_text",
+                      editable_text, "additional_text", additional_text,
+                      "highlighted_for_drop",
+                      icon == container->details->drop_target, NULL);
+
+  g_free(editable_text);
+  g_free(additional_text);
+}
+
 void caja_icon_container_update_icon(CajaIconContainer *container,
                                      CajaIcon *icon) {
   CajaIconContainerDetails *details;
@@ -6039,7 +6530,6 @@ void caja_icon_container_update_icon(CajaIconContainer *container,
   gboolean has_embedded_text_rect;
   GdkPixbuf *pixbuf;
   GList *emblem_pixbufs;
-  char *editable_text, *additional_text;
   char *embedded_text;
   GdkRectangle embedded_text_rect;
   gboolean large_embedded_text;
@@ -6052,6 +6542,18 @@ void caja_icon_container_update_icon(CajaIconContainer *container,
 
   details = container->details;
 
+  /* The size of the item may change, so it needs to be laid out again. */
+  icon->layout_dirty = TRUE;
+
+  /* Looking up the images is what dormancy saves, they are set when the
+   * icon wakes up. The text is kept up to date, renaming and accessibility
+   * go by it.
+   */
+  if (caja_icon_canvas_item_is_dormant(icon->item)) {
+    update_icon_text(container, icon);
+    return;
+  }
+
   /* compute the maximum size based on the scale factor */
   min_image_size = MINIMUM_IMAGE_SIZE * EEL_CANVAS(container)->pixels_per_unit;
   max_image_size =
@@ -6091,24 +6593,7 @@ void caja_icon_container_update_icon(CajaIconContainer *container,
                                                large_embedded_text);
   }
 
-  caja_icon_container_get_icon_text(container, icon->data, &editable_text,
-                                    &additional_text, FALSE);
-
-  /* If name of icon being renamed was changed from elsewhere, end renaming
-   * mode. Alternatively, we could replace the characters in the editable text
-   * widget with the new name, but that could cause timing problems if the user
-   * just happened to be typing at that moment.
-   */
-  if (icon == get_icon_being_renamed(container) &&
-      g_strcmp0(editable_text,
-                caja_icon_canvas_item_get_editable_text(icon->item)) != 0) {
-    end_renaming_mode(container, FALSE);
-  }
-
-  eel_canvas_item_set(EEL_CANVAS_ITEM(icon->item), "editable_text",
-                      editable_text, "additional_text", additional_text,
-                      "highlighted_for_drop", icon == details->drop_target,
-                      NULL);
+  update_icon_text(container, icon);
 
   caja_icon_canvas_item_set_image(icon->item, pixbuf);
   caja_icon_canvas_item_set_attach_points(icon->item, attach_points,
@@ -6121,9 +6606,6 @@ void caja_icon_container_update_icon(CajaIconContainer *container,
   g_object_unref(pixbuf);
   g_list_free_full(emblem_pixbufs, g_object_unref);
 
-  g_free(editable_text);
-  g_free(additional_text);
-
   g_object_unref(icon_info);
 }
 
@@ -6151,7 +6633,14 @@ static gboolean assign_icon_position(CajaIconContainer *container,
 
 static void finish_adding_icon(CajaIconContainer *container, CajaIcon *icon) {
   caja_icon_container_update_icon(container, icon);
-  eel_canvas_item_show(EEL_CANVAS_ITEM(icon->item));
+
+  /* The horizontal auto-layout may leave icons far out of view without a
+   * position for a while; icon_set_position() shows them when they get one.
+   */
+  if (icon_is_positioned(icon) || !container->details->auto_layout ||
+      caja_icon_container_is_layout_vertical(container)) {
+    eel_canvas_item_show(EEL_CANVAS_ITEM(icon->item));
+  }
 
   g_signal_connect_object(icon->item, "event", G_CALLBACK(item_event_callback),
                           container, 0);
@@ -6306,6 +6795,7 @@ gboolean caja_icon_container_add(CajaIconContainer *container,
   icon->data = data;
   icon->x = ICON_UNPOSITIONED_VALUE;
   icon->y = ICON_UNPOSITIONED_VALUE;
+  icon->layout_dirty = TRUE;
 
   /* Whether the saved icon position should only be used
    * if the previous icon position is free. If the position
@@ -6438,7 +6928,10 @@ void caja_icon_container_set_zoom_level(CajaIconContainer *container,
   pixels_per_unit = ((double)icon_size) / ((double)CAJA_ICON_SIZE_STANDARD);
   eel_canvas_set_pixels_per_unit(EEL_CANVAS(container), pixels_per_unit);
 
-  invalidate_labels(container);
+  /* The zoom level is part of the label cache keys, the measurements of
+   * the other levels are kept for zooming back.
+   */
+  invalidate_label_layouts(container);
   caja_icon_container_request_update_all(container);
 }
 
@@ -6559,6 +7052,8 @@ static GArray *caja_icon_container_get_icon_locations(
   GList *node;
   int index;
 
+  finish_deferred_layout(container);
+
   result = g_array_new(FALSE, TRUE, sizeof(GdkPoint));
   result = g_array_set_size(result, g_list_length(icons));
 
@@ -6960,6 +7455,7 @@ void caja_icon_container_set_auto_layout(CajaIconContainer *container,
 
   reset_scroll_region_if_not_empty(container);
   container->details->auto_layout = auto_layout;
+  invalidate_incremental_layout(container);
 
   if (!auto_layout) {
     reload_icon_positions(container);
@@ -7226,6 +7722,7 @@ void caja_icon_container_start_renaming_selected_item(
 
   g_assert(!has_multiple_selection(container));
 
+  finish_deferred_layout(container);
   if (!icon_is_positioned(icon)) {
     set_pending_icon_to_rename(container, icon);
     return;
@@ -8206,6 +8703,9 @@ void caja_icon_container_begin_loading(CajaIconContainer *container) {
     g_signal_emit(container, signals[GET_STORED_LAYOUT_TIMESTAMP], 0, NULL,
                   &container->details->layout_timestamp, &dummy);
   }
+
+  /* Count only the frames of this load, see log_frame_stats() */
+  eel_canvas_reset_frame_stats(EEL_CANVAS(container));
 }
 
 static void store_layout_timestamps_now(CajaIconContainer *container) {
@@ -8225,6 +8725,29 @@ static void store_layout_timestamps_now(CajaIconContainer *container) {
   }
 }
 
+static void log_frame_stats(CajaIconContainer *container) {
+  EelCanvasFrameStats stats;
+
+  if (!caja_debug_log_is_domain_enabled(CAJA_DEBUG_LOG_DOMAIN_RENDERING)) {
+    return;
+  }
+
+  eel_canvas_get_frame_stats(EEL_CANVAS(container), &stats);
+  eel_canvas_reset_frame_stats(EEL_CANVAS(container));
+
+  if (stats.n_frames == 0) {
+    return;
+  }
+
+  caja_debug_log(FALSE, CAJA_DEBUG_LOG_DOMAIN_RENDERING,
+                 "loading drew %u frames for %" G_GUINT64_FORMAT
+                 " redraw requests and %" G_GUINT64_FORMAT
+                 " dirty rectangles in %" G_GINT64_FORMAT
+                 " us, the slowest took %" G_GINT64_FORMAT " us",
+                 stats.n_frames, stats.n_redraw_requests, stats.n_dirty_rects,
+                 stats.draw_time, stats.max_draw_time);
+}
+
 void caja_icon_container_end_loading(CajaIconContainer *container,
                                      gboolean all_icons_added) {
   if (all_icons_added &&
@@ -8236,6 +8759,10 @@ void caja_icon_container_end_loading(CajaIconContainer *container,
           TRUE;
     }
   }
+
+  if (all_icons_added) {
+    log_frame_stats(container);
+  }
 }
 
 gboolean caja_icon_container_get_store_layout_timestamps(
@@ -143,7 +143,7 @@ typedef struct {
   void (*stop_monitor_top_left)(CajaIconContainer *container,
                                 CajaIconData *data, gconstpointer client);
   void (*prioritize_thumbnailing)(CajaIconContainer *container,
-                                  CajaIconData *data);
+                                  CajaIconData *data, guint distance);
 
   /* Queries on icons for subclass/client.
    * These must be implemented => These are signals !
@@ -54,6 +54,11 @@ typedef struct {
   /* Scale factor (stretches icon). */
   double scale;
 
+  /* Position in the sorted icon list at the time this icon was last
+   * laid out by the incremental layout.
+   */
+  guint layout_index;
+
   /* Whether this item is selected. */
   eel_boolean_bit is_selected : 1;
 
@@ -67,8 +72,47 @@ typedef struct {
   eel_boolean_bit is_monitored : 1;
 
   eel_boolean_bit has_lazy_position : 1;
+
+  /* Whether the size of this item changed since it was last laid out. */
+  eel_boolean_bit layout_dirty : 1;
 } CajaIcon;
 
+/* A line of icons in the horizontal auto-layout. The lines are kept
+ * around so that a relayout only has to re-flow the icons starting at
+ * the first line that was affected by an insertion, removal or resize.
+ */
+typedef struct {
+  guint first_index;
+  guint n_icons;
+
+  /* Top of the line, before the ICON_PAD_TOP padding. */
+  double y;
+} CajaIconLayoutLine;
+
+/* Parameters the cached lines were computed with. If any of these
+ * change, all the lines have to be laid out again.
+ */
+typedef struct {
+  double canvas_width;
+  double grid_width;
+  double max_icon_width;
+  gboolean gridded;
+  gboolean is_rtl;
+  CajaIconLabelPosition label_position;
+} CajaIconLayoutParams;
+
+/* Measured extents of an icon label, shared between all the icons of a
+ * container that show the same text under the same layout constraints.
+ */
+typedef struct {
+  int text_width;
+  int text_dx;
+  int text_height;
+  int text_height_for_layout;
+  int text_height_for_entire_text;
+  int editable_text_height;
+} CajaIconLabelMetrics;
+
 /* Private CajaIconContainer members. */
 
 typedef struct {
@@ -182,6 +226,18 @@ struct CajaIconContainerDetails {
   /* Idle ID. */
   guint idle_id;
 
+  /* Incremental layout state. layout_lines covers the first
+   * layout_n_icons icons of the sorted list; if layout_deferred is
+   * set, the icons after those have not been laid out yet because
+   * they are far below the visible area.
+   */
+  GArray *layout_lines;
+  guint layout_n_icons;
+  double layout_next_y;
+  double layout_deferred_bottom;
+  CajaIconLayoutParams layout_params;
+  gboolean layout_deferred;
+
   /* Idle handler for stretch code */
   guint stretch_idle_id;
 
@@ -197,6 +253,13 @@ struct CajaIconContainerDetails {
   /* specific fonts used to draw labels */
   char *font;
 
+  /* Label metrics cache, keyed by the label text and everything that
+   * affects how it is wrapped. label_cache_lru holds the entries with
+   * the most recently used one at the head.
+   */
+  GHashTable *label_cache;
+  GQueue label_cache_lru;
+
   /* font sizes used to draw labels */
   int font_size_table[CAJA_ZOOM_LEVEL_LARGEST + 1];
 
@@ -302,5 +365,11 @@ gboolean caja_icon_container_emit_preview_signal(CajaIconContainer *view,
 gboolean caja_icon_container_scroll(CajaIconContainer *container, int delta_x,
                                     int delta_y);
 void caja_icon_container_update_scroll_region(CajaIconContainer *container);
+gboolean caja_icon_container_lookup_label_metrics(CajaIconContainer *container,
+                                                  const char *key,
+                                                  CajaIconLabelMetrics *metrics);
+void caja_icon_container_store_label_metrics(
+    CajaIconContainer *container, const char *key,
+    const CajaIconLabelMetrics *metrics);
 
 #endif /* CAJA_ICON_CONTAINER_PRIVATE_H */
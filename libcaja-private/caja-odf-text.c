@@ -0,0 +1,315 @@
+/*
+   caja-odf-text.c: Reading the text of OpenDocument files.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include <config.h>
+
+#include "caja-odf-text.h"
+
+#include <libxml/xmlreader.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* An OpenDocument file is a zip archive, its text is in this member */
+#define ODF_CONTENT_NAME "content.xml"
+
+#define ODF_TEXT_NS "urn:oasis:names:tc:opendocument:xmlns:text:1.0"
+
+#define ZIP_END_SIGNATURE 0x06054b50
+#define ZIP_END_SIZE 22
+#define ZIP_MAX_COMMENT 65535
+#define ZIP_DIRECTORY_SIGNATURE 0x02014b50
+#define ZIP_DIRECTORY_ENTRY_SIZE 46
+#define ZIP_LOCAL_SIGNATURE 0x04034b50
+#define ZIP_LOCAL_HEADER_SIZE 30
+
+#define ZIP_FLAG_ENCRYPTED 0x0001
+#define ZIP_METHOD_STORED 0
+#define ZIP_METHOD_DEFLATED 8
+
+/* Documents with a bigger zip directory than this aren't ones */
+#define ZIP_MAX_DIRECTORY_SIZE (16 * 1024 * 1024)
+
+/* Runs of spaces longer than this are passed on as this many */
+#define ODF_MAX_SPACES 16
+
+typedef struct {
+  GInputStream *stream;
+  GCancellable *cancellable;
+  /* What is left of a member that isn't compressed */
+  guint64 remaining;
+} ContentReader;
+
+static guint16 get_le16(const guchar *p) { return p[0] | p[1] << 8; }
+
+static guint32 get_le32(const guchar *p) {
+  return (guint32)p[0] | (guint32)p[1] << 8 | (guint32)p[2] << 16 |
+         (guint32)p[3] << 24;
+}
+
+static gboolean read_at(GInputStream *stream, goffset offset, guchar *buffer,
+                        gsize len, GCancellable *cancellable) {
+  gsize n_read;
+
+  return g_seekable_seek(G_SEEKABLE(stream), offset, G_SEEK_SET, cancellable,
+                         NULL) &&
+         g_input_stream_read_all(stream, buffer, len, &n_read, cancellable,
+                                 NULL) &&
+         n_read == len;
+}
+
+/* Finds the content member in the zip directory. Returns FALSE if stream
+ * isn't a zip archive with one in it that can be read.
+ */
+static gboolean find_content(GInputStream *stream, goffset *data_offset,
+                             guint16 *method, guint64 *size,
+                             GCancellable *cancellable) {
+  guchar *tail, *directory, *entry;
+  goffset file_size, tail_offset, local_offset;
+  gsize tail_len, directory_size, pos, name_len;
+  guint32 directory_offset;
+  guint16 n_entries, i;
+  guchar header[ZIP_LOCAL_HEADER_SIZE];
+  gboolean found;
+  gssize end;
+
+  if (!G_IS_SEEKABLE(stream) ||
+      !g_seekable_seek(G_SEEKABLE(stream), 0, G_SEEK_END, cancellable, NULL)) {
+    return FALSE;
+  }
+  file_size = g_seekable_tell(G_SEEKABLE(stream));
+  if (file_size < ZIP_END_SIZE) {
+    return FALSE;
+  }
+
+  /* The end record is last, followed only by a comment */
+  tail_len = MIN(file_size, ZIP_END_SIZE + ZIP_MAX_COMMENT);
+  tail_offset = file_size - tail_len;
+  tail = g_malloc(tail_len);
+  if (!read_at(stream, tail_offset, tail, tail_len, cancellable)) {
+    g_free(tail);
+    return FALSE;
+  }
+
+  for (end = tail_len - ZIP_END_SIZE; end >= 0; end--) {
+    if (get_le32(tail + end) == ZIP_END_SIGNATURE) {
+      break;
+    }
+  }
+  if (end < 0) {
+    g_free(tail);
+    return FALSE;
+  }
+
+  n_entries = get_le16(tail + end + 10);
+  directory_size = get_le32(tail + end + 12);
+  directory_offset = get_le32(tail + end + 16);
+  g_free(tail);
+
+  if (directory_size > ZIP_MAX_DIRECTORY_SIZE ||
+      (goffset)directory_offset + directory_size > file_size) {
+    return FALSE;
+  }
+
+  directory = g_malloc(directory_size);
+  if (!read_at(stream, directory_offset, directory, directory_size,
+               cancellable)) {
+    g_free(directory);
+    return FALSE;
+  }
+
+  found = FALSE;
+  pos = 0;
+  for (i = 0; i < n_entries && pos + ZIP_DIRECTORY_ENTRY_SIZE <= directory_size;
+       i++) {
+    entry = directory + pos;
+    if (get_le32(entry) != ZIP_DIRECTORY_SIGNATURE) {
+      break;
+    }
+
+    name_len = get_le16(entry + 28);
+    if (pos + ZIP_DIRECTORY_ENTRY_SIZE + name_len > directory_size) {
+      break;
+    }
+
+    if (name_len == strlen(ODF_CONTENT_NAME) &&
+        memcmp(entry + ZIP_DIRECTORY_ENTRY_SIZE, ODF_CONTENT_NAME, name_len) ==
+            0) {
+      if ((get_le16(entry + 8) & ZIP_FLAG_ENCRYPTED) == 0) {
+        *method = get_le16(entry + 10);
+        *size = get_le32(entry + 20);
+        local_offset = get_le32(entry + 42);
+        found = TRUE;
+      }
+      break;
+    }
+
+    pos += ZIP_DIRECTORY_ENTRY_SIZE + name_len + get_le16(entry + 30) +
+           get_le16(entry + 32);
+  }
+  g_free(directory);
+
+  if (!found || (*method != ZIP_METHOD_STORED &&
+                 *method != ZIP_METHOD_DEFLATED)) {
+    return FALSE;
+  }
+
+  /* The local header can have other extra fields than the directory */
+  if (!read_at(stream, local_offset, header, ZIP_LOCAL_HEADER_SIZE,
+               cancellable) ||
+      get_le32(header) != ZIP_LOCAL_SIGNATURE) {
+    return FALSE;
+  }
+  *data_offset = local_offset + ZIP_LOCAL_HEADER_SIZE + get_le16(header + 26) +
+                 get_le16(header + 28);
+
+  return g_seekable_seek(G_SEEKABLE(stream), *data_offset, G_SEEK_SET,
+                         cancellable, NULL);
+}
+
+static int content_read_callback(void *context, char *buffer, int len) {
+  ContentReader *reader;
+  gssize n_read;
+
+  reader = context;
+
+  n_read = g_input_stream_read(reader->stream, buffer,
+                               MIN((guint64)len, reader->remaining),
+                               reader->cancellable, NULL);
+  if (n_read < 0) {
+    return -1;
+  }
+  reader->remaining -= n_read;
+
+  return n_read;
+}
+
+static int content_close_callback(void *context) { return 0; }
+
+static gboolean is_text_element(xmlTextReaderPtr reader, const char *name) {
+  return g_strcmp0((const char *)xmlTextReaderConstLocalName(reader), name) ==
+             0 &&
+         g_strcmp0((const char *)xmlTextReaderConstNamespaceUri(reader),
+                   ODF_TEXT_NS) == 0;
+}
+
+/* Passes on the text nodes, and what the text elements for spacing and
+ * paragraphs stand for.
+ */
+static void read_content(ContentReader *content, CajaOdfTextFunc func,
+                         gpointer user_data) {
+  xmlTextReaderPtr reader;
+  const char *value;
+  char spaces[ODF_MAX_SPACES];
+  xmlChar *count;
+  gboolean more;
+  int type, n;
+
+  reader = xmlReaderForIO(content_read_callback, content_close_callback,
+                          content, NULL, NULL,
+                          XML_PARSE_NONET | XML_PARSE_NOERROR |
+                              XML_PARSE_NOWARNING);
+  if (reader == NULL) {
+    return;
+  }
+
+  memset(spaces, ' ', sizeof(spaces));
+
+  more = TRUE;
+  while (more && xmlTextReaderRead(reader) == 1) {
+    if (g_cancellable_is_cancelled(content->cancellable)) {
+      break;
+    }
+
+    type = xmlTextReaderNodeType(reader);
+    if (type == XML_READER_TYPE_TEXT || type == XML_READER_TYPE_CDATA ||
+        type == XML_READER_TYPE_SIGNIFICANT_WHITESPACE) {
+      value = (const char *)xmlTextReaderConstValue(reader);
+      if (value != NULL) {
+        more = func(value, strlen(value), user_data);
+      }
+    } else if (type == XML_READER_TYPE_ELEMENT) {
+      if (is_text_element(reader, "s")) {
+        count = xmlTextReaderGetAttributeNs(reader, (const xmlChar *)"c",
+                                            (const xmlChar *)ODF_TEXT_NS);
+        n = count != NULL ? CLAMP(atoi((const char *)count), 1, ODF_MAX_SPACES)
+                          : 1;
+        xmlFree(count);
+        more = func(spaces, n, user_data);
+      } else if (is_text_element(reader, "tab")) {
+        more = func("\t", 1, user_data);
+      } else if (is_text_element(reader, "line-break") ||
+                 (xmlTextReaderIsEmptyElement(reader) &&
+                  (is_text_element(reader, "p") ||
+                   is_text_element(reader, "h")))) {
+        more = func("\n", 1, user_data);
+      }
+    } else if (type == XML_READER_TYPE_END_ELEMENT) {
+      if (is_text_element(reader, "p") || is_text_element(reader, "h")) {
+        more = func("\n", 1, user_data);
+      }
+    }
+  }
+
+  xmlFreeTextReader(reader);
+}
+
+gboolean caja_odf_text_read(GFile *file, CajaOdfTextFunc func,
+                            gpointer user_data, GCancellable *cancellable) {
+  GFileInputStream *file_stream;
+  GConverter *decompressor;
+  ContentReader content;
+  goffset data_offset;
+  guint16 method;
+  guint64 size;
+
+  g_return_val_if_fail(G_IS_FILE(file), FALSE);
+  g_return_val_if_fail(func != NULL, FALSE);
+
+  file_stream = g_file_read(file, cancellable, NULL);
+  if (file_stream == NULL) {
+    return FALSE;
+  }
+
+  if (!find_content(G_INPUT_STREAM(file_stream), &data_offset, &method, &size,
+                    cancellable)) {
+    g_object_unref(file_stream);
+    return FALSE;
+  }
+
+  content.cancellable = cancellable;
+  if (method == ZIP_METHOD_DEFLATED) {
+    /* the deflate stream ends by itself */
+    decompressor = G_CONVERTER(
+        g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW));
+    content.stream =
+        g_converter_input_stream_new(G_INPUT_STREAM(file_stream), decompressor);
+    content.remaining = G_MAXUINT64;
+    g_object_unref(decompressor);
+  } else {
+    content.stream = g_object_ref(G_INPUT_STREAM(file_stream));
+    content.remaining = size;
+  }
+
+  read_content(&content, func, user_data);
+
+  g_object_unref(content.stream);
+  g_object_unref(file_stream);
+
+  return TRUE;
+}
@@ -0,0 +1,37 @@
+/*
+   caja-odf-text.h: Reading the text of OpenDocument files.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef CAJA_ODF_TEXT_H
+#define CAJA_ODF_TEXT_H
+
+#include <gio/gio.h>
+
+/* Gets the text of a document piece by piece, in order. Returns FALSE to
+   stop reading. */
+typedef gboolean (*CajaOdfTextFunc)(const char *text, gsize len,
+                                    gpointer user_data);
+
+/* Passes the text of the OpenDocument file to func while unpacking it,
+   without loading the whole document or running other programs. Paragraphs
+   end with a newline. Returns FALSE if file isn't a readable OpenDocument
+   file. */
+gboolean caja_odf_text_read(GFile *file, CajaOdfTextFunc func,
+                            gpointer user_data, GCancellable *cancellable);
+
+#endif /* CAJA_ODF_TEXT_H */
@@ -38,9 +38,22 @@
 #include "caja-file.h"
 #include "caja-search-directory-file.h"
 #include "caja-search-engine.h"
+#include "caja-search-relevance.h"
+
+/* How long turning hits into files may take before the main loop gets to
+   draw, about half a frame */
+#define HITS_TIME_BUDGET_USECS (8 * 1000)
+
+/* Hits added between looking at the clock */
+#define HITS_PER_TIME_CHECK 32
 
 struct CajaSearchDirectoryDetails {
   CajaQuery *query;
+  /* The query that files holds the hits for, all of them once
+     search_finished is set */
+  CajaQuery *hits_query;
+  /* Scores the hits of hits_query */
+  CajaSearchRelevance *relevance;
   char *saved_search_uri;
   gboolean modified;
 
@@ -48,9 +61,22 @@ struct CajaSearchDirectoryDetails {
 
   gboolean search_running;
   gboolean search_finished;
+  /* The hits were refined for a reload, kept for the view coming back for
+     them even if it was the last client */
+  gboolean hits_refined;
 
   GList *files;
+  /* The files, for looking them up */
   GHashTable *file_hash;
+  /* How well the files match hits_query, from 0 to 100 */
+  GHashTable *relevances;
+
+  /* PendingHits the engine found that aren't files yet, added to files in
+     an idle so that many hits don't hold up the main loop */
+  GQueue pending_hits;
+  guint pending_hits_idle_id;
+  /* The engine is done, but pending_hits isn't */
+  gboolean engine_finished;
 
   GList *monitor_list;
   GList *callback_list;
@@ -76,10 +102,20 @@ typedef struct {
   GHashTable *non_ready_hash;
 } SearchCallback;
 
+typedef struct {
+  /* NULL for hits known by their URI only */
+  GFile *parent;
+  /* The GFileInfos of the hits in parent, or else their URIs */
+  GList *hits;
+} PendingHits;
+
 G_DEFINE_TYPE(CajaSearchDirectory, caja_search_directory, CAJA_TYPE_DIRECTORY);
 
 static void search_engine_hits_added(CajaSearchEngine *engine, GList *hits,
                                      CajaSearchDirectory *search);
+static void search_engine_hit_batches_added(CajaSearchEngine *engine,
+                                            GList *batches,
+                                            CajaSearchDirectory *search);
 static void search_engine_hits_subtracted(CajaSearchEngine *engine, GList *hits,
                                           CajaSearchDirectory *search);
 static void search_engine_finished(CajaSearchEngine *engine,
@@ -94,6 +130,8 @@ static void ensure_search_engine(CajaSearchDirectory *search) {
     search->details->engine = caja_search_engine_new();
     g_signal_connect(search->details->engine, "hits-added",
                      G_CALLBACK(search_engine_hits_added), search);
+    g_signal_connect(search->details->engine, "hit-batches-added",
+                     G_CALLBACK(search_engine_hit_batches_added), search);
     g_signal_connect(search->details->engine, "hits-subtracted",
                      G_CALLBACK(search_engine_hits_subtracted), search);
     g_signal_connect(search->details->engine, "finished",
@@ -103,6 +141,26 @@ static void ensure_search_engine(CajaSearchDirectory *search) {
   }
 }
 
+static void pending_hits_free(PendingHits *pending) {
+  if (pending->parent != NULL) {
+    g_object_unref(pending->parent);
+    g_list_free_full(pending->hits, g_object_unref);
+  } else {
+    g_list_free_full(pending->hits, g_free);
+  }
+  g_free(pending);
+}
+
+static void clear_pending_hits(CajaSearchDirectory *search) {
+  if (search->details->pending_hits_idle_id != 0) {
+    g_source_remove(search->details->pending_hits_idle_id);
+    search->details->pending_hits_idle_id = 0;
+  }
+  g_queue_clear_full(&search->details->pending_hits,
+                     (GDestroyNotify)pending_hits_free);
+  search->details->engine_finished = FALSE;
+}
+
 static void reset_file_list(CajaSearchDirectory *search) {
   GList *list, *monitor_list;
   SearchMonitor *monitor;
@@ -125,6 +183,344 @@ static void reset_file_list(CajaSearchDirectory *search) {
 
   caja_file_list_free(search->details->files);
   search->details->files = NULL;
+  g_hash_table_remove_all(search->details->file_hash);
+  g_hash_table_remove_all(search->details->relevances);
+
+  clear_pending_hits(search);
+}
+
+static void set_hits_query(CajaSearchDirectory *search, CajaQuery *query) {
+  if (query) {
+    g_object_ref(query);
+  }
+
+  if (search->details->hits_query) {
+    g_object_unref(search->details->hits_query);
+  }
+
+  search->details->hits_query = query;
+
+  if (search->details->relevance) {
+    caja_search_relevance_free(search->details->relevance);
+    search->details->relevance = NULL;
+  }
+  if (query) {
+    search->details->relevance = caja_search_relevance_new(query);
+  }
+}
+
+static int get_file_depth(CajaSearchDirectory *search, CajaFile *file) {
+  GFile *parent;
+  int depth;
+
+  parent = caja_file_get_parent_location(file);
+  if (parent == NULL) {
+    return -1;
+  }
+  depth = caja_search_relevance_get_depth(search->details->relevance, parent);
+  g_object_unref(parent);
+
+  return depth;
+}
+
+/* Scores file as a hit of hits_query, depth is how far below the searched
+ * folder it is. Returns TRUE if that changed the relevance of file.
+ */
+static gboolean rank_file(CajaSearchDirectory *search, CajaFile *file,
+                          int depth) {
+  char *name;
+  int relevance;
+  gpointer old_relevance;
+
+  name = caja_file_get_display_name(file);
+  relevance = caja_search_relevance_score(search->details->relevance, name,
+                                          depth, caja_file_get_mtime(file));
+  g_free(name);
+
+  if (g_hash_table_lookup_extended(search->details->relevances, file, NULL,
+                                   &old_relevance) &&
+      GPOINTER_TO_INT(old_relevance) == relevance) {
+    return FALSE;
+  }
+  g_hash_table_insert(search->details->relevances, file,
+                      GINT_TO_POINTER(relevance));
+
+  return TRUE;
+}
+
+/* Splits the text of query into words like the search engines do it */
+static char **get_query_words(CajaQuery *query) {
+  char *text, *normalized, *lower;
+  char **words;
+
+  text = caja_query_get_text(query);
+  normalized = g_utf8_normalize(text != NULL ? text : "", -1, G_NORMALIZE_NFD);
+  lower = g_utf8_strdown(normalized, -1);
+  words = g_strsplit(lower, " ", -1);
+  g_free(lower);
+  g_free(normalized);
+  g_free(text);
+
+  return words;
+}
+
+static gboolean string_list_contains(GList *list, const char *string) {
+  return g_list_find_custom(list, string, (GCompareFunc)g_strcmp0) != NULL;
+}
+
+/* Whether every string of list is in other */
+static gboolean string_list_is_subset(GList *list, GList *other) {
+  for (; list != NULL; list = list->next) {
+    if (!string_list_contains(other, list->data)) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Whether all that has every word of words has every word of old_words too */
+static gboolean words_narrow(char **old_words, char **words) {
+  int i, j;
+
+  for (i = 0; old_words[i] != NULL; i++) {
+    if (old_words[i][0] == '\0') {
+      continue;
+    }
+
+    for (j = 0; words[j] != NULL; j++) {
+      if (strstr(words[j], old_words[i]) != NULL) {
+        break;
+      }
+    }
+    if (words[j] == NULL) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Whether the hits of query are among the hits of old_query, and the
+ * differences are in what is known about the files without reading them:
+ * their names, types, modification times and sizes. The signs of the
+ * timestamp and size tell whether they are upper or lower bounds, see the
+ * simple search engine.
+ */
+static gboolean query_narrows(CajaQuery *old_query, CajaQuery *query) {
+  char *old_string, *string;
+  char **old_words, **words;
+  GList *old_list, *list;
+  gint64 old_value, value;
+  gboolean narrows;
+
+  old_string = caja_query_get_location(old_query);
+  string = caja_query_get_location(query);
+  narrows = g_strcmp0(old_string, string) == 0;
+  g_free(old_string);
+  g_free(string);
+
+  if (narrows) {
+    old_string = caja_query_get_contained_text(old_query);
+    string = caja_query_get_contained_text(query);
+    narrows = g_strcmp0(old_string, string) == 0;
+    g_free(old_string);
+    g_free(string);
+  }
+
+  if (narrows) {
+    old_list = caja_query_get_tags(old_query);
+    list = caja_query_get_tags(query);
+    narrows = string_list_is_subset(old_list, list) &&
+              string_list_is_subset(list, old_list);
+    g_list_free_full(old_list, g_free);
+    g_list_free_full(list, g_free);
+  }
+
+  if (narrows) {
+    /* No types means any type */
+    old_list = caja_query_get_mime_types(old_query);
+    list = caja_query_get_mime_types(query);
+    narrows = old_list == NULL ||
+              (list != NULL && string_list_is_subset(list, old_list));
+    g_list_free_full(old_list, g_free);
+    g_list_free_full(list, g_free);
+  }
+
+  if (narrows) {
+    old_value = caja_query_get_timestamp(old_query);
+    value = caja_query_get_timestamp(query);
+    narrows = old_value == 0 ||
+              (old_value > 0 && 0 < value && value <= old_value) ||
+              (old_value < 0 && value <= old_value);
+  }
+
+  if (narrows) {
+    old_value = caja_query_get_size(old_query);
+    value = caja_query_get_size(query);
+    narrows = old_value == 0 || (old_value > 0 && value >= old_value) ||
+              (old_value < 0 && old_value <= value && value < 0);
+  }
+
+  if (narrows) {
+    old_words = get_query_words(old_query);
+    words = get_query_words(query);
+    narrows = words_narrow(old_words, words);
+    g_strfreev(old_words);
+    g_strfreev(words);
+  }
+
+  return narrows;
+}
+
+/* Matches the display name, like the search engines do */
+static gboolean file_matches_words(CajaFile *file, char **words) {
+  char *display_name, *normalized, *lower_name;
+  gboolean matches;
+  int i;
+
+  display_name = caja_file_get_display_name(file);
+  normalized = g_utf8_normalize(display_name, -1, G_NORMALIZE_NFD);
+  lower_name = g_utf8_strdown(normalized, -1);
+  g_free(normalized);
+  g_free(display_name);
+
+  matches = TRUE;
+  for (i = 0; words[i] != NULL; i++) {
+    if (strstr(lower_name, words[i]) == NULL) {
+      matches = FALSE;
+      break;
+    }
+  }
+  g_free(lower_name);
+
+  return matches;
+}
+
+/* Checks the parts of query that query_narrows() allows to differ */
+static gboolean file_matches_query(CajaFile *file, CajaQuery *query,
+                                   char **words, GList *mime_types) {
+  char *mime_type;
+  gboolean matches;
+  gint64 timestamp, size;
+  time_t mtime;
+  goffset file_size;
+
+  if (!file_matches_words(file, words)) {
+    return FALSE;
+  }
+
+  if (mime_types != NULL) {
+    mime_type = caja_file_get_mime_type(file);
+    matches = FALSE;
+    for (; mime_type != NULL && mime_types != NULL;
+         mime_types = mime_types->next) {
+      if (g_content_type_equals(mime_type, mime_types->data)) {
+        matches = TRUE;
+        break;
+      }
+    }
+    g_free(mime_type);
+
+    if (!matches) {
+      return FALSE;
+    }
+  }
+
+  timestamp = caja_query_get_timestamp(query);
+  if (timestamp != 0) {
+    mtime = caja_file_get_mtime(file);
+    if (timestamp > 0 ? timestamp < mtime : mtime < ABS(timestamp)) {
+      return FALSE;
+    }
+  }
+
+  size = caja_query_get_size(query);
+  if (size != 0) {
+    file_size = caja_file_get_size(file);
+    if (size > 0 ? file_size < size : ABS(size) < file_size) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+static void remove_files(CajaSearchDirectory *search, GList *file_list);
+
+/* Brings the hits up to date with the query without searching again, when
+ * the hits are complete and the query only narrows the one they are for.
+ * Only hits that are being kept up to date are used: those of a search with
+ * clients, or the ones just refined for a reload. Returns FALSE if the
+ * search has to run again.
+ */
+static gboolean refine_file_list(CajaSearchDirectory *search) {
+  CajaQuery *query;
+  GList *list, *next, *mime_types, *removed, *changed;
+  char **words;
+  gboolean needs_info;
+  CajaFile *file;
+
+  query = search->details->query;
+
+  if (!search->details->search_finished ||
+      search->details->hits_query == NULL ||
+      (!search->details->search_running && !search->details->hits_refined)) {
+    return FALSE;
+  }
+  if (search->details->hits_query == query) {
+    return search->details->hits_refined;
+  }
+  if (!query_narrows(search->details->hits_query, query)) {
+    return FALSE;
+  }
+
+  mime_types = caja_query_get_mime_types(query);
+  needs_info = mime_types != NULL || caja_query_get_timestamp(query) != 0 ||
+               caja_query_get_size(query) != 0;
+
+  if (needs_info) {
+    for (list = search->details->files; list != NULL; list = list->next) {
+      if (!caja_file_check_if_ready(list->data, CAJA_FILE_ATTRIBUTE_INFO)) {
+        g_list_free_full(mime_types, g_free);
+        return FALSE;
+      }
+    }
+  }
+
+  words = get_query_words(query);
+  removed = NULL;
+  for (list = search->details->files; list != NULL; list = next) {
+    next = list->next;
+    file = list->data;
+
+    if (!file_matches_query(file, query, words, mime_types)) {
+      search->details->files =
+          g_list_remove_link(search->details->files, list);
+      removed = g_list_concat(list, removed);
+    }
+  }
+  g_strfreev(words);
+  g_list_free_full(mime_types, g_free);
+
+  set_hits_query(search, query);
+
+  if (removed != NULL) {
+    remove_files(search, removed);
+  }
+
+  /* The views sorting by relevance move the ones that rank differently */
+  changed = NULL;
+  for (list = search->details->files; list != NULL; list = list->next) {
+    file = list->data;
+    if (rank_file(search, file, get_file_depth(search, file))) {
+      changed = g_list_prepend(changed, file);
+    }
+  }
+  caja_directory_emit_files_changed(CAJA_DIRECTORY(search), changed);
+  g_list_free(changed);
+
+  return TRUE;
 }
 
 static void start_or_stop_search_engine(CajaSearchDirectory *search,
@@ -135,10 +531,16 @@ static void start_or_stop_search_engine(CajaSearchDirectory *search,
       search->details->query && !search->details->search_running) {
     /* We need to start the search engine */
     search->details->search_running = TRUE;
+    if (refine_file_list(search)) {
+      return;
+    }
+
+    search->details->hits_refined = FALSE;
     search->details->search_finished = FALSE;
     ensure_search_engine(search);
     caja_search_engine_set_query(search->details->engine,
                                  search->details->query);
+    set_hits_query(search, search->details->query);
 
     reset_file_list(search);
 
@@ -147,8 +549,18 @@ static void start_or_stop_search_engine(CajaSearchDirectory *search,
              !search->details->pending_callback_list &&
              search->details->engine && search->details->search_running) {
     search->details->search_running = FALSE;
-    caja_search_engine_stop(search->details->engine);
+    if (search->details->hits_refined) {
+      /* The view reloading for the refined query comes back for them */
+      return;
+    }
 
+    if (!search->details->search_finished) {
+      caja_search_engine_stop(search->details->engine);
+    }
+
+    /* Nothing keeps the hits up to date any more */
+    search->details->search_finished = FALSE;
+    set_hits_query(search, NULL);
     reset_file_list(search);
   }
 }
@@ -194,6 +606,10 @@ static void search_monitor_add(CajaDirectory *directory, gconstpointer client,
   }
 
   start_or_stop_search_engine(search, TRUE);
+
+  /* A view is back for the refined hits, from now on they are kept only
+     while there are clients */
+  search->details->hits_refined = FALSE;
 }
 
 static void search_monitor_remove_file_monitors(SearchMonitor *monitor,
@@ -441,65 +857,203 @@ static void search_cancel_callback(CajaDirectory *directory,
   }
 }
 
-static void search_engine_hits_added(CajaSearchEngine *engine, GList *hits,
-                                     CajaSearchDirectory *search) {
-  GList *hit_list;
+/* Returns a reference to the file for a hit the engine has the info of,
+ * made from that info unless the file exists already.
+ */
+static CajaFile *get_file_for_info(CajaDirectory *directory, GFileInfo *info) {
+  CajaFile *file;
+  const char *name;
+
+  name = g_file_info_get_name(info);
+  file = caja_directory_find_file_by_name(directory, name);
+  if (file != NULL) {
+    return caja_file_ref(file);
+  }
+
+  file = caja_file_new_from_info(directory, info);
+  caja_directory_add_file(directory, file);
+
+  return file;
+}
+
+static void search_finish(CajaSearchDirectory *search);
+
+/* Turns pending hits into files until there are no more or deadline has
+ * passed, 0 for no deadline. Returns TRUE if some are left.
+ */
+static gboolean add_pending_hits(CajaSearchDirectory *search,
+                                 gint64 deadline) {
+  PendingHits *pending;
+  CajaDirectory *directory;
   GList *file_list;
   CajaFile *file;
   SearchMonitor *monitor;
   GList *monitor_list;
+  gboolean out_of_time;
+  const char *name;
+  guint n_hits;
+  int depth;
 
   file_list = NULL;
+  out_of_time = FALSE;
+  n_hits = 0;
+
+  while (!out_of_time && !g_queue_is_empty(&search->details->pending_hits)) {
+    pending = g_queue_peek_head(&search->details->pending_hits);
+
+    /* One lookup for all the hits in a folder */
+    directory = NULL;
+    depth = -1;
+    if (pending->parent != NULL) {
+      directory = caja_directory_get(pending->parent);
+      depth = caja_search_relevance_get_depth(search->details->relevance,
+                                              pending->parent);
+    }
 
-  for (hit_list = hits; hit_list != NULL; hit_list = hit_list->next) {
-    char *uri;
+    while (pending->hits != NULL && !out_of_time) {
+      file = NULL;
+      if (directory != NULL) {
+        name = g_file_info_get_name(pending->hits->data);
+        /* Never return saved searches themselves as hits */
+        if (name != NULL &&
+            !g_str_has_suffix(name, CAJA_SAVED_SEARCH_EXTENSION)) {
+          file = get_file_for_info(directory, pending->hits->data);
+        }
+        g_object_unref(pending->hits->data);
+      } else {
+        if (!g_str_has_suffix(pending->hits->data,
+                              CAJA_SAVED_SEARCH_EXTENSION)) {
+          file = caja_file_get_by_uri(pending->hits->data);
+        }
+        g_free(pending->hits->data);
+      }
+      pending->hits = g_list_delete_link(pending->hits, pending->hits);
+
+      if (file != NULL &&
+          g_hash_table_contains(search->details->file_hash, file)) {
+        /* Found twice */
+        caja_file_unref(file);
+      } else if (file != NULL) {
+        rank_file(search, file,
+                  directory != NULL ? depth : get_file_depth(search, file));
+
+        for (monitor_list = search->details->monitor_list; monitor_list;
+             monitor_list = monitor_list->next) {
+          monitor = monitor_list->data;
+
+          /* Add monitors */
+          caja_file_monitor_add(file, monitor, monitor->monitor_attributes);
+        }
+
+        g_signal_connect(file, "changed", G_CALLBACK(file_changed), search);
+
+        g_hash_table_add(search->details->file_hash, file);
+        search->details->files = g_list_prepend(search->details->files, file);
+        file_list = g_list_prepend(file_list, file);
+      }
+
+      n_hits++;
+      out_of_time = deadline != 0 && n_hits % HITS_PER_TIME_CHECK == 0 &&
+                    g_get_monotonic_time() >= deadline;
+    }
 
-    uri = hit_list->data;
+    if (directory != NULL) {
+      caja_directory_unref(directory);
+    }
 
-    if (g_str_has_suffix(uri, CAJA_SAVED_SEARCH_EXTENSION)) {
-      /* Never return saved searches themselves as hits */
-      continue;
+    if (pending->hits == NULL) {
+      g_queue_pop_head(&search->details->pending_hits);
+      pending_hits_free(pending);
     }
+  }
 
-    file = caja_file_get_by_uri(uri);
+  if (file_list != NULL) {
+    caja_directory_emit_files_added(CAJA_DIRECTORY(search), file_list);
+    g_list_free(file_list);
 
-    for (monitor_list = search->details->monitor_list; monitor_list;
-         monitor_list = monitor_list->next) {
-      monitor = monitor_list->data;
+    file = caja_directory_get_corresponding_file(CAJA_DIRECTORY(search));
+    caja_file_emit_changed(file);
+    caja_file_unref(file);
+  }
 
-      /* Add monitors */
-      caja_file_monitor_add(file, monitor, monitor->monitor_attributes);
-    }
+  return !g_queue_is_empty(&search->details->pending_hits);
+}
 
-    g_signal_connect(file, "changed", G_CALLBACK(file_changed), search);
+static gboolean pending_hits_idle_callback(gpointer user_data) {
+  CajaSearchDirectory *search;
+
+  search = CAJA_SEARCH_DIRECTORY(user_data);
+
+  if (add_pending_hits(search,
+                       g_get_monotonic_time() + HITS_TIME_BUDGET_USECS)) {
+    return TRUE;
+  }
 
-    file_list = g_list_prepend(file_list, file);
+  search->details->pending_hits_idle_id = 0;
+  if (search->details->engine_finished) {
+    search->details->engine_finished = FALSE;
+    search_finish(search);
   }
 
-  search->details->files = g_list_concat(search->details->files, file_list);
+  return FALSE;
+}
 
-  caja_directory_emit_files_added(CAJA_DIRECTORY(search), file_list);
+static void queue_pending_hits(CajaSearchDirectory *search,
+                               PendingHits *pending) {
+  g_queue_push_tail(&search->details->pending_hits, pending);
 
-  file = caja_directory_get_corresponding_file(CAJA_DIRECTORY(search));
-  caja_file_emit_changed(file);
-  caja_file_unref(file);
+  /* Below the priority of redrawing, so the views get drawn in between */
+  if (search->details->pending_hits_idle_id == 0) {
+    search->details->pending_hits_idle_id =
+        g_idle_add(pending_hits_idle_callback, search);
+  }
 }
 
-static void search_engine_hits_subtracted(CajaSearchEngine *engine, GList *hits,
-                                          CajaSearchDirectory *search) {
-  GList *hit_list;
+static void search_engine_hits_added(CajaSearchEngine *engine, GList *hits,
+                                     CajaSearchDirectory *search) {
+  PendingHits *pending;
+
+  if (hits == NULL) {
+    return;
+  }
+
+  pending = g_new0(PendingHits, 1);
+  pending->hits = g_list_copy_deep(hits, (GCopyFunc)g_strdup, NULL);
+  queue_pending_hits(search, pending);
+}
+
+static void search_engine_hit_batches_added(CajaSearchEngine *engine,
+                                            GList *batches,
+                                            CajaSearchDirectory *search) {
+  CajaSearchHitBatch *batch;
+  PendingHits *pending;
+  GList *list;
+
+  for (list = batches; list != NULL; list = list->next) {
+    batch = list->data;
+    if (batch->infos == NULL) {
+      continue;
+    }
+
+    pending = g_new0(PendingHits, 1);
+    pending->parent = g_object_ref(batch->parent);
+    pending->hits =
+        g_list_copy_deep(batch->infos, (GCopyFunc)g_object_ref, NULL);
+    queue_pending_hits(search, pending);
+  }
+}
+
+/* Takes the files out of the search, file_list has to be unlinked from the
+ * file list already and its references are dropped.
+ */
+static void remove_files(CajaSearchDirectory *search, GList *file_list) {
+  GList *list;
   GList *monitor_list;
   SearchMonitor *monitor;
-  GList *file_list;
   CajaFile *file;
 
-  file_list = NULL;
-
-  for (hit_list = hits; hit_list != NULL; hit_list = hit_list->next) {
-    char *uri;
-
-    uri = hit_list->data;
-    file = caja_file_get_by_uri(uri);
+  for (list = file_list; list != NULL; list = list->next) {
+    file = list->data;
 
     for (monitor_list = search->details->monitor_list; monitor_list;
          monitor_list = monitor_list->next) {
@@ -509,12 +1063,11 @@ static void search_engine_hits_subtracted(CajaSearchEngine *engine, GList *hits,
     }
 
     g_signal_handlers_disconnect_by_func(file, file_changed, search);
-
-    search->details->files = g_list_remove(search->details->files, file);
-
-    file_list = g_list_prepend(file_list, file);
+    g_hash_table_remove(search->details->file_hash, file);
+    g_hash_table_remove(search->details->relevances, file);
   }
 
+  /* The views check whether changed files are still in the directory */
   caja_directory_emit_files_changed(CAJA_DIRECTORY(search), file_list);
 
   caja_file_list_free(file_list);
@@ -524,6 +1077,44 @@ static void search_engine_hits_subtracted(CajaSearchEngine *engine, GList *hits,
   caja_file_unref(file);
 }
 
+static void search_engine_hits_subtracted(CajaSearchEngine *engine, GList *hits,
+                                          CajaSearchDirectory *search) {
+  GList *hit_list;
+  GList *file_list, *link;
+  CajaFile *file;
+
+  /* The hits may not be files yet */
+  add_pending_hits(search, 0);
+
+  file_list = NULL;
+
+  for (hit_list = hits; hit_list != NULL; hit_list = hit_list->next) {
+    char *uri;
+
+    uri = hit_list->data;
+    file = caja_file_get_existing_by_uri(uri);
+    if (file == NULL) {
+      continue;
+    }
+
+    link = NULL;
+    if (g_hash_table_contains(search->details->file_hash, file)) {
+      link = g_list_find(search->details->files, file);
+    }
+    if (link != NULL) {
+      search->details->files =
+          g_list_remove_link(search->details->files, link);
+      file_list = g_list_concat(link, file_list);
+    }
+
+    caja_file_unref(file);
+  }
+
+  if (file_list != NULL) {
+    remove_files(search, file_list);
+  }
+}
+
 static void search_callback_add_pending_file_callbacks(
     SearchCallback *callback) {
   callback->file_list =
@@ -546,6 +1137,16 @@ static void search_engine_error(CajaSearchEngine *engine,
 
 static void search_engine_finished(CajaSearchEngine *engine,
                                    CajaSearchDirectory *search) {
+  if (!g_queue_is_empty(&search->details->pending_hits)) {
+    /* Done once all the hits are files */
+    search->details->engine_finished = TRUE;
+    return;
+  }
+
+  search_finish(search);
+}
+
+static void search_finish(CajaSearchDirectory *search) {
   search->details->search_finished = TRUE;
 
   caja_directory_emit_done_loading(CAJA_DIRECTORY(search));
@@ -569,6 +1170,14 @@ static void search_force_reload(CajaDirectory *directory) {
     return;
   }
 
+  /* Reloading for the same query looks for changes on disk */
+  if (search->details->hits_query != search->details->query &&
+      refine_file_list(search)) {
+    search->details->hits_refined = TRUE;
+    return;
+  }
+
+  search->details->hits_refined = FALSE;
   search->details->search_finished = FALSE;
 
   if (!search->details->engine) {
@@ -582,7 +1191,10 @@ static void search_force_reload(CajaDirectory *directory) {
     caja_search_engine_stop(search->details->engine);
     caja_search_engine_set_query(search->details->engine,
                                  search->details->query);
+    set_hits_query(search, search->details->query);
     caja_search_engine_start(search->details->engine);
+  } else {
+    set_hits_query(search, NULL);
   }
 }
 
@@ -599,8 +1211,7 @@ static gboolean search_contains_file(CajaDirectory *directory, CajaFile *file) {
 
   search = CAJA_SEARCH_DIRECTORY(directory);
 
-  /* FIXME: Maybe put the files in a hash */
-  return (g_list_find(search->details->files, file) != NULL);
+  return g_hash_table_contains(search->details->file_hash, file);
 }
 
 static GList *search_get_file_list(CajaDirectory *directory) {
@@ -651,6 +1262,7 @@ static void search_dispose(GObject *object) {
     g_object_unref(search->details->query);
     search->details->query = NULL;
   }
+  set_hits_query(search, NULL);
 
   if (search->details->engine) {
     if (search->details->search_running) {
@@ -670,6 +1282,8 @@ static void search_finalize(GObject *object) {
   search = CAJA_SEARCH_DIRECTORY(object);
 
   g_free(search->details->saved_search_uri);
+  g_hash_table_destroy(search->details->file_hash);
+  g_hash_table_destroy(search->details->relevances);
 
   g_free(search->details);
 
@@ -678,6 +1292,9 @@ static void search_finalize(GObject *object) {
 
 static void caja_search_directory_init(CajaSearchDirectory *search) {
   search->details = g_new0(CajaSearchDirectoryDetails, 1);
+  search->details->file_hash = g_hash_table_new(NULL, NULL);
+  search->details->relevances = g_hash_table_new(NULL, NULL);
+  g_queue_init(&search->details->pending_hits);
 }
 
 static void caja_search_directory_class_init(CajaSearchDirectoryClass *class) {
@@ -737,6 +1354,13 @@ void caja_search_directory_set_query(CajaSearchDirectory *search,
   }
 }
 
+/* How well file matches the query, from 0 to 100, 0 if it isn't a hit */
+int caja_search_directory_get_relevance(CajaSearchDirectory *search,
+                                        CajaFile *file) {
+  return GPOINTER_TO_INT(
+      g_hash_table_lookup(search->details->relevances, file));
+}
+
 CajaQuery *caja_search_directory_get_query(CajaSearchDirectory *search) {
   if (search->details->query != NULL) {
     return g_object_ref(search->details->query);
@@ -71,5 +71,7 @@ void caja_search_directory_save_to_file(CajaSearchDirectory *search,
 CajaQuery *caja_search_directory_get_query(CajaSearchDirectory *search);
 void caja_search_directory_set_query(CajaSearchDirectory *search,
                                      CajaQuery *query);
+int caja_search_directory_get_relevance(CajaSearchDirectory *search,
+                                        CajaFile *file);
 
 #endif /* CAJA_SEARCH_DIRECTORY_H */
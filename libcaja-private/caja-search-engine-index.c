@@ -0,0 +1,279 @@
+/*
+   caja-search-engine-index.c: Search engine using the file name index.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include <config.h>
+
+#include "caja-search-engine-index.h"
+
+#include <eel/eel-gtk-macros.h>
+#include <string.h>
+
+#include "caja-filename-index.h"
+#include "caja-search-engine-simple.h"
+
+struct CajaSearchEngineIndexDetails {
+  CajaQuery *query;
+
+  /* Answers the queries the index can't */
+  CajaSearchEngine *fallback;
+
+  guint search_idle_id;
+};
+
+G_DEFINE_TYPE(CajaSearchEngineIndex, caja_search_engine_index,
+              CAJA_TYPE_SEARCH_ENGINE);
+
+static CajaSearchEngineClass *parent_class = NULL;
+
+static void finalize(GObject *object) {
+  CajaSearchEngineIndex *index;
+
+  index = CAJA_SEARCH_ENGINE_INDEX(object);
+
+  if (index->details->search_idle_id != 0) {
+    g_source_remove(index->details->search_idle_id);
+  }
+  if (index->details->query) {
+    g_object_unref(index->details->query);
+    index->details->query = NULL;
+  }
+  g_signal_handlers_disconnect_by_data(index->details->fallback, index);
+  g_object_unref(index->details->fallback);
+
+  g_free(index->details);
+
+  EEL_CALL_PARENT(G_OBJECT_CLASS, finalize, (object));
+}
+
+/* Whether the query only asks for file names and tags in an indexed
+   folder */
+static gboolean query_fits_index(CajaQuery *query) {
+  GList *mime_types;
+  char *location, *contained_text;
+  gboolean fits;
+
+  mime_types = caja_query_get_mime_types(query);
+  contained_text = caja_query_get_contained_text(query);
+  location = caja_query_get_location(query);
+
+  fits = mime_types == NULL &&
+         (contained_text == NULL || contained_text[0] == '\0') &&
+         caja_query_get_timestamp(query) == 0 &&
+         caja_query_get_size(query) == 0 && location != NULL &&
+         caja_filename_index_covers(location);
+
+  g_list_free_full(mime_types, g_free);
+  g_free(contained_text);
+  g_free(location);
+
+  return fits;
+}
+
+static char *fold_text(const char *text) {
+  char *normalized, *lower;
+
+  /* cf. search_thread_data_new() of the simple search engine */
+  normalized = g_utf8_normalize(text, -1, G_NORMALIZE_NFD);
+  if (normalized == NULL) {
+    return NULL;
+  }
+  lower = g_utf8_strdown(normalized, -1);
+  g_free(normalized);
+
+  return lower;
+}
+
+/* Returns the tags of the query folded, NULL if there are none */
+static char **get_query_tags(CajaQuery *query) {
+  GPtrArray *folded;
+  GList *tags, *l;
+  char *tag;
+
+  tags = caja_query_get_tags(query);
+  if (tags == NULL) {
+    return NULL;
+  }
+
+  folded = g_ptr_array_new();
+  for (l = tags; l != NULL; l = l->next) {
+    /* the search predicate leaves out those that aren't UTF-8 too */
+    tag = fold_text(l->data);
+    if (tag != NULL) {
+      g_ptr_array_add(folded, tag);
+    }
+  }
+  g_ptr_array_add(folded, NULL);
+  g_list_free_full(tags, g_free);
+
+  return (char **)g_ptr_array_free(folded, FALSE);
+}
+
+static gboolean search_idle_callback(gpointer user_data) {
+  CajaSearchEngineIndex *index;
+  char *text, *lower, *location;
+  char **words, **tags;
+  GList *hits;
+
+  index = CAJA_SEARCH_ENGINE_INDEX(user_data);
+  index->details->search_idle_id = 0;
+
+  text = caja_query_get_text(index->details->query);
+  lower = fold_text(text);
+  words = g_strsplit(lower != NULL ? lower : "", " ", -1);
+  g_free(lower);
+  g_free(text);
+
+  tags = get_query_tags(index->details->query);
+
+  location = caja_query_get_location(index->details->query);
+  hits = caja_filename_index_search(location, words, tags);
+  g_free(location);
+  g_strfreev(words);
+  g_strfreev(tags);
+
+  if (hits != NULL) {
+    caja_search_engine_hits_added(CAJA_SEARCH_ENGINE(index), hits);
+    g_list_free_full(hits, g_free);
+  }
+  caja_search_engine_finished(CAJA_SEARCH_ENGINE(index));
+
+  return FALSE;
+}
+
+static void caja_search_engine_index_start(CajaSearchEngine *engine) {
+  CajaSearchEngineIndex *index;
+
+  index = CAJA_SEARCH_ENGINE_INDEX(engine);
+
+  if (index->details->query == NULL || index->details->search_idle_id != 0) {
+    return;
+  }
+
+  if (!query_fits_index(index->details->query)) {
+    caja_search_engine_set_query(index->details->fallback,
+                                 index->details->query);
+    caja_search_engine_start(index->details->fallback);
+    return;
+  }
+
+  /* The hits come after start() returns, like with the other engines */
+  index->details->search_idle_id = g_idle_add(search_idle_callback, index);
+}
+
+static void caja_search_engine_index_stop(CajaSearchEngine *engine) {
+  CajaSearchEngineIndex *index;
+
+  index = CAJA_SEARCH_ENGINE_INDEX(engine);
+
+  if (index->details->search_idle_id != 0) {
+    g_source_remove(index->details->search_idle_id);
+    index->details->search_idle_id = 0;
+  }
+  caja_search_engine_stop(index->details->fallback);
+}
+
+static gboolean caja_search_engine_index_is_indexed(CajaSearchEngine *engine) {
+  /* Only some queries are, the others take as long as without the index */
+  return FALSE;
+}
+
+static void caja_search_engine_index_set_query(CajaSearchEngine *engine,
+                                               CajaQuery *query) {
+  CajaSearchEngineIndex *index;
+
+  index = CAJA_SEARCH_ENGINE_INDEX(engine);
+
+  if (query) {
+    g_object_ref(query);
+  }
+
+  if (index->details->query) {
+    g_object_unref(index->details->query);
+  }
+
+  index->details->query = query;
+}
+
+static void fallback_hits_added(CajaSearchEngine *fallback, GList *hits,
+                                CajaSearchEngine *engine) {
+  caja_search_engine_hits_added(engine, hits);
+}
+
+static void fallback_hit_batches_added(CajaSearchEngine *fallback,
+                                      GList *batches,
+                                      CajaSearchEngine *engine) {
+  caja_search_engine_hit_batches_added(engine, batches);
+}
+
+static void fallback_hits_subtracted(CajaSearchEngine *fallback, GList *hits,
+                                     CajaSearchEngine *engine) {
+  caja_search_engine_hits_subtracted(engine, hits);
+}
+
+static void fallback_finished(CajaSearchEngine *fallback,
+                              CajaSearchEngine *engine) {
+  caja_search_engine_finished(engine);
+}
+
+static void fallback_error(CajaSearchEngine *fallback,
+                           const char *error_message,
+                           CajaSearchEngine *engine) {
+  caja_search_engine_error(engine, error_message);
+}
+
+static void caja_search_engine_index_class_init(
+    CajaSearchEngineIndexClass *class) {
+  GObjectClass *gobject_class;
+  CajaSearchEngineClass *engine_class;
+
+  parent_class = g_type_class_peek_parent(class);
+
+  gobject_class = G_OBJECT_CLASS(class);
+  gobject_class->finalize = finalize;
+
+  engine_class = CAJA_SEARCH_ENGINE_CLASS(class);
+  engine_class->set_query = caja_search_engine_index_set_query;
+  engine_class->start = caja_search_engine_index_start;
+  engine_class->stop = caja_search_engine_index_stop;
+  engine_class->is_indexed = caja_search_engine_index_is_indexed;
+}
+
+static void caja_search_engine_index_init(CajaSearchEngineIndex *engine) {
+  engine->details = g_new0(CajaSearchEngineIndexDetails, 1);
+
+  engine->details->fallback = caja_search_engine_simple_new();
+  g_signal_connect(engine->details->fallback, "hits-added",
+                   G_CALLBACK(fallback_hits_added), engine);
+  g_signal_connect(engine->details->fallback, "hit-batches-added",
+                   G_CALLBACK(fallback_hit_batches_added), engine);
+  g_signal_connect(engine->details->fallback, "hits-subtracted",
+                   G_CALLBACK(fallback_hits_subtracted), engine);
+  g_signal_connect(engine->details->fallback, "finished",
+                   G_CALLBACK(fallback_finished), engine);
+  g_signal_connect(engine->details->fallback, "error",
+                   G_CALLBACK(fallback_error), engine);
+}
+
+CajaSearchEngine *caja_search_engine_index_new(void) {
+  if (!caja_filename_index_is_enabled()) {
+    return NULL;
+  }
+
+  return g_object_new(CAJA_TYPE_SEARCH_ENGINE_INDEX, NULL);
+}
@@ -32,27 +32,109 @@
 #include <glib.h>
 #include <string.h>
 
+#include "caja-file-private.h"
+#include "caja-global-preferences.h"
+#include "caja-odf-text.h"
+#include "caja-search-predicate.h"
+
 #define BATCH_SIZE 500
 
+/* Upper bound for the threads walking the directories. They mostly wait
+   for the file system, so there are more of them than processors. */
+#define SEARCH_MAX_WORKERS 16
+
+/* The visited set is split in this many parts, each with its own lock */
+#define VISITED_SHARDS 16
+
+/* How long a worker without directories waits for the others to find
+   some, before looking again */
+#define SEARCH_IDLE_WAIT_USECS (50 * 1000)
+
+/* Bytes read from a file at a time when searching for text in it */
+#define CONTENT_CHUNK_SIZE (64 * 1024)
+
+/* What a CajaFile is made from, so the enumerated info of a hit can be
+   handed on as it is */
+#define STD_ATTRIBUTES CAJA_FILE_DEFAULT_ATTRIBUTES "," G_FILE_ATTRIBUTE_ID_FILE
+
+typedef struct SearchThreadData SearchThreadData;
+
+typedef struct {
+  /* The text searched for, normalized and in lower case */
+  char *needle;
+  gsize needle_len;
+  /* Whether needle is plain ASCII. The parts of files that are plain ASCII
+     too are then searched as they are, without normalizing them. */
+  gboolean ascii;
+  /* Bytes of a chunk kept for the next one, to find matches across chunks.
+     The normalized lower case text can be shorter than the original. */
+  gsize overlap;
+} ContentMatcher;
+
+/* The state of searching one file */
+typedef struct {
+  ContentMatcher *matcher;
+  /* The end of what was searched last, followed by what is not searched
+     yet */
+  char *buffer;
+  gsize size;
+  gsize len;
+  /* Whether some of buffer is not searched yet */
+  gboolean pending;
+  gboolean found;
+} ContentScan;
+
 typedef struct {
+  GMutex lock;
+  GHashTable *ids;
+} VisitedShard;
+
+typedef struct {
+  SearchThreadData *data;
+  guint index;
+
+  /* GFiles. The worker takes the ones it found last from the tail,
+     the others steal the oldest ones, which have the most below them,
+     from the head. */
+  GMutex lock;
+  GQueue directories;
+
+  gint n_processed_files;
+  /* CajaSearchHitBatches, the one for the directory being visited first */
+  GList *hit_batches;
+
+  CajaSearchScratch scratch;
+} SearchWorker;
+
+struct SearchThreadData {
   CajaSearchEngineSimple *engine;
   GCancellable *cancellable;
 
-  char *contained_text;
-  GList *mime_types;
-  GList *tags;
-  char **words;
-  GList *found_list;
+  /* The query, made ready for matching files against it */
+  CajaSearchPredicate *predicate;
+  /* NULL if there is no text to search for in the files */
+  ContentMatcher *content_matcher;
+  /* What to ask the enumerators for */
+  char *attributes;
 
-  GQueue *directories; /* GFiles */
+  GFile *location;
 
-  GHashTable *visited;
+  SearchWorker *workers;
+  guint n_workers;
 
-  gint n_processed_files;
-  GList *uri_hits;
-  gint64 timestamp;
-  gint64 size;
-} SearchThreadData;
+  VisitedShard visited[VISITED_SHARDS];
+
+  /* Directories queued or being visited. The walk is over when this
+     drops to zero. Only accessed atomically. */
+  gint pending_directories;
+  /* Workers that haven't exited yet. Only accessed atomically. */
+  gint running_workers;
+
+  /* Workers without directories wait here */
+  GMutex idle_lock;
+  GCond idle_cond;
+  gint idle_workers;
+};
 
 struct CajaSearchEngineSimpleDetails {
   CajaQuery *query;
@@ -82,17 +164,78 @@ static void finalize(GObject *object) {
   EEL_CALL_PARENT(G_OBJECT_CLASS, finalize, (object));
 }
 
+static inline gchar *utf8_normalize_strdown(const char *str) {
+  gchar *lower = NULL;
+  gchar *normalized = g_utf8_normalize(str, -1, G_NORMALIZE_DEFAULT);
+
+  if (normalized) lower = g_utf8_strdown(normalized, -1);
+
+  g_free(normalized);
+
+  return lower;
+}
+
+static ContentMatcher *content_matcher_new(const char *text) {
+  ContentMatcher *matcher;
+  gsize i;
+
+  matcher = g_new0(ContentMatcher, 1);
+  matcher->needle = utf8_normalize_strdown(text);
+  if (matcher->needle == NULL) {
+    /* not valid UTF-8, it can't match anything */
+    g_free(matcher);
+    return NULL;
+  }
+
+  matcher->needle_len = strlen(matcher->needle);
+  matcher->ascii = TRUE;
+  for (i = 0; i < matcher->needle_len; i++) {
+    if ((guchar)matcher->needle[i] >= 0x80) {
+      matcher->ascii = FALSE;
+      break;
+    }
+  }
+  /* Lower casing and normalizing shrinks a character to a third at most */
+  matcher->overlap = matcher->needle_len * 4;
+
+  return matcher;
+}
+
+static void content_matcher_free(ContentMatcher *matcher) {
+  g_free(matcher->needle);
+  g_free(matcher);
+}
+
 static SearchThreadData *search_thread_data_new(CajaSearchEngineSimple *engine,
                                                 CajaQuery *query) {
   SearchThreadData *data;
-  char *text, *lower, *normalized, *uri;
+  char *contained_text, *uri;
+  goffset content_max_size;
   GFile *location;
+  guint i;
 
   data = g_new0(SearchThreadData, 1);
 
   data->engine = engine;
-  data->directories = g_queue_new();
-  data->visited = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  data->n_workers =
+      CLAMP(g_get_num_processors() * 2, 2, SEARCH_MAX_WORKERS);
+  data->workers = g_new0(SearchWorker, data->n_workers);
+  for (i = 0; i < data->n_workers; i++) {
+    data->workers[i].data = data;
+    data->workers[i].index = i;
+    g_mutex_init(&data->workers[i].lock);
+    g_queue_init(&data->workers[i].directories);
+    caja_search_scratch_init(&data->workers[i].scratch);
+  }
+  for (i = 0; i < VISITED_SHARDS; i++) {
+    g_mutex_init(&data->visited[i].lock);
+    data->visited[i].ids =
+        g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  }
+  g_mutex_init(&data->idle_lock);
+  g_cond_init(&data->idle_cond);
+
   uri = caja_query_get_location(query);
   location = NULL;
   if (uri != NULL) {
@@ -102,21 +245,28 @@ static SearchThreadData *search_thread_data_new(CajaSearchEngineSimple *engine,
   if (location == NULL) {
     location = g_file_new_for_path("/");
   }
-  g_queue_push_tail(data->directories, location);
-
-  text = caja_query_get_text(query);
-  normalized = g_utf8_normalize(text, -1, G_NORMALIZE_NFD);
-  lower = g_utf8_strdown(normalized, -1);
-  data->words = g_strsplit(lower, " ", -1);
-  g_free(text);
-  g_free(lower);
-  g_free(normalized);
-
-  data->tags = caja_query_get_tags(query);
-  data->mime_types = caja_query_get_mime_types(query);
-  data->timestamp = caja_query_get_timestamp(query);
-  data->size = caja_query_get_size(query);
-  data->contained_text = caja_query_get_contained_text(query);
+  /* The first worker queues it, this keeps the others waiting until then */
+  data->location = location;
+  data->pending_directories = 1;
+  data->running_workers = data->n_workers;
+
+  content_max_size = 0;
+  if (caja_preferences != NULL) {
+    content_max_size =
+        (goffset)g_settings_get_int(caja_preferences,
+                                    CAJA_PREFERENCES_SEARCH_CONTENT_MAX_SIZE) *
+        1024 * 1024;
+  }
+  data->predicate = caja_search_predicate_new(query, content_max_size);
+  data->attributes =
+      g_strconcat(STD_ATTRIBUTES ",",
+                  caja_search_predicate_get_attributes(data->predicate), NULL);
+
+  contained_text = caja_query_get_contained_text(query);
+  if (contained_text != NULL) {
+    data->content_matcher = content_matcher_new(contained_text);
+    g_free(contained_text);
+  }
 
   data->cancellable = g_cancellable_new();
 
@@ -124,15 +274,31 @@ static SearchThreadData *search_thread_data_new(CajaSearchEngineSimple *engine,
 }
 
 static void search_thread_data_free(SearchThreadData *data) {
-  g_queue_foreach(data->directories, (GFunc)g_object_unref, NULL);
-  g_queue_free(data->directories);
-  g_hash_table_destroy(data->visited);
+  guint i;
+
+  for (i = 0; i < data->n_workers; i++) {
+    g_queue_clear_full(&data->workers[i].directories, g_object_unref);
+    g_mutex_clear(&data->workers[i].lock);
+    g_list_free_full(data->workers[i].hit_batches,
+                     (GDestroyNotify)caja_search_hit_batch_free);
+    caja_search_scratch_clear(&data->workers[i].scratch);
+  }
+  g_free(data->workers);
+  for (i = 0; i < VISITED_SHARDS; i++) {
+    g_hash_table_destroy(data->visited[i].ids);
+    g_mutex_clear(&data->visited[i].lock);
+  }
+  g_mutex_clear(&data->idle_lock);
+  g_cond_clear(&data->idle_cond);
+  if (data->location != NULL) {
+    g_object_unref(data->location);
+  }
   g_object_unref(data->cancellable);
-  g_strfreev(data->words);
-  g_list_free_full(data->tags, g_free);
-  g_list_free_full(data->mime_types, g_free);
-  g_list_free_full(data->uri_hits, g_free);
-  g_free(data->contained_text);
+  caja_search_predicate_free(data->predicate);
+  g_free(data->attributes);
+  if (data->content_matcher != NULL) {
+    content_matcher_free(data->content_matcher);
+  }
   g_free(data);
 }
 
@@ -152,7 +318,7 @@ static gboolean search_thread_done_idle(gpointer user_data) {
 }
 
 typedef struct {
-  GList *uris;
+  GList *batches;
   SearchThreadData *thread_data;
 } SearchHits;
 
@@ -162,419 +328,376 @@ static gboolean search_thread_add_hits_idle(gpointer user_data) {
   hits = user_data;
 
   if (!g_cancellable_is_cancelled(hits->thread_data->cancellable)) {
-    caja_search_engine_hits_added(CAJA_SEARCH_ENGINE(hits->thread_data->engine),
-                                  hits->uris);
+    caja_search_engine_hit_batches_added(
+        CAJA_SEARCH_ENGINE(hits->thread_data->engine), hits->batches);
   }
 
-  g_list_free_full(hits->uris, g_free);
+  g_list_free_full(hits->batches, (GDestroyNotify)caja_search_hit_batch_free);
   g_free(hits);
 
   return FALSE;
 }
 
-static void send_batch(SearchThreadData *data) {
-  data->n_processed_files = 0;
+static void send_batch(SearchWorker *worker) {
+  worker->n_processed_files = 0;
 
-  if (data->uri_hits) {
+  if (worker->hit_batches) {
     SearchHits *hits;
 
     hits = g_new(SearchHits, 1);
-    hits->uris = data->uri_hits;
-    hits->thread_data = data;
+    hits->batches = worker->hit_batches;
+    hits->thread_data = worker->data;
     g_idle_add(search_thread_add_hits_idle, hits);
   }
-  data->uri_hits = NULL;
+  worker->hit_batches = NULL;
 }
 
-#define G_FILE_ATTRIBUTE_XATTR_XDG_TAGS "xattr::xdg.tags"
-
-#define STD_ATTRIBUTES                                                      \
-  G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME \
-                                 "," G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN    \
-                                 "," G_FILE_ATTRIBUTE_STANDARD_TYPE         \
-                                 "," G_FILE_ATTRIBUTE_ID_FILE
-
-/* Stolen code
- * file: glocalfileinfo.c
- * function: hex_unescape_string
- * GIO - GLib Input, Output and Streaming Library
+/* Queues a hit in dir for the next batch, with the info it was
+ * enumerated with.
  */
-static char *hex_unescape_string(const char *str, int *out_len,
-                                 gboolean *free_return) {
-  int i;
-  char *unescaped_str, *p;
-  unsigned char c;
-  int len;
-
-  len = strlen(str);
-
-  if (strchr(str, '\\') == NULL) {
-    if (out_len) *out_len = len;
-    *free_return = FALSE;
-    return (char *)str;
-  }
-
-  unescaped_str = g_malloc(len + 1);
-
-  p = unescaped_str;
-  for (i = 0; i < len; i++) {
-    if (str[i] == '\\' && str[i + 1] == 'x' && len - i >= 4) {
-      c = (g_ascii_xdigit_value(str[i + 2]) << 4) |
-          g_ascii_xdigit_value(str[i + 3]);
-      *p++ = c;
-      i += 3;
-    } else
-      *p++ = str[i];
-  }
-  *p++ = 0;
-
-  if (out_len) *out_len = p - unescaped_str;
-  *free_return = TRUE;
-  return unescaped_str;
+static void add_hit(SearchWorker *worker, GFile *dir, GFileInfo *info) {
+  CajaSearchHitBatch *batch;
+
+  batch = worker->hit_batches != NULL ? worker->hit_batches->data : NULL;
+  if (batch == NULL || batch->parent != dir) {
+    batch = caja_search_hit_batch_new(dir);
+    worker->hit_batches = g_list_prepend(worker->hit_batches, batch);
+  }
+  batch->infos = g_list_prepend(batch->infos, g_object_ref(info));
 }
-/* End of stolen code */
 
-static inline gchar **get_tags_from_info(GFileInfo *info) {
-  char **result;
-  const gchar *escaped_tags_string =
-      g_file_info_get_attribute_string(info, G_FILE_ATTRIBUTE_XATTR_XDG_TAGS);
+/* Adds id to the visited set. Returns FALSE if it was there already. */
+static gboolean mark_visited(SearchThreadData *data, const char *id) {
+  VisitedShard *shard;
+  gboolean added;
 
-  gboolean new_created;
-  gchar *tags_string =
-      hex_unescape_string(escaped_tags_string, NULL, &new_created);
+  shard = &data->visited[g_str_hash(id) % VISITED_SHARDS];
 
-  gchar *normalized = g_utf8_normalize(tags_string, -1, G_NORMALIZE_NFD);
+  g_mutex_lock(&shard->lock);
+  added = !g_hash_table_contains(shard->ids, id);
+  if (added) {
+    g_hash_table_add(shard->ids, g_strdup(id));
+  }
+  g_mutex_unlock(&shard->lock);
 
-  if (new_created) g_free(tags_string);
+  return added;
+}
 
-  gchar *lower_case = g_utf8_strdown(normalized, -1);
-  g_free(normalized);
+static void queue_directory(SearchWorker *worker, GFile *dir) {
+  SearchThreadData *data;
 
-  result = g_strsplit(lower_case, ",", -1);
-  g_free(lower_case);
+  data = worker->data;
 
-  return result;
-}
+  g_atomic_int_inc(&data->pending_directories);
 
-static inline gboolean file_has_all_tags(GFileInfo *info, GList *tags) {
-  if (g_list_length(tags) == 0) {
-    return TRUE;
+  g_mutex_lock(&worker->lock);
+  g_queue_push_tail(&worker->directories, g_object_ref(dir));
+  g_mutex_unlock(&worker->lock);
+
+  if (g_atomic_int_get(&data->idle_workers) > 0) {
+    g_mutex_lock(&data->idle_lock);
+    g_cond_signal(&data->idle_cond);
+    g_mutex_unlock(&data->idle_lock);
   }
+}
 
-  if (!g_file_info_has_attribute(info, G_FILE_ATTRIBUTE_XATTR_XDG_TAGS)) {
-    return FALSE;
+/* Returns the next directory for worker to visit: one it found itself, or
+   else one stolen from another worker. */
+static GFile *take_directory(SearchWorker *worker) {
+  SearchThreadData *data;
+  SearchWorker *victim;
+  GFile *dir;
+  guint i;
+
+  data = worker->data;
+
+  g_mutex_lock(&worker->lock);
+  dir = g_queue_pop_tail(&worker->directories);
+  g_mutex_unlock(&worker->lock);
+
+  for (i = 1; dir == NULL && i < data->n_workers; i++) {
+    victim = &data->workers[(worker->index + i) % data->n_workers];
+    g_mutex_lock(&victim->lock);
+    dir = g_queue_pop_head(&victim->directories);
+    g_mutex_unlock(&victim->lock);
   }
 
-  char **file_tags = get_tags_from_info(info);
+  return dir;
+}
 
-  guint file_tags_len = g_strv_length(file_tags);
-  if (file_tags_len < g_list_length(tags)) {
-    g_strfreev(file_tags);
-    return FALSE;
+static gboolean content_matcher_search(ContentMatcher *matcher,
+                                       const char *text, gsize len) {
+  gchar *valid, *lower;
+  gboolean found;
+
+  if (caja_search_text_is_ascii(text, len)) {
+    /* Normalizing plain ASCII leaves it as it is, and lower casing it
+       only changes the ASCII case */
+    return matcher->ascii &&
+           caja_search_text_find_ascii_caseless(text, len, matcher->needle,
+                                                matcher->needle_len);
   }
 
-  GList *l;
+  valid = g_utf8_make_valid(text, len);
+  lower = utf8_normalize_strdown(valid);
+  found = lower != NULL && strstr(lower, matcher->needle) != NULL;
+  g_free(lower);
+  g_free(valid);
 
-  for (l = tags; l != NULL; l = l->next) {
-    gboolean found = FALSE;
-    int i;
+  return found;
+}
 
-    for (i = 0; i < file_tags_len; ++i) {
-      if (g_strcmp0(l->data, file_tags[i]) == 0) {
-        found = TRUE;
-        break;
-      }
-    }
+/* Returns the length of text without an incomplete character at its end */
+static gsize get_complete_length(const char *text, gsize len) {
+  gsize i, needed;
+  guchar c;
 
-    if (found == FALSE) {
-      g_strfreev(file_tags);
-      return FALSE;
+  for (i = 1; i <= 4 && i <= len; i++) {
+    c = text[len - i];
+    if ((c & 0xc0) != 0x80) {
+      needed = c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 1;
+      return needed > i ? len - i : len;
     }
   }
 
-  g_strfreev(file_tags);
-  return TRUE;
+  return len;
+}
+
+static void content_scan_init(ContentScan *scan, ContentMatcher *matcher) {
+  scan->matcher = matcher;
+  /* room for a chunk after the overlap and at most 3 bytes of a character */
+  scan->size = matcher->overlap + 4 + CONTENT_CHUNK_SIZE;
+  scan->buffer = g_malloc(scan->size);
+  scan->len = 0;
+  scan->pending = FALSE;
+  scan->found = FALSE;
 }
 
-static inline gboolean check_odt2txt(void) {
-  gboolean rc = TRUE;
-  int exit = 0;
-  gchar *output = NULL;
+/* Searches what is in the buffer, and keeps only its end for the next time */
+static void content_scan_search(ContentScan *scan) {
+  gsize end, start;
 
-  gboolean cmd_rc = g_spawn_command_line_sync("odt2txt --version", &output,
-                                              NULL, &exit, NULL);
+  end = get_complete_length(scan->buffer, scan->len);
+  scan->found = content_matcher_search(scan->matcher, scan->buffer, end);
+  scan->pending = FALSE;
 
-  if (!cmd_rc || exit != 0 || !output || !g_str_has_prefix(output, "odt2txt")) {
-    rc = FALSE;
+  start = end > scan->matcher->overlap ? end - scan->matcher->overlap : 0;
+  while (start < end && (scan->buffer[start] & 0xc0) == 0x80) {
+    start++;
   }
-
-  g_free(output);
-  return rc;
+  scan->len -= start;
+  memmove(scan->buffer, scan->buffer + start, scan->len);
 }
 
-static inline gchar *read_odt(const char *filepath) {
-  gchar *command = g_strdup_printf("odt2txt \"%s\"", filepath);
-  gchar *output = NULL;
-  int exit = 0;
+/* A CajaOdfTextFunc */
+static gboolean content_scan_feed(const char *text, gsize len,
+                                  gpointer user_data) {
+  ContentScan *scan;
+  gsize n;
 
-  gboolean rc = g_spawn_command_line_sync(command, &output, NULL, &exit, NULL);
-  if (!rc || exit != 0) {
-    g_free(output);
-    g_free(command);
-    return NULL;
+  scan = user_data;
+
+  while (len > 0 && !scan->found) {
+    n = MIN(len, scan->size - scan->len);
+    memcpy(scan->buffer + scan->len, text, n);
+    scan->len += n;
+    scan->pending = TRUE;
+    text += n;
+    len -= n;
+
+    if (scan->len == scan->size) {
+      content_scan_search(scan);
+    }
   }
 
-  g_free(command);
-  return output;
+  return !scan->found;
 }
 
-static inline gchar *utf8_normalize_strdown(const char *str) {
-  gchar *lower = NULL;
-  gchar *normalized = g_utf8_normalize(str, -1, G_NORMALIZE_DEFAULT);
+static void content_scan_read(ContentScan *scan, GInputStream *stream,
+                              GCancellable *cancellable) {
+  gssize n_read;
 
-  if (normalized) lower = g_utf8_strdown(normalized, -1);
+  while (!scan->found) {
+    n_read = g_input_stream_read(stream, scan->buffer + scan->len,
+                                 scan->size - scan->len, cancellable, NULL);
+    if (n_read <= 0) {
+      break;
+    }
 
-  g_free(normalized);
+    scan->len += n_read;
+    scan->pending = TRUE;
+    if (scan->len == scan->size) {
+      content_scan_search(scan);
+    }
+  }
+}
 
-  return lower;
+static gboolean content_scan_finish(ContentScan *scan) {
+  if (scan->pending && !scan->found) {
+    content_scan_search(scan);
+  }
+  g_free(scan->buffer);
+
+  return scan->found;
 }
 
-static inline gboolean is_file_has_str(const char *filepath, const char *str,
-                                       const char *mime_type,
-                                       gboolean odt2txt_available) {
-  gboolean rc = TRUE;
-  gchar *contents = NULL;
-  gchar *lower_contents = NULL;
-  gchar *lower_str = NULL;
+/* Looks for the text of matcher in file a chunk at a time, until it turns
+ * up. Each chunk is searched together with the end of the one before it.
+ */
+static gboolean file_contains_text(ContentMatcher *matcher, GFile *file,
+                                   gboolean document,
+                                   GCancellable *cancellable) {
+  GInputStream *stream;
+  ContentScan scan;
 
-  if (str[0] == '\0') {
+  if (matcher->needle_len == 0) {
     return TRUE;
   }
 
-  if (g_content_type_is_mime_type(mime_type, "text/plain")) {
-    rc = g_file_get_contents(filepath, &contents, NULL, NULL);
-  } else {
-    if (!odt2txt_available) {
-      g_warning("Can't search in file '%s'. odt2txt not found.", filepath);
-      rc = FALSE;
-    } else {
-      contents = read_odt(filepath);
-      if (!contents) rc = FALSE;
-    }
-  }
+  content_scan_init(&scan, matcher);
 
-  if (rc) {
-    lower_str = utf8_normalize_strdown(str);
-    lower_contents = utf8_normalize_strdown(contents);
-
-    if (lower_str && lower_contents && strstr(lower_contents, lower_str))
-      rc = TRUE;
-    else
-      rc = FALSE;
+  if (!document) {
+    stream = G_INPUT_STREAM(g_file_read(file, cancellable, NULL));
+    if (stream != NULL) {
+      content_scan_read(&scan, stream, cancellable);
+      g_object_unref(stream);
+    }
+  } else {
+    caja_odf_text_read(file, content_scan_feed, &scan, cancellable);
   }
 
-  g_free(contents);
-  g_free(lower_str);
-  g_free(lower_contents);
-
-  return rc;
+  return content_scan_finish(&scan);
 }
 
-static void visit_directory(GFile *dir, SearchThreadData *data) {
+static void visit_directory(GFile *dir, SearchWorker *worker) {
+  SearchThreadData *data = worker->data;
   GFileEnumerator *enumerator;
   GFileInfo *info;
   GFile *child;
-  const char *mime_type, *display_name;
-  char *lower_name, *normalized;
-  gboolean hit;
-  int i;
-  GList *l;
+  CajaSearchPredicateResult result;
+  gboolean hit, is_directory;
   const char *id;
-  gboolean visited;
-  GTimeVal result;
-  gchar *attributes;
-  GString *attr_string;
-  gchar *filepath = NULL;
-  gboolean odt2txt_available = FALSE;
-
-  attr_string = g_string_new(STD_ATTRIBUTES);
-  if (data->mime_types != NULL || data->contained_text != NULL) {
-    g_string_append(attr_string, "," G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE);
-  }
-  if (data->tags != NULL) {
-    g_string_append(attr_string, "," G_FILE_ATTRIBUTE_XATTR_XDG_TAGS);
-  }
-  if (data->timestamp != 0) {
-    g_string_append(attr_string, "," G_FILE_ATTRIBUTE_TIME_MODIFIED
-                                 "," G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
-  }
-  if (data->size != 0) {
-    g_string_append(attr_string, "," G_FILE_ATTRIBUTE_STANDARD_SIZE);
-  }
-
-  if (data->contained_text != NULL) {
-    odt2txt_available = check_odt2txt();
-  }
 
-  attributes = g_string_free(attr_string, FALSE);
-  enumerator = g_file_enumerate_children(dir, (const char *)attributes, 0,
+  enumerator = g_file_enumerate_children(dir, data->attributes, 0,
                                          data->cancellable, NULL);
-
-  g_free(attributes);
   if (enumerator == NULL) {
     return;
   }
 
   while ((info = g_file_enumerator_next_file(enumerator, data->cancellable,
                                              NULL)) != NULL) {
-    if (g_file_info_get_is_hidden(info)) {
+    if (g_file_info_get_is_hidden(info) ||
+        g_file_info_get_display_name(info) == NULL) {
       goto next;
     }
 
-    display_name = g_file_info_get_display_name(info);
-    if (display_name == NULL) {
-      goto next;
-    }
-
-    normalized = g_utf8_normalize(display_name, -1, G_NORMALIZE_NFD);
-    lower_name = g_utf8_strdown(normalized, -1);
-    g_free(normalized);
-
-    hit = TRUE;
-    for (i = 0; data->words[i] != NULL; i++) {
-      if (strstr(lower_name, data->words[i]) == NULL) {
-        hit = FALSE;
-        break;
-      }
-    }
-    g_free(lower_name);
-
-    if (hit && data->mime_types) {
-      mime_type = g_file_info_get_content_type(info);
-      hit = FALSE;
+    result =
+        caja_search_predicate_match(data->predicate, info, &worker->scratch);
+    is_directory = g_file_info_get_file_type(info) == G_FILE_TYPE_DIRECTORY;
 
-      for (l = data->mime_types; mime_type != NULL && l != NULL; l = l->next) {
-        if (g_content_type_equals(mime_type, l->data)) {
-          hit = TRUE;
-          break;
-        }
-      }
-    }
-
-    if (hit && data->tags) {
-      hit = file_has_all_tags(info, data->tags);
-    }
-
-    if (hit && data->timestamp != 0) {
-      g_file_info_get_modification_time(info, &result);
-      if (data->timestamp > 0) {
-        if (data->timestamp < result.tv_sec) hit = FALSE;
-      } else {
-        if (result.tv_sec < ABS(data->timestamp)) hit = FALSE;
-      }
-    }
-
-    if (hit && data->size != 0) {
-      gint64 file_size = g_file_info_get_size(info);
-      if (data->size > 0) {
-        if (file_size < data->size) hit = FALSE;
-      } else {
-        if (ABS(data->size) < file_size) hit = FALSE;
-      }
+    /* Most files neither match nor need visiting */
+    if (result == CAJA_SEARCH_PREDICATE_NO_MATCH && !is_directory) {
+      worker->n_processed_files++;
+      goto next;
     }
 
     child = g_file_get_child(dir, g_file_info_get_name(info));
 
-    if (hit && data->contained_text) {
-      mime_type = g_file_info_get_content_type(info);
-
-      if (g_content_type_is_mime_type(mime_type, "text/plain") ||
-          g_content_type_equals(mime_type,
-                                "application/vnd.oasis.opendocument.text") ||
-          g_content_type_equals(
-              mime_type, "application/vnd.oasis.opendocument.text-template") ||
-          g_content_type_equals(
-              mime_type, "application/vnd.oasis.opendocument.spreadsheet") ||
-          g_content_type_equals(
-              mime_type,
-              "application/vnd.oasis.opendocument.spreadsheet-template") ||
-          g_content_type_equals(
-              mime_type, "application/vnd.oasis.opendocument.presentation") ||
-          g_content_type_equals(
-              mime_type,
-              "application/vnd.oasis.opendocument.presentation-template")) {
-        g_free(filepath);
-        filepath = g_file_get_path(child);
-        hit = is_file_has_str(filepath, data->contained_text, mime_type,
-                              odt2txt_available);
-      } else {
-        hit = FALSE;
-      }
+    hit = result == CAJA_SEARCH_PREDICATE_MATCH;
+    if (result == CAJA_SEARCH_PREDICATE_READ_TEXT ||
+        result == CAJA_SEARCH_PREDICATE_READ_DOCUMENT) {
+      hit = data->content_matcher != NULL &&
+            file_contains_text(data->content_matcher, child,
+                               result == CAJA_SEARCH_PREDICATE_READ_DOCUMENT,
+                               data->cancellable);
     }
 
     if (hit) {
-      data->uri_hits = g_list_prepend(data->uri_hits, g_file_get_uri(child));
+      add_hit(worker, dir, info);
     }
 
-    data->n_processed_files++;
-    if (data->n_processed_files > BATCH_SIZE) {
-      send_batch(data);
-    }
+    worker->n_processed_files++;
 
-    if (g_file_info_get_file_type(info) == G_FILE_TYPE_DIRECTORY) {
+    if (is_directory) {
       id = g_file_info_get_attribute_string(info, G_FILE_ATTRIBUTE_ID_FILE);
-      visited = FALSE;
-      if (id) {
-        if (g_hash_table_lookup_extended(data->visited, id, NULL, NULL)) {
-          visited = TRUE;
-        } else {
-          g_hash_table_insert(data->visited, g_strdup(id), NULL);
-        }
-      }
-
-      if (!visited) {
-        g_queue_push_tail(data->directories, g_object_ref(child));
+      if (id == NULL || mark_visited(data, id)) {
+        queue_directory(worker, child);
       }
     }
 
     g_object_unref(child);
   next:
+    if (worker->n_processed_files > BATCH_SIZE) {
+      send_batch(worker);
+    }
     g_object_unref(info);
   }
 
-  g_free(filepath);
   g_object_unref(enumerator);
 }
 
 static gpointer search_thread_func(gpointer user_data) {
+  SearchWorker *worker;
   SearchThreadData *data;
   GFile *dir;
   GFileInfo *info;
 
-  data = user_data;
+  worker = user_data;
+  data = worker->data;
 
-  /* Insert id for toplevel directory into visited */
-  dir = g_queue_peek_head(data->directories);
-  info = g_file_query_info(dir, G_FILE_ATTRIBUTE_ID_FILE, 0, data->cancellable,
-                           NULL);
-  if (info) {
-    const char *id;
+  if (worker->index == 0) {
+    /* Insert id for toplevel directory into visited */
+    info = g_file_query_info(data->location, G_FILE_ATTRIBUTE_ID_FILE, 0,
+                             data->cancellable, NULL);
+    if (info) {
+      const char *id;
 
-    id = g_file_info_get_attribute_string(info, G_FILE_ATTRIBUTE_ID_FILE);
-    if (id) {
-      g_hash_table_insert(data->visited, g_strdup(id), NULL);
+      id = g_file_info_get_attribute_string(info, G_FILE_ATTRIBUTE_ID_FILE);
+      if (id) {
+        mark_visited(data, id);
+      }
+      g_object_unref(info);
     }
-    g_object_unref(info);
+
+    /* pending_directories counts it already */
+    g_mutex_lock(&worker->lock);
+    g_queue_push_tail(&worker->directories, g_object_ref(data->location));
+    g_mutex_unlock(&worker->lock);
   }
 
-  while (!g_cancellable_is_cancelled(data->cancellable) &&
-         (dir = g_queue_pop_head(data->directories)) != NULL) {
-    visit_directory(dir, data);
-    g_object_unref(dir);
+  while (!g_cancellable_is_cancelled(data->cancellable)) {
+    dir = take_directory(worker);
+    if (dir != NULL) {
+      visit_directory(dir, worker);
+      g_object_unref(dir);
+
+      if (g_atomic_int_dec_and_test(&data->pending_directories)) {
+        /* That was the last one, let the idle workers exit */
+        g_mutex_lock(&data->idle_lock);
+        g_cond_broadcast(&data->idle_cond);
+        g_mutex_unlock(&data->idle_lock);
+      }
+      continue;
+    }
+
+    if (g_atomic_int_get(&data->pending_directories) == 0) {
+      break;
+    }
+
+    /* The others are still visiting directories and may find more. The
+       wait is short, so cancelling stays quick. */
+    g_mutex_lock(&data->idle_lock);
+    g_atomic_int_inc(&data->idle_workers);
+    g_cond_wait_until(&data->idle_cond, &data->idle_lock,
+                      g_get_monotonic_time() + SEARCH_IDLE_WAIT_USECS);
+    g_atomic_int_add(&data->idle_workers, -1);
+    g_mutex_unlock(&data->idle_lock);
   }
-  send_batch(data);
+  send_batch(worker);
 
-  g_idle_add(search_thread_done_idle, data);
+  if (g_atomic_int_dec_and_test(&data->running_workers)) {
+    g_idle_add(search_thread_done_idle, data);
+  }
 
   return NULL;
 }
@@ -583,6 +706,7 @@ static void caja_search_engine_simple_start(CajaSearchEngine *engine) {
   CajaSearchEngineSimple *simple;
   SearchThreadData *data;
   GThread *thread;
+  guint i;
 
   simple = CAJA_SEARCH_ENGINE_SIMPLE(engine);
 
@@ -595,11 +719,13 @@ static void caja_search_engine_simple_start(CajaSearchEngine *engine) {
   }
 
   data = search_thread_data_new(simple, simple->details->query);
-
-  thread = g_thread_new("caja-search-simple", search_thread_func, data);
   simple->details->active_search = data;
 
-  g_thread_unref(thread);
+  for (i = 0; i < data->n_workers; i++) {
+    thread = g_thread_new("caja-search-simple", search_thread_func,
+                          &data->workers[i]);
+    g_thread_unref(thread);
+  }
 }
 
 static void caja_search_engine_simple_stop(CajaSearchEngine *engine) {
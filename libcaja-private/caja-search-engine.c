@@ -30,6 +30,7 @@
 #include <eel/eel-gtk-macros.h>
 
 #include "caja-search-engine-beagle.h"
+#include "caja-search-engine-index.h"
 #include "caja-search-engine-simple.h"
 #include "caja-search-engine-tracker.h"
 
@@ -37,7 +38,14 @@ struct CajaSearchEngineDetails {
   int none;
 };
 
-enum { HITS_ADDED, HITS_SUBTRACTED, FINISHED, ERROR, LAST_SIGNAL };
+enum {
+  HITS_ADDED,
+  HIT_BATCHES_ADDED,
+  HITS_SUBTRACTED,
+  FINISHED,
+  ERROR,
+  LAST_SIGNAL
+};
 
 static guint signals[LAST_SIGNAL] = {0};
 
@@ -68,6 +76,12 @@ static void caja_search_engine_class_init(CajaSearchEngineClass *class) {
       G_STRUCT_OFFSET(CajaSearchEngineClass, hits_added), NULL, NULL,
       g_cclosure_marshal_VOID__POINTER, G_TYPE_NONE, 1, G_TYPE_POINTER);
 
+  /* Like hits-added, for engines that have the file info of their hits */
+  signals[HIT_BATCHES_ADDED] = g_signal_new(
+      "hit-batches-added", G_TYPE_FROM_CLASS(class), G_SIGNAL_RUN_LAST,
+      G_STRUCT_OFFSET(CajaSearchEngineClass, hit_batches_added), NULL, NULL,
+      g_cclosure_marshal_VOID__POINTER, G_TYPE_NONE, 1, G_TYPE_POINTER);
+
   signals[HITS_SUBTRACTED] = g_signal_new(
       "hits-subtracted", G_TYPE_FROM_CLASS(class), G_SIGNAL_RUN_LAST,
       G_STRUCT_OFFSET(CajaSearchEngineClass, hits_subtracted), NULL, NULL,
@@ -91,6 +105,12 @@ static void caja_search_engine_init(CajaSearchEngine *engine) {
 CajaSearchEngine *caja_search_engine_new(void) {
   CajaSearchEngine *engine;
 
+  /* The user chose the folders to index */
+  engine = caja_search_engine_index_new();
+  if (engine) {
+    return engine;
+  }
+
   engine = caja_search_engine_tracker_new();
   if (engine) {
     return engine;
@@ -140,6 +160,13 @@ void caja_search_engine_hits_added(CajaSearchEngine *engine, GList *hits) {
   g_signal_emit(engine, signals[HITS_ADDED], 0, hits);
 }
 
+void caja_search_engine_hit_batches_added(CajaSearchEngine *engine,
+                                          GList *batches) {
+  g_return_if_fail(CAJA_IS_SEARCH_ENGINE(engine));
+
+  g_signal_emit(engine, signals[HIT_BATCHES_ADDED], 0, batches);
+}
+
 void caja_search_engine_hits_subtracted(CajaSearchEngine *engine, GList *hits) {
   g_return_if_fail(CAJA_IS_SEARCH_ENGINE(engine));
 
@@ -158,3 +185,18 @@ void caja_search_engine_error(CajaSearchEngine *engine,
 
   g_signal_emit(engine, signals[ERROR], 0, error_message);
 }
+
+CajaSearchHitBatch *caja_search_hit_batch_new(GFile *parent) {
+  CajaSearchHitBatch *batch;
+
+  batch = g_new0(CajaSearchHitBatch, 1);
+  batch->parent = g_object_ref(parent);
+
+  return batch;
+}
+
+void caja_search_hit_batch_free(CajaSearchHitBatch *batch) {
+  g_object_unref(batch->parent);
+  g_list_free_full(batch->infos, g_object_unref);
+  g_free(batch);
+}
@@ -24,6 +24,7 @@
 #ifndef CAJA_SEARCH_ENGINE_H
 #define CAJA_SEARCH_ENGINE_H
 
+#include <gio/gio.h>
 #include <glib-object.h>
 
 #include "caja-query.h"
@@ -44,6 +45,14 @@
 
 typedef struct CajaSearchEngineDetails CajaSearchEngineDetails;
 
+/* Hits in one folder, with the file info the engine got while looking for
+   them, so that they don't have to be queried again */
+typedef struct {
+  GFile *parent;
+  /* GFileInfos with CAJA_FILE_DEFAULT_ATTRIBUTES */
+  GList *infos;
+} CajaSearchHitBatch;
+
 typedef struct CajaSearchEngine {
   GObject parent;
   CajaSearchEngineDetails *details;
@@ -60,6 +69,7 @@ typedef struct {
 
   /* Signals */
   void (*hits_added)(CajaSearchEngine *engine, GList *hits);
+  void (*hit_batches_added)(CajaSearchEngine *engine, GList *batches);
   void (*hits_subtracted)(CajaSearchEngine *engine, GList *hits);
   void (*finished)(CajaSearchEngine *engine);
   void (*error)(CajaSearchEngine *engine, const char *error_message);
@@ -76,9 +86,14 @@ void caja_search_engine_stop(CajaSearchEngine *engine);
 gboolean caja_search_engine_is_indexed(CajaSearchEngine *engine);
 
 void caja_search_engine_hits_added(CajaSearchEngine *engine, GList *hits);
+void caja_search_engine_hit_batches_added(CajaSearchEngine *engine,
+                                          GList *batches);
 void caja_search_engine_hits_subtracted(CajaSearchEngine *engine, GList *hits);
 void caja_search_engine_finished(CajaSearchEngine *engine);
 void caja_search_engine_error(CajaSearchEngine *engine,
                               const char *error_message);
 
+CajaSearchHitBatch *caja_search_hit_batch_new(GFile *parent);
+void caja_search_hit_batch_free(CajaSearchHitBatch *batch);
+
 #endif /* CAJA_SEARCH_ENGINE_H */
@@ -0,0 +1,569 @@
+/*
+   caja-search-predicate.c: Matching files against a search query.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include <config.h>
+
+#include "caja-search-predicate.h"
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+typedef struct {
+  /* Decomposed and in lower case */
+  char *text;
+  gsize len;
+  gboolean ascii;
+} SearchWord;
+
+struct CajaSearchPredicate {
+  char *attributes;
+
+  /* The query can't match anything */
+  gboolean impossible;
+
+  SearchWord *words;
+  guint n_words;
+
+  /* The types of the query and their aliases, NULL for any type */
+  GHashTable *mime_types;
+
+  /* Folded tag -> its number, counting from 1 */
+  GHashTable *tags;
+  guint n_tags;
+
+  gint64 timestamp;
+  gint64 size;
+
+  /* Type -> CajaSearchPredicateResult for the types that can be searched
+     for text, NULL if the query has no text to search for */
+  GHashTable *content_types;
+  goffset content_max_size;
+};
+
+static const char *document_types[] = {
+    "application/vnd.oasis.opendocument.text",
+    "application/vnd.oasis.opendocument.text-template",
+    "application/vnd.oasis.opendocument.spreadsheet",
+    "application/vnd.oasis.opendocument.spreadsheet-template",
+    "application/vnd.oasis.opendocument.presentation",
+    "application/vnd.oasis.opendocument.presentation-template"};
+
+gboolean caja_search_text_is_ascii(const char *text, gsize len) {
+  gsize i;
+
+  i = 0;
+#ifdef __SSE2__
+  for (; i + 16 <= len; i += 16) {
+    if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(text + i))) != 0) {
+      return FALSE;
+    }
+  }
+#endif
+  for (; i < len; i++) {
+    if ((guchar)text[i] >= 0x80) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+gboolean caja_search_text_find_ascii_caseless(const char *text, gsize len,
+                                              const char *needle,
+                                              gsize needle_len) {
+  gsize i, last;
+
+  if (needle_len == 0) {
+    return TRUE;
+  }
+  if (needle_len > len) {
+    return FALSE;
+  }
+
+  i = 0;
+  last = needle_len - 1;
+#ifdef __SSE2__
+  {
+    __m128i first_lower, first_upper, last_lower, last_upper;
+    __m128i block_first, block_last, candidates;
+    guint mask;
+
+    first_lower = _mm_set1_epi8(needle[0]);
+    first_upper = _mm_set1_epi8(g_ascii_toupper(needle[0]));
+    last_lower = _mm_set1_epi8(needle[last]);
+    last_upper = _mm_set1_epi8(g_ascii_toupper(needle[last]));
+
+    /* Checks the first and the last byte for 16 positions at once, and
+       compares the rest only where both fit */
+    for (; i + last + 16 <= len; i += 16) {
+      block_first = _mm_loadu_si128((const __m128i *)(text + i));
+      block_last = _mm_loadu_si128((const __m128i *)(text + i + last));
+      candidates = _mm_and_si128(
+          _mm_or_si128(_mm_cmpeq_epi8(block_first, first_lower),
+                       _mm_cmpeq_epi8(block_first, first_upper)),
+          _mm_or_si128(_mm_cmpeq_epi8(block_last, last_lower),
+                       _mm_cmpeq_epi8(block_last, last_upper)));
+
+      mask = _mm_movemask_epi8(candidates);
+      while (mask != 0) {
+        if (g_ascii_strncasecmp(text + i + g_bit_nth_lsf(mask, -1), needle,
+                                needle_len) == 0) {
+          return TRUE;
+        }
+        mask &= mask - 1;
+      }
+    }
+  }
+#endif
+  for (; i + last < len; i++) {
+    if (g_ascii_tolower(text[i]) == needle[0] &&
+        g_ascii_strncasecmp(text + i, needle, needle_len) == 0) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+void caja_search_scratch_init(CajaSearchScratch *scratch) {
+  scratch->text = g_string_sized_new(256);
+  scratch->folded = g_string_sized_new(256);
+  scratch->chars = g_array_sized_new(FALSE, FALSE, sizeof(gunichar), 256);
+  scratch->found_tags = g_array_new(FALSE, TRUE, sizeof(gboolean));
+}
+
+void caja_search_scratch_clear(CajaSearchScratch *scratch) {
+  g_string_free(scratch->text, TRUE);
+  g_string_free(scratch->folded, TRUE);
+  g_array_free(scratch->chars, TRUE);
+  g_array_free(scratch->found_tags, TRUE);
+}
+
+/* Puts text into scratch->folded decomposed and in lower case, like
+ * g_utf8_normalize() with G_NORMALIZE_NFD followed by g_utf8_strdown()
+ * would, but into buffers that are already there. Returns FALSE if text
+ * isn't valid UTF-8.
+ */
+static gboolean fold_text(const char *text, gsize len,
+                          CajaSearchScratch *scratch) {
+  gunichar decomposition[G_UNICHAR_MAX_DECOMPOSITION_LENGTH];
+  gunichar c, *chars;
+  const char *p, *end;
+  gsize n, i, j;
+  int class;
+
+  g_array_set_size(scratch->chars, 0);
+
+  end = text + len;
+  for (p = text; p < end; p = g_utf8_next_char(p)) {
+    c = g_utf8_get_char_validated(p, end - p);
+    if (c == (gunichar)-1 || c == (gunichar)-2) {
+      return FALSE;
+    }
+
+    n = g_unichar_fully_decompose(c, FALSE, decomposition,
+                                  G_N_ELEMENTS(decomposition));
+    for (i = 0; i < n; i++) {
+      c = g_unichar_tolower(decomposition[i]);
+      g_array_append_val(scratch->chars, c);
+
+      /* Combining marks go in the canonical order */
+      class = g_unichar_combining_class(c);
+      if (class != 0) {
+        chars = (gunichar *)scratch->chars->data;
+        for (j = scratch->chars->len - 1;
+             j > 0 && g_unichar_combining_class(chars[j - 1]) > class; j--) {
+          chars[j] = chars[j - 1];
+        }
+        chars[j] = c;
+      }
+    }
+  }
+
+  g_string_truncate(scratch->folded, 0);
+  chars = (gunichar *)scratch->chars->data;
+  for (i = 0; i < scratch->chars->len; i++) {
+    g_string_append_unichar(scratch->folded, chars[i]);
+  }
+
+  return TRUE;
+}
+
+static void add_words(CajaSearchPredicate *predicate, const char *text,
+                      CajaSearchScratch *scratch) {
+  GArray *words;
+  SearchWord word;
+  char **split;
+  int i;
+
+  if (text == NULL) {
+    return;
+  }
+  if (!fold_text(text, strlen(text), scratch)) {
+    predicate->impossible = TRUE;
+    return;
+  }
+
+  words = g_array_new(FALSE, FALSE, sizeof(SearchWord));
+  split = g_strsplit(scratch->folded->str, " ", -1);
+  for (i = 0; split[i] != NULL; i++) {
+    /* Every name contains an empty word */
+    if (split[i][0] == '\0') {
+      continue;
+    }
+
+    word.text = g_strdup(split[i]);
+    word.len = strlen(word.text);
+    word.ascii = caja_search_text_is_ascii(word.text, word.len);
+    g_array_append_val(words, word);
+  }
+  g_strfreev(split);
+
+  predicate->n_words = words->len;
+  predicate->words = (SearchWord *)g_array_free(words, FALSE);
+}
+
+/* Adds type and all the known types that are the same to set, with value */
+static void add_equal_types(GHashTable *set, GList *registered,
+                            const char *type, gpointer value) {
+  GList *l;
+
+  g_hash_table_insert(set, g_strdup(type), value);
+
+  for (l = registered; l != NULL; l = l->next) {
+    if (g_content_type_equals(l->data, type)) {
+      g_hash_table_insert(set, g_strdup(l->data), value);
+    }
+  }
+}
+
+static GHashTable *make_mime_type_set(GList *mime_types, GList *registered) {
+  GHashTable *set;
+  GList *l;
+
+  set = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  for (l = mime_types; l != NULL; l = l->next) {
+    add_equal_types(set, registered, l->data, GINT_TO_POINTER(TRUE));
+  }
+
+  return set;
+}
+
+/* Finds the types whose files can be searched for text ahead of time, so
+ * that matching doesn't go through the type hierarchy for each file.
+ */
+static GHashTable *make_content_type_set(GList *registered) {
+  GHashTable *set;
+  GList *l;
+  guint i;
+
+  set = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  for (l = registered; l != NULL; l = l->next) {
+    if (g_content_type_is_mime_type(l->data, "text/plain")) {
+      g_hash_table_insert(set, g_strdup(l->data),
+                          GINT_TO_POINTER(CAJA_SEARCH_PREDICATE_READ_TEXT));
+    }
+  }
+  g_hash_table_insert(set, g_strdup("text/plain"),
+                      GINT_TO_POINTER(CAJA_SEARCH_PREDICATE_READ_TEXT));
+
+  for (i = 0; i < G_N_ELEMENTS(document_types); i++) {
+    add_equal_types(set, registered, document_types[i],
+                    GINT_TO_POINTER(CAJA_SEARCH_PREDICATE_READ_DOCUMENT));
+  }
+
+  return set;
+}
+
+static GHashTable *make_tag_set(GList *tags, guint *n_tags,
+                                CajaSearchScratch *scratch) {
+  GHashTable *set;
+  GList *l;
+
+  set = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  for (l = tags; l != NULL; l = l->next) {
+    if (fold_text(l->data, strlen(l->data), scratch) &&
+        !g_hash_table_contains(set, scratch->folded->str)) {
+      g_hash_table_insert(set, g_strdup(scratch->folded->str),
+                          GUINT_TO_POINTER(g_hash_table_size(set) + 1));
+    }
+  }
+  *n_tags = g_hash_table_size(set);
+
+  return set;
+}
+
+CajaSearchPredicate *caja_search_predicate_new(CajaQuery *query,
+                                               goffset content_max_size) {
+  CajaSearchPredicate *predicate;
+  CajaSearchScratch scratch;
+  GList *mime_types, *tags, *registered;
+  char *text, *contained_text;
+  GString *attributes;
+
+  predicate = g_new0(CajaSearchPredicate, 1);
+  caja_search_scratch_init(&scratch);
+
+  text = caja_query_get_text(query);
+  add_words(predicate, text, &scratch);
+  g_free(text);
+
+  mime_types = caja_query_get_mime_types(query);
+  tags = caja_query_get_tags(query);
+  contained_text = caja_query_get_contained_text(query);
+
+  registered = NULL;
+  if (mime_types != NULL || contained_text != NULL) {
+    registered = g_content_types_get_registered();
+  }
+
+  if (mime_types != NULL) {
+    predicate->mime_types = make_mime_type_set(mime_types, registered);
+  }
+  if (tags != NULL) {
+    predicate->tags = make_tag_set(tags, &predicate->n_tags, &scratch);
+  }
+  if (contained_text != NULL) {
+    predicate->content_types = make_content_type_set(registered);
+    predicate->content_max_size = content_max_size;
+  }
+  predicate->timestamp = caja_query_get_timestamp(query);
+  predicate->size = caja_query_get_size(query);
+
+  attributes = g_string_new(G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME);
+  if (predicate->mime_types != NULL || predicate->content_types != NULL) {
+    g_string_append(attributes, "," G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE);
+  }
+  if (predicate->tags != NULL) {
+    g_string_append(attributes, "," G_FILE_ATTRIBUTE_XATTR_XDG_TAGS);
+  }
+  if (predicate->timestamp != 0) {
+    g_string_append(attributes, "," G_FILE_ATTRIBUTE_TIME_MODIFIED);
+  }
+  if (predicate->size != 0 || predicate->content_max_size != 0) {
+    g_string_append(attributes, "," G_FILE_ATTRIBUTE_STANDARD_SIZE);
+  }
+  predicate->attributes = g_string_free(attributes, FALSE);
+
+  g_list_free_full(registered, g_free);
+  g_list_free_full(mime_types, g_free);
+  g_list_free_full(tags, g_free);
+  g_free(contained_text);
+  caja_search_scratch_clear(&scratch);
+
+  return predicate;
+}
+
+void caja_search_predicate_free(CajaSearchPredicate *predicate) {
+  guint i;
+
+  for (i = 0; i < predicate->n_words; i++) {
+    g_free(predicate->words[i].text);
+  }
+  g_free(predicate->words);
+  if (predicate->mime_types != NULL) {
+    g_hash_table_destroy(predicate->mime_types);
+  }
+  if (predicate->tags != NULL) {
+    g_hash_table_destroy(predicate->tags);
+  }
+  if (predicate->content_types != NULL) {
+    g_hash_table_destroy(predicate->content_types);
+  }
+  g_free(predicate->attributes);
+  g_free(predicate);
+}
+
+const char *caja_search_predicate_get_attributes(
+    CajaSearchPredicate *predicate) {
+  return predicate->attributes;
+}
+
+static gboolean name_matches(CajaSearchPredicate *predicate, const char *name,
+                             CajaSearchScratch *scratch) {
+  SearchWord *word;
+  gsize len;
+  guint i;
+
+  if (predicate->n_words == 0) {
+    return TRUE;
+  }
+
+  len = strlen(name);
+
+  if (caja_search_text_is_ascii(name, len)) {
+    /* Decomposing plain ASCII leaves it as it is, and lower casing it only
+       changes the ASCII case */
+    for (i = 0; i < predicate->n_words; i++) {
+      word = &predicate->words[i];
+      if (!word->ascii || !caja_search_text_find_ascii_caseless(
+                              name, len, word->text, word->len)) {
+        return FALSE;
+      }
+    }
+    return TRUE;
+  }
+
+  if (!fold_text(name, len, scratch)) {
+    return FALSE;
+  }
+  for (i = 0; i < predicate->n_words; i++) {
+    if (strstr(scratch->folded->str, predicate->words[i].text) == NULL) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Puts the tags of the file into scratch->text, with the \xNN escapes of
+ * the extended attribute undone.
+ */
+static void unescape_tags(const char *escaped, CajaSearchScratch *scratch) {
+  const char *p;
+
+  g_string_truncate(scratch->text, 0);
+
+  for (p = escaped; *p != '\0'; p++) {
+    if (p[0] == '\\' && p[1] == 'x' && g_ascii_isxdigit(p[2]) &&
+        g_ascii_isxdigit(p[3])) {
+      g_string_append_c(scratch->text, g_ascii_xdigit_value(p[2]) << 4 |
+                                           g_ascii_xdigit_value(p[3]));
+      p += 3;
+    } else {
+      g_string_append_c(scratch->text, *p);
+    }
+  }
+}
+
+static gboolean tags_match(CajaSearchPredicate *predicate, GFileInfo *info,
+                           CajaSearchScratch *scratch) {
+  const char *escaped, *tag, *end;
+  gboolean *found;
+  guint n_found, number;
+
+  escaped =
+      g_file_info_get_attribute_string(info, G_FILE_ATTRIBUTE_XATTR_XDG_TAGS);
+  if (escaped == NULL) {
+    return FALSE;
+  }
+
+  unescape_tags(escaped, scratch);
+
+  g_array_set_size(scratch->found_tags, predicate->n_tags);
+  found = (gboolean *)scratch->found_tags->data;
+  memset(found, 0, predicate->n_tags * sizeof(gboolean));
+  n_found = 0;
+
+  /* The tags are separated by commas */
+  tag = scratch->text->str;
+  while (tag != NULL) {
+    end = strchr(tag, ',');
+
+    if (fold_text(tag, end != NULL ? (gsize)(end - tag) : strlen(tag),
+                  scratch)) {
+      number = GPOINTER_TO_UINT(
+          g_hash_table_lookup(predicate->tags, scratch->folded->str));
+      if (number != 0 && !found[number - 1]) {
+        found[number - 1] = TRUE;
+        n_found++;
+      }
+    }
+
+    tag = end != NULL ? end + 1 : NULL;
+  }
+
+  return n_found == predicate->n_tags;
+}
+
+CajaSearchPredicateResult caja_search_predicate_match(
+    CajaSearchPredicate *predicate, GFileInfo *info,
+    CajaSearchScratch *scratch) {
+  const char *display_name, *mime_type;
+  CajaSearchPredicateResult result;
+  guint64 mtime;
+  goffset size;
+
+  if (predicate->impossible) {
+    return CAJA_SEARCH_PREDICATE_NO_MATCH;
+  }
+
+  /* The cheap tests first */
+  if (predicate->timestamp != 0) {
+    mtime = g_file_info_get_attribute_uint64(info,
+                                             G_FILE_ATTRIBUTE_TIME_MODIFIED);
+    if (predicate->timestamp > 0
+            ? (guint64)predicate->timestamp < mtime
+            : mtime < (guint64)ABS(predicate->timestamp)) {
+      return CAJA_SEARCH_PREDICATE_NO_MATCH;
+    }
+  }
+
+  if (predicate->size != 0) {
+    size = g_file_info_get_size(info);
+    if (predicate->size > 0 ? size < predicate->size
+                            : ABS(predicate->size) < size) {
+      return CAJA_SEARCH_PREDICATE_NO_MATCH;
+    }
+  }
+
+  mime_type = NULL;
+  if (predicate->mime_types != NULL || predicate->content_types != NULL) {
+    mime_type = g_file_info_get_content_type(info);
+  }
+
+  if (predicate->mime_types != NULL &&
+      (mime_type == NULL ||
+       !g_hash_table_contains(predicate->mime_types, mime_type))) {
+    return CAJA_SEARCH_PREDICATE_NO_MATCH;
+  }
+
+  display_name = g_file_info_get_display_name(info);
+  if (display_name == NULL ||
+      !name_matches(predicate, display_name, scratch)) {
+    return CAJA_SEARCH_PREDICATE_NO_MATCH;
+  }
+
+  if (predicate->tags != NULL && !tags_match(predicate, info, scratch)) {
+    return CAJA_SEARCH_PREDICATE_NO_MATCH;
+  }
+
+  if (predicate->content_types != NULL) {
+    if (mime_type == NULL || (predicate->content_max_size != 0 &&
+                              g_file_info_get_size(info) >
+                                  predicate->content_max_size)) {
+      return CAJA_SEARCH_PREDICATE_NO_MATCH;
+    }
+
+    result = GPOINTER_TO_INT(
+        g_hash_table_lookup(predicate->content_types, mime_type));
+    if (result == CAJA_SEARCH_PREDICATE_NO_MATCH &&
+        g_str_has_prefix(mime_type, "text/")) {
+      /* Every text type is plain text, even ones that aren't known */
+      result = CAJA_SEARCH_PREDICATE_READ_TEXT;
+    }
+    return result;
+  }
+
+  return CAJA_SEARCH_PREDICATE_MATCH;
+}
@@ -0,0 +1,82 @@
+/*
+   caja-search-predicate.h: Matching files against a search query.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef CAJA_SEARCH_PREDICATE_H
+#define CAJA_SEARCH_PREDICATE_H
+
+#include <gio/gio.h>
+
+#include "caja-query.h"
+
+/* The tags of a file, separated by commas, with \xNN escapes */
+#define G_FILE_ATTRIBUTE_XATTR_XDG_TAGS "xattr::xdg.tags"
+
+/* A query prepared for matching many files quickly. It doesn't change once
+   made, so several threads can use it at the same time. */
+typedef struct CajaSearchPredicate CajaSearchPredicate;
+
+typedef enum {
+  CAJA_SEARCH_PREDICATE_NO_MATCH,
+  CAJA_SEARCH_PREDICATE_MATCH,
+  /* The rest matches, the file is plain text that has to contain the
+     text of the query */
+  CAJA_SEARCH_PREDICATE_READ_TEXT,
+  /* Likewise, but for an OpenDocument file */
+  CAJA_SEARCH_PREDICATE_READ_DOCUMENT
+} CajaSearchPredicateResult;
+
+/* Buffers a thread reuses from file to file, so that matching doesn't
+   allocate memory once they have grown big enough */
+typedef struct {
+  GString *text;
+  GString *folded;
+  GArray *chars;
+  GArray *found_tags;
+} CajaSearchScratch;
+
+/* Files bigger than content_max_size don't match text to be contained in
+   them, 0 for no limit */
+CajaSearchPredicate *caja_search_predicate_new(CajaQuery *query,
+                                               goffset content_max_size);
+void caja_search_predicate_free(CajaSearchPredicate *predicate);
+
+/* The file attributes caja_search_predicate_match() needs, for
+   g_file_enumerate_children() */
+const char *caja_search_predicate_get_attributes(
+    CajaSearchPredicate *predicate);
+
+/* Matches everything about the file but its contents, which are left to
+   the caller when the result says so */
+CajaSearchPredicateResult caja_search_predicate_match(
+    CajaSearchPredicate *predicate, GFileInfo *info,
+    CajaSearchScratch *scratch);
+
+void caja_search_scratch_init(CajaSearchScratch *scratch);
+void caja_search_scratch_clear(CajaSearchScratch *scratch);
+
+/* Whether text is plain ASCII */
+gboolean caja_search_text_is_ascii(const char *text, gsize len);
+
+/* Looks for needle, which is ASCII and in lower case, in text ignoring the
+   ASCII case */
+gboolean caja_search_text_find_ascii_caseless(const char *text, gsize len,
+                                              const char *needle,
+                                              gsize needle_len);
+
+#endif /* CAJA_SEARCH_PREDICATE_H */
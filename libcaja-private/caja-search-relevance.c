@@ -0,0 +1,200 @@
+/*
+   caja-search-relevance.c: Ranking search hits.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include <config.h>
+
+#include "caja-search-relevance.h"
+
+#include <string.h>
+
+/* The points a hit gets for each thing making it relevant. They add up to
+ * CAJA_SEARCH_RELEVANCE_MAX.
+ */
+
+/* The name has the text of the query, and not just the contents */
+#define NAME_MATCH_POINTS 30
+/* The name starts with the text of the query */
+#define PREFIX_POINTS 15
+/* The name is the text of the query, but for the extension */
+#define EXACT_POINTS 30
+/* Right in the searched folder, less for each folder further down */
+#define DEPTH_POINTS 10
+#define DEPTH_STEP 2
+/* Changed within the last day, less the longer ago */
+#define RECENCY_POINTS 15
+
+#define DAY (24 * 60 * 60)
+
+struct CajaSearchRelevance {
+  /* Normalized and in lower case, like the search engines match it */
+  char *text;
+  char **words;
+  char *contained_text;
+
+  GFile *location;
+  time_t now;
+};
+
+static char *fold(const char *text) {
+  char *normalized, *lower;
+
+  normalized = g_utf8_normalize(text != NULL ? text : "", -1,
+                                G_NORMALIZE_NFD);
+  if (normalized == NULL) {
+    return g_strdup("");
+  }
+  lower = g_utf8_strdown(normalized, -1);
+  g_free(normalized);
+
+  return lower;
+}
+
+CajaSearchRelevance *caja_search_relevance_new(CajaQuery *query) {
+  CajaSearchRelevance *relevance;
+  char *text, *uri;
+
+  relevance = g_new0(CajaSearchRelevance, 1);
+
+  text = caja_query_get_text(query);
+  relevance->text = g_strstrip(fold(text));
+  relevance->words = g_strsplit(relevance->text, " ", -1);
+  g_free(text);
+
+  text = caja_query_get_contained_text(query);
+  relevance->contained_text = fold(text);
+  g_free(text);
+
+  uri = caja_query_get_location(query);
+  relevance->location =
+      uri != NULL ? g_file_new_for_uri(uri) : g_file_new_for_path("/");
+  g_free(uri);
+
+  relevance->now = time(NULL);
+
+  return relevance;
+}
+
+void caja_search_relevance_free(CajaSearchRelevance *relevance) {
+  g_free(relevance->text);
+  g_strfreev(relevance->words);
+  g_free(relevance->contained_text);
+  g_object_unref(relevance->location);
+  g_free(relevance);
+}
+
+int caja_search_relevance_get_depth(CajaSearchRelevance *relevance,
+                                    GFile *parent) {
+  char *path, *p;
+  int depth;
+
+  if (g_file_equal(parent, relevance->location)) {
+    return 0;
+  }
+
+  path = g_file_get_relative_path(relevance->location, parent);
+  if (path == NULL) {
+    return -1;
+  }
+
+  depth = 1;
+  for (p = path; *p != '\0'; p++) {
+    if (*p == G_DIR_SEPARATOR && p[1] != '\0') {
+      depth++;
+    }
+  }
+  g_free(path);
+
+  return depth;
+}
+
+static gboolean has_words(const char *name, char **words) {
+  gboolean any;
+  int i;
+
+  any = FALSE;
+  for (i = 0; words[i] != NULL; i++) {
+    if (words[i][0] == '\0') {
+      continue;
+    }
+    if (strstr(name, words[i]) == NULL) {
+      return FALSE;
+    }
+    any = TRUE;
+  }
+
+  return any;
+}
+
+/* Whether name is text, maybe followed by an extension */
+static gboolean is_exact(const char *name, const char *text) {
+  gsize len;
+
+  len = strlen(text);
+
+  return strncmp(name, text, len) == 0 &&
+         (name[len] == '\0' ||
+          (name[len] == '.' && strchr(name + len + 1, '.') == NULL));
+}
+
+int caja_search_relevance_score(CajaSearchRelevance *relevance,
+                                const char *display_name, int depth,
+                                time_t mtime) {
+  char *name;
+  time_t age;
+  int score;
+
+  name = fold(display_name);
+  score = 0;
+
+  /* Hits matched by their contents only rank below those with the text in
+     their names */
+  if (has_words(name, relevance->words) ||
+      (relevance->contained_text[0] != '\0' &&
+       strstr(name, relevance->contained_text) != NULL)) {
+    score += NAME_MATCH_POINTS;
+  }
+
+  if (relevance->text[0] != '\0' && g_str_has_prefix(name, relevance->text)) {
+    score += PREFIX_POINTS;
+    if (is_exact(name, relevance->text)) {
+      score += EXACT_POINTS;
+    }
+  }
+
+  g_free(name);
+
+  if (depth >= 0) {
+    score += MAX(DEPTH_POINTS - depth * DEPTH_STEP, 0);
+  }
+
+  if (mtime > 0) {
+    age = relevance->now - mtime;
+    if (age < DAY) {
+      score += RECENCY_POINTS;
+    } else if (age < 7 * DAY) {
+      score += RECENCY_POINTS * 2 / 3;
+    } else if (age < 31 * DAY) {
+      score += RECENCY_POINTS * 2 / 5;
+    } else if (age < 365 * DAY) {
+      score += RECENCY_POINTS / 5;
+    }
+  }
+
+  return score;
+}
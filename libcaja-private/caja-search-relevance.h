@@ -0,0 +1,47 @@
+/*
+   caja-search-relevance.h: Ranking search hits.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef CAJA_SEARCH_RELEVANCE_H
+#define CAJA_SEARCH_RELEVANCE_H
+
+#include <gio/gio.h>
+#include <time.h>
+
+#include "caja-query.h"
+
+/* The score of a hit that couldn't match better */
+#define CAJA_SEARCH_RELEVANCE_MAX 100
+
+/* A query prepared for scoring its hits */
+typedef struct CajaSearchRelevance CajaSearchRelevance;
+
+CajaSearchRelevance *caja_search_relevance_new(CajaQuery *query);
+void caja_search_relevance_free(CajaSearchRelevance *relevance);
+
+/* How many folders below the searched one parent is, -1 if it isn't in it */
+int caja_search_relevance_get_depth(CajaSearchRelevance *relevance,
+                                    GFile *parent);
+
+/* Scores a hit from 0 to CAJA_SEARCH_RELEVANCE_MAX by how its name matches
+   the query, how deep it is and how recently it changed, 0 if unknown */
+int caja_search_relevance_score(CajaSearchRelevance *relevance,
+                                const char *display_name, int depth,
+                                time_t mtime);
+
+#endif /* CAJA_SEARCH_RELEVANCE_H */
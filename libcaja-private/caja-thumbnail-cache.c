@@ -0,0 +1,334 @@
+/*
+   caja-thumbnail-cache.c: Process wide cache of decoded thumbnails.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include <config.h>
+
+#include "caja-thumbnail-cache.h"
+
+#include <eel/eel-debug.h>
+#include <gio/gio.h>
+
+#include "caja-global-preferences.h"
+#include "caja-ui-utilities.h"
+
+/* How many display sized copies an entry keeps, e.g. for windows at
+   different zoom levels */
+#define MAX_SCALED_COPIES 4
+
+typedef struct {
+  int width;
+  int height;
+  gboolean framed;
+  GdkPixbuf *pixbuf;
+} ScaledCopy;
+
+struct CajaThumbnailCacheEntry {
+  int ref_count;
+
+  char *uri;
+  time_t mtime;
+  gboolean from_original;
+  /* The thumbnail size it was loaded from, 0 for originals */
+  int size;
+
+  /* NULL once evicted */
+  GdkPixbuf *pixbuf;
+
+  /* ScaledCopy, the one asked for last first */
+  GList *scaled;
+
+  gsize bytes;
+
+  /* Link in thumbnail_cache_lru while the entry has pixels */
+  GList link;
+};
+
+/* Maps uris to their entries. The table holds a reference to each. */
+static GHashTable *thumbnail_cache = NULL;
+/* Entries with pixels, most recently used first */
+static GQueue thumbnail_cache_lru = G_QUEUE_INIT;
+static gsize thumbnail_cache_bytes = 0;
+static gsize thumbnail_cache_max_bytes = 0;
+
+#if GLIB_CHECK_VERSION(2, 64, 0)
+static GMemoryMonitor *memory_monitor = NULL;
+#endif
+
+static gsize get_pixbuf_bytes(GdkPixbuf *pixbuf) {
+  return pixbuf != NULL ? gdk_pixbuf_get_byte_length(pixbuf) : 0;
+}
+
+static void scaled_copy_free(ScaledCopy *copy) {
+  g_object_unref(copy->pixbuf);
+  g_free(copy);
+}
+
+static void evict_entry(CajaThumbnailCacheEntry *entry) {
+  if (entry->pixbuf == NULL) {
+    return;
+  }
+
+  g_queue_unlink(&thumbnail_cache_lru, &entry->link);
+  thumbnail_cache_bytes -= entry->bytes;
+  entry->bytes = 0;
+  g_clear_object(&entry->pixbuf);
+  g_list_free_full(entry->scaled, (GDestroyNotify)scaled_copy_free);
+  entry->scaled = NULL;
+
+  if (g_hash_table_lookup(thumbnail_cache, entry->uri) == entry) {
+    /* drops the table's reference, so do it last */
+    g_hash_table_remove(thumbnail_cache, entry->uri);
+  }
+}
+
+static void trim_to(gsize max_bytes) {
+  CajaThumbnailCacheEntry *entry;
+
+  /* The entry used last stays, it is being shown right now */
+  while (thumbnail_cache_bytes > max_bytes &&
+         thumbnail_cache_lru.length > 1) {
+    entry = g_queue_peek_tail(&thumbnail_cache_lru);
+    evict_entry(entry);
+  }
+}
+
+void caja_thumbnail_cache_trim(gsize max_bytes) {
+  if (thumbnail_cache != NULL) {
+    trim_to(max_bytes);
+  }
+}
+
+static void cache_size_changed_callback(gpointer user_data) {
+  thumbnail_cache_max_bytes =
+      (gsize)g_settings_get_int(caja_preferences,
+                                CAJA_PREFERENCES_THUMBNAIL_CACHE_SIZE) *
+      1024 * 1024;
+  caja_thumbnail_cache_trim(thumbnail_cache_max_bytes);
+}
+
+#if GLIB_CHECK_VERSION(2, 64, 0)
+static void low_memory_warning_callback(GMemoryMonitor *monitor,
+                                        GMemoryMonitorWarningLevel level,
+                                        gpointer user_data) {
+  if (level >= G_MEMORY_MONITOR_WARNING_LEVEL_CRITICAL) {
+    caja_thumbnail_cache_trim(0);
+  } else if (level >= G_MEMORY_MONITOR_WARNING_LEVEL_MEDIUM) {
+    caja_thumbnail_cache_trim(thumbnail_cache_bytes / 4);
+  } else {
+    caja_thumbnail_cache_trim(thumbnail_cache_bytes / 2);
+  }
+}
+#endif
+
+static void destroy_thumbnail_cache(void) {
+  g_signal_handlers_disconnect_by_func(
+      caja_preferences, G_CALLBACK(cache_size_changed_callback), NULL);
+#if GLIB_CHECK_VERSION(2, 64, 0)
+  if (memory_monitor != NULL) {
+    g_signal_handlers_disconnect_by_func(
+        memory_monitor, G_CALLBACK(low_memory_warning_callback), NULL);
+    g_clear_object(&memory_monitor);
+  }
+#endif
+
+  while (!g_queue_is_empty(&thumbnail_cache_lru)) {
+    evict_entry(g_queue_peek_tail(&thumbnail_cache_lru));
+  }
+  g_clear_pointer(&thumbnail_cache, g_hash_table_destroy);
+}
+
+static void ensure_thumbnail_cache(void) {
+  if (thumbnail_cache != NULL) {
+    return;
+  }
+
+  thumbnail_cache = g_hash_table_new_full(
+      g_str_hash, g_str_equal, NULL,
+      (GDestroyNotify)caja_thumbnail_cache_entry_unref);
+
+  cache_size_changed_callback(NULL);
+  g_signal_connect_swapped(caja_preferences,
+                           "changed::" CAJA_PREFERENCES_THUMBNAIL_CACHE_SIZE,
+                           G_CALLBACK(cache_size_changed_callback), NULL);
+
+#if GLIB_CHECK_VERSION(2, 64, 0)
+  memory_monitor = g_memory_monitor_dup_default();
+  if (memory_monitor != NULL) {
+    g_signal_connect(memory_monitor, "low-memory-warning",
+                     G_CALLBACK(low_memory_warning_callback), NULL);
+  }
+#endif
+
+  eel_debug_call_at_shutdown(destroy_thumbnail_cache);
+}
+
+static void touch_entry(CajaThumbnailCacheEntry *entry) {
+  g_queue_unlink(&thumbnail_cache_lru, &entry->link);
+  g_queue_push_head_link(&thumbnail_cache_lru, &entry->link);
+}
+
+CajaThumbnailCacheEntry *caja_thumbnail_cache_lookup(const char *uri,
+                                                     time_t mtime,
+                                                     gboolean need_original,
+                                                     int min_size) {
+  CajaThumbnailCacheEntry *entry;
+
+  if (thumbnail_cache == NULL) {
+    return NULL;
+  }
+
+  entry = g_hash_table_lookup(thumbnail_cache, uri);
+  if (entry == NULL || (entry->mtime != 0 && entry->mtime != mtime) ||
+      (need_original && !entry->from_original) ||
+      (!entry->from_original && entry->size < min_size)) {
+    return NULL;
+  }
+
+  touch_entry(entry);
+
+  return caja_thumbnail_cache_entry_ref(entry);
+}
+
+CajaThumbnailCacheEntry *caja_thumbnail_cache_insert(const char *uri,
+                                                     GdkPixbuf *pixbuf,
+                                                     time_t mtime,
+                                                     gboolean from_original,
+                                                     int size) {
+  CajaThumbnailCacheEntry *entry, *old_entry;
+
+  g_return_val_if_fail(GDK_IS_PIXBUF(pixbuf), NULL);
+
+  ensure_thumbnail_cache();
+
+  /* Whoever still holds the old one has to load the new one */
+  old_entry = g_hash_table_lookup(thumbnail_cache, uri);
+  if (old_entry != NULL) {
+    evict_entry(old_entry);
+  }
+
+  entry = g_new0(CajaThumbnailCacheEntry, 1);
+  entry->ref_count = 1;
+  entry->uri = g_strdup(uri);
+  entry->mtime = mtime;
+  entry->from_original = from_original;
+  entry->size = from_original ? 0 : size;
+  entry->pixbuf = g_object_ref(pixbuf);
+  entry->bytes = get_pixbuf_bytes(pixbuf);
+  entry->link.data = entry;
+
+  g_hash_table_insert(thumbnail_cache, entry->uri, entry);
+  g_queue_push_head_link(&thumbnail_cache_lru, &entry->link);
+  thumbnail_cache_bytes += entry->bytes;
+
+  trim_to(thumbnail_cache_max_bytes);
+
+  return caja_thumbnail_cache_entry_ref(entry);
+}
+
+CajaThumbnailCacheEntry *caja_thumbnail_cache_entry_ref(
+    CajaThumbnailCacheEntry *entry) {
+  entry->ref_count++;
+  return entry;
+}
+
+void caja_thumbnail_cache_entry_unref(CajaThumbnailCacheEntry *entry) {
+  if (--entry->ref_count > 0) {
+    return;
+  }
+
+  /* The table holds a reference while the entry has pixels */
+  g_assert(entry->pixbuf == NULL);
+
+  g_free(entry->uri);
+  g_free(entry);
+}
+
+time_t caja_thumbnail_cache_entry_get_mtime(CajaThumbnailCacheEntry *entry) {
+  return entry->mtime;
+}
+
+int caja_thumbnail_cache_entry_get_size(CajaThumbnailCacheEntry *entry) {
+  return entry->size;
+}
+
+gboolean caja_thumbnail_cache_entry_is_evicted(
+    CajaThumbnailCacheEntry *entry) {
+  return entry->pixbuf == NULL;
+}
+
+GdkPixbuf *caja_thumbnail_cache_entry_get_pixbuf(
+    CajaThumbnailCacheEntry *entry) {
+  if (entry->pixbuf != NULL) {
+    touch_entry(entry);
+  }
+
+  return entry->pixbuf;
+}
+
+GdkPixbuf *caja_thumbnail_cache_entry_get_scaled(
+    CajaThumbnailCacheEntry *entry, int width, int height, gboolean framed) {
+  ScaledCopy *copy;
+  GdkPixbuf *scaled;
+  GList *l, *last;
+
+  if (entry->pixbuf == NULL) {
+    return NULL;
+  }
+
+  touch_entry(entry);
+
+  for (l = entry->scaled; l != NULL; l = l->next) {
+    copy = l->data;
+    if (copy->width == width && copy->height == height &&
+        copy->framed == framed) {
+      entry->scaled = g_list_remove_link(entry->scaled, l);
+      entry->scaled = g_list_concat(l, entry->scaled);
+      return g_object_ref(copy->pixbuf);
+    }
+  }
+
+  copy = g_new(ScaledCopy, 1);
+  copy->width = width;
+  copy->height = height;
+  copy->framed = framed;
+  copy->pixbuf = gdk_pixbuf_scale_simple(entry->pixbuf, width, height,
+                                         GDK_INTERP_BILINEAR);
+  if (framed) {
+    caja_ui_frame_image(&copy->pixbuf);
+  }
+  entry->scaled = g_list_prepend(entry->scaled, copy);
+  entry->bytes += get_pixbuf_bytes(copy->pixbuf);
+  thumbnail_cache_bytes += get_pixbuf_bytes(copy->pixbuf);
+
+  if (g_list_length(entry->scaled) > MAX_SCALED_COPIES) {
+    last = g_list_last(entry->scaled);
+    entry->scaled = g_list_remove_link(entry->scaled, last);
+    copy = last->data;
+    entry->bytes -= get_pixbuf_bytes(copy->pixbuf);
+    thumbnail_cache_bytes -= get_pixbuf_bytes(copy->pixbuf);
+    scaled_copy_free(copy);
+    g_list_free_1(last);
+  }
+
+  /* what is returned stays alive even if this evicts the entry */
+  scaled = g_object_ref(((ScaledCopy *)entry->scaled->data)->pixbuf);
+  trim_to(thumbnail_cache_max_bytes);
+
+  return scaled;
+}
@@ -0,0 +1,66 @@
+/*
+   caja-thumbnail-cache.h: Process wide cache of decoded thumbnails.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef CAJA_THUMBNAIL_CACHE_H
+#define CAJA_THUMBNAIL_CACHE_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <time.h>
+
+/* A handle on a decoded thumbnail. The pixels are shared by all files and
+   views showing the same uri, and are dropped when the cache goes over its
+   budget; the handle then reports no pixbuf and the thumbnail has to be
+   loaded again. Only use these from the main thread. */
+typedef struct CajaThumbnailCacheEntry CajaThumbnailCacheEntry;
+
+/* Returns a new reference to the thumbnail cached for uri, or NULL if
+   there is none for a file modified at mtime. If need_original is set, only
+   a thumbnail made from the original file will do, otherwise one of at
+   least the thumbnail size min_size. */
+CajaThumbnailCacheEntry *caja_thumbnail_cache_lookup(const char *uri,
+                                                     time_t mtime,
+                                                     gboolean need_original,
+                                                     int min_size);
+/* Caches pixbuf for uri, replacing what was cached for it before, and
+   returns a new reference to the entry. size is the thumbnail size the
+   pixbuf was loaded from. */
+CajaThumbnailCacheEntry *caja_thumbnail_cache_insert(const char *uri,
+                                                     GdkPixbuf *pixbuf,
+                                                     time_t mtime,
+                                                     gboolean from_original,
+                                                     int size);
+void caja_thumbnail_cache_trim(gsize max_bytes);
+
+CajaThumbnailCacheEntry *caja_thumbnail_cache_entry_ref(
+    CajaThumbnailCacheEntry *entry);
+void caja_thumbnail_cache_entry_unref(CajaThumbnailCacheEntry *entry);
+time_t caja_thumbnail_cache_entry_get_mtime(CajaThumbnailCacheEntry *entry);
+/* The thumbnail size the entry was loaded from, or 0 for an original. */
+int caja_thumbnail_cache_entry_get_size(CajaThumbnailCacheEntry *entry);
+/* Whether the cache dropped the pixels of the entry */
+gboolean caja_thumbnail_cache_entry_is_evicted(
+    CajaThumbnailCacheEntry *entry);
+/* Both return NULL once the entry was evicted. The entry keeps the scaled
+   copies of the last few sizes asked for. */
+GdkPixbuf *caja_thumbnail_cache_entry_get_pixbuf(
+    CajaThumbnailCacheEntry *entry);
+GdkPixbuf *caja_thumbnail_cache_entry_get_scaled(
+    CajaThumbnailCacheEntry *entry, int width, int height, gboolean framed);
+
+#endif /* CAJA_THUMBNAIL_CACHE_H */
@@ -0,0 +1,457 @@
+/*
+   caja-thumbnail-pregenerator.c: Making thumbnails ahead of time.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include <config.h>
+
+#include "caja-thumbnail-pregenerator.h"
+
+#include <eel/eel-debug.h>
+
+#include "caja-debug-log.h"
+#include "caja-global-preferences.h"
+#include "caja-thumbnails.h"
+
+/* Leave Caja alone while it starts up and opens its first windows */
+#define PREGENERATE_START_DELAY_SECS 60
+
+/* Thumbnails expire from the cache, so walk the folders again every now
+   and then */
+#define PREGENERATE_INTERVAL_SECS (60 * 60)
+
+/* Files asked of an enumerator at a time */
+#define PREGENERATE_BATCH_SIZE 64
+
+/* The walk waits while more thumbnails than this are queued, so the queue
+   doesn't grow with the size of the folders */
+#define PREGENERATE_MAX_QUEUED 256
+
+/* How often a waiting walk looks whether it can go on */
+#define PREGENERATE_RETRY_SECS 2
+
+#define PREGENERATE_ATTRIBUTES                                             \
+  G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_STANDARD_TYPE        \
+                                 "," G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN   \
+                                 "," G_FILE_ATTRIBUTE_STANDARD_SIZE        \
+                                 "," G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE \
+                                 "," G_FILE_ATTRIBUTE_TIME_MODIFIED        \
+                                 "," G_FILE_ATTRIBUTE_THUMBNAIL_PATH       \
+                                 "," G_FILE_ATTRIBUTE_THUMBNAILING_FAILED
+
+#define UPOWER_DBUS_NAME "org.freedesktop.UPower"
+#define UPOWER_DBUS_PATH "/org/freedesktop/UPower"
+#define UPOWER_DBUS_INTERFACE "org.freedesktop.UPower"
+
+static const char introspection_xml[] =
+    "<node>"
+    "  <interface name='org.mate.Caja.Thumbnails'>"
+    "    <method name='GetStatistics'>"
+    "      <arg type='a{sv}' name='statistics' direction='out'/>"
+    "    </method>"
+    "  </interface>"
+    "</node>";
+
+/* Folders left to walk, and the one being walked */
+static GQueue folders_to_walk = G_QUEUE_INIT;
+static GFile *walked_folder = NULL;
+static GFileEnumerator *walked_enumerator = NULL;
+static GCancellable *walk_cancellable = NULL;
+static gboolean walking = FALSE;
+/* Set while the walk waits for an enumerator to answer */
+static gboolean walk_busy = FALSE;
+static guint walk_timeout_id = 0;
+
+/* Progress of the current walk */
+static guint folders_walked = 0;
+static guint files_queued = 0;
+
+static GDBusProxy *upower_proxy = NULL;
+static gboolean on_battery = FALSE;
+static gboolean paused = FALSE;
+
+static GDBusConnection *dbus_connection = NULL;
+static guint dbus_registration_id = 0;
+
+static void walk_continue(void);
+static void walk_start(void);
+
+static gboolean walk_continue_callback(gpointer user_data) {
+  walk_timeout_id = 0;
+  walk_continue();
+  return FALSE;
+}
+
+static gboolean walk_start_callback(gpointer user_data) {
+  walk_timeout_id = 0;
+  walk_start();
+  return FALSE;
+}
+
+static void walk_schedule(guint seconds, GSourceFunc callback) {
+  if (walk_timeout_id != 0) {
+    g_source_remove(walk_timeout_id);
+  }
+  walk_timeout_id = g_timeout_add_seconds_full(G_PRIORITY_LOW, seconds,
+                                               callback, NULL, NULL);
+}
+
+static void walk_close_folder(void) {
+  g_clear_object(&walked_enumerator);
+  g_clear_object(&walked_folder);
+}
+
+static void walk_finish(void) {
+  walk_close_folder();
+  walking = FALSE;
+
+  caja_debug_log(FALSE, CAJA_DEBUG_LOG_DOMAIN_THUMBNAILS,
+                 "pre-generation walked %u folders and queued %u thumbnails",
+                 folders_walked, files_queued);
+
+  walk_schedule(PREGENERATE_INTERVAL_SECS, walk_start_callback);
+}
+
+static gboolean file_wants_thumbnail(GFileInfo *info, guint64 size_limit) {
+  const char *content_type;
+
+  if (g_file_info_get_file_type(info) != G_FILE_TYPE_REGULAR ||
+      g_file_info_get_attribute_byte_string(
+          info, G_FILE_ATTRIBUTE_THUMBNAIL_PATH) != NULL ||
+      g_file_info_get_attribute_boolean(
+          info, G_FILE_ATTRIBUTE_THUMBNAILING_FAILED)) {
+    return FALSE;
+  }
+
+  /* cf. caja_file_should_show_thumbnail() */
+  content_type = g_file_info_get_content_type(info);
+  if (content_type == NULL ||
+      (caja_thumbnail_is_mimetype_limited_by_size(content_type) &&
+       (guint64)g_file_info_get_size(info) > size_limit)) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void walk_next_files_callback(GObject *source_object,
+                                     GAsyncResult *res, gpointer user_data) {
+  GList *infos, *l;
+  GFileInfo *info;
+  GFile *child;
+  guint64 size_limit;
+  char *uri;
+
+  infos = g_file_enumerator_next_files_finish(
+      G_FILE_ENUMERATOR(source_object), res, NULL);
+  if (g_cancellable_is_cancelled(G_CANCELLABLE(user_data))) {
+    g_list_free_full(infos, g_object_unref);
+    g_object_unref(user_data);
+    return;
+  }
+  g_object_unref(user_data);
+  walk_busy = FALSE;
+
+  if (infos == NULL) {
+    /* done with this folder, or it failed half way */
+    walk_close_folder();
+    folders_walked++;
+    walk_continue();
+    return;
+  }
+
+  g_settings_get(caja_preferences, CAJA_PREFERENCES_IMAGE_FILE_THUMBNAIL_LIMIT,
+                 "t", &size_limit);
+
+  for (l = infos; l != NULL; l = l->next) {
+    info = l->data;
+
+    if (g_file_info_get_is_hidden(info)) {
+      continue;
+    }
+
+    child = g_file_get_child(walked_folder, g_file_info_get_name(info));
+    if (g_file_info_get_file_type(info) == G_FILE_TYPE_DIRECTORY) {
+      g_queue_push_tail(&folders_to_walk, g_object_ref(child));
+    } else if (file_wants_thumbnail(info, size_limit)) {
+      uri = g_file_get_uri(child);
+      if (caja_thumbnail_queue_background(
+              uri, g_file_info_get_content_type(info),
+              g_file_info_get_attribute_uint64(
+                  info, G_FILE_ATTRIBUTE_TIME_MODIFIED))) {
+        files_queued++;
+      }
+      g_free(uri);
+    }
+    g_object_unref(child);
+  }
+  g_list_free_full(infos, g_object_unref);
+
+  walk_continue();
+}
+
+static void walk_enumerate_callback(GObject *source_object, GAsyncResult *res,
+                                    gpointer user_data) {
+  GFileEnumerator *enumerator;
+
+  enumerator =
+      g_file_enumerate_children_finish(G_FILE(source_object), res, NULL);
+  if (g_cancellable_is_cancelled(G_CANCELLABLE(user_data))) {
+    if (enumerator != NULL) {
+      g_object_unref(enumerator);
+    }
+    g_object_unref(user_data);
+    return;
+  }
+  g_object_unref(user_data);
+  walk_busy = FALSE;
+
+  if (enumerator == NULL) {
+    /* skip folders we can't read */
+    walk_close_folder();
+  } else {
+    walked_enumerator = enumerator;
+  }
+  walk_continue();
+}
+
+/* Takes the walk one step further, unless it has to wait: for power, or
+   for the thumbnailers to catch up. */
+static void walk_continue(void) {
+  CajaThumbnailStatistics statistics;
+
+  if (!walking || walk_busy) {
+    return;
+  }
+
+  caja_thumbnail_get_statistics(&statistics);
+  if (paused || statistics.background_queued >= PREGENERATE_MAX_QUEUED) {
+    walk_schedule(PREGENERATE_RETRY_SECS, walk_continue_callback);
+    return;
+  }
+
+  if (walked_enumerator != NULL) {
+    walk_busy = TRUE;
+    g_file_enumerator_next_files_async(
+        walked_enumerator, PREGENERATE_BATCH_SIZE, G_PRIORITY_LOW,
+        walk_cancellable, walk_next_files_callback,
+        g_object_ref(walk_cancellable));
+    return;
+  }
+
+  walked_folder = g_queue_pop_head(&folders_to_walk);
+  if (walked_folder == NULL) {
+    walk_finish();
+    return;
+  }
+
+  /* Don't follow symlinks, they may lead back up */
+  walk_busy = TRUE;
+  g_file_enumerate_children_async(
+      walked_folder, PREGENERATE_ATTRIBUTES,
+      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, G_PRIORITY_LOW, walk_cancellable,
+      walk_enumerate_callback, g_object_ref(walk_cancellable));
+}
+
+static void walk_stop(void) {
+  if (walk_cancellable != NULL) {
+    g_cancellable_cancel(walk_cancellable);
+    g_clear_object(&walk_cancellable);
+  }
+  if (walk_timeout_id != 0) {
+    g_source_remove(walk_timeout_id);
+    walk_timeout_id = 0;
+  }
+  g_queue_clear_full(&folders_to_walk, g_object_unref);
+  walk_close_folder();
+  walking = FALSE;
+  walk_busy = FALSE;
+}
+
+static void folders_changed_callback(gpointer user_data) {
+  walk_start();
+}
+
+static void walk_start(void) {
+  char **folders;
+  int i;
+
+  walk_stop();
+
+  folders = g_settings_get_strv(caja_preferences,
+                                CAJA_PREFERENCES_THUMBNAIL_PREGENERATE_FOLDERS);
+  for (i = 0; folders[i] != NULL; i++) {
+    g_queue_push_tail(&folders_to_walk, g_file_parse_name(folders[i]));
+  }
+  g_strfreev(folders);
+
+  if (g_queue_is_empty(&folders_to_walk)) {
+    return;
+  }
+
+  walk_cancellable = g_cancellable_new();
+  walking = TRUE;
+  folders_walked = 0;
+  files_queued = 0;
+  walk_continue();
+}
+
+static void update_paused(gpointer user_data) {
+  paused = on_battery &&
+           !g_settings_get_boolean(
+               caja_preferences,
+               CAJA_PREFERENCES_THUMBNAIL_PREGENERATE_ON_BATTERY);
+  caja_thumbnail_set_background_paused(paused);
+}
+
+static void upower_properties_changed_callback(GDBusProxy *proxy,
+                                               GVariant *changed_properties,
+                                               GStrv invalidated_properties,
+                                               gpointer user_data) {
+  GVariant *value;
+
+  value = g_dbus_proxy_get_cached_property(proxy, "OnBattery");
+  on_battery = value != NULL && g_variant_get_boolean(value);
+  if (value != NULL) {
+    g_variant_unref(value);
+  }
+
+  update_paused(NULL);
+}
+
+static void upower_proxy_ready_callback(GObject *source_object,
+                                        GAsyncResult *res,
+                                        gpointer user_data) {
+  /* Without UPower we don't know about batteries, and just go on */
+  upower_proxy = g_dbus_proxy_new_for_bus_finish(res, NULL);
+  if (upower_proxy == NULL) {
+    return;
+  }
+
+  g_signal_connect(upower_proxy, "g-properties-changed",
+                   G_CALLBACK(upower_properties_changed_callback), NULL);
+  upower_properties_changed_callback(upower_proxy, NULL, NULL, NULL);
+}
+
+static void add_statistic(GVariantBuilder *builder, const char *name,
+                          guint64 value) {
+  g_variant_builder_add(builder, "{sv}", name, g_variant_new_uint64(value));
+}
+
+static void handle_method_call(GDBusConnection *connection,
+                               const char *sender, const char *object_path,
+                               const char *interface_name,
+                               const char *method_name, GVariant *parameters,
+                               GDBusMethodInvocation *invocation,
+                               gpointer user_data) {
+  CajaThumbnailStatistics statistics;
+  GVariantBuilder builder;
+
+  if (g_strcmp0(method_name, "GetStatistics") != 0) {
+    return;
+  }
+
+  caja_thumbnail_get_statistics(&statistics);
+
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+  add_statistic(&builder, "made", statistics.made);
+  add_statistic(&builder, "failed", statistics.failed);
+  add_statistic(&builder, "from-previews", statistics.from_previews);
+  add_statistic(&builder, "from-scaled-decodes",
+                statistics.from_scaled_decodes);
+  add_statistic(&builder, "originals-avoided", statistics.originals_avoided);
+  add_statistic(&builder, "background-made", statistics.background_made);
+  add_statistic(&builder, "busy-usecs", statistics.busy_usecs);
+  add_statistic(&builder, "workers-running", statistics.workers_running);
+  add_statistic(&builder, "queued", statistics.queued);
+  add_statistic(&builder, "background-queued", statistics.background_queued);
+  add_statistic(&builder, "folders-walked", folders_walked);
+  add_statistic(&builder, "folders-left", g_queue_get_length(&folders_to_walk));
+  add_statistic(&builder, "files-queued", files_queued);
+  g_variant_builder_add(&builder, "{sv}", "walking",
+                        g_variant_new_boolean(walking));
+  g_variant_builder_add(&builder, "{sv}", "paused",
+                        g_variant_new_boolean(paused));
+
+  g_dbus_method_invocation_return_value(invocation,
+                                        g_variant_new("(a{sv})", &builder));
+}
+
+static const GDBusInterfaceVTable interface_vtable = {handle_method_call,
+                                                      NULL, NULL};
+
+static void register_dbus_object(GDBusConnection *connection) {
+  GDBusNodeInfo *introspection_data;
+
+  introspection_data = g_dbus_node_info_new_for_xml(introspection_xml, NULL);
+  g_return_if_fail(introspection_data != NULL);
+
+  dbus_connection = g_object_ref(connection);
+  dbus_registration_id = g_dbus_connection_register_object(
+      connection, CAJA_THUMBNAIL_PREGENERATOR_DBUS_PATH,
+      introspection_data->interfaces[0], &interface_vtable, NULL, NULL, NULL);
+
+  g_dbus_node_info_unref(introspection_data);
+}
+
+static void pregenerator_shutdown(void) {
+  walk_stop();
+
+  g_signal_handlers_disconnect_by_func(caja_preferences,
+                                       G_CALLBACK(folders_changed_callback),
+                                       NULL);
+  g_signal_handlers_disconnect_by_func(caja_preferences,
+                                       G_CALLBACK(update_paused), NULL);
+  g_clear_object(&upower_proxy);
+
+  if (dbus_registration_id != 0) {
+    g_dbus_connection_unregister_object(dbus_connection, dbus_registration_id);
+    dbus_registration_id = 0;
+  }
+  g_clear_object(&dbus_connection);
+}
+
+void caja_thumbnail_pregenerator_start(GDBusConnection *connection) {
+  static gboolean started = FALSE;
+
+  if (started) {
+    return;
+  }
+  started = TRUE;
+
+  if (connection != NULL) {
+    register_dbus_object(connection);
+  }
+
+  g_dbus_proxy_new_for_bus(G_BUS_TYPE_SYSTEM, G_DBUS_PROXY_FLAGS_NONE, NULL,
+                           UPOWER_DBUS_NAME, UPOWER_DBUS_PATH,
+                           UPOWER_DBUS_INTERFACE, NULL,
+                           upower_proxy_ready_callback, NULL);
+
+  g_signal_connect_swapped(
+      caja_preferences,
+      "changed::" CAJA_PREFERENCES_THUMBNAIL_PREGENERATE_FOLDERS,
+      G_CALLBACK(folders_changed_callback), NULL);
+  g_signal_connect_swapped(
+      caja_preferences,
+      "changed::" CAJA_PREFERENCES_THUMBNAIL_PREGENERATE_ON_BATTERY,
+      G_CALLBACK(update_paused), NULL);
+
+  walk_schedule(PREGENERATE_START_DELAY_SECS, walk_start_callback);
+
+  eel_debug_call_at_shutdown(pregenerator_shutdown);
+}
@@ -0,0 +1,34 @@
+/*
+   caja-thumbnail-pregenerator.h: Making thumbnails ahead of time.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef CAJA_THUMBNAIL_PREGENERATOR_H
+#define CAJA_THUMBNAIL_PREGENERATOR_H
+
+#include <gio/gio.h>
+
+#define CAJA_THUMBNAIL_PREGENERATOR_DBUS_PATH "/org/mate/Caja/Thumbnails"
+
+/* Walks the folders of the thumbnail-pregenerate-folders setting while
+   Caja has nothing else to do, and queues thumbnails for the files that
+   have none yet. Pauses on battery power unless the settings allow it.
+   The progress and the thumbnail statistics are published on connection,
+   which may be NULL. */
+void caja_thumbnail_pregenerator_start(GDBusConnection *connection);
+
+#endif /* CAJA_THUMBNAIL_PREGENERATOR_H */
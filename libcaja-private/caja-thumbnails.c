@@ -28,13 +28,21 @@
 #endif
 
 #include <errno.h>
+#include <glib/gstdio.h>
 #include <gtk/gtk.h>
 #include <math.h>
 #include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#endif
 
 #define MATE_DESKTOP_USE_UNSTABLE_API
 #include <eel/eel-debug.h>
@@ -44,6 +52,7 @@
 #include <eel/eel-vfs-extensions.h>
 #include <libmate-desktop/mate-desktop-thumbnail.h>
 
+#include "caja-debug-log.h"
 #include "caja-directory-notify.h"
 #include "caja-file-private.h"
 #include "caja-file-utilities.h"
@@ -61,6 +70,26 @@
 /* Cool-off period between last file modification time and thumbnail creation */
 #define THUMBNAIL_CREATION_DELAY_SECS 3
 
+/* Upper bound for the number of thumbnail workers, whatever the
+   thumbnail-workers setting or the processor count say. */
+#define THUMBNAIL_MAX_WORKERS 32
+
+/* Workers allowed to thumbnail files from spinning disks at once. More than
+   this only makes the disks seek between the files. */
+#define THUMBNAIL_ROTATIONAL_MAX_WORKERS 2
+
+/* The factories of this slot belong to the background thread */
+#define THUMBNAIL_BACKGROUND_SLOT THUMBNAIL_MAX_WORKERS
+
+/* How often the background thread looks whether the workers are done */
+#define THUMBNAIL_BACKGROUND_WAIT_USECS G_USEC_PER_SEC
+
+/* The background thread's processor and disk priorities: the lowest */
+#define THUMBNAIL_BACKGROUND_NICE 19
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_WHO_PROCESS 1
+
 static void thumbnail_thread_func(GTask *task, gpointer source_object,
                                   gpointer task_data,
                                   GCancellable *cancellable);
@@ -72,38 +101,89 @@ typedef struct {
   char *image_uri;
   char *mime_type;
   time_t original_file_mtime;
+  /* The thumbnail size asked for, one of the CAJA_THUMBNAIL_SIZE_* */
+  int size;
+  /* Distance from the visible part of the view, in viewport pages, and
+     the order in which the info got that priority. */
+  guint priority;
+  guint64 serial;
+  /* Position in thumbnails_to_make, or NULL while a worker makes the
+     thumbnail. The info stays in thumbnails_to_make_hash meanwhile. */
+  GSequenceIter *iter;
 } CajaThumbnailInfo;
 
 /*
  * Thumbnail thread state.
  */
 
-/* The id of the idle handler used to start the thumbnail thread, or 0 if no
+/* The id of the idle handler used to start thumbnail workers, or 0 if no
    idle handler is currently registered. */
 static guint thumbnail_thread_starter_id = 0;
 
 /* Our mutex used when accessing data shared between the main thread and the
-   thumbnail thread, i.e. the thumbnail_thread_is_running flag and the
+   thumbnail workers, i.e. the worker bookkeeping, the statistics and the
    thumbnails_to_make list. */
 static GMutex thumbnails_mutex;
 
-/* A flag to indicate whether a thumbnail thread is running, so we don't
-   start more than one. Lock thumbnails_mutex when accessing this. */
-static volatile gboolean thumbnail_thread_is_running = FALSE;
-
-/* The list of CajaThumbnailInfo structs containing information about the
-   thumbnails we are making. Lock thumbnails_mutex when accessing this. */
-static volatile GQueue thumbnails_to_make = G_QUEUE_INIT;
-
-/* Quickly check if uri is in thumbnails_to_make list */
+/* The number of running workers and the number we want to run, so we know
+   whether starting another one helps. Lock thumbnails_mutex when accessing
+   these. */
+static guint thumbnail_workers_running = 0;
+static guint thumbnail_workers_wanted = 0;
+
+/* Which worker slots are taken. Each slot has its own thumbnail factory, so
+   the workers don't serialize on the lock inside a shared one. The
+   factories are created in the main thread and kept around. */
+static gboolean thumbnail_worker_busy[THUMBNAIL_MAX_WORKERS];
+static MateDesktopThumbnailFactory
+    *thumbnail_factories[THUMBNAIL_MAX_WORKERS + 1];
+
+/* The same for the large size, only created once a view asks for large
+   thumbnails. There are no factories for the x-large size; those
+   thumbnails are made and saved by us. */
+static MateDesktopThumbnailFactory
+    *thumbnail_large_factories[THUMBNAIL_MAX_WORKERS + 1];
+static gboolean thumbnail_large_factories_wanted = FALSE;
+
+/* Whether the background thread runs, whether it should, and the number of
+   background infos in thumbnails_to_make. The background thread waits on
+   the condition while the workers are busy. Lock thumbnails_mutex when
+   accessing these. */
+static gboolean thumbnail_background_running = FALSE;
+static gboolean thumbnail_background_paused = FALSE;
+static guint thumbnails_background_queued = 0;
+static GCond thumbnail_background_cond;
+
+/* The number of workers currently reading from a rotational disk, and the
+   condition they wait on when there are too many. Lock thumbnails_mutex
+   when accessing these. */
+static guint thumbnail_rotational_jobs = 0;
+static GCond thumbnail_rotational_cond;
+
+/* Maps "major:minor" device numbers to whether the device is rotational,
+   so sysfs is only read once per device. Lock thumbnails_mutex when
+   accessing this. */
+static GHashTable *rotational_devices = NULL;
+
+/* Throughput counters. Lock thumbnails_mutex when accessing these. */
+static CajaThumbnailStatistics thumbnail_statistics;
+static gint64 thumbnail_batch_start = 0;
+static guint thumbnail_batch_made = 0;
+
+/* The CajaThumbnailInfo structs containing information about the
+   thumbnails we are making, nearest to the visible part of a view first.
+   Lock thumbnails_mutex when accessing this. */
+static GSequence *thumbnails_to_make = NULL;
+
+/* Gives infos with the same priority first come, first served order. Lock
+   thumbnails_mutex when accessing this. */
+static guint64 thumbnails_next_serial = 0;
+
+/* Maps uris to the infos in thumbnails_to_make or being made by a worker,
+   to quickly check if one is there already. Lock thumbnails_mutex when
+   accessing this. */
 static GHashTable *thumbnails_to_make_hash = NULL;
 
-/* The currently thumbnailed icon. it also exists in the thumbnails_to_make list
- * to avoid adding it again. Lock thumbnails_mutex when accessing this. */
-static CajaThumbnailInfo *currently_thumbnailing = NULL;
-
-static MateDesktopThumbnailFactory *thumbnail_factory = NULL;
-
 static gboolean get_file_mtime(const char *file_uri, time_t *mtime) {
   GFile *file;
   GFileInfo *info;
@@ -134,6 +214,40 @@ static void free_thumbnail_info(CajaThumbnailInfo *info) {
   g_free(info);
 }
 
+static int compare_thumbnail_info(gconstpointer a, gconstpointer b,
+                                  gpointer user_data) {
+  const CajaThumbnailInfo *info_a = a;
+  const CajaThumbnailInfo *info_b = b;
+
+  if (info_a->priority != info_b->priority) {
+    return info_a->priority < info_b->priority ? -1 : 1;
+  }
+  if (info_a->serial != info_b->serial) {
+    return info_a->serial < info_b->serial ? -1 : 1;
+  }
+  return 0;
+}
+
+/* Adds info to thumbnails_to_make. Lock thumbnails_mutex when calling
+   this. */
+static void queue_thumbnail_info(CajaThumbnailInfo *info) {
+  info->iter = g_sequence_insert_sorted(thumbnails_to_make, info,
+                                        compare_thumbnail_info, NULL);
+  if (info->priority == CAJA_THUMBNAIL_PRIORITY_BACKGROUND) {
+    thumbnails_background_queued++;
+  }
+}
+
+/* Takes info out of thumbnails_to_make. Lock thumbnails_mutex when calling
+   this. */
+static void unqueue_thumbnail_info(CajaThumbnailInfo *info) {
+  if (info->priority == CAJA_THUMBNAIL_PRIORITY_BACKGROUND) {
+    thumbnails_background_queued--;
+  }
+  g_sequence_remove(info->iter);
+  info->iter = NULL;
+}
+
 static MateDesktopThumbnailFactory *get_thumbnail_factory(void) {
   static MateDesktopThumbnailFactory *thumbnail_factory = NULL;
 
@@ -145,37 +259,222 @@ static MateDesktopThumbnailFactory *get_thumbnail_factory(void) {
   return thumbnail_factory;
 }
 
+/* The freedesktop thumbnail sizes, and the folders in the thumbnail cache
+   holding each */
+static const struct {
+  int size;
+  const char *folder;
+} thumbnail_sizes[] = {
+    {CAJA_THUMBNAIL_SIZE_NORMAL, "normal"},
+    {CAJA_THUMBNAIL_SIZE_LARGE, "large"},
+    {CAJA_THUMBNAIL_SIZE_XLARGE, "x-large"},
+};
+
+/* Returns the smallest thumbnail size that fills pixels, or the largest
+   one there is. */
+int caja_thumbnail_size_for_pixels(int pixels) {
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(thumbnail_sizes); i++) {
+    if (thumbnail_sizes[i].size >= pixels) {
+      return thumbnail_sizes[i].size;
+    }
+  }
+  return CAJA_THUMBNAIL_SIZE_XLARGE;
+}
+
+/* Tells the size of a thumbnail by the folder it is in. Thumbnails from
+   elsewhere count as normal ones. */
+int caja_thumbnail_get_size_for_path(const char *path) {
+  char *folder, *name;
+  int size;
+  guint i;
+
+  folder = g_path_get_dirname(path);
+  name = g_path_get_basename(folder);
+
+  size = CAJA_THUMBNAIL_SIZE_NORMAL;
+  for (i = 0; i < G_N_ELEMENTS(thumbnail_sizes); i++) {
+    if (strcmp(name, thumbnail_sizes[i].folder) == 0) {
+      size = thumbnail_sizes[i].size;
+      break;
+    }
+  }
+
+  g_free(name);
+  g_free(folder);
+
+  return size;
+}
+
+static char *get_thumbnail_path(const char *uri, guint size_index) {
+  char *md5, *file_name, *path;
+
+  md5 = g_compute_checksum_for_string(G_CHECKSUM_MD5, uri, -1);
+  file_name = g_strconcat(md5, ".png", NULL);
+  path = g_build_filename(g_get_user_cache_dir(), "thumbnails",
+                          thumbnail_sizes[size_index].folder, file_name,
+                          NULL);
+  g_free(file_name);
+  g_free(md5);
+
+  return path;
+}
+
+static guint get_size_index(int size) {
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(thumbnail_sizes) - 1; i++) {
+    if (thumbnail_sizes[i].size >= size) {
+      break;
+    }
+  }
+  return i;
+}
+
+char *caja_thumbnail_find_path(const char *uri, int min_size, int *size) {
+  char *path;
+  guint i;
+
+  for (i = get_size_index(min_size); i < G_N_ELEMENTS(thumbnail_sizes); i++) {
+    path = get_thumbnail_path(uri, i);
+    if (g_file_test(path, G_FILE_TEST_EXISTS)) {
+      if (size != NULL) {
+        *size = thumbnail_sizes[i].size;
+      }
+      return path;
+    }
+    g_free(path);
+  }
+
+  return NULL;
+}
+
+static guint get_thumbnail_worker_count(void) {
+  int workers;
+
+  workers = g_settings_get_int(caja_preferences,
+                               CAJA_PREFERENCES_THUMBNAIL_WORKERS);
+  if (workers <= 0) {
+    workers = g_get_num_processors();
+  }
+
+  return CLAMP(workers, 1, THUMBNAIL_MAX_WORKERS);
+}
+
+/* Creates the large size factories for the worker slots that may run.
+   Only call this from the main thread. */
+static void ensure_large_factories(guint workers) {
+  guint slot;
+
+  thumbnail_large_factories_wanted = TRUE;
+  for (slot = 0; slot < workers; slot++) {
+    if (thumbnail_large_factories[slot] == NULL) {
+      thumbnail_large_factories[slot] =
+          mate_desktop_thumbnail_factory_new(MATE_DESKTOP_THUMBNAIL_SIZE_LARGE);
+    }
+  }
+}
+
 /* This function is added as a very low priority idle function to start the
-   thread to create any needed thumbnails. It is added with a very low priority
-   so that it doesn't delay showing the directory in the icon/list views.
-   We want to show the files in the directory as quickly as possible. */
+   workers that create any needed thumbnails. It is added with a very low
+   priority so that it doesn't delay showing the directory in the icon/list
+   views. We want to show the files in the directory as quickly as possible. */
 static gboolean thumbnail_thread_starter_cb(gpointer data) {
   GTask *task;
+  guint wanted, waiting, slot;
+
+  wanted = get_thumbnail_worker_count();
+
+  /* Don't do this in a worker, the factories watch the thumbnailer
+     directories from the main context */
+  for (slot = 0; slot < wanted; slot++) {
+    if (thumbnail_factories[slot] == NULL) {
+      thumbnail_factories[slot] =
+          slot == 0 ? g_object_ref(get_thumbnail_factory())
+                    : mate_desktop_thumbnail_factory_new(
+                          MATE_DESKTOP_THUMBNAIL_SIZE_NORMAL);
+    }
+  }
+  if (thumbnail_large_factories_wanted) {
+    ensure_large_factories(wanted);
+  }
 
-  /* Don't do this in thread, since g_object_ref is not threadsafe */
-  if (thumbnail_factory == NULL) {
-    thumbnail_factory = get_thumbnail_factory();
+  g_mutex_lock(&thumbnails_mutex);
+
+  /*********************************
+   * MUTEX LOCKED
+   *********************************/
+
+  thumbnail_workers_wanted = wanted;
+  thumbnail_thread_starter_id = 0;
+
+  /* Queued infos are never in progress, so this is the work left over for
+     new workers. The background ones aren't theirs. */
+  waiting = g_sequence_get_length(thumbnails_to_make) -
+            thumbnails_background_queued;
+  if (thumbnail_workers_running < wanted) {
+    waiting = MIN(waiting, wanted - thumbnail_workers_running);
+  } else {
+    waiting = 0;
   }
 
+  if (thumbnail_workers_running == 0 && waiting > 0) {
+    thumbnail_batch_start = g_get_monotonic_time();
+    thumbnail_batch_made = 0;
+  }
+
+  for (slot = 0; slot < wanted && waiting > 0; slot++) {
+    if (thumbnail_worker_busy[slot]) {
+      continue;
+    }
+
 #ifdef DEBUG_THUMBNAILS
-  g_message("(Main Thread) Creating thumbnails thread\n");
+    g_message("(Main Thread) Creating thumbnail worker %u\n", slot);
 #endif
-  /* We set a flag to indicate the thread is running, so we don't create
-     a new one. We don't need to lock a mutex here, as the thumbnail
-     thread isn't running yet. And we know we won't create the thread
-     twice, as we also check thumbnail_thread_starter_id before
-     scheduling this idle function. */
-  thumbnail_thread_is_running = TRUE;
-  task = g_task_new(NULL, NULL, NULL, NULL);
-  g_task_run_in_thread(task, thumbnail_thread_func);
+    thumbnail_worker_busy[slot] = TRUE;
+    thumbnail_workers_running++;
+    waiting--;
+
+    task = g_task_new(NULL, NULL, NULL, NULL);
+    g_task_set_task_data(task, GUINT_TO_POINTER(slot), NULL);
+    g_task_run_in_thread(task, thumbnail_thread_func);
+    g_object_unref(task);
+  }
 
-  thumbnail_thread_starter_id = 0;
+  /*********************************
+   * MUTEX UNLOCKED
+   *********************************/
 
-  g_object_unref(task);
+  g_mutex_unlock(&thumbnails_mutex);
 
   return FALSE;
 }
 
+/* If we could use another thumbnail worker, and we haven't scheduled an
+   idle function to start one up, do that now. We don't want to start it
+   until all the other work is done, so the GUI will be updated as quickly
+   as possible. Lock thumbnails_mutex when calling this. */
+static void schedule_thumbnail_workers(void) {
+  if ((thumbnail_workers_running == 0 ||
+       thumbnail_workers_running < thumbnail_workers_wanted) &&
+      thumbnail_thread_starter_id == 0) {
+    thumbnail_thread_starter_id = g_idle_add_full(
+        G_PRIORITY_LOW, thumbnail_thread_starter_cb, NULL, NULL);
+  }
+}
+
+void caja_thumbnail_get_statistics(CajaThumbnailStatistics *statistics) {
+  g_mutex_lock(&thumbnails_mutex);
+  *statistics = thumbnail_statistics;
+  statistics->workers_running = thumbnail_workers_running;
+  statistics->queued = thumbnails_to_make != NULL
+                           ? g_sequence_get_length(thumbnails_to_make)
+                           : 0;
+  statistics->background_queued = thumbnails_background_queued;
+  g_mutex_unlock(&thumbnails_mutex);
+}
+
 void caja_thumbnail_remove_from_queue(const char *file_uri) {
 #ifdef DEBUG_THUMBNAILS
   g_message("(Remove from queue) Locking mutex\n");
@@ -187,14 +486,14 @@ void caja_thumbnail_remove_from_queue(const char *file_uri) {
    *********************************/
 
   if (thumbnails_to_make_hash) {
-    GList *node;
+    CajaThumbnailInfo *info;
 
-    node = g_hash_table_lookup(thumbnails_to_make_hash, file_uri);
+    info = g_hash_table_lookup(thumbnails_to_make_hash, file_uri);
 
-    if (node && node->data != currently_thumbnailing) {
+    if (info && info->iter != NULL) {
       g_hash_table_remove(thumbnails_to_make_hash, file_uri);
-      free_thumbnail_info(node->data);
-      g_queue_delete_link((GQueue *)&thumbnails_to_make, node);
+      unqueue_thumbnail_info(info);
+      free_thumbnail_info(info);
     }
   }
 
@@ -208,7 +507,11 @@ void caja_thumbnail_remove_from_queue(const char *file_uri) {
   g_mutex_unlock(&thumbnails_mutex);
 }
 
-void caja_thumbnail_prioritize(const char *file_uri) {
+void caja_thumbnail_set_priority(const char *file_uri, guint distance) {
+  guint priority;
+
+  priority = MIN(distance, CAJA_THUMBNAIL_PRIORITY_DEFERRED);
+
 #ifdef DEBUG_THUMBNAILS
   g_message("(Prioritize) Locking mutex\n");
 #endif
@@ -219,13 +522,28 @@ void caja_thumbnail_prioritize(const char *file_uri) {
    *********************************/
 
   if (thumbnails_to_make_hash) {
-    GList *node;
-
-    node = g_hash_table_lookup(thumbnails_to_make_hash, file_uri);
-
-    if (node && node->data != currently_thumbnailing) {
-      g_queue_unlink((GQueue *)&thumbnails_to_make, node);
-      g_queue_push_head_link((GQueue *)&thumbnails_to_make, node);
+    CajaThumbnailInfo *info;
+
+    info = g_hash_table_lookup(thumbnails_to_make_hash, file_uri);
+
+    /* Keeping the serial of unchanged priorities keeps the order within
+       a priority stable while the view scrolls */
+    if (info && info->priority != priority) {
+      if (info->iter != NULL &&
+          info->priority == CAJA_THUMBNAIL_PRIORITY_BACKGROUND) {
+        /* A view shows a file only pre-generation wanted so far */
+        unqueue_thumbnail_info(info);
+        info->priority = priority;
+        info->serial = thumbnails_next_serial++;
+        queue_thumbnail_info(info);
+        schedule_thumbnail_workers();
+      } else {
+        info->priority = priority;
+        info->serial = thumbnails_next_serial++;
+        if (info->iter != NULL) {
+          g_sequence_sort_changed(info->iter, compare_thumbnail_info, NULL);
+        }
+      }
     }
   }
 
@@ -239,6 +557,496 @@ void caja_thumbnail_prioritize(const char *file_uri) {
   g_mutex_unlock(&thumbnails_mutex);
 }
 
+/***************************************************************************
+ * Fast paths for photos.
+ ***************************************************************************/
+
+/* Previews bigger than this are not worth reading, the factory will do */
+#define PREVIEW_MAX_BYTES (32 * 1024 * 1024)
+
+/* How far a preview's aspect ratio may be off from the photo's before we
+   take it for letterboxed */
+#define PREVIEW_MAX_ASPECT_ERROR 0.02
+
+/* Limits for walking TIFF structures, which may be corrupt or hostile */
+#define TIFF_MAX_IFD_ENTRIES 1024
+#define TIFF_MAX_DEPTH 3
+#define TIFF_MAX_CHAINED_IFDS 4
+#define TIFF_MAX_SUB_IFDS 8
+
+/* Camera raw formats that are TIFF files inside, with JPEG previews */
+static const char *const raw_mime_types[] = {
+    "image/x-adobe-dng",  "image/x-canon-cr2", "image/x-nikon-nef",
+    "image/x-nikon-nrw",  "image/x-olympus-orf", "image/x-panasonic-rw2",
+    "image/x-pentax-pef", "image/x-samsung-srw", "image/x-sony-arw",
+    "image/x-sony-sr2",   "image/x-sony-srf",  NULL};
+
+typedef struct {
+  goffset offset;
+  gsize length;
+  int width;
+  int height;
+} JpegPreview;
+
+typedef struct {
+  FILE *file;
+  /* where the TIFF header starts in the file */
+  goffset base;
+  gboolean big_endian;
+
+  int orientation;
+  GArray *previews;
+} TiffReader;
+
+static gboolean read_at(FILE *file, goffset offset, void *buffer, gsize len) {
+  if (offset < 0 || fseeko(file, offset, SEEK_SET) != 0) {
+    return FALSE;
+  }
+  return fread(buffer, 1, len, file) == len;
+}
+
+static guint16 tiff_get16(TiffReader *reader, const guchar *p) {
+  return reader->big_endian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+}
+
+static guint32 tiff_get32(TiffReader *reader, const guchar *p) {
+  return reader->big_endian ? ((guint32)p[0] << 24) | (p[1] << 16) |
+                                  (p[2] << 8) | p[3]
+                            : ((guint32)p[3] << 24) | (p[2] << 16) |
+                                  (p[1] << 8) | p[0];
+}
+
+/* Finds the size of the JPEG at offset in its start of frame marker,
+   without decoding anything. */
+static gboolean get_jpeg_size(FILE *file, goffset offset, goffset end,
+                              int *width, int *height) {
+  guchar marker[9];
+  guint length;
+
+  if (!read_at(file, offset, marker, 2) || marker[0] != 0xff ||
+      marker[1] != 0xd8) {
+    return FALSE;
+  }
+  offset += 2;
+
+  while (end < 0 || offset + 4 <= end) {
+    if (!read_at(file, offset, marker, 4) || marker[0] != 0xff) {
+      return FALSE;
+    }
+    length = (marker[2] << 8) | marker[3];
+    if (length < 2) {
+      return FALSE;
+    }
+
+    /* SOF0 to SOF15, except DHT, JPG and DAC which share the range */
+    if (marker[1] >= 0xc0 && marker[1] <= 0xcf && marker[1] != 0xc4 &&
+        marker[1] != 0xc8 && marker[1] != 0xcc) {
+      if (!read_at(file, offset + 4, marker, 5)) {
+        return FALSE;
+      }
+      *height = (marker[1] << 8) | marker[2];
+      *width = (marker[3] << 8) | marker[4];
+      return *width > 0 && *height > 0;
+    }
+    if (marker[1] == 0xda) {
+      /* start of scan without a frame */
+      return FALSE;
+    }
+
+    offset += 2 + length;
+  }
+
+  return FALSE;
+}
+
+static void add_jpeg_preview(TiffReader *reader, guint32 offset,
+                             guint32 length) {
+  JpegPreview preview;
+
+  if (length == 0 || length > PREVIEW_MAX_BYTES) {
+    return;
+  }
+
+  preview.offset = reader->base + offset;
+  preview.length = length;
+  if (get_jpeg_size(reader->file, preview.offset, preview.offset + length,
+                    &preview.width, &preview.height)) {
+    g_array_append_val(reader->previews, preview);
+  }
+}
+
+static void scan_ifd(TiffReader *reader, guint32 ifd_offset, int depth);
+
+/* Collects the orientation and the JPEG previews of one IFD, and of the
+   IFDs hanging off it. Returns the offset of the next IFD in the chain. */
+static guint32 scan_one_ifd(TiffReader *reader, guint32 ifd_offset,
+                            int depth) {
+  guchar entry[12], count_bytes[2], next[4];
+  guint32 jpeg_offset = 0, jpeg_length = 0;
+  guint32 strip_offset = 0, strip_length = 0;
+  guint32 sub_ifds[TIFF_MAX_SUB_IFDS];
+  guint n_sub_ifds = 0;
+  guint compression = 0, subfile_type = 0;
+  guint16 n_entries, tag, type;
+  guint32 count, value;
+  guint i;
+
+  if (!read_at(reader->file, reader->base + ifd_offset, count_bytes, 2)) {
+    return 0;
+  }
+  n_entries = tiff_get16(reader, count_bytes);
+  if (n_entries > TIFF_MAX_IFD_ENTRIES) {
+    return 0;
+  }
+
+  for (i = 0; i < n_entries; i++) {
+    if (!read_at(reader->file, reader->base + ifd_offset + 2 + i * 12, entry,
+                 12)) {
+      return 0;
+    }
+    tag = tiff_get16(reader, entry);
+    type = tiff_get16(reader, entry + 2);
+    count = tiff_get32(reader, entry + 4);
+    /* SHORT values sit in the first half of the value field */
+    value = type == 3 ? tiff_get16(reader, entry + 8)
+                      : tiff_get32(reader, entry + 8);
+
+    switch (tag) {
+      case 0x00fe: /* NewSubfileType */
+        subfile_type = value;
+        break;
+      case 0x0103: /* Compression */
+        compression = value;
+        break;
+      case 0x0111: /* StripOffsets */
+        strip_offset = count == 1 ? value : 0;
+        break;
+      case 0x0117: /* StripByteCounts */
+        strip_length = count == 1 ? value : 0;
+        break;
+      case 0x0112: /* Orientation */
+        if (depth == 0 && value >= 1 && value <= 8) {
+          reader->orientation = value;
+        }
+        break;
+      case 0x0201: /* JPEGInterchangeFormat */
+        jpeg_offset = value;
+        break;
+      case 0x0202: /* JPEGInterchangeFormatLength */
+        jpeg_length = value;
+        break;
+      case 0x014a: /* SubIFDs */
+        if (count == 1) {
+          sub_ifds[n_sub_ifds++] = value;
+        } else {
+          guchar offsets[4 * TIFF_MAX_SUB_IFDS];
+
+          count = MIN(count, TIFF_MAX_SUB_IFDS);
+          if (read_at(reader->file, reader->base + value, offsets, 4 * count)) {
+            for (n_sub_ifds = 0; n_sub_ifds < count; n_sub_ifds++) {
+              sub_ifds[n_sub_ifds] =
+                  tiff_get32(reader, offsets + 4 * n_sub_ifds);
+            }
+          }
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  if (jpeg_offset != 0) {
+    add_jpeg_preview(reader, jpeg_offset, jpeg_length);
+  }
+  /* Reduced resolution JPEG strips are previews too; full resolution ones
+     are lossless JPEG raw data that gdk-pixbuf can't read */
+  if (strip_offset != 0 &&
+      (compression == 6 || (compression == 7 && subfile_type == 1))) {
+    add_jpeg_preview(reader, strip_offset, strip_length);
+  }
+
+  for (i = 0; i < n_sub_ifds; i++) {
+    scan_ifd(reader, sub_ifds[i], depth + 1);
+  }
+
+  if (!read_at(reader->file, reader->base + ifd_offset + 2 + n_entries * 12,
+               next, 4)) {
+    return 0;
+  }
+  return tiff_get32(reader, next);
+}
+
+static void scan_ifd(TiffReader *reader, guint32 ifd_offset, int depth) {
+  int i;
+
+  if (depth > TIFF_MAX_DEPTH) {
+    return;
+  }
+
+  for (i = 0; ifd_offset != 0 && i < TIFF_MAX_CHAINED_IFDS; i++) {
+    ifd_offset = scan_one_ifd(reader, ifd_offset, depth);
+  }
+}
+
+/* Reads the TIFF structure at base: an EXIF block in a JPEG, or a whole
+   camera raw file. */
+static gboolean scan_tiff(TiffReader *reader) {
+  guchar header[8];
+  guint16 magic;
+
+  if (!read_at(reader->file, reader->base, header, 8)) {
+    return FALSE;
+  }
+  if (header[0] == 'M' && header[1] == 'M') {
+    reader->big_endian = TRUE;
+  } else if (header[0] == 'I' && header[1] == 'I') {
+    reader->big_endian = FALSE;
+  } else {
+    return FALSE;
+  }
+
+  /* TIFF, and the variants Olympus and Panasonic use */
+  magic = tiff_get16(reader, header + 2);
+  if (magic != 42 && magic != 0x4f52 && magic != 0x5352 && magic != 0x55) {
+    return FALSE;
+  }
+
+  scan_ifd(reader, tiff_get32(reader, header + 4), 0);
+
+  return TRUE;
+}
+
+/* Finds the EXIF block of a JPEG file and returns where its TIFF header
+   starts, or -1. */
+static goffset find_jpeg_exif(FILE *file) {
+  guchar marker[10];
+  goffset offset;
+  guint length;
+
+  offset = 2;
+  for (;;) {
+    if (!read_at(file, offset, marker, 4) || marker[0] != 0xff) {
+      return -1;
+    }
+    length = (marker[2] << 8) | marker[3];
+    /* EXIF comes before the image data */
+    if (length < 2 || marker[1] == 0xda || (marker[1] >= 0xc0 &&
+                                            marker[1] <= 0xcf)) {
+      return -1;
+    }
+    if (marker[1] == 0xe1 && length >= 8 &&
+        read_at(file, offset + 4, marker, 6) &&
+        memcmp(marker, "Exif\0\0", 6) == 0) {
+      return offset + 10;
+    }
+    offset += 2 + length;
+  }
+}
+
+static void thumbnail_fast_size_prepared(GdkPixbufLoader *loader, int width,
+                                         int height, gpointer user_data) {
+  int size;
+
+  size = GPOINTER_TO_INT(user_data);
+  if (width > size || height > size) {
+    if (width > height) {
+      height = MAX(height * size / width, 1);
+      width = size;
+    } else {
+      width = MAX(width * size / height, 1);
+      height = size;
+    }
+    /* For JPEG this makes libjpeg decode at 1/2, 1/4 or 1/8 scale in
+       the DCT domain before the remaining scaling */
+    gdk_pixbuf_loader_set_size(loader, width, height);
+  }
+}
+
+/* Decodes the JPEG at offset scaled down to fit size. A length of -1 reads
+   to the end of the file. */
+static GdkPixbuf *load_scaled_jpeg(FILE *file, goffset offset, gssize length,
+                                   int size) {
+  GdkPixbufLoader *loader;
+  GdkPixbuf *pixbuf;
+  guchar buffer[65536];
+  gsize chunk;
+  gboolean ok;
+
+  if (fseeko(file, offset, SEEK_SET) != 0) {
+    return NULL;
+  }
+
+  loader = gdk_pixbuf_loader_new_with_type("jpeg", NULL);
+  if (loader == NULL) {
+    return NULL;
+  }
+  g_signal_connect(loader, "size-prepared",
+                   G_CALLBACK(thumbnail_fast_size_prepared),
+                   GINT_TO_POINTER(size));
+
+  ok = TRUE;
+  while (ok && length != 0) {
+    chunk = length < 0 ? sizeof(buffer) : MIN(sizeof(buffer), (gsize)length);
+    chunk = fread(buffer, 1, chunk, file);
+    if (chunk == 0) {
+      break;
+    }
+    ok = gdk_pixbuf_loader_write(loader, buffer, chunk, NULL);
+    if (length > 0) {
+      length -= chunk;
+    }
+  }
+
+  pixbuf = NULL;
+  if (gdk_pixbuf_loader_close(loader, NULL) && ok) {
+    pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
+    if (pixbuf != NULL) {
+      g_object_ref(pixbuf);
+    }
+  }
+  g_object_unref(loader);
+
+  return pixbuf;
+}
+
+/* Picks the smallest preview that still fills size and shows the whole
+   picture, or NULL. A photo_width of 0 means the photo size is unknown and
+   the largest preview is taken for the photo. */
+static JpegPreview *choose_preview(GArray *previews, int photo_width,
+                                   int photo_height, int size) {
+  JpegPreview *preview, *best;
+  double aspect;
+  guint i;
+
+  if (previews->len == 0) {
+    return NULL;
+  }
+
+  if (photo_width == 0) {
+    for (i = 0; i < previews->len; i++) {
+      preview = &g_array_index(previews, JpegPreview, i);
+      if (preview->width * preview->height > photo_width * photo_height) {
+        photo_width = preview->width;
+        photo_height = preview->height;
+      }
+    }
+  }
+  aspect = (double)photo_width / photo_height;
+
+  best = NULL;
+  for (i = 0; i < previews->len; i++) {
+    preview = &g_array_index(previews, JpegPreview, i);
+    if (MAX(preview->width, preview->height) < size ||
+        fabs((double)preview->width / preview->height - aspect) >
+            aspect * PREVIEW_MAX_ASPECT_ERROR) {
+      continue;
+    }
+    if (best == NULL || preview->width < best->width) {
+      best = preview;
+    }
+  }
+
+  return best;
+}
+
+static gboolean is_raw_mime_type(const char *mime_type) {
+  int i;
+
+  for (i = 0; raw_mime_types[i] != NULL; i++) {
+    if (strcmp(mime_type, raw_mime_types[i]) == 0) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/* Makes a thumbnail fitting size for a JPEG or camera raw photo without
+   decoding the whole photo. It takes the preview the camera embedded, or
+   else decodes the JPEG scaled down in the DCT domain. Returns NULL for
+   other files, and for files this can't handle; the thumbnail factory has
+   to make those. Safe to call from any thread. */
+GdkPixbuf *caja_thumbnail_generate_fast(const char *uri, const char *mime_type,
+                                        int size, gboolean *used_preview) {
+  TiffReader reader = {NULL};
+  JpegPreview *preview;
+  GdkPixbuf *pixbuf, *oriented;
+  gboolean is_jpeg;
+  char *path, orientation[2];
+  int photo_width, photo_height;
+
+  *used_preview = FALSE;
+
+  if (mime_type == NULL) {
+    return NULL;
+  }
+
+  is_jpeg = strcmp(mime_type, "image/jpeg") == 0;
+  if (!is_jpeg && !is_raw_mime_type(mime_type)) {
+    return NULL;
+  }
+
+  path = g_filename_from_uri(uri, NULL, NULL);
+  if (path == NULL) {
+    return NULL;
+  }
+  reader.file = fopen(path, "rb");
+  g_free(path);
+  if (reader.file == NULL) {
+    return NULL;
+  }
+
+  reader.orientation = 1;
+  reader.previews = g_array_new(FALSE, FALSE, sizeof(JpegPreview));
+
+  photo_width = photo_height = 0;
+  if (is_jpeg) {
+    if (!get_jpeg_size(reader.file, 0, -1, &photo_width, &photo_height)) {
+      photo_width = photo_height = 0;
+      is_jpeg = FALSE;
+    }
+    reader.base = find_jpeg_exif(reader.file);
+    if (reader.base >= 0) {
+      scan_tiff(&reader);
+    }
+  } else {
+    reader.base = 0;
+    scan_tiff(&reader);
+  }
+
+  pixbuf = NULL;
+  preview = choose_preview(reader.previews, photo_width, photo_height, size);
+  if (preview != NULL) {
+    pixbuf = load_scaled_jpeg(reader.file, preview->offset, preview->length,
+                              size);
+    if (pixbuf != NULL) {
+      *used_preview = TRUE;
+
+      /* The preview has no EXIF of its own, it goes by the photo's */
+      if (reader.orientation != 1 &&
+          gdk_pixbuf_get_option(pixbuf, "orientation") == NULL) {
+        orientation[0] = '0' + reader.orientation;
+        orientation[1] = '\0';
+        gdk_pixbuf_set_option(pixbuf, "orientation", orientation);
+      }
+    }
+  }
+
+  if (pixbuf == NULL && is_jpeg) {
+    pixbuf = load_scaled_jpeg(reader.file, 0, -1, size);
+  }
+
+  if (pixbuf != NULL) {
+    oriented = gdk_pixbuf_apply_embedded_orientation(pixbuf);
+    g_object_unref(pixbuf);
+    pixbuf = oriented;
+  }
+
+  g_array_free(reader.previews, TRUE);
+  fclose(reader.file);
+
+  return pixbuf;
+}
+
 /***************************************************************************
  * Thumbnail Thread Functions.
  ***************************************************************************/
@@ -250,7 +1058,9 @@ void caja_thumbnail_prioritize(const char *file_uri) {
 static gboolean thumbnail_thread_notify_file_changed(gpointer image_uri) {
   CajaFile *file;
 
-  file = caja_file_get_by_uri((char *)image_uri);
+  /* Files nobody holds on to have nothing to update, e.g. the ones
+     pre-generation made thumbnails for */
+  file = caja_file_get_existing_by_uri((char *)image_uri);
 #ifdef DEBUG_THUMBNAILS
   g_message("(Thumbnail Thread) Notifying file changed file:%p uri: %s\n", file,
             (char *)image_uri);
@@ -340,16 +1150,25 @@ gboolean caja_can_thumbnail(CajaFile *file) {
   return res;
 }
 
-void caja_create_thumbnail(CajaFile *file) {
+void caja_create_thumbnail(CajaFile *file, int size) {
   time_t file_mtime = 0;
   CajaThumbnailInfo *info;
-  GList *existing;
+  CajaThumbnailInfo *existing;
 
   caja_file_set_is_thumbnailing(file, TRUE);
 
+  size = caja_thumbnail_size_for_pixels(size);
+  file->details->thumbnail_requested_size =
+      MAX(file->details->thumbnail_requested_size, size);
+  /* The workers can't create them, they are tied to the main context */
+  if (size > CAJA_THUMBNAIL_SIZE_NORMAL) {
+    ensure_large_factories(get_thumbnail_worker_count());
+  }
+
   info = g_new0(CajaThumbnailInfo, 1);
   info->image_uri = caja_file_get_uri(file);
   info->mime_type = caja_file_get_mime_type(file);
+  info->size = size;
 
   /* Hopefully the CajaFile will already have the image file mtime,
      so we can just use that. Otherwise we have to get it ourselves. */
@@ -373,39 +1192,42 @@ void caja_create_thumbnail(CajaFile *file) {
 
   if (thumbnails_to_make_hash == NULL) {
     thumbnails_to_make_hash = g_hash_table_new(g_str_hash, g_str_equal);
+    thumbnails_to_make = g_sequence_new(NULL);
   }
 
   /* Check if it is already in the list of thumbnails to make. */
   existing = g_hash_table_lookup(thumbnails_to_make_hash, info->image_uri);
   if (existing == NULL) {
-    GList *node;
-
-    /* Add the thumbnail to the list. */
+    /* Add the thumbnail to the list. Its view tells us where it
+       actually is once it updates the priorities. */
 #ifdef DEBUG_THUMBNAILS
     g_message("(Main Thread) Adding thumbnail: %s\n", info->image_uri);
 #endif
-    g_queue_push_tail((GQueue *)&thumbnails_to_make, info);
-    node = g_queue_peek_tail_link((GQueue *)&thumbnails_to_make);
-    g_hash_table_insert(thumbnails_to_make_hash, info->image_uri, node);
-    /* If the thumbnail thread isn't running, and we haven't
-       scheduled an idle function to start it up, do that now.
-       We don't want to start it until all the other work is done,
-       so the GUI will be updated as quickly as possible.*/
-    if (thumbnail_thread_is_running == FALSE &&
-        thumbnail_thread_starter_id == 0) {
-      thumbnail_thread_starter_id = g_idle_add_full(
-          G_PRIORITY_LOW, thumbnail_thread_starter_cb, NULL, NULL);
-    }
+    info->priority = CAJA_THUMBNAIL_PRIORITY_DEFAULT;
+    info->serial = thumbnails_next_serial++;
+    queue_thumbnail_info(info);
+    g_hash_table_insert(thumbnails_to_make_hash, info->image_uri, info);
+    schedule_thumbnail_workers();
   } else {
-    CajaThumbnailInfo *existing_info;
-
 #ifdef DEBUG_THUMBNAILS
     g_message("(Main Thread) Updating non-current mtime: %s\n",
               info->image_uri);
 #endif
-    /* The file in the queue might need a new original mtime */
-    existing_info = existing->data;
-    existing_info->original_file_mtime = info->original_file_mtime;
+    /* The file in the queue might need a new original mtime, or a
+       larger thumbnail */
+    existing->original_file_mtime = info->original_file_mtime;
+    existing->size = MAX(existing->size, info->size);
+    /* Pre-generation got there first, but now a view waits for it */
+    if (existing->priority == CAJA_THUMBNAIL_PRIORITY_BACKGROUND) {
+      if (existing->iter != NULL) {
+        unqueue_thumbnail_info(existing);
+        existing->priority = CAJA_THUMBNAIL_PRIORITY_DEFAULT;
+        queue_thumbnail_info(existing);
+        schedule_thumbnail_workers();
+      } else {
+        existing->priority = CAJA_THUMBNAIL_PRIORITY_DEFAULT;
+      }
+    }
     free_thumbnail_info(info);
   }
 
@@ -419,21 +1241,465 @@ void caja_create_thumbnail(CajaFile *file) {
   g_mutex_unlock(&thumbnails_mutex);
 }
 
-/* thumbnail_thread is invoked as a separate thread to to make thumbnails. */
+static gpointer thumbnail_background_thread_func(gpointer data);
+
+/* Starts the background thread if there is work for it. Lock
+   thumbnails_mutex when calling this. */
+static void start_background_thread(void) {
+  GThread *thread;
+
+  if (thumbnail_background_running || thumbnail_background_paused ||
+      thumbnails_background_queued == 0) {
+    return;
+  }
+
+  /* Its own thread rather than a pooled one, it lowers its priority */
+  thumbnail_background_running = TRUE;
+  thread = g_thread_new("caja-thumbnail-background",
+                        thumbnail_background_thread_func, NULL);
+  g_thread_unref(thread);
+}
+
+gboolean caja_thumbnail_queue_background(const char *uri,
+                                         const char *mime_type, time_t mtime) {
+  CajaThumbnailInfo *info;
+  gboolean queued;
+
+  if (!mate_desktop_thumbnail_factory_can_thumbnail(get_thumbnail_factory(),
+                                                    uri, mime_type, mtime)) {
+    return FALSE;
+  }
+
+  /* The factories watch the thumbnailer directories from the main
+     context, so create this one here */
+  if (thumbnail_factories[THUMBNAIL_BACKGROUND_SLOT] == NULL) {
+    thumbnail_factories[THUMBNAIL_BACKGROUND_SLOT] =
+        mate_desktop_thumbnail_factory_new(MATE_DESKTOP_THUMBNAIL_SIZE_NORMAL);
+  }
+
+  g_mutex_lock(&thumbnails_mutex);
+
+  if (thumbnails_to_make_hash == NULL) {
+    thumbnails_to_make_hash = g_hash_table_new(g_str_hash, g_str_equal);
+    thumbnails_to_make = g_sequence_new(NULL);
+  }
+
+  queued = FALSE;
+  if (g_hash_table_lookup(thumbnails_to_make_hash, uri) == NULL) {
+    info = g_new0(CajaThumbnailInfo, 1);
+    info->image_uri = g_strdup(uri);
+    info->mime_type = g_strdup(mime_type);
+    info->original_file_mtime = mtime;
+    info->size = CAJA_THUMBNAIL_SIZE_NORMAL;
+    info->priority = CAJA_THUMBNAIL_PRIORITY_BACKGROUND;
+    info->serial = thumbnails_next_serial++;
+    queue_thumbnail_info(info);
+    g_hash_table_insert(thumbnails_to_make_hash, info->image_uri, info);
+
+    start_background_thread();
+    queued = TRUE;
+  }
+
+  g_mutex_unlock(&thumbnails_mutex);
+
+  return queued;
+}
+
+void caja_thumbnail_set_background_paused(gboolean paused) {
+  g_mutex_lock(&thumbnails_mutex);
+
+  thumbnail_background_paused = paused;
+  if (paused) {
+    g_cond_broadcast(&thumbnail_background_cond);
+  } else if (thumbnails_to_make != NULL) {
+    start_background_thread();
+  }
+
+  g_mutex_unlock(&thumbnails_mutex);
+}
+
+/* Checks whether the local file behind uri lives on a spinning disk, going
+   by the queue attributes the kernel exports for its block device. Call
+   this without thumbnails_mutex held. */
+static gboolean file_is_on_rotational_disk(const char *uri) {
+#ifdef __linux__
+  struct stat st;
+  char *path, *key, *sysfs, *contents;
+  gpointer cached;
+  gboolean rotational, found;
+
+  path = g_filename_from_uri(uri, NULL, NULL);
+  if (path == NULL) {
+    return FALSE;
+  }
+  found = stat(path, &st) == 0;
+  g_free(path);
+  if (!found) {
+    return FALSE;
+  }
+
+  key = g_strdup_printf("%u:%u", major(st.st_dev), minor(st.st_dev));
+
+  g_mutex_lock(&thumbnails_mutex);
+  cached = rotational_devices != NULL
+               ? g_hash_table_lookup(rotational_devices, key)
+               : NULL;
+  g_mutex_unlock(&thumbnails_mutex);
+
+  if (cached != NULL) {
+    g_free(key);
+    return GPOINTER_TO_INT(cached) == 2;
+  }
+
+  /* Partitions keep the queue attributes on their parent device */
+  contents = NULL;
+  sysfs = g_strdup_printf("/sys/dev/block/%s/queue/rotational", key);
+  if (!g_file_get_contents(sysfs, &contents, NULL, NULL)) {
+    g_free(sysfs);
+    sysfs = g_strdup_printf("/sys/dev/block/%s/../queue/rotational", key);
+    g_file_get_contents(sysfs, &contents, NULL, NULL);
+  }
+  g_free(sysfs);
+
+  rotational = contents != NULL && contents[0] == '1';
+  g_free(contents);
+
+  g_mutex_lock(&thumbnails_mutex);
+  if (rotational_devices == NULL) {
+    rotational_devices =
+        g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  }
+  /* Stores 1 or 2 so that a cached FALSE isn't NULL */
+  g_hash_table_insert(rotational_devices, key,
+                      GINT_TO_POINTER(rotational ? 2 : 1));
+  g_mutex_unlock(&thumbnails_mutex);
+
+  return rotational;
+#else
+  return FALSE;
+#endif
+}
+
+/* Done with an info a worker took. Frees it, unless the original file
+   mtime of the request changed meanwhile, or a larger thumbnail was asked
+   for; then the thumbnail needs to be redone and the info goes back into
+   the queue. Its old serial puts it ahead of the others with its priority.
+   Lock thumbnails_mutex when calling this. */
+static void finish_thumbnail_info(CajaThumbnailInfo *info,
+                                  time_t made_for_mtime, int made_for_size) {
+  g_assert(g_hash_table_lookup(thumbnails_to_make_hash, info->image_uri) ==
+           info);
+
+  if (info->original_file_mtime == made_for_mtime &&
+      info->size <= made_for_size) {
+    g_hash_table_remove(thumbnails_to_make_hash, info->image_uri);
+    free_thumbnail_info(info);
+  } else {
+    queue_thumbnail_info(info);
+    if (info->priority < CAJA_THUMBNAIL_PRIORITY_BACKGROUND) {
+      schedule_thumbnail_workers();
+    }
+  }
+}
+
+/* Scales pixbuf down to fit size, keeping its aspect ratio. Returns a new
+   reference. */
+static GdkPixbuf *scale_to_size(GdkPixbuf *pixbuf, int size) {
+  int width, height;
+
+  width = gdk_pixbuf_get_width(pixbuf);
+  height = gdk_pixbuf_get_height(pixbuf);
+  if (width <= size && height <= size) {
+    return g_object_ref(pixbuf);
+  }
+
+  if (width > height) {
+    height = MAX(height * size / width, 1);
+    width = size;
+  } else {
+    width = MAX(width * size / height, 1);
+    height = size;
+  }
+  return gdk_pixbuf_scale_simple(pixbuf, width, height, GDK_INTERP_BILINEAR);
+}
+
+/* Looks for an up to date thumbnail of uri larger than size, and returns
+   it scaled down to size, or NULL. */
+static GdkPixbuf *load_larger_thumbnail(const char *uri, time_t mtime,
+                                        int size) {
+  GdkPixbuf *pixbuf, *scaled;
+  const char *thumb_mtime;
+  char *path;
+  guint i;
+
+  for (i = get_size_index(size) + 1; i < G_N_ELEMENTS(thumbnail_sizes); i++) {
+    path = get_thumbnail_path(uri, i);
+    pixbuf = gdk_pixbuf_new_from_file(path, NULL);
+    g_free(path);
+    if (pixbuf == NULL) {
+      continue;
+    }
+
+    thumb_mtime = gdk_pixbuf_get_option(pixbuf, "tEXt::Thumb::MTime");
+    if (thumb_mtime != NULL && atol(thumb_mtime) == mtime) {
+      scaled = scale_to_size(pixbuf, size);
+      g_object_unref(pixbuf);
+      return scaled;
+    }
+    g_object_unref(pixbuf);
+  }
+
+  return NULL;
+}
+
+/* Saves an x-large thumbnail the way the thumbnail factory saves the
+   others: with the uri and mtime it is for, only readable by the user, and
+   renamed into place so readers never see half of it. */
+static void save_xlarge_thumbnail(GdkPixbuf *pixbuf, const char *uri,
+                                  time_t mtime) {
+  char *path, *folder, *tmp_path, *mtime_str;
+  int fd;
+
+  path = get_thumbnail_path(uri, get_size_index(CAJA_THUMBNAIL_SIZE_XLARGE));
+  folder = g_path_get_dirname(path);
+  g_mkdir_with_parents(folder, 0700);
+  g_free(folder);
+
+  tmp_path = g_strconcat(path, ".XXXXXX", NULL);
+  fd = g_mkstemp(tmp_path);
+  if (fd >= 0) {
+    close(fd);
+
+    mtime_str = g_strdup_printf("%" G_GINT64_FORMAT, (gint64)mtime);
+    if (gdk_pixbuf_save(pixbuf, tmp_path, "png", NULL, "tEXt::Thumb::URI", uri,
+                        "tEXt::Thumb::MTime", mtime_str, NULL)) {
+      g_rename(tmp_path, path);
+    } else {
+      g_unlink(tmp_path);
+    }
+    g_free(mtime_str);
+  }
+
+  g_free(tmp_path);
+  g_free(path);
+}
+
+static void save_thumbnail(guint slot, GdkPixbuf *pixbuf, const char *uri,
+                           time_t mtime, int size) {
+  switch (size) {
+    case CAJA_THUMBNAIL_SIZE_NORMAL:
+      mate_desktop_thumbnail_factory_save_thumbnail(thumbnail_factories[slot],
+                                                    pixbuf, uri, mtime);
+      break;
+    case CAJA_THUMBNAIL_SIZE_LARGE:
+      mate_desktop_thumbnail_factory_save_thumbnail(
+          thumbnail_large_factories[slot], pixbuf, uri, mtime);
+      break;
+    default:
+      save_xlarge_thumbnail(pixbuf, uri, mtime);
+      break;
+  }
+}
+
+/* The thumbnail factory stops at the large size. For x-large ones of the
+   images gdk-pixbuf reads, decode the image itself. */
+static GdkPixbuf *load_xlarge_image(const char *uri, const char *mime_type) {
+  GdkPixbuf *pixbuf, *oriented;
+  char *path;
+
+  if (mime_type == NULL || !g_str_has_prefix(mime_type, "image/")) {
+    return NULL;
+  }
+
+  path = g_filename_from_uri(uri, NULL, NULL);
+  if (path == NULL) {
+    return NULL;
+  }
+  pixbuf = gdk_pixbuf_new_from_file_at_size(path, CAJA_THUMBNAIL_SIZE_XLARGE,
+                                            CAJA_THUMBNAIL_SIZE_XLARGE, NULL);
+  g_free(path);
+
+  if (pixbuf != NULL) {
+    oriented = gdk_pixbuf_apply_embedded_orientation(pixbuf);
+    g_object_unref(pixbuf);
+    pixbuf = oriented;
+  }
+
+  return pixbuf;
+}
+
+/* Makes the thumbnail for info, as it was when taken from the queue, with
+   the factories of slot. Returns whether a thumbnail was made. */
+static gboolean make_thumbnail(CajaThumbnailInfo *info, time_t orig_mtime,
+                               int info_size, guint slot) {
+  MateDesktopThumbnailFactory *factory;
+  GdkPixbuf *pixbuf, *smaller;
+  time_t current_time;
+  gboolean rotational, made, fast, used_preview;
+  int made_size, size;
+  guint originals_avoided;
+  gint64 start;
+
+  time(&current_time);
+
+  /* Don't try to create a thumbnail if the file was modified recently.
+     This prevents constant re-thumbnailing of changing files. */
+  if (current_time < orig_mtime + THUMBNAIL_CREATION_DELAY_SECS &&
+      current_time >= orig_mtime) {
+#ifdef DEBUG_THUMBNAILS
+    g_message("(Thumbnail Worker %u) Skipping: %s\n", slot, info->image_uri);
+#endif
+    /* Reschedule thumbnailing via a change notification */
+    g_timeout_add_seconds(1, thumbnail_thread_notify_file_changed,
+                          g_strdup(info->image_uri));
+    return FALSE;
+  }
+
+  /* Only let a few workers at a time read from a spinning disk */
+  rotational = file_is_on_rotational_disk(info->image_uri);
+  if (rotational) {
+    g_mutex_lock(&thumbnails_mutex);
+    while (thumbnail_rotational_jobs >= THUMBNAIL_ROTATIONAL_MAX_WORKERS) {
+      g_cond_wait(&thumbnail_rotational_cond, &thumbnails_mutex);
+    }
+    thumbnail_rotational_jobs++;
+    g_mutex_unlock(&thumbnails_mutex);
+  }
+
+  /* Create the thumbnail. */
+#ifdef DEBUG_THUMBNAILS
+  g_message("(Thumbnail Worker %u) Creating thumbnail: %s\n", slot,
+            info->image_uri);
+#endif
+  start = g_get_monotonic_time();
+  made_size = info_size;
+  originals_avoided = 0;
+  fast = used_preview = FALSE;
+
+  /* A larger thumbnail has everything a smaller one needs */
+  pixbuf = load_larger_thumbnail(info->image_uri, orig_mtime, info_size);
+  if (pixbuf != NULL) {
+    originals_avoided++;
+  } else {
+    pixbuf = caja_thumbnail_generate_fast(info->image_uri, info->mime_type,
+                                          info_size, &used_preview);
+    fast = pixbuf != NULL;
+  }
+  if (pixbuf == NULL && info_size == CAJA_THUMBNAIL_SIZE_XLARGE) {
+    pixbuf = load_xlarge_image(info->image_uri, info->mime_type);
+  }
+  if (pixbuf == NULL) {
+    if (info_size == CAJA_THUMBNAIL_SIZE_NORMAL) {
+      factory = thumbnail_factories[slot];
+    } else {
+      factory = thumbnail_large_factories[slot];
+      made_size = CAJA_THUMBNAIL_SIZE_LARGE;
+    }
+    pixbuf = mate_desktop_thumbnail_factory_generate_thumbnail(
+        factory, info->image_uri, info->mime_type);
+  }
+  made = pixbuf != NULL;
+
+  if (pixbuf) {
+#ifdef DEBUG_THUMBNAILS
+    g_message("(Thumbnail Worker %u) Saving thumbnail: %s\n", slot,
+              info->image_uri);
+#endif
+    save_thumbnail(slot, pixbuf, info->image_uri, orig_mtime, made_size);
+
+    /* Derive the smaller sizes now, views at other zoom levels then
+       don't have to read the file again */
+    for (size = CAJA_THUMBNAIL_SIZE_NORMAL; size < made_size; size *= 2) {
+      smaller = scale_to_size(pixbuf, size);
+      save_thumbnail(slot, smaller, info->image_uri, orig_mtime, size);
+      g_object_unref(smaller);
+      originals_avoided++;
+    }
+    g_object_unref(pixbuf);
+  } else if (info_size == CAJA_THUMBNAIL_SIZE_NORMAL) {
+#ifdef DEBUG_THUMBNAILS
+    g_message("(Thumbnail Worker %u) Thumbnail failed: %s\n", slot,
+              info->image_uri);
+#endif
+    /* Only for the normal size, a file may still have a normal
+       thumbnail when a larger one fails */
+    mate_desktop_thumbnail_factory_create_failed_thumbnail(
+        thumbnail_factories[slot], info->image_uri, orig_mtime);
+  }
+
+  g_mutex_lock(&thumbnails_mutex);
+  if (rotational) {
+    thumbnail_rotational_jobs--;
+    g_cond_signal(&thumbnail_rotational_cond);
+  }
+  if (fast && used_preview) {
+    thumbnail_statistics.from_previews++;
+  } else if (fast) {
+    thumbnail_statistics.from_scaled_decodes++;
+  }
+  thumbnail_statistics.originals_avoided += originals_avoided;
+  if (made) {
+    thumbnail_statistics.made++;
+  } else {
+    thumbnail_statistics.failed++;
+  }
+  thumbnail_statistics.busy_usecs += g_get_monotonic_time() - start;
+  g_mutex_unlock(&thumbnails_mutex);
+
+  /* We need to call caja_file_changed(), but I don't think that is
+     thread safe. So add an idle handler and do it from the main loop. */
+  g_idle_add_full(G_PRIORITY_HIGH_IDLE, thumbnail_thread_notify_file_changed,
+                  g_strdup(info->image_uri), NULL);
+
+  return made;
+}
+
+/* Takes the first info of the queue for a worker. It stays in
+   thumbnails_to_make_hash until it is created so the main thread doesn't
+   add it again while we are creating it. Lock thumbnails_mutex when
+   calling this. */
+static CajaThumbnailInfo *take_thumbnail_info(void) {
+  CajaThumbnailInfo *info;
+
+  info = g_sequence_get(g_sequence_get_begin_iter(thumbnails_to_make));
+  unqueue_thumbnail_info(info);
+
+  return info;
+}
+
+/* The priority of the first info of the queue, or G_MAXUINT if there is
+   none. Lock thumbnails_mutex when calling this. */
+static guint get_first_priority(void) {
+  GSequenceIter *iter;
+  CajaThumbnailInfo *info;
+
+  iter = g_sequence_get_begin_iter(thumbnails_to_make);
+  if (g_sequence_iter_is_end(iter)) {
+    return G_MAXUINT;
+  }
+  info = g_sequence_get(iter);
+  return info->priority;
+}
+
+/* thumbnail_thread_func is invoked in a separate thread for each worker to
+   make thumbnails. The workers take their thumbnails from the shared
+   thumbnails_to_make queue, and leave the background ones at its end to
+   the background thread. */
 static void thumbnail_thread_func(GTask *task, gpointer source_object,
                                   gpointer task_data,
                                   GCancellable *cancellable) {
   CajaThumbnailInfo *info = NULL;
-  GdkPixbuf *pixbuf;
   time_t current_orig_mtime = 0;
-  time_t current_time;
-  GList *node;
+  int current_size = 0;
+  guint slot;
+
+  slot = GPOINTER_TO_UINT(task_data);
 
   /* We loop until there are no more thumbails to make, at which point
      we exit the thread. */
   for (;;) {
 #ifdef DEBUG_THUMBNAILS
-    g_message("(Thumbnail Thread) Locking mutex\n");
+    g_message("(Thumbnail Worker %u) Locking mutex\n", slot);
 #endif
     g_mutex_lock(&thumbnails_mutex);
 
@@ -441,91 +1707,112 @@ static void thumbnail_thread_func(GTask *task, gpointer source_object,
      * MUTEX LOCKED
      *********************************/
 
-    /* Pop the last thumbnail we just made off the head of the
-       list and free it. I did this here so we only have to lock
-       the mutex once per thumbnail, rather than once before
-       creating it and once after.
-       Don't pop the thumbnail off the queue if the original file
-       mtime of the request changed. Then we need to redo the thumbnail.
-    */
-    if (currently_thumbnailing &&
-        currently_thumbnailing->original_file_mtime == current_orig_mtime) {
-      g_assert(info == currently_thumbnailing);
-      node = g_hash_table_lookup(thumbnails_to_make_hash, info->image_uri);
-      g_assert(node != NULL);
-      g_hash_table_remove(thumbnails_to_make_hash, info->image_uri);
-      free_thumbnail_info(info);
-      g_queue_delete_link((GQueue *)&thumbnails_to_make, node);
+    /* Finish the thumbnail we just made. I did this here so we only
+       have to lock the mutex once per thumbnail, rather than once
+       before creating it and once after. */
+    if (info != NULL) {
+      finish_thumbnail_info(info, current_orig_mtime, current_size);
+      thumbnail_batch_made++;
+      info = NULL;
     }
-    currently_thumbnailing = NULL;
 
-    /* If there are no more thumbnails to make, reset the
-       thumbnail_thread_is_running flag, unlock the mutex, and
-       exit the thread. */
-    if (g_queue_is_empty((GQueue *)&thumbnails_to_make)) {
+    /* If there are no more thumbnails to make, give up our slot, unlock
+       the mutex, and exit the thread. */
+    if (get_first_priority() >= CAJA_THUMBNAIL_PRIORITY_BACKGROUND) {
 #ifdef DEBUG_THUMBNAILS
-      g_message("(Thumbnail Thread) Exiting\n");
+      g_message("(Thumbnail Worker %u) Exiting\n", slot);
 #endif
-      thumbnail_thread_is_running = FALSE;
+      thumbnail_worker_busy[slot] = FALSE;
+      thumbnail_workers_running--;
+      if (thumbnail_workers_running == 0 && thumbnail_batch_made > 0) {
+        double seconds;
+
+        seconds = (g_get_monotonic_time() - thumbnail_batch_start) /
+                  (double)G_USEC_PER_SEC;
+        caja_debug_log(FALSE, CAJA_DEBUG_LOG_DOMAIN_THUMBNAILS,
+                       "made %u thumbnails in %.2f s with up to %u workers, "
+                       "%.1f per second",
+                       thumbnail_batch_made, seconds, thumbnail_workers_wanted,
+                       seconds > 0 ? thumbnail_batch_made / seconds : 0.0);
+      }
       g_mutex_unlock(&thumbnails_mutex);
       return;
     }
 
-    /* Get the next one to make. We leave it on the list until it
-       is created so the main thread doesn't add it again while we
-       are creating it. */
-    info = g_queue_peek_head((GQueue *)&thumbnails_to_make);
-    currently_thumbnailing = info;
+    info = take_thumbnail_info();
     current_orig_mtime = info->original_file_mtime;
+    current_size = info->size;
     /*********************************
      * MUTEX UNLOCKED
      *********************************/
 
 #ifdef DEBUG_THUMBNAILS
-    g_message("(Thumbnail Thread) Unlocking mutex\n");
+    g_message("(Thumbnail Worker %u) Unlocking mutex\n", slot);
 #endif
     g_mutex_unlock(&thumbnails_mutex);
 
-    time(&current_time);
+    make_thumbnail(info, current_orig_mtime, current_size, slot);
+  }
+}
 
-    /* Don't try to create a thumbnail if the file was modified recently.
-       This prevents constant re-thumbnailing of changing files. */
-    if (current_time < current_orig_mtime + THUMBNAIL_CREATION_DELAY_SECS &&
-        current_time >= current_orig_mtime) {
-#ifdef DEBUG_THUMBNAILS
-      g_message("(Thumbnail Thread) Skipping: %s\n", info->image_uri);
+/* Makes the calling thread use the processors and the disks only when
+   nothing else wants them. Linux keeps both priorities per thread, which
+   is why the background thread isn't a pooled one. */
+static void lower_thread_priority(void) {
+#ifdef __linux__
+  setpriority(PRIO_PROCESS, 0, THUMBNAIL_BACKGROUND_NICE);
+#ifdef SYS_ioprio_set
+  syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+          IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
 #endif
-      /* Reschedule thumbnailing via a change notification */
-      g_timeout_add_seconds(1, thumbnail_thread_notify_file_changed,
-                            g_strdup(info->image_uri));
-      continue;
-    }
-
-    /* Create the thumbnail. */
-#ifdef DEBUG_THUMBNAILS
-    g_message("(Thumbnail Thread) Creating thumbnail: %s\n", info->image_uri);
 #endif
+}
 
-    pixbuf = mate_desktop_thumbnail_factory_generate_thumbnail(
-        thumbnail_factory, info->image_uri, info->mime_type);
+/* The background thread makes the thumbnails queued by the pre-generation
+   of caja-thumbnail-pregenerator.c, while the workers have nothing to do.
+   It exits when the background queue is empty or pre-generation is
+   paused. */
+static gpointer thumbnail_background_thread_func(gpointer data) {
+  CajaThumbnailInfo *info = NULL;
+  time_t current_orig_mtime = 0;
+  gboolean made = FALSE;
+  gint64 end_time;
 
-    if (pixbuf) {
-#ifdef DEBUG_THUMBNAILS
-      g_message("(Thumbnail Thread) Saving thumbnail: %s\n", info->image_uri);
-#endif
-      mate_desktop_thumbnail_factory_save_thumbnail(
-          thumbnail_factory, pixbuf, info->image_uri, current_orig_mtime);
-      g_object_unref(pixbuf);
-    } else {
-#ifdef DEBUG_THUMBNAILS
-      g_message("(Thumbnail Thread) Thumbnail failed: %s\n", info->image_uri);
-#endif
-      mate_desktop_thumbnail_factory_create_failed_thumbnail(
-          thumbnail_factory, info->image_uri, current_orig_mtime);
+  lower_thread_priority();
+
+  for (;;) {
+    g_mutex_lock(&thumbnails_mutex);
+
+    if (info != NULL) {
+      finish_thumbnail_info(info, current_orig_mtime,
+                            CAJA_THUMBNAIL_SIZE_NORMAL);
+      if (made) {
+        thumbnail_statistics.background_made++;
+      }
+      info = NULL;
     }
-    /* We need to call caja_file_changed(), but I don't think that is
-       thread safe. So add an idle handler and do it from the main loop. */
-    g_idle_add_full(G_PRIORITY_HIGH_IDLE, thumbnail_thread_notify_file_changed,
-                    g_strdup(info->image_uri), NULL);
+
+    /* Thumbnails for the views go first */
+    while (!thumbnail_background_paused && thumbnails_background_queued > 0 &&
+           get_first_priority() < CAJA_THUMBNAIL_PRIORITY_BACKGROUND) {
+      schedule_thumbnail_workers();
+      end_time = g_get_monotonic_time() + THUMBNAIL_BACKGROUND_WAIT_USECS;
+      g_cond_wait_until(&thumbnail_background_cond, &thumbnails_mutex,
+                        end_time);
+    }
+
+    if (thumbnail_background_paused || thumbnails_background_queued == 0) {
+      thumbnail_background_running = FALSE;
+      g_mutex_unlock(&thumbnails_mutex);
+      return NULL;
+    }
+
+    info = take_thumbnail_info();
+    current_orig_mtime = info->original_file_mtime;
+
+    g_mutex_unlock(&thumbnails_mutex);
+
+    made = make_thumbnail(info, current_orig_mtime,
+                          CAJA_THUMBNAIL_SIZE_NORMAL, THUMBNAIL_BACKGROUND_SLOT);
   }
 }
@@ -29,14 +29,65 @@
 
 #include "caja-file.h"
 
+typedef struct {
+  guint64 made;
+  guint64 failed;
+  /* Made by the photo fast path rather than the thumbnail factory */
+  guint64 from_previews;
+  guint64 from_scaled_decodes;
+  /* Made by scaling down a larger thumbnail of the same file, without
+     reading the file itself */
+  guint64 originals_avoided;
+  /* Made ahead of time by pre-generation, also counted in made */
+  guint64 background_made;
+  /* Time the workers spent generating, summed over all of them */
+  gint64 busy_usecs;
+  guint workers_running;
+  guint queued;
+  guint background_queued;
+} CajaThumbnailStatistics;
+
+/* The freedesktop thumbnail sizes, in pixels */
+#define CAJA_THUMBNAIL_SIZE_NORMAL 128
+#define CAJA_THUMBNAIL_SIZE_LARGE 256
+#define CAJA_THUMBNAIL_SIZE_XLARGE 512
+
 /* Returns NULL if there's no thumbnail yet. */
-void caja_create_thumbnail(CajaFile *file);
+void caja_create_thumbnail(CajaFile *file, int size);
 gboolean caja_can_thumbnail(CajaFile *file);
 gboolean caja_can_thumbnail_internally(CajaFile *file);
 gboolean caja_thumbnail_is_mimetype_limited_by_size(const char *mime_type);
 
+/* Priorities are distances, in viewport pages, from the visible part of the
+   view showing the file. Farther ones are deferred until the nearer ones
+   are done. */
+#define CAJA_THUMBNAIL_PRIORITY_VISIBLE 0
+#define CAJA_THUMBNAIL_PRIORITY_DEFAULT 1
+#define CAJA_THUMBNAIL_PRIORITY_DEFERRED 8
+/* Pre-generated thumbnails, made at the lowest processor and disk priority
+   when there is nothing else to do */
+#define CAJA_THUMBNAIL_PRIORITY_BACKGROUND (CAJA_THUMBNAIL_PRIORITY_DEFERRED + 1)
+
 /* Queue handling: */
 void caja_thumbnail_remove_from_queue(const char *file_uri);
-void caja_thumbnail_prioritize(const char *file_uri);
+void caja_thumbnail_set_priority(const char *file_uri, guint distance);
+/* Queues a normal size thumbnail for a file no view shows. Returns FALSE if
+   it can't be thumbnailed or is in the queue already. */
+gboolean caja_thumbnail_queue_background(const char *uri,
+                                         const char *mime_type, time_t mtime);
+void caja_thumbnail_set_background_paused(gboolean paused);
+
+void caja_thumbnail_get_statistics(CajaThumbnailStatistics *statistics);
+
+/* Thumbnail sizes: */
+int caja_thumbnail_size_for_pixels(int pixels);
+int caja_thumbnail_get_size_for_path(const char *path);
+/* Returns the path of an existing thumbnail of uri that is at least
+   min_size, the smallest one there is, or NULL. Doesn't check whether it
+   is up to date. */
+char *caja_thumbnail_find_path(const char *uri, int min_size, int *size);
+
+GdkPixbuf *caja_thumbnail_generate_fast(const char *uri, const char *mime_type,
+                                        int size, gboolean *used_preview);
 
 #endif /* CAJA_THUMBNAILS_H */
@@ -53,10 +53,12 @@
 #include <libcaja-private/caja-directory-private.h>
 #include <libcaja-private/caja-extensions.h>
 #include <libcaja-private/caja-file-utilities.h>
+#include <libcaja-private/caja-filename-index.h>
 #include <libcaja-private/caja-global-preferences.h>
 #include <libcaja-private/caja-lib-self-check-functions.h>
 #include <libcaja-private/caja-module.h>
 #include <libcaja-private/caja-signaller.h>
+#include <libcaja-private/caja-thumbnail-pregenerator.h>
 #include <libmate-desktop/mate-bg.h>
 
 #if ENABLE_EMPTY_VIEW
@@ -370,6 +372,18 @@ void caja_application_quit(CajaApplication *self) {
   g_application_quit(G_APPLICATION(self));
 }
 
+static void rebuild_search_index_activated(GSimpleAction *action,
+                                           GVariant *parameter,
+                                           gpointer user_data) {
+  caja_filename_index_rebuild();
+}
+
+static void check_search_index_activated(GSimpleAction *action,
+                                         GVariant *parameter,
+                                         gpointer user_data) {
+  caja_filename_index_check();
+}
+
 static void caja_application_init(CajaApplication *application) {
   GSimpleAction *action;
   application->priv = caja_application_get_instance_private(application);
@@ -381,6 +395,24 @@ static void caja_application_init(CajaApplication *application) {
                            G_CALLBACK(caja_application_quit), application);
 
   g_object_unref(action);
+
+  action = g_simple_action_new("rebuild-search-index", NULL);
+
+  g_action_map_add_action(G_ACTION_MAP(application), G_ACTION(action));
+
+  g_signal_connect(action, "activate",
+                   G_CALLBACK(rebuild_search_index_activated), NULL);
+
+  g_object_unref(action);
+
+  action = g_simple_action_new("check-search-index", NULL);
+
+  g_action_map_add_action(G_ACTION_MAP(application), G_ACTION(action));
+
+  g_signal_connect(action, "activate",
+                   G_CALLBACK(check_search_index_activated), NULL);
+
+  g_object_unref(action);
 }
 
 static void caja_application_finalize(GObject *object) {
@@ -1631,6 +1663,8 @@ static gboolean caja_application_local_command_line(GApplication *application,
   gboolean browser_window = FALSE;
   gboolean open_in_tabs = FALSE;
   gboolean kill_shell = FALSE;
+  gboolean rebuild_search_index = FALSE;
+  gboolean check_search_index = FALSE;
   const gchar *autostart_id;
   gboolean no_default_window = FALSE;
   gboolean select_uris = FALSE;
@@ -1666,6 +1700,13 @@ static gboolean caja_application_local_command_line(GApplication *application,
       {"browser", '\0', 0, G_OPTION_ARG_NONE, &browser_window,
        N_("Open a browser window."), NULL},
       {"quit", 'q', 0, G_OPTION_ARG_NONE, &kill_shell, N_("Quit Caja."), NULL},
+      {"rebuild-search-index", '\0', 0, G_OPTION_ARG_NONE,
+       &rebuild_search_index,
+       N_("Build the file name index of the running Caja again."), NULL},
+      {"check-search-index", '\0', 0, G_OPTION_ARG_NONE, &check_search_index,
+       N_("Read the folders in the file name index of the running Caja "
+          "again, to find the tags that changed unnoticed."),
+       NULL},
       {"select", 's', 0, G_OPTION_ARG_NONE, &select_uris,
        N_("Select specified URI in parent folder."), NULL},
       {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_STRING_ARRAY, &remaining, NULL,
@@ -1743,6 +1784,18 @@ static gboolean caja_application_local_command_line(GApplication *application,
     goto out;
   }
 
+  if (rebuild_search_index) {
+    g_action_group_activate_action(G_ACTION_GROUP(application),
+                                   "rebuild-search-index", NULL);
+    goto out;
+  }
+
+  if (check_search_index) {
+    g_action_group_activate_action(G_ACTION_GROUP(application),
+                                   "check-search-index", NULL);
+    goto out;
+  }
+
   /* Initialize  and load session info if available */
   /* Load session if and only if autostarted        */
   /* This avoids errors on command line invocation  */
@@ -1965,6 +2018,13 @@ static void caja_application_startup(GApplication *app) {
    */
   caja_global_preferences_init();
 
+  /* Make thumbnails ahead of time, if the user asked for that */
+  caja_thumbnail_pregenerator_start(
+      g_application_get_dbus_connection(app));
+
+  /* Keep the file name index of the folders the user chose */
+  caja_filename_index_start();
+
   /* initialize the session manager client */
   caja_application_smclient_startup(self);
 
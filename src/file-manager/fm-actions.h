@@ -97,6 +97,7 @@
 #define FM_ACTION_NEW_EMPTY_FILE "New Empty File"
 #define FM_ACTION_EMPTY_TRASH_CONDITIONAL "Empty Trash Conditional"
 #define FM_ACTION_MANUAL_LAYOUT "Manual Layout"
+#define FM_ACTION_SORT_BY_RELEVANCE "Sort by Relevance"
 #define FM_ACTION_TIGHTER_LAYOUT "Tighter Layout"
 #define FM_ACTION_REVERSED_ORDER "Reversed Order"
 #define FM_ACTION_CLEAN_UP "Clean Up"
@@ -108,6 +108,11 @@
 
 #define MAX_QUEUED_UPDATES 500
 
+/* The most relevant hits of a running search that are shown at each
+ * update, the others wait for later ones or for the search to finish.
+ */
+#define SEARCH_TOP_HITS 100
+
 #define FM_DIRECTORY_VIEW_MENU_PATH_APPLICATIONS_SUBMENU_PLACEHOLDER \
   "/MenuBar/File/Open Placeholder/Open With/Applications Placeholder"
 #define FM_DIRECTORY_VIEW_MENU_PATH_APPLICATIONS_PLACEHOLDER \
@@ -323,6 +328,8 @@ static void remove_update_status_idle_callback(FMDirectoryView *view);
 static void reset_update_interval(FMDirectoryView *view);
 static void schedule_idle_display_of_pending_files(FMDirectoryView *view);
 static void unschedule_display_of_pending_files(FMDirectoryView *view);
+static void schedule_timeout_display_of_pending_files(FMDirectoryView *view,
+                                                      guint interval);
 static void disconnect_model_handlers(FMDirectoryView *view);
 static void metadata_for_directory_as_file_ready_callback(
     CajaFile *file, gpointer callback_data);
@@ -2701,15 +2708,70 @@ static void process_old_files(FMDirectoryView *view) {
   }
 }
 
+static int compare_pending_by_relevance(gconstpointer a, gconstpointer b) {
+  const FileAndDirectory *pending_1 = a;
+  const FileAndDirectory *pending_2 = b;
+
+  /* The hits are all files of the search directory */
+  return caja_file_compare_for_sort_in_directory(
+      pending_1->file, pending_2->file, CAJA_FILE_SORT_BY_SEARCH_RELEVANCE,
+      pending_1->directory, FALSE, FALSE);
+}
+
+/* Leaves the SEARCH_TOP_HITS most relevant added files to be shown now and
+ * returns the others.
+ */
+static GList *hold_back_less_relevant_files(FMDirectoryView *view) {
+  GList *rest;
+
+  view->details->old_added_files = g_list_sort(view->details->old_added_files,
+                                               compare_pending_by_relevance);
+  rest = g_list_nth(view->details->old_added_files, SEARCH_TOP_HITS);
+  if (rest != NULL) {
+    rest->prev->next = NULL;
+    rest->prev = NULL;
+  }
+  sort_files(view, &view->details->old_added_files);
+
+  return rest;
+}
+
 static void display_pending_files(FMDirectoryView *view) {
+  GList *held_back, *node, *next;
+  FileAndDirectory *pending;
+
   /* Don't dispatch any updates while the view is frozen. */
   if (view->details->updates_frozen) {
     return;
   }
 
   process_new_files(view);
+
+  /* The best hits of a search come first, while it goes on */
+  held_back = NULL;
+  if (view->details->loading && fm_directory_view_is_search(view) &&
+      !caja_directory_are_all_files_seen(view->details->model)) {
+    held_back = hold_back_less_relevant_files(view);
+  }
+
   process_old_files(view);
 
+  /* Hits may have been dropped from the search while they were held back */
+  for (node = held_back; node != NULL; node = next) {
+    next = node->next;
+    pending = node->data;
+    if (!still_should_show_file(view, pending->file, pending->directory)) {
+      held_back = g_list_delete_link(held_back, node);
+      file_and_directory_free(pending);
+    }
+  }
+
+  if (held_back != NULL) {
+    view->details->old_added_files = held_back;
+    schedule_timeout_display_of_pending_files(view,
+                                              view->details->update_interval);
+  }
+
   if (view->details->model != NULL &&
       caja_directory_are_all_files_seen(view->details->model) &&
       g_hash_table_size(view->details->non_ready_files) == 0) {
@@ -2856,7 +2918,9 @@ static void queue_pending_files(FMDirectoryView *view, CajaDirectory *directory,
   *pending_list = g_list_concat(
       file_and_directory_list_from_files(directory, files), *pending_list);
 
-  if (!view->details->loading || caja_directory_are_all_files_seen(directory)) {
+  /* The hits of a search are shown while it goes on, it may take long */
+  if (!view->details->loading || caja_directory_are_all_files_seen(directory) ||
+      fm_directory_view_is_search(view)) {
     schedule_timeout_display_of_pending_files(view,
                                               view->details->update_interval);
   }
@@ -9113,6 +9177,14 @@ gboolean fm_directory_view_is_editable(FMDirectoryView *view) {
   return TRUE;
 }
 
+gboolean fm_directory_view_is_search(FMDirectoryView *view) {
+  CajaDirectory *directory;
+
+  directory = fm_directory_view_get_model(view);
+
+  return directory != NULL && CAJA_IS_SEARCH_DIRECTORY(directory);
+}
+
 void fm_directory_view_set_initiated_unmount(FMDirectoryView *view,
                                              gboolean initiated_unmount) {
   if (view->details->window != NULL) {
@@ -450,6 +450,7 @@ void fm_directory_view_remove_subdirectory(FMDirectoryView *view,
                                            CajaDirectory *directory);
 
 gboolean fm_directory_view_is_editable(FMDirectoryView *view);
+gboolean fm_directory_view_is_search(FMDirectoryView *view);
 void fm_directory_view_set_initiated_unmount(FMDirectoryView *view,
                                              gboolean inititated_unmount);
 
@@ -159,18 +159,24 @@ static void fm_icon_container_stop_monitor_top_left(
 }
 
 static void fm_icon_container_prioritize_thumbnailing(
-    CajaIconContainer *container, CajaIconData *data) {
+    CajaIconContainer *container, CajaIconData *data, guint distance) {
   CajaFile *file;
 
   file = (CajaFile *)data;
 
   g_assert(CAJA_IS_FILE(file));
 
+  /* The thumbnail cache may have dropped the thumbnail since the icon was
+     shown last */
+  if (distance == CAJA_THUMBNAIL_PRIORITY_VISIBLE) {
+    caja_file_reload_dropped_thumbnail(file);
+  }
+
   if (caja_file_is_thumbnailing(file)) {
     char *uri;
 
     uri = caja_file_get_uri(file);
-    caja_thumbnail_prioritize(uri);
+    caja_thumbnail_set_priority(uri, distance);
     g_free(uri);
   }
 }
@@ -134,7 +134,10 @@ static const SortCriterion sort_criteria[] = {
      N_("by T_rash Time"), N_("Keep icons sorted by trash time in rows")},
     {CAJA_FILE_SORT_BY_EXTENSION, "extension", "Sort by Extension",
      N_("by E_xtension"),
-     N_("Keep icons sorted by reversed extension segments in rows")}};
+     N_("Keep icons sorted by reversed extension segments in rows")},
+    {CAJA_FILE_SORT_BY_SEARCH_RELEVANCE, "search_relevance",
+     "Sort by Relevance", N_("by _Relevance"),
+     N_("Keep icons sorted by how well they match the search in rows")}};
 
 static gboolean default_sort_in_reverse_order = FALSE;
 static int preview_sound_auto_value;
@@ -1494,6 +1497,9 @@ static const GtkRadioActionEntry arrange_radio_entries[] = {
     {"Sort by Extension", NULL, N_("By E_xtension"), NULL,
      N_("Keep icons sorted by reverse extension segments in rows"),
      CAJA_FILE_SORT_BY_EXTENSION},
+    {"Sort by Relevance", NULL, N_("By _Relevance"), NULL,
+     N_("Keep icons sorted by how well they match the search in rows"),
+     CAJA_FILE_SORT_BY_SEARCH_RELEVANCE},
 };
 
 static void fm_icon_view_merge_menus(FMDirectoryView *view) {
@@ -1611,6 +1617,11 @@ static void fm_icon_view_update_menus(FMDirectoryView *view) {
   action = gtk_action_group_get_action(icon_view->details->icon_action_group,
                                        FM_ACTION_MANUAL_LAYOUT);
   gtk_action_set_sensitive(action, editable);
+
+  /* Only hits of a search have a relevance */
+  action = gtk_action_group_get_action(icon_view->details->icon_action_group,
+                                       FM_ACTION_SORT_BY_RELEVANCE);
+  gtk_action_set_visible(action, fm_directory_view_is_search(view));
 }
 
 static void fm_icon_view_reset_to_defaults(FMDirectoryView *view) {
@@ -2010,9 +2021,10 @@ static void renaming_icon_callback(CajaIconContainer *container,
 
 int fm_icon_view_compare_files(FMIconView *icon_view, CajaFile *a,
                                CajaFile *b) {
-  return caja_file_compare_for_sort(
+  return caja_file_compare_for_sort_in_directory(
       a, b, icon_view->details->sort->sort_type,
       /* Use type-unsafe cast for performance */
+      fm_directory_view_get_model((FMDirectoryView *)icon_view),
       fm_directory_view_should_sort_directories_first(
           (FMDirectoryView *)icon_view),
       icon_view->details->sort_reversed);
@@ -76,6 +76,9 @@ struct FMListModelDetails {
   GPtrArray *columns;
 
   GList *highlight_files;
+
+  /* The directory of the top level files */
+  CajaDirectory *directory;
 };
 
 typedef struct {
@@ -96,6 +99,13 @@ struct FileEntry {
   guint loaded : 1;
 };
 
+/* The directory file_entry is shown as a file of */
+static CajaDirectory *file_entry_get_directory(FMListModel *model,
+                                               FileEntry *file_entry) {
+  return file_entry->parent != NULL ? file_entry->parent->subdirectory
+                                    : model->details->directory;
+}
+
 G_DEFINE_TYPE_WITH_CODE(
     FMListModel, fm_list_model, G_TYPE_OBJECT,
     G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL, fm_list_model_tree_model_init)
@@ -424,7 +434,8 @@ static void fm_list_model_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter,
         if (file != NULL) {
           char *str;
 
-          str = caja_file_get_string_attribute_with_default_q(file, attribute);
+          str = caja_file_get_string_attribute_with_default_in_directory_q(
+              file, attribute, file_entry_get_directory(model, file_entry));
           g_value_take_string(value, str);
         } else if (attribute == attribute_name_q) {
           if (file_entry->parent->loaded) {
@@ -675,8 +686,9 @@ static int fm_list_model_file_entry_compare_func(gconstpointer a,
   file_entry2 = (FileEntry *)b;
 
   if (file_entry1->file != NULL && file_entry2->file != NULL) {
-    result = caja_file_compare_for_sort_by_attribute_q(
+    result = caja_file_compare_for_sort_by_attribute_q_in_directory(
         file_entry1->file, file_entry2->file, model->details->sort_attribute,
+        file_entry_get_directory(model, file_entry1),
         model->details->sort_directories_first,
         (model->details->order == GTK_SORT_DESCENDING));
   } else if (file_entry1->file == NULL) {
@@ -692,8 +704,8 @@ int fm_list_model_compare_func(FMListModel *model, CajaFile *file1,
                                CajaFile *file2) {
   int result;
 
-  result = caja_file_compare_for_sort_by_attribute_q(
-      file1, file2, model->details->sort_attribute,
+  result = caja_file_compare_for_sort_by_attribute_q_in_directory(
+      file1, file2, model->details->sort_attribute, model->details->directory,
       model->details->sort_directories_first,
       (model->details->order == GTK_SORT_DESCENDING));
 
@@ -1291,6 +1303,22 @@ void fm_list_model_set_should_sort_directories_first(
   fm_list_model_sort(model);
 }
 
+/* Sets the directory of the top level files, sorting by relevance and
+ * showing it needs the search directory.
+ */
+void fm_list_model_set_directory(FMListModel *model, CajaDirectory *directory) {
+  if (model->details->directory == directory) {
+    return;
+  }
+
+  if (directory != NULL) {
+    caja_directory_ref(directory);
+  }
+  caja_directory_unref(model->details->directory);
+  model->details->directory = directory;
+  fm_list_model_sort(model);
+}
+
 int fm_list_model_get_sort_column_id_from_attribute(FMListModel *model,
                                                     GQuark attribute) {
   guint i;
@@ -1437,6 +1465,11 @@ static void fm_list_model_dispose(GObject *object) {
     model->details->directory_reverse_map = NULL;
   }
 
+  if (model->details->directory != NULL) {
+    caja_directory_unref(model->details->directory);
+    model->details->directory = NULL;
+  }
+
   G_OBJECT_CLASS(fm_list_model_parent_class)->dispose(object);
 }
 
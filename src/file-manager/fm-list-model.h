@@ -91,6 +91,7 @@ gboolean fm_list_model_get_first_iter_for_file(FMListModel *model,
                                                GtkTreeIter *iter);
 void fm_list_model_set_should_sort_directories_first(
     FMListModel *model, gboolean sort_directories_first);
+void fm_list_model_set_directory(FMListModel *model, CajaDirectory *directory);
 
 int fm_list_model_get_sort_column_id_from_attribute(FMListModel *model,
                                                     GQuark attribute);
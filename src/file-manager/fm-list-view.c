@@ -56,6 +56,7 @@
 #include <libcaja-private/caja-icon-dnd.h>
 #include <libcaja-private/caja-metadata.h>
 #include <libcaja-private/caja-module.h>
+#include <libcaja-private/caja-thumbnails.h>
 #include <libcaja-private/caja-tree-view-drag-dest.h>
 #include <libcaja-private/caja-ui-utilities.h>
 #include <libcaja-private/caja-view-factory.h>
@@ -114,6 +115,8 @@ struct FMListViewDetails {
 
   gulong clipboard_handler_id;
 
+  guint thumbnail_priority_idle_id;
+
   GQuark last_sort_attr;
 };
 
@@ -122,6 +125,11 @@ struct SelectionForeachData {
   GtkTreeSelection *selection;
 };
 
+struct ThumbnailPriorityData {
+  int first_visible;
+  int last_visible;
+};
+
 /* We wait two seconds after row is collapsed to unload the subdirectory */
 #define COLLAPSE_TO_UNLOAD_DELAY 2
 
@@ -1363,6 +1371,82 @@ static gint get_icon_scale_callback(FMListModel *model, FMListView *view) {
   return gtk_widget_get_scale_factor(GTK_WIDGET(view->details->tree_view));
 }
 
+static gboolean update_thumbnail_priority(GtkTreeModel *model,
+                                          GtkTreePath *path, GtkTreeIter *iter,
+                                          gpointer callback_data) {
+  struct ThumbnailPriorityData *data;
+  CajaFile *file;
+  char *uri;
+  int row, page;
+  guint distance;
+
+  data = callback_data;
+
+  gtk_tree_model_get(model, iter, FM_LIST_MODEL_FILE_COLUMN, &file, -1);
+  if (file == NULL) {
+    return FALSE;
+  }
+
+  /* Rows in expanded folders count as their top level row */
+  row = gtk_tree_path_get_indices(path)[0];
+  page = data->last_visible - data->first_visible + 1;
+  if (row < data->first_visible) {
+    distance = 1 + (data->first_visible - row - 1) / page;
+  } else if (row > data->last_visible) {
+    distance = 1 + (row - data->last_visible - 1) / page;
+  } else {
+    distance = CAJA_THUMBNAIL_PRIORITY_VISIBLE;
+    /* The thumbnail cache may have dropped the thumbnail since the row
+       was shown last */
+    caja_file_reload_dropped_thumbnail(file);
+  }
+
+  if (caja_file_is_thumbnailing(file)) {
+    uri = caja_file_get_uri(file);
+    caja_thumbnail_set_priority(uri, distance);
+    g_free(uri);
+  }
+
+  caja_file_unref(file);
+
+  return FALSE;
+}
+
+/* Puts the thumbnails of the rows nearest to the visible ones first, so
+   scrolling fast doesn't leave the thumbnailers behind on rows long gone. */
+static gboolean update_thumbnail_priorities_callback(gpointer callback_data) {
+  FMListView *view;
+  GtkTreePath *start, *end;
+  struct ThumbnailPriorityData data;
+
+  view = FM_LIST_VIEW(callback_data);
+  view->details->thumbnail_priority_idle_id = 0;
+
+  if (view->details->model == NULL ||
+      !gtk_tree_view_get_visible_range(view->details->tree_view, &start,
+                                       &end)) {
+    return FALSE;
+  }
+
+  data.first_visible = gtk_tree_path_get_indices(start)[0];
+  data.last_visible = gtk_tree_path_get_indices(end)[0];
+  gtk_tree_path_free(start);
+  gtk_tree_path_free(end);
+
+  gtk_tree_model_foreach(GTK_TREE_MODEL(view->details->model),
+                         update_thumbnail_priority, &data);
+
+  return FALSE;
+}
+
+static void list_view_vadjustment_changed_callback(GtkAdjustment *adjustment,
+                                                   FMListView *view) {
+  if (view->details->thumbnail_priority_idle_id == 0) {
+    view->details->thumbnail_priority_idle_id =
+        g_idle_add(update_thumbnail_priorities_callback, view);
+  }
+}
+
 static void create_and_set_up_tree_view(FMListView *view) {
   GtkCellRenderer *cell;
   GtkTreeViewColumn *column;
@@ -1548,6 +1632,11 @@ static void create_and_set_up_tree_view(FMListView *view) {
   gtk_widget_show(GTK_WIDGET(view->details->tree_view));
   gtk_container_add(GTK_CONTAINER(view), GTK_WIDGET(view->details->tree_view));
 
+  g_signal_connect_object(
+      gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(view)),
+      "value-changed", G_CALLBACK(list_view_vadjustment_changed_callback),
+      view, 0);
+
   atk_obj = gtk_widget_get_accessible(GTK_WIDGET(view->details->tree_view));
   atk_object_set_name(atk_obj, _("List View"));
 }
@@ -1717,6 +1806,8 @@ static void fm_list_view_begin_loading(FMDirectoryView *view) {
 
   list_view = FM_LIST_VIEW(view);
 
+  fm_list_model_set_directory(list_view->details->model,
+                              fm_directory_view_get_model(view));
   set_sort_order_from_metadata_and_preferences(list_view);
   set_zoom_level_from_metadata_and_preferences(list_view);
   set_columns_settings_from_metadata_and_preferences(list_view);
@@ -2630,6 +2721,11 @@ static void fm_list_view_dispose(GObject *object) {
     list_view->details->renaming_file_activate_timeout = 0;
   }
 
+  if (list_view->details->thumbnail_priority_idle_id != 0) {
+    g_source_remove(list_view->details->thumbnail_priority_idle_id);
+    list_view->details->thumbnail_priority_idle_id = 0;
+  }
+
   if (list_view->details->clipboard_handler_id != 0) {
     g_signal_handler_disconnect(caja_clipboard_monitor_get(),
                                 list_view->details->clipboard_handler_id);
@@ -0,0 +1,647 @@
+/* Benchmarks the search engines on a generated folder tree, and checks
+ * that they find what the tree is known to hold.
+ *
+ * The tree is made from a seed, so the same options always give the same
+ * files: plain text, OpenDocument text, binary files, some of them tagged,
+ * with sizes and modification times spread over a range. Each query runs
+ * on each engine and prints a line of JSON with the time to the first hit,
+ * the total time, the files searched per second and the peak memory use.
+ * The exit status is 1 if an engine found a different number of files than
+ * expected.
+ *
+ * Usage: test-caja-search-benchmark [--files=N] [--seed=N] [--runs=N]
+ *            [--engine=simple|default] [--directory=DIR] [--keep]
+ */
+
+#include <gio/gio.h>
+#include <libcaja-private/caja-search-engine-simple.h>
+#include <libcaja-private/caja-search-engine.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Every text file and document may contain this */
+#define NEEDLE "zebrafish"
+
+/* Files bigger than this are hits for the size query */
+#define SIZE_BOUND (64 * 1024)
+
+/* The modification times go from here over five years, the date query
+   asks for the first one */
+#define TIME_BASE G_GINT64_CONSTANT(1500000000)
+#define TIME_SPREAD (5 * 365 * 24 * 3600)
+#define TIME_BOUND (TIME_BASE + 365 * 24 * 3600)
+
+#define FOLDERS_PER_FOLDER 6
+#define FOLDER_DEPTH 3
+
+#define ODF_MIME_TYPE "application/vnd.oasis.opendocument.text"
+
+static const char *words[] = {"alpha",   "budget", "report", "holiday",
+                              "summary", "draft",  "notes",  "invoice",
+                              "meeting", "photo",  "backup", "letter"};
+
+typedef enum {
+  KIND_TEXT,
+  KIND_DOCUMENT,
+  KIND_BINARY,
+} FileKind;
+
+typedef enum {
+  QUERY_NAME,
+  QUERY_WORDS,
+  QUERY_MIME,
+  QUERY_SIZE,
+  QUERY_DATE,
+  QUERY_TAG,
+  QUERY_CONTENT,
+  N_QUERIES
+} QueryKind;
+
+static const char *query_names[N_QUERIES] = {
+    "name", "words", "mime", "size", "date", "tag", "content"};
+
+typedef struct {
+  GFile *root;
+  guint n_files;
+  guint n_folders;
+  guint n_tag_failures;
+  guint expected[N_QUERIES];
+} Tree;
+
+typedef struct {
+  GMainLoop *loop;
+  gint64 start;
+  gint64 first_hit;
+  guint n_hits;
+} Run;
+
+static int files_option = 20000;
+static int seed_option = 1;
+static int runs_option = 3;
+static char *engine_option = NULL;
+static char *directory_option = NULL;
+static gboolean keep_option = FALSE;
+
+static GOptionEntry option_entries[] = {
+    {"files", 0, 0, G_OPTION_ARG_INT, &files_option, "Files to create", "N"},
+    {"seed", 0, 0, G_OPTION_ARG_INT, &seed_option, "Seed of the tree", "N"},
+    {"runs", 0, 0, G_OPTION_ARG_INT, &runs_option, "Runs of each query", "N"},
+    {"engine", 0, 0, G_OPTION_ARG_STRING, &engine_option,
+     "simple, or default for the one Caja picks", "ENGINE"},
+    {"directory", 0, 0, G_OPTION_ARG_FILENAME, &directory_option,
+     "Where to make the tree", "DIR"},
+    {"keep", 0, 0, G_OPTION_ARG_NONE, &keep_option, "Keep the tree", NULL},
+    {NULL}};
+
+static guint32 crc32_update(guint32 crc, const guchar *data, gsize len) {
+  static guint32 table[256];
+  guint32 c;
+  gsize i;
+  int k;
+
+  if (table[1] == 0) {
+    for (i = 0; i < 256; i++) {
+      c = i;
+      for (k = 0; k < 8; k++) {
+        c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+      }
+      table[i] = c;
+    }
+  }
+
+  crc = ~crc;
+  for (i = 0; i < len; i++) {
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+
+  return ~crc;
+}
+
+static void put_le16(GByteArray *array, guint16 value) {
+  guint8 bytes[2] = {value & 0xff, value >> 8};
+
+  g_byte_array_append(array, bytes, 2);
+}
+
+static void put_le32(GByteArray *array, guint32 value) {
+  guint8 bytes[4] = {value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff,
+                     value >> 24};
+
+  g_byte_array_append(array, bytes, 4);
+}
+
+static GBytes *deflate_bytes(const char *data, gsize len) {
+  GOutputStream *memory, *stream;
+  GConverter *compressor;
+  GBytes *bytes;
+
+  memory = g_memory_output_stream_new_resizable();
+  compressor =
+      G_CONVERTER(g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW, -1));
+  stream = g_converter_output_stream_new(memory, compressor);
+  g_output_stream_write_all(stream, data, len, NULL, NULL, NULL);
+  g_output_stream_close(stream, NULL, NULL);
+  bytes = g_memory_output_stream_steal_as_bytes(G_MEMORY_OUTPUT_STREAM(memory));
+
+  g_object_unref(stream);
+  g_object_unref(compressor);
+  g_object_unref(memory);
+
+  return bytes;
+}
+
+/* Adds a member to the zip archive in zip, and its entry to directory */
+static void zip_add(GByteArray *zip, GByteArray *directory, const char *name,
+                    const char *data, gsize len, gboolean compress) {
+  GBytes *deflated;
+  const guchar *stored;
+  gsize stored_len;
+  guint32 crc, offset;
+
+  crc = crc32_update(0, (const guchar *)data, len);
+  deflated = NULL;
+  stored = (const guchar *)data;
+  stored_len = len;
+  if (compress) {
+    deflated = deflate_bytes(data, len);
+    stored = g_bytes_get_data(deflated, &stored_len);
+  }
+  offset = zip->len;
+
+  put_le32(zip, 0x04034b50);
+  put_le16(zip, 20);
+  put_le16(zip, 0);
+  put_le16(zip, compress ? 8 : 0);
+  put_le32(zip, 0);
+  put_le32(zip, crc);
+  put_le32(zip, stored_len);
+  put_le32(zip, len);
+  put_le16(zip, strlen(name));
+  put_le16(zip, 0);
+  g_byte_array_append(zip, (const guint8 *)name, strlen(name));
+  g_byte_array_append(zip, stored, stored_len);
+
+  put_le32(directory, 0x02014b50);
+  put_le16(directory, 20);
+  put_le16(directory, 20);
+  put_le16(directory, 0);
+  put_le16(directory, compress ? 8 : 0);
+  put_le32(directory, 0);
+  put_le32(directory, crc);
+  put_le32(directory, stored_len);
+  put_le32(directory, len);
+  put_le16(directory, strlen(name));
+  put_le16(directory, 0);
+  put_le16(directory, 0);
+  put_le16(directory, 0);
+  put_le16(directory, 0);
+  put_le32(directory, 0);
+  put_le32(directory, offset);
+  g_byte_array_append(directory, (const guint8 *)name, strlen(name));
+
+  if (deflated != NULL) {
+    g_bytes_unref(deflated);
+  }
+}
+
+/* A minimal OpenDocument text file with paragraphs of text in it */
+static GByteArray *make_document(const char *text) {
+  GByteArray *zip, *directory;
+  GString *content;
+  char **paragraphs;
+  char *escaped;
+  guint16 n_entries;
+  guint32 directory_offset;
+  int i;
+
+  content = g_string_new(
+      "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      "<office:document-content "
+      "xmlns:office=\"urn:oasis:names:tc:opendocument:xmlns:office:1.0\" "
+      "xmlns:text=\"urn:oasis:names:tc:opendocument:xmlns:text:1.0\">"
+      "<office:body><office:text>");
+  paragraphs = g_strsplit(text, "\n", -1);
+  for (i = 0; paragraphs[i] != NULL; i++) {
+    escaped = g_markup_escape_text(paragraphs[i], -1);
+    g_string_append_printf(content, "<text:p>%s</text:p>", escaped);
+    g_free(escaped);
+  }
+  g_strfreev(paragraphs);
+  g_string_append(content, "</office:text></office:body>"
+                           "</office:document-content>");
+
+  zip = g_byte_array_new();
+  directory = g_byte_array_new();
+  zip_add(zip, directory, "mimetype", ODF_MIME_TYPE, strlen(ODF_MIME_TYPE),
+          FALSE);
+  zip_add(zip, directory, "content.xml", content->str, content->len, TRUE);
+  n_entries = 2;
+
+  directory_offset = zip->len;
+  g_byte_array_append(zip, directory->data, directory->len);
+  put_le32(zip, 0x06054b50);
+  put_le16(zip, 0);
+  put_le16(zip, 0);
+  put_le16(zip, n_entries);
+  put_le16(zip, n_entries);
+  put_le32(zip, directory->len);
+  put_le32(zip, directory_offset);
+  put_le16(zip, 0);
+
+  g_byte_array_free(directory, TRUE);
+  g_string_free(content, TRUE);
+
+  return zip;
+}
+
+/* Lines of words, with the needle somewhere if with_needle is set */
+static char *make_text(GRand *rand, gsize len, gboolean with_needle) {
+  GString *text;
+  gsize needle_at;
+
+  text = g_string_sized_new(len + 16);
+  needle_at = with_needle ? g_rand_int_range(rand, 0, len + 1) : G_MAXSIZE;
+
+  while (text->len < len) {
+    if (text->len >= needle_at) {
+      g_string_append(text, NEEDLE " ");
+      needle_at = G_MAXSIZE;
+    }
+    g_string_append(text, words[g_rand_int_range(rand, 0, G_N_ELEMENTS(words))]);
+    g_string_append_c(text, g_rand_int_range(rand, 0, 8) == 0 ? '\n' : ' ');
+  }
+  if (needle_at != G_MAXSIZE) {
+    g_string_append(text, NEEDLE);
+  }
+
+  return g_string_free(text, FALSE);
+}
+
+static void make_folders(GFile *folder, int depth, GPtrArray *folders,
+                         Tree *tree) {
+  GFile *child;
+  char *name;
+  int i;
+
+  g_ptr_array_add(folders, g_object_ref(folder));
+  if (depth == FOLDER_DEPTH) {
+    return;
+  }
+
+  for (i = 0; i < FOLDERS_PER_FOLDER; i++) {
+    name = g_strdup_printf("d%d", i);
+    child = g_file_get_child(folder, name);
+    g_free(name);
+
+    g_file_make_directory(child, NULL, NULL);
+    tree->n_folders++;
+    make_folders(child, depth + 1, folders, tree);
+    g_object_unref(child);
+  }
+}
+
+static void make_file(GFile *folder, guint number, GRand *rand, Tree *tree) {
+  GFile *file;
+  FileKind kind;
+  GByteArray *document;
+  char *name, *lower, *text, *data;
+  const char *extension, *tags;
+  gsize len, i;
+  gboolean with_needle, tagged;
+  guint64 mtime;
+  int choice;
+
+  choice = g_rand_int_range(rand, 0, 10);
+  kind = choice < 5 ? KIND_TEXT : choice < 7 ? KIND_DOCUMENT : KIND_BINARY;
+  extension = kind == KIND_TEXT ? "txt" : kind == KIND_DOCUMENT ? "odt" : "bin";
+
+  name = g_strdup_printf(
+      "%s-%s-%u.%s", words[g_rand_int_range(rand, 0, G_N_ELEMENTS(words))],
+      words[g_rand_int_range(rand, 0, G_N_ELEMENTS(words))], number,
+      extension);
+  file = g_file_get_child(folder, name);
+
+  /* Mostly small files, a few big ones */
+  len = g_rand_int_range(rand, 0, 10) == 0
+            ? g_rand_int_range(rand, SIZE_BOUND / 2, SIZE_BOUND * 4)
+            : g_rand_int_range(rand, 64, 8 * 1024);
+  with_needle = kind != KIND_BINARY && g_rand_int_range(rand, 0, 20) == 0;
+
+  if (kind == KIND_BINARY) {
+    data = g_malloc(len);
+    for (i = 0; i < len; i++) {
+      data[i] = g_rand_int_range(rand, 0, 256);
+    }
+    g_file_replace_contents(file, data, len, NULL, FALSE,
+                            G_FILE_CREATE_NONE, NULL, NULL, NULL);
+    g_free(data);
+  } else {
+    text = make_text(rand, len, with_needle);
+    if (kind == KIND_TEXT) {
+      len = strlen(text);
+      g_file_replace_contents(file, text, len, NULL, FALSE,
+                              G_FILE_CREATE_NONE, NULL, NULL, NULL);
+    } else {
+      document = make_document(text);
+      len = document->len;
+      g_file_replace_contents(file, (const char *)document->data, len, NULL,
+                              FALSE, G_FILE_CREATE_NONE, NULL, NULL, NULL);
+      g_byte_array_free(document, TRUE);
+    }
+    g_free(text);
+  }
+
+  tags = NULL;
+  choice = g_rand_int_range(rand, 0, 10);
+  if (choice == 0) {
+    tags = "urgent";
+  } else if (choice == 1) {
+    tags = "work,urgent";
+  } else if (choice == 2) {
+    tags = "work";
+  }
+  tagged = FALSE;
+  if (tags != NULL) {
+    if (g_file_set_attribute_string(file, "xattr::xdg.tags", tags,
+                                    G_FILE_QUERY_INFO_NONE, NULL, NULL)) {
+      tagged = strstr(tags, "urgent") != NULL;
+    } else {
+      tree->n_tag_failures++;
+    }
+  }
+
+  mtime = TIME_BASE + g_rand_int_range(rand, 0, TIME_SPREAD);
+  g_file_set_attribute_uint64(file, G_FILE_ATTRIBUTE_TIME_MODIFIED, mtime,
+                              G_FILE_QUERY_INFO_NONE, NULL, NULL);
+
+  lower = g_ascii_strdown(name, -1);
+  tree->expected[QUERY_NAME] += strstr(lower, "report") != NULL;
+  tree->expected[QUERY_WORDS] +=
+      strstr(lower, "budget") != NULL && strstr(lower, "draft") != NULL;
+  g_free(lower);
+  tree->expected[QUERY_MIME] += kind == KIND_TEXT;
+  tree->expected[QUERY_SIZE] += len >= SIZE_BOUND;
+  tree->expected[QUERY_DATE] += mtime <= TIME_BOUND;
+  tree->expected[QUERY_TAG] += tagged;
+  tree->expected[QUERY_CONTENT] += with_needle;
+  tree->n_files++;
+
+  g_object_unref(file);
+  g_free(name);
+}
+
+static gboolean make_tree(Tree *tree) {
+  GPtrArray *folders;
+  GRand *rand;
+  char *path;
+  guint i;
+
+  if (directory_option != NULL) {
+    path = g_build_filename(directory_option, "caja-search-benchmark", NULL);
+    if (g_mkdir_with_parents(path, 0700) != 0) {
+      g_printerr("Can't make %s\n", path);
+      g_free(path);
+      return FALSE;
+    }
+  } else {
+    path = g_dir_make_tmp("caja-search-benchmark-XXXXXX", NULL);
+    if (path == NULL) {
+      g_printerr("Can't make a temporary folder\n");
+      return FALSE;
+    }
+  }
+  tree->root = g_file_new_for_path(path);
+  g_free(path);
+
+  rand = g_rand_new_with_seed(seed_option);
+  folders = g_ptr_array_new_with_free_func(g_object_unref);
+  make_folders(tree->root, 0, folders, tree);
+
+  for (i = 0; i < (guint)files_option; i++) {
+    make_file(folders->pdata[g_rand_int_range(rand, 0, folders->len)], i, rand,
+              tree);
+  }
+
+  g_ptr_array_free(folders, TRUE);
+  g_rand_free(rand);
+
+  return TRUE;
+}
+
+static void delete_recursively(GFile *file) {
+  GFileEnumerator *enumerator;
+  GFileInfo *info;
+  GFile *child;
+
+  enumerator = g_file_enumerate_children(
+      file, G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_STANDARD_TYPE,
+      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL, NULL);
+  if (enumerator != NULL) {
+    while ((info = g_file_enumerator_next_file(enumerator, NULL, NULL)) !=
+           NULL) {
+      child = g_file_get_child(file, g_file_info_get_name(info));
+      if (g_file_info_get_file_type(info) == G_FILE_TYPE_DIRECTORY) {
+        delete_recursively(child);
+      } else {
+        g_file_delete(child, NULL, NULL);
+      }
+      g_object_unref(child);
+      g_object_unref(info);
+    }
+    g_object_unref(enumerator);
+  }
+
+  g_file_delete(file, NULL, NULL);
+}
+
+static CajaQuery *make_query(QueryKind kind, GFile *root) {
+  CajaQuery *query;
+  char *uri;
+
+  query = caja_query_new();
+  uri = g_file_get_uri(root);
+  caja_query_set_location(query, uri);
+  g_free(uri);
+  caja_query_set_text(query, "");
+
+  switch (kind) {
+    case QUERY_NAME:
+      caja_query_set_text(query, "report");
+      break;
+    case QUERY_WORDS:
+      caja_query_set_text(query, "budget draft");
+      break;
+    case QUERY_MIME:
+      caja_query_add_mime_type(query, "text/plain");
+      break;
+    case QUERY_SIZE:
+      caja_query_set_size(query, SIZE_BOUND);
+      break;
+    case QUERY_DATE:
+      caja_query_set_timestamp(query, TIME_BOUND);
+      break;
+    case QUERY_TAG:
+      caja_query_add_tag(query, "urgent");
+      break;
+    case QUERY_CONTENT:
+      caja_query_set_contained_text(query, NEEDLE);
+      break;
+    default:
+      g_assert_not_reached();
+  }
+
+  return query;
+}
+
+/* The most memory the process used, in KiB, since the last call. Linux
+ * only, -1 elsewhere.
+ */
+static gint64 get_peak_memory(void) {
+  char *status, *line;
+  FILE *clear_refs;
+  gint64 peak;
+
+  peak = -1;
+  if (g_file_get_contents("/proc/self/status", &status, NULL, NULL)) {
+    line = strstr(status, "VmHWM:");
+    if (line != NULL) {
+      peak = g_ascii_strtoll(line + strlen("VmHWM:"), NULL, 10);
+    }
+    g_free(status);
+  }
+
+  /* Starts over for the next run */
+  clear_refs = fopen("/proc/self/clear_refs", "w");
+  if (clear_refs != NULL) {
+    fputs("5", clear_refs);
+    fclose(clear_refs);
+  }
+
+  return peak;
+}
+
+static void hits_added_cb(CajaSearchEngine *engine, GList *hits, Run *run) {
+  if (hits != NULL && run->first_hit < 0) {
+    run->first_hit = g_get_monotonic_time();
+  }
+  run->n_hits += g_list_length(hits);
+}
+
+static void hit_batches_added_cb(CajaSearchEngine *engine, GList *batches,
+                                 Run *run) {
+  CajaSearchHitBatch *batch;
+  GList *l;
+
+  for (l = batches; l != NULL; l = l->next) {
+    batch = l->data;
+    if (batch->infos != NULL && run->first_hit < 0) {
+      run->first_hit = g_get_monotonic_time();
+    }
+    run->n_hits += g_list_length(batch->infos);
+  }
+}
+
+static void finished_cb(CajaSearchEngine *engine, Run *run) {
+  g_main_loop_quit(run->loop);
+}
+
+static void error_cb(CajaSearchEngine *engine, const char *error_message,
+                     Run *run) {
+  g_printerr("%s\n", error_message);
+  g_main_loop_quit(run->loop);
+}
+
+static CajaSearchEngine *make_engine(void) {
+  if (g_strcmp0(engine_option, "default") == 0) {
+    return caja_search_engine_new();
+  }
+  return caja_search_engine_simple_new();
+}
+
+/* Returns FALSE if the engine didn't find what it should have */
+static gboolean run_query(QueryKind kind, Tree *tree, int number) {
+  CajaSearchEngine *engine;
+  CajaQuery *query;
+  Run run;
+  gint64 total, peak;
+  guint n_entries;
+
+  engine = make_engine();
+  query = make_query(kind, tree->root);
+  caja_search_engine_set_query(engine, query);
+
+  run.loop = g_main_loop_new(NULL, FALSE);
+  run.first_hit = -1;
+  run.n_hits = 0;
+  g_signal_connect(engine, "hits-added", G_CALLBACK(hits_added_cb), &run);
+  g_signal_connect(engine, "hit-batches-added",
+                   G_CALLBACK(hit_batches_added_cb), &run);
+  g_signal_connect(engine, "finished", G_CALLBACK(finished_cb), &run);
+  g_signal_connect(engine, "error", G_CALLBACK(error_cb), &run);
+
+  get_peak_memory();
+  run.start = g_get_monotonic_time();
+  caja_search_engine_start(engine);
+  g_main_loop_run(run.loop);
+  total = g_get_monotonic_time() - run.start;
+  peak = get_peak_memory();
+
+  n_entries = tree->n_files + tree->n_folders;
+  g_print("{\"engine\": \"%s\", \"query\": \"%s\", \"run\": %d, "
+          "\"files\": %u, \"hits\": %u, \"expected_hits\": %u, "
+          "\"first_hit_ms\": %.3f, \"total_ms\": %.3f, "
+          "\"files_per_second\": %.0f, \"peak_memory_kib\": %" G_GINT64_FORMAT
+          "}\n",
+          engine_option != NULL ? engine_option : "simple", query_names[kind],
+          number, n_entries, run.n_hits, tree->expected[kind],
+          run.first_hit >= 0 ? (run.first_hit - run.start) / 1000.0 : -1.0,
+          total / 1000.0, total > 0 ? n_entries * 1e6 / total : 0.0, peak);
+
+  g_main_loop_unref(run.loop);
+  g_object_unref(query);
+  g_object_unref(engine);
+
+  return run.n_hits == tree->expected[kind];
+}
+
+int main(int argc, char *argv[]) {
+  GOptionContext *context;
+  GError *error;
+  Tree tree = {0};
+  gboolean same;
+  int kind, i;
+
+  context = g_option_context_new(NULL);
+  g_option_context_add_main_entries(context, option_entries, NULL);
+  error = NULL;
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    return 2;
+  }
+  g_option_context_free(context);
+
+  if (!make_tree(&tree)) {
+    return 2;
+  }
+  if (tree.n_tag_failures > 0) {
+    g_printerr("Couldn't tag %u files, the file system may not support "
+               "extended attributes\n",
+               tree.n_tag_failures);
+  }
+
+  same = TRUE;
+  for (kind = 0; kind < N_QUERIES; kind++) {
+    for (i = 0; i < runs_option; i++) {
+      same &= run_query(kind, &tree, i);
+    }
+  }
+
+  if (!keep_option) {
+    delete_recursively(tree.root);
+  }
+  g_object_unref(tree.root);
+
+  return same ? 0 : 1;
+}
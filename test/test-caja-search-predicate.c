@@ -0,0 +1,286 @@
+/* Measures matching file infos against a query, compared to how the simple
+ * search engine did it before the query was compiled into a predicate, and
+ * checks that both agree.
+ *
+ * Usage: test-caja-search-predicate [n-files] [rounds]
+ */
+
+#include <gio/gio.h>
+#include <libcaja-private/caja-search-predicate.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAGS_ATTRIBUTE "xattr::xdg.tags"
+
+static const char *name_parts[] = {"report", "Holiday", "budget", "notes",
+                                   "Übersicht", "café", "IMG", "draft",
+                                   "résumé", "backup", "Ωmega", "final"};
+
+static const char *extensions[] = {".txt", ".odt", ".png", ".c", ".pdf"};
+
+static const char *content_types[] = {
+    "text/plain", "application/vnd.oasis.opendocument.text", "image/png",
+    "text/x-csrc", "application/pdf"};
+
+static const char *tag_lists[] = {NULL, "work", "work,urgent",
+                                  "personal,\\x55rgent", "archive"};
+
+static GPtrArray *make_infos(guint n_files) {
+  GPtrArray *infos;
+  GFileInfo *info;
+  GRand *rand;
+  char *name;
+  guint i, kind;
+
+  /* Always the same files */
+  rand = g_rand_new_with_seed(42);
+  infos = g_ptr_array_new_with_free_func(g_object_unref);
+
+  for (i = 0; i < n_files; i++) {
+    kind = g_rand_int_range(rand, 0, G_N_ELEMENTS(extensions));
+    name = g_strdup_printf(
+        "%s %s %u%s",
+        name_parts[g_rand_int_range(rand, 0, G_N_ELEMENTS(name_parts))],
+        name_parts[g_rand_int_range(rand, 0, G_N_ELEMENTS(name_parts))], i,
+        extensions[kind]);
+
+    info = g_file_info_new();
+    g_file_info_set_name(info, name);
+    g_file_info_set_display_name(info, name);
+    g_file_info_set_content_type(info, content_types[kind]);
+    g_file_info_set_size(info, g_rand_int_range(rand, 0, 1024 * 1024));
+    g_file_info_set_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                                     1500000000 +
+                                         g_rand_int_range(rand, 0, 100000000));
+    kind = g_rand_int_range(rand, 0, G_N_ELEMENTS(tag_lists));
+    if (tag_lists[kind] != NULL) {
+      g_file_info_set_attribute_string(info, TAGS_ATTRIBUTE, tag_lists[kind]);
+    }
+
+    g_ptr_array_add(infos, info);
+    g_free(name);
+  }
+
+  g_rand_free(rand);
+
+  return infos;
+}
+
+static char *normalize_strdown(const char *text) {
+  char *normalized, *lower;
+
+  normalized = g_utf8_normalize(text, -1, G_NORMALIZE_NFD);
+  lower = g_utf8_strdown(normalized, -1);
+  g_free(normalized);
+
+  return lower;
+}
+
+static char *unescape(const char *text) {
+  GString *result;
+  const char *p;
+
+  result = g_string_new(NULL);
+  for (p = text; *p != '\0'; p++) {
+    if (p[0] == '\\' && p[1] == 'x' && g_ascii_isxdigit(p[2]) &&
+        g_ascii_isxdigit(p[3])) {
+      g_string_append_c(result, g_ascii_xdigit_value(p[2]) << 4 |
+                                    g_ascii_xdigit_value(p[3]));
+      p += 3;
+    } else {
+      g_string_append_c(result, *p);
+    }
+  }
+
+  return g_string_free(result, FALSE);
+}
+
+/* The query the way the simple search engine kept it */
+typedef struct {
+  char **words;
+  GList *mime_types;
+  GList *tags;
+  gint64 size;
+} ReferenceQuery;
+
+static void reference_query_init(ReferenceQuery *reference, CajaQuery *query) {
+  char *text, *lower;
+
+  text = caja_query_get_text(query);
+  lower = normalize_strdown(text);
+  reference->words = g_strsplit(lower, " ", -1);
+  g_free(lower);
+  g_free(text);
+
+  reference->mime_types = caja_query_get_mime_types(query);
+  reference->tags = caja_query_get_tags(query);
+  reference->size = caja_query_get_size(query);
+}
+
+static void reference_query_clear(ReferenceQuery *reference) {
+  g_strfreev(reference->words);
+  g_list_free_full(reference->mime_types, g_free);
+  g_list_free_full(reference->tags, g_free);
+}
+
+/* Matching the way visit_directory() did it for each file */
+static gboolean reference_match(ReferenceQuery *reference, GFileInfo *info) {
+  char *lower, *name, *unescaped;
+  char **file_tags;
+  const char *mime_type, *value;
+  gboolean hit;
+  GList *l;
+  int i;
+
+  name = normalize_strdown(g_file_info_get_display_name(info));
+  hit = TRUE;
+  for (i = 0; reference->words[i] != NULL; i++) {
+    if (strstr(name, reference->words[i]) == NULL) {
+      hit = FALSE;
+      break;
+    }
+  }
+  g_free(name);
+
+  if (hit && reference->mime_types != NULL) {
+    mime_type = g_file_info_get_content_type(info);
+    hit = FALSE;
+    for (l = reference->mime_types; mime_type != NULL && l != NULL;
+         l = l->next) {
+      if (g_content_type_equals(mime_type, l->data)) {
+        hit = TRUE;
+        break;
+      }
+    }
+  }
+
+  if (hit && reference->tags != NULL) {
+    value = g_file_info_get_attribute_string(info, TAGS_ATTRIBUTE);
+    if (value == NULL) {
+      hit = FALSE;
+    } else {
+      unescaped = unescape(value);
+      lower = normalize_strdown(unescaped);
+      file_tags = g_strsplit(lower, ",", -1);
+      for (l = reference->tags; hit && l != NULL; l = l->next) {
+        hit = g_strv_contains((const char *const *)file_tags, l->data);
+      }
+      g_strfreev(file_tags);
+      g_free(lower);
+      g_free(unescaped);
+    }
+  }
+
+  if (hit && reference->size > 0) {
+    hit = g_file_info_get_size(info) >= reference->size;
+  }
+
+  return hit;
+}
+
+/* Returns FALSE if the predicate doesn't match the same files */
+static gboolean run_query(const char *description, CajaQuery *query,
+                          GPtrArray *infos, guint rounds) {
+  CajaSearchPredicate *predicate;
+  CajaSearchScratch scratch;
+  CajaSearchPredicateResult result;
+  ReferenceQuery reference;
+  gint64 start, reference_time, predicate_time;
+  guint i, round, n_hits, n_differences;
+  gboolean hit;
+
+  reference_query_init(&reference, query);
+
+  start = g_get_monotonic_time();
+  for (round = 0; round < rounds; round++) {
+    for (i = 0; i < infos->len; i++) {
+      reference_match(&reference, infos->pdata[i]);
+    }
+  }
+  reference_time = g_get_monotonic_time() - start;
+
+  predicate = caja_search_predicate_new(query, 0);
+  caja_search_scratch_init(&scratch);
+
+  n_hits = 0;
+  start = g_get_monotonic_time();
+  for (round = 0; round < rounds; round++) {
+    for (i = 0; i < infos->len; i++) {
+      result = caja_search_predicate_match(predicate, infos->pdata[i],
+                                           &scratch);
+      n_hits += result == CAJA_SEARCH_PREDICATE_MATCH;
+    }
+  }
+  predicate_time = g_get_monotonic_time() - start;
+
+  n_differences = 0;
+  for (i = 0; i < infos->len; i++) {
+    hit = caja_search_predicate_match(predicate, infos->pdata[i], &scratch) ==
+          CAJA_SEARCH_PREDICATE_MATCH;
+    if (hit != reference_match(&reference, infos->pdata[i])) {
+      g_printerr("%s: %s: %s\n", description,
+                 g_file_info_get_display_name(infos->pdata[i]),
+                 hit ? "only the predicate matches"
+                     : "only the reference matches");
+      n_differences++;
+    }
+  }
+
+  caja_search_scratch_clear(&scratch);
+  caja_search_predicate_free(predicate);
+  reference_query_clear(&reference);
+
+  g_print("%-22s %8u hits %10.1f ns/file before %10.1f ns/file now%s\n",
+          description, n_hits / rounds,
+          reference_time * 1000.0 / ((double)infos->len * rounds),
+          predicate_time * 1000.0 / ((double)infos->len * rounds),
+          n_differences > 0 ? "  DIFFERENT" : "");
+
+  return n_differences == 0;
+}
+
+int main(int argc, char *argv[]) {
+  GPtrArray *infos;
+  CajaQuery *query;
+  guint n_files, rounds;
+  gboolean same;
+
+  n_files = argc > 1 ? atoi(argv[1]) : 100000;
+  rounds = argc > 2 ? atoi(argv[2]) : 5;
+
+  infos = make_infos(n_files);
+  same = TRUE;
+
+  query = caja_query_new();
+  caja_query_set_text(query, "report");
+  same &= run_query("ascii word", query, infos, rounds);
+  caja_query_set_text(query, "budget notes");
+  same &= run_query("two ascii words", query, infos, rounds);
+  caja_query_set_text(query, "übersicht");
+  same &= run_query("accented word", query, infos, rounds);
+  g_object_unref(query);
+
+  query = caja_query_new();
+  caja_query_set_text(query, "");
+  caja_query_add_mime_type(query, "text/plain");
+  caja_query_add_mime_type(query, "application/vnd.oasis.opendocument.text");
+  same &= run_query("types", query, infos, rounds);
+  g_object_unref(query);
+
+  query = caja_query_new();
+  caja_query_set_text(query, "");
+  caja_query_add_tag(query, "work");
+  caja_query_add_tag(query, "urgent");
+  same &= run_query("tags", query, infos, rounds);
+  g_object_unref(query);
+
+  query = caja_query_new();
+  caja_query_set_text(query, "final");
+  caja_query_set_size(query, 512 * 1024);
+  same &= run_query("word and size", query, infos, rounds);
+  g_object_unref(query);
+
+  g_ptr_array_free(infos, TRUE);
+
+  return same ? 0 : 1;
+}
@@ -0,0 +1,116 @@
+#define MATE_DESKTOP_USE_UNSTABLE_API
+#include <libcaja-private/caja-thumbnails.h>
+#include <libmate-desktop/mate-desktop-thumbnail.h>
+#include <stdlib.h>
+
+#include "test.h"
+
+/* Compares the photo fast path of the thumbnailer with the thumbnail
+ * factory on a folder of photos, e.g. a camera card.
+ */
+
+#define THUMBNAIL_SIZE 128
+
+typedef struct {
+  guint files;
+  guint previews;
+  guint scaled_decodes;
+  gint64 fast_usecs;
+  gint64 factory_usecs;
+} Totals;
+
+static void thumbnail_folder(MateDesktopThumbnailFactory *factory,
+                             const char *path, Totals *totals) {
+  GFileEnumerator *enumerator;
+  GFileInfo *info;
+  GFile *folder, *file;
+  GdkPixbuf *pixbuf;
+  gboolean used_preview;
+  gint64 t1, t2, t3;
+  const char *mime_type;
+  char *uri;
+
+  folder = g_file_new_for_commandline_arg(path);
+  enumerator = g_file_enumerate_children(
+      folder,
+      G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE,
+      0, NULL, NULL);
+  if (enumerator == NULL) {
+    printf("can't read %s\n", path);
+    exit(1);
+  }
+
+  while ((info = g_file_enumerator_next_file(enumerator, NULL, NULL)) != NULL) {
+    mime_type = g_file_info_get_content_type(info);
+    file = g_file_get_child(folder, g_file_info_get_name(info));
+    uri = g_file_get_uri(file);
+
+    t1 = g_get_monotonic_time();
+    pixbuf = caja_thumbnail_generate_fast(uri, mime_type, THUMBNAIL_SIZE,
+                                          &used_preview);
+    t2 = g_get_monotonic_time();
+
+    if (pixbuf != NULL) {
+      g_object_unref(pixbuf);
+
+      totals->files++;
+      totals->fast_usecs += t2 - t1;
+      if (used_preview) {
+        totals->previews++;
+      } else {
+        totals->scaled_decodes++;
+      }
+
+      /* what the same file costs without the fast path */
+      pixbuf = mate_desktop_thumbnail_factory_generate_thumbnail(factory, uri,
+                                                                 mime_type);
+      t3 = g_get_monotonic_time();
+      totals->factory_usecs += t3 - t2;
+      if (pixbuf != NULL) {
+        g_object_unref(pixbuf);
+      }
+    }
+
+    g_free(uri);
+    g_object_unref(file);
+    g_object_unref(info);
+  }
+
+  g_object_unref(enumerator);
+  g_object_unref(folder);
+}
+
+static void print_rate(const char *what, guint files, gint64 usecs) {
+  printf("%s: %" G_GINT64_FORMAT " usecs per photo, %.1f photos per second\n",
+         what, files > 0 ? usecs / files : 0,
+         usecs > 0 ? files * (double)G_USEC_PER_SEC / usecs : 0.0);
+}
+
+int main(int argc, char *argv[]) {
+  MateDesktopThumbnailFactory *factory;
+  Totals totals = {0};
+  int i;
+
+  test_init(&argc, &argv);
+
+  if (argc < 2) {
+    printf("Usage: test folder [folder...]\n");
+    exit(1);
+  }
+
+  factory =
+      mate_desktop_thumbnail_factory_new(MATE_DESKTOP_THUMBNAIL_SIZE_NORMAL);
+
+  for (i = 1; i < argc; i++) {
+    thumbnail_folder(factory, argv[i], &totals);
+  }
+
+  printf("%u photos, %u from embedded previews, %u decoded scaled down\n",
+         totals.files, totals.previews, totals.scaled_decodes);
+  print_rate("fast path", totals.files, totals.fast_usecs);
+  print_rate("thumbnail factory", totals.files, totals.factory_usecs);
+
+  g_object_unref(factory);
+
+  return 0;
+}
@@ -0,0 +1,352 @@
+#include <eel/eel-graphic-effects.h>
+#include <string.h>
+
+#include "test.h"
+
+/* Checks that the graphic effects give exactly the same pixels as the
+ * straightforward per-sample loops they used to be, for all the row widths
+ * and layouts the vectorized kernels treat differently, with each of the
+ * kernels this CPU can run.
+ */
+
+#define MAX_WIDTH 67
+#define HEIGHT 3
+#define BENCHMARK_SIZE 256
+#define BENCHMARK_ROUNDS 200
+
+static const struct {
+  EelPixelKernels kernels;
+  const char *name;
+} all_kernels[] = {{EEL_PIXEL_KERNELS_SCALAR, "scalar"},
+                   {EEL_PIXEL_KERNELS_SSE2, "SSE2"},
+                   {EEL_PIXEL_KERNELS_AVX2, "AVX2"},
+                   {EEL_PIXEL_KERNELS_NEON, "NEON"}};
+
+/* The name of the kernels being checked */
+static const char *kernels_name;
+
+static guchar lighten_component(guchar cur_value) {
+  int new_value = cur_value;
+  new_value += 24 + (new_value >> 3);
+  if (new_value > 255) {
+    new_value = 255;
+  }
+  return (guchar)new_value;
+}
+
+static GdkPixbuf *reference_spotlight(GdkPixbuf *src) {
+  GdkPixbuf *dest;
+  guchar *pixsrc, *pixdest;
+  int i, j, n_channels;
+
+  dest = gdk_pixbuf_copy(src);
+  n_channels = gdk_pixbuf_get_n_channels(src);
+  for (i = 0; i < gdk_pixbuf_get_height(src); i++) {
+    pixsrc = gdk_pixbuf_get_pixels(src) + i * gdk_pixbuf_get_rowstride(src);
+    pixdest = gdk_pixbuf_get_pixels(dest) + i * gdk_pixbuf_get_rowstride(dest);
+    for (j = 0; j < gdk_pixbuf_get_width(src); j++) {
+      *pixdest++ = lighten_component(*pixsrc++);
+      *pixdest++ = lighten_component(*pixsrc++);
+      *pixdest++ = lighten_component(*pixsrc++);
+      if (n_channels == 4) {
+        *pixdest++ = *pixsrc++;
+      }
+    }
+  }
+
+  return dest;
+}
+
+static GdkPixbuf *reference_darkened(GdkPixbuf *src, int saturation,
+                                     int darken) {
+  GdkPixbuf *dest;
+  guchar *pixsrc, *pixdest;
+  guchar intensity, alpha, negalpha, r, g, b;
+  int i, j, n_channels;
+
+  dest = gdk_pixbuf_copy(src);
+  n_channels = gdk_pixbuf_get_n_channels(src);
+  for (i = 0; i < gdk_pixbuf_get_height(src); i++) {
+    pixsrc = gdk_pixbuf_get_pixels(src) + i * gdk_pixbuf_get_rowstride(src);
+    pixdest = gdk_pixbuf_get_pixels(dest) + i * gdk_pixbuf_get_rowstride(dest);
+    for (j = 0; j < gdk_pixbuf_get_width(src); j++) {
+      r = *pixsrc++;
+      g = *pixsrc++;
+      b = *pixsrc++;
+      intensity = (r * 77 + g * 150 + b * 28) >> 8;
+      negalpha = ((255 - saturation) * darken) >> 8;
+      alpha = (saturation * darken) >> 8;
+      *pixdest++ = (negalpha * intensity + alpha * r) >> 8;
+      *pixdest++ = (negalpha * intensity + alpha * g) >> 8;
+      *pixdest++ = (negalpha * intensity + alpha * b) >> 8;
+      if (n_channels == 4) {
+        *pixdest++ = *pixsrc++;
+      }
+    }
+  }
+
+  return dest;
+}
+
+static GdkPixbuf *reference_colorized(GdkPixbuf *src, GdkRGBA *color) {
+  GdkPixbuf *dest;
+  guchar *pixsrc, *pixdest;
+  int red, green, blue;
+  int i, j, n_channels;
+
+  red = eel_round(color->red * 255);
+  green = eel_round(color->green * 255);
+  blue = eel_round(color->blue * 255);
+
+  dest = gdk_pixbuf_copy(src);
+  n_channels = gdk_pixbuf_get_n_channels(src);
+  for (i = 0; i < gdk_pixbuf_get_height(src); i++) {
+    pixsrc = gdk_pixbuf_get_pixels(src) + i * gdk_pixbuf_get_rowstride(src);
+    pixdest = gdk_pixbuf_get_pixels(dest) + i * gdk_pixbuf_get_rowstride(dest);
+    for (j = 0; j < gdk_pixbuf_get_width(src); j++) {
+      *pixdest++ = (*pixsrc++ * red) >> 8;
+      *pixdest++ = (*pixsrc++ * green) >> 8;
+      *pixdest++ = (*pixsrc++ * blue) >> 8;
+      if (n_channels == 4) {
+        *pixdest++ = *pixsrc++;
+      }
+    }
+  }
+
+  return dest;
+}
+
+static GdkPixbuf *random_pixbuf(GRand *rand, int width, gboolean has_alpha) {
+  GdkPixbuf *pixbuf;
+  guchar *pixels;
+  int i, j, row_bytes;
+
+  pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, has_alpha, 8, width, HEIGHT);
+  row_bytes = width * gdk_pixbuf_get_n_channels(pixbuf);
+  for (i = 0; i < HEIGHT; i++) {
+    pixels =
+        gdk_pixbuf_get_pixels(pixbuf) + i * gdk_pixbuf_get_rowstride(pixbuf);
+    for (j = 0; j < row_bytes; j++) {
+      /* mix in the extremes, they are where saturation goes wrong */
+      switch (g_rand_int_range(rand, 0, 4)) {
+        case 0:
+          pixels[j] = 0;
+          break;
+        case 1:
+          pixels[j] = 255;
+          break;
+        default:
+          pixels[j] = g_rand_int_range(rand, 0, 256);
+          break;
+      }
+    }
+  }
+
+  return pixbuf;
+}
+
+static gboolean pixbufs_equal(GdkPixbuf *a, GdkPixbuf *b) {
+  int i, row_bytes;
+
+  row_bytes = gdk_pixbuf_get_width(a) * gdk_pixbuf_get_n_channels(a);
+  for (i = 0; i < gdk_pixbuf_get_height(a); i++) {
+    if (memcmp(gdk_pixbuf_get_pixels(a) + i * gdk_pixbuf_get_rowstride(a),
+               gdk_pixbuf_get_pixels(b) + i * gdk_pixbuf_get_rowstride(b),
+               row_bytes) != 0) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+static gboolean check(const char *what, int width, gboolean has_alpha,
+                      GdkPixbuf *result, GdkPixbuf *expected) {
+  gboolean equal;
+
+  equal = pixbufs_equal(result, expected);
+  if (!equal) {
+    printf("FAIL: %s kernels, %s, width %d, %s\n", kernels_name, what, width,
+           has_alpha ? "with alpha" : "without alpha");
+  }
+
+  g_object_unref(result);
+  g_object_unref(expected);
+
+  return equal;
+}
+
+static gboolean check_spotlight_surface(GdkPixbuf *pixbuf) {
+  cairo_surface_t *surface, *result, *expected;
+  GdkPixbuf *round_trip, *spotlight;
+  gboolean equal;
+  int i, width;
+
+  /* the surface version has to match spotlighting a pixbuf made from the
+   * same surface and turning that back into a surface
+   */
+  width = gdk_pixbuf_get_width(pixbuf);
+  surface = gdk_cairo_surface_create_from_pixbuf(pixbuf, 1, NULL);
+  round_trip = gdk_pixbuf_get_from_surface(surface, 0, 0, width, HEIGHT);
+  spotlight = reference_spotlight(round_trip);
+  expected = gdk_cairo_surface_create_from_pixbuf(spotlight, 1, NULL);
+
+  result = eel_create_spotlight_surface(surface, 1);
+
+  cairo_surface_flush(result);
+  cairo_surface_flush(expected);
+  equal = TRUE;
+  for (i = 0; i < HEIGHT; i++) {
+    if (memcmp(cairo_image_surface_get_data(result) +
+                   i * cairo_image_surface_get_stride(result),
+               cairo_image_surface_get_data(expected) +
+                   i * cairo_image_surface_get_stride(expected),
+               width * 4) != 0) {
+      equal = FALSE;
+    }
+  }
+  if (!equal) {
+    printf("FAIL: %s kernels, spotlight surface, width %d\n", kernels_name,
+           width);
+  }
+
+  cairo_surface_destroy(expected);
+  cairo_surface_destroy(result);
+  cairo_surface_destroy(surface);
+  g_object_unref(spotlight);
+  g_object_unref(round_trip);
+
+  return equal;
+}
+
+static void benchmark(GRand *rand) {
+  GdkPixbuf *pixbuf, *result;
+  cairo_surface_t *surface, *surface_result;
+  GdkRGBA color = {0.2, 0.5, 0.9, 1.0};
+  gint64 t1, t2;
+  int i;
+
+  pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, BENCHMARK_SIZE,
+                          BENCHMARK_SIZE);
+  for (i = 0; i < BENCHMARK_SIZE * gdk_pixbuf_get_rowstride(pixbuf); i++) {
+    gdk_pixbuf_get_pixels(pixbuf)[i] = g_rand_int_range(rand, 0, 256);
+  }
+  surface = gdk_cairo_surface_create_from_pixbuf(pixbuf, 1, NULL);
+
+  t1 = g_get_monotonic_time();
+  for (i = 0; i < BENCHMARK_ROUNDS; i++) {
+    result = eel_create_spotlight_pixbuf(pixbuf);
+    g_object_unref(result);
+  }
+  t2 = g_get_monotonic_time();
+  g_print("Time for eel_create_spotlight_pixbuf: %" G_GINT64_FORMAT " usecs\n",
+          (t2 - t1) / BENCHMARK_ROUNDS);
+
+  t1 = g_get_monotonic_time();
+  for (i = 0; i < BENCHMARK_ROUNDS; i++) {
+    result = eel_create_darkened_pixbuf(pixbuf, 128, 200);
+    g_object_unref(result);
+  }
+  t2 = g_get_monotonic_time();
+  g_print("Time for eel_create_darkened_pixbuf: %" G_GINT64_FORMAT " usecs\n",
+          (t2 - t1) / BENCHMARK_ROUNDS);
+
+  t1 = g_get_monotonic_time();
+  for (i = 0; i < BENCHMARK_ROUNDS; i++) {
+    result = eel_create_colorized_pixbuf(pixbuf, &color);
+    g_object_unref(result);
+  }
+  t2 = g_get_monotonic_time();
+  g_print("Time for eel_create_colorized_pixbuf: %" G_GINT64_FORMAT " usecs\n",
+          (t2 - t1) / BENCHMARK_ROUNDS);
+
+  t1 = g_get_monotonic_time();
+  for (i = 0; i < BENCHMARK_ROUNDS; i++) {
+    surface_result = eel_create_spotlight_surface(surface, 1);
+    cairo_surface_destroy(surface_result);
+  }
+  t2 = g_get_monotonic_time();
+  g_print("Time for eel_create_spotlight_surface: %" G_GINT64_FORMAT " usecs\n",
+          (t2 - t1) / BENCHMARK_ROUNDS);
+
+  cairo_surface_destroy(surface);
+  g_object_unref(pixbuf);
+}
+
+static gboolean check_all(void) {
+  GRand *rand;
+  GdkPixbuf *pixbuf;
+  GdkRGBA color;
+  gboolean ok, has_alpha;
+  int width, saturation, darken;
+
+  /* the same pixels for all the kernels */
+  rand = g_rand_new_with_seed(42);
+  ok = TRUE;
+
+  for (width = 1; width <= MAX_WIDTH; width++) {
+    for (has_alpha = FALSE; has_alpha <= TRUE; has_alpha++) {
+      pixbuf = random_pixbuf(rand, width, has_alpha);
+
+      ok &= check("spotlight", width, has_alpha,
+                  eel_create_spotlight_pixbuf(pixbuf),
+                  reference_spotlight(pixbuf));
+
+      saturation = g_rand_int_range(rand, 0, 256);
+      darken = g_rand_int_range(rand, 0, 256);
+      ok &= check("darkened", width, has_alpha,
+                  eel_create_darkened_pixbuf(pixbuf, saturation, darken),
+                  reference_darkened(pixbuf, saturation, darken));
+
+      color.red = g_rand_double(rand);
+      color.green = g_rand_double(rand);
+      color.blue = g_rand_double(rand);
+      color.alpha = 1.0;
+      ok &= check("colorized", width, has_alpha,
+                  eel_create_colorized_pixbuf(pixbuf, &color),
+                  reference_colorized(pixbuf, &color));
+
+      if (has_alpha) {
+        ok &= check_spotlight_surface(pixbuf);
+      }
+
+      g_object_unref(pixbuf);
+    }
+  }
+
+  g_rand_free(rand);
+
+  return ok;
+}
+
+int main(int argc, char *argv[]) {
+  GRand *rand;
+  gboolean ok;
+  guint i;
+
+  test_init(&argc, &argv);
+
+  ok = TRUE;
+
+  for (i = 0; i < G_N_ELEMENTS(all_kernels); i++) {
+    kernels_name = all_kernels[i].name;
+    if (!eel_graphic_effects_force_kernels(all_kernels[i].kernels)) {
+      printf("Skipping the %s kernels, not available here\n", kernels_name);
+      continue;
+    }
+    if (check_all()) {
+      printf("The %s kernels are bit-exact\n", kernels_name);
+    } else {
+      ok = FALSE;
+    }
+  }
+  eel_graphic_effects_force_kernels(EEL_PIXEL_KERNELS_BEST);
+
+  printf("%s\n", ok ? "All graphic effects are bit-exact" : "Mismatches found");
+
+  rand = g_rand_new_with_seed(42);
+  benchmark(rand);
+  g_rand_free(rand);
+
+  return ok ? 0 : 1;
+}
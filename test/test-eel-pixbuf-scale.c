@@ -1,30 +1,289 @@
 #include <eel/eel-gdk-pixbuf-extensions.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "test.h"
 
 #define DEST_WIDTH 32
 #define DEST_HEIGHT 32
 
+/* The box filter as it was before it was vectorized and split into
+ * stripes; eel_gdk_pixbuf_scale_down() has to match it byte for byte.
+ */
+static GdkPixbuf *reference_scale_down(GdkPixbuf *pixbuf, int dest_width,
+                                       int dest_height) {
+  int source_width, source_height;
+  int s_y1, s_x2;
+  int s_yfrac;
+  int dx, dx_frac, dy, dy_frac;
+  div_t ddx, ddy;
+  int x, y;
+  int r, g, b, a;
+  int n_pixels;
+  gboolean has_alpha;
+  guchar *dest, *src, *xsrc, *src_pixels;
+  GdkPixbuf *dest_pixbuf;
+  int pixel_stride;
+  int source_rowstride, dest_rowstride;
+
+  if (dest_width == 0 || dest_height == 0) {
+    return NULL;
+  }
+
+  source_width = gdk_pixbuf_get_width(pixbuf);
+  source_height = gdk_pixbuf_get_height(pixbuf);
+
+  g_assert(source_width >= dest_width);
+  g_assert(source_height >= dest_height);
+
+  ddx = div(source_width, dest_width);
+  dx = ddx.quot;
+  dx_frac = ddx.rem;
+
+  ddy = div(source_height, dest_height);
+  dy = ddy.quot;
+  dy_frac = ddy.rem;
+
+  has_alpha = gdk_pixbuf_get_has_alpha(pixbuf);
+  source_rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+  src_pixels = gdk_pixbuf_get_pixels(pixbuf);
+
+  dest_pixbuf =
+      gdk_pixbuf_new(GDK_COLORSPACE_RGB, has_alpha, 8, dest_width, dest_height);
+  dest = gdk_pixbuf_get_pixels(dest_pixbuf);
+  dest_rowstride = gdk_pixbuf_get_rowstride(dest_pixbuf);
+
+  pixel_stride = (has_alpha) ? 4 : 3;
+
+  s_y1 = 0;
+  s_yfrac = -dest_height / 2;
+  while (s_y1 < source_height) {
+    int s_x1, s_y2;
+    int s_xfrac;
+
+    s_y2 = s_y1 + dy;
+    s_yfrac += dy_frac;
+    if (s_yfrac > 0) {
+      s_y2++;
+      s_yfrac -= dest_height;
+    }
+
+    s_x1 = 0;
+    s_xfrac = -dest_width / 2;
+    while (s_x1 < source_width) {
+      s_x2 = s_x1 + dx;
+      s_xfrac += dx_frac;
+      if (s_xfrac > 0) {
+        s_x2++;
+        s_xfrac -= dest_width;
+      }
+
+      /* Average block of [x1,x2[ x [y1,y2[ and store in dest */
+      r = g = b = a = 0;
+      n_pixels = 0;
+
+      src = src_pixels + s_y1 * source_rowstride + s_x1 * pixel_stride;
+      for (y = s_y1; y < s_y2; y++) {
+        xsrc = src;
+        if (has_alpha) {
+          for (x = 0; x < s_x2 - s_x1; x++) {
+            n_pixels++;
+
+            r += xsrc[3] * xsrc[0];
+            g += xsrc[3] * xsrc[1];
+            b += xsrc[3] * xsrc[2];
+            a += xsrc[3];
+            xsrc += 4;
+          }
+        } else {
+          for (x = 0; x < s_x2 - s_x1; x++) {
+            n_pixels++;
+            r += *xsrc++;
+            g += *xsrc++;
+            b += *xsrc++;
+          }
+        }
+        src += source_rowstride;
+      }
+
+      if (has_alpha) {
+        if (a != 0) {
+          *dest++ = r / a;
+          *dest++ = g / a;
+          *dest++ = b / a;
+          *dest++ = a / n_pixels;
+        } else {
+          *dest++ = 0;
+          *dest++ = 0;
+          *dest++ = 0;
+          *dest++ = 0;
+        }
+      } else {
+        if (n_pixels != 0) {
+          *dest++ = r / n_pixels;
+          *dest++ = g / n_pixels;
+          *dest++ = b / n_pixels;
+        } else {
+          *dest++ = 0;
+          *dest++ = 0;
+          *dest++ = 0;
+        }
+      }
+
+      s_x1 = s_x2;
+    }
+    s_y1 = s_y2;
+    dest += dest_rowstride - dest_width * pixel_stride;
+  }
+
+  return dest_pixbuf;
+}
+
+static GdkPixbuf *random_pixbuf(GRand *rand, int width, int height,
+                                gboolean has_alpha) {
+  GdkPixbuf *pixbuf;
+  guchar *pixels;
+  int i, n_bytes;
+
+  pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, has_alpha, 8, width, height);
+  pixels = gdk_pixbuf_get_pixels(pixbuf);
+  n_bytes = (height - 1) * gdk_pixbuf_get_rowstride(pixbuf) +
+            width * gdk_pixbuf_get_n_channels(pixbuf);
+  for (i = 0; i < n_bytes; i++) {
+    /* plenty of fully transparent and opaque pixels */
+    switch (g_rand_int_range(rand, 0, 4)) {
+      case 0:
+        pixels[i] = 0;
+        break;
+      case 1:
+        pixels[i] = 255;
+        break;
+      default:
+        pixels[i] = g_rand_int_range(rand, 0, 256);
+        break;
+    }
+  }
+
+  return pixbuf;
+}
+
+static gboolean check_scale_down(GdkPixbuf *pixbuf, int dest_width,
+                                 int dest_height) {
+  GdkPixbuf *expected, *scaled;
+  cairo_surface_t *expected_surface, *surface;
+  gboolean equal;
+  int y, row_bytes;
+
+  expected = reference_scale_down(pixbuf, dest_width, dest_height);
+  scaled = eel_gdk_pixbuf_scale_down(pixbuf, dest_width, dest_height);
+  row_bytes = dest_width * gdk_pixbuf_get_n_channels(expected);
+
+  equal = TRUE;
+  for (y = 0; y < dest_height; y++) {
+    if (memcmp(gdk_pixbuf_get_pixels(expected) +
+                   y * gdk_pixbuf_get_rowstride(expected),
+               gdk_pixbuf_get_pixels(scaled) +
+                   y * gdk_pixbuf_get_rowstride(scaled),
+               row_bytes) != 0) {
+      equal = FALSE;
+    }
+  }
+
+  /* the surface has to hold what converting the pixbuf would give */
+  expected_surface = gdk_cairo_surface_create_from_pixbuf(expected, 1, NULL);
+  surface = eel_gdk_pixbuf_scale_down_to_surface(pixbuf, dest_width,
+                                                 dest_height);
+  cairo_surface_flush(expected_surface);
+  for (y = 0; y < dest_height; y++) {
+    if (memcmp(cairo_image_surface_get_data(expected_surface) +
+                   y * cairo_image_surface_get_stride(expected_surface),
+               cairo_image_surface_get_data(surface) +
+                   y * cairo_image_surface_get_stride(surface),
+               dest_width * 4) != 0) {
+      equal = FALSE;
+    }
+  }
+
+  if (!equal) {
+    printf("FAIL: %dx%d %s to %dx%d\n", gdk_pixbuf_get_width(pixbuf),
+           gdk_pixbuf_get_height(pixbuf),
+           gdk_pixbuf_get_has_alpha(pixbuf) ? "RGBA" : "RGB", dest_width,
+           dest_height);
+  }
+
+  cairo_surface_destroy(surface);
+  cairo_surface_destroy(expected_surface);
+  g_object_unref(scaled);
+  g_object_unref(expected);
+
+  return equal;
+}
+
+static gboolean check_exact_output(void) {
+  GRand *rand;
+  GdkPixbuf *pixbuf;
+  gboolean ok;
+  int i, width, height;
+
+  rand = g_rand_new_with_seed(23);
+  ok = TRUE;
+
+  for (i = 0; i < 200; i++) {
+    width = g_rand_int_range(rand, 1, 300);
+    height = g_rand_int_range(rand, 1, 200);
+    pixbuf = random_pixbuf(rand, width, height, g_rand_boolean(rand));
+
+    ok &= check_scale_down(pixbuf, g_rand_int_range(rand, 1, width + 1),
+                           g_rand_int_range(rand, 1, height + 1));
+    g_object_unref(pixbuf);
+  }
+
+  /* big enough to be split across threads */
+  pixbuf = random_pixbuf(rand, 4000, 3000, TRUE);
+  ok &= check_scale_down(pixbuf, 256, 192);
+  ok &= check_scale_down(pixbuf, 7, 3000);
+  g_object_unref(pixbuf);
+
+  g_rand_free(rand);
+
+  printf("%s\n", ok ? "eel_gdk_pixbuf_scale_down output is exact"
+                    : "eel_gdk_pixbuf_scale_down output differs");
+
+  return ok;
+}
+
 int main(int argc, char *argv[]) {
   GdkPixbuf *pixbuf, *scaled;
+  cairo_surface_t *surface;
   GError *error;
+  GRand *rand;
   gint64 t1, t2;
   int width;
   int height;
+  gboolean ok;
 
   test_init(&argc, &argv);
 
-  if (argc != 2) {
-    printf("Usage: test <image filename>\n");
+  if (argc > 2) {
+    printf("Usage: test [image filename]\n");
     exit(1);
   }
 
-  error = NULL;
-  pixbuf = gdk_pixbuf_new_from_file(argv[1], &error);
+  ok = check_exact_output();
 
-  if (pixbuf == NULL) {
-    printf("error loading pixbuf: %s\n", error->message);
-    exit(1);
+  if (argc == 2) {
+    error = NULL;
+    pixbuf = gdk_pixbuf_new_from_file(argv[1], &error);
+
+    if (pixbuf == NULL) {
+      printf("error loading pixbuf: %s\n", error->message);
+      exit(1);
+    }
+  } else {
+    /* a big camera picture */
+    rand = g_rand_new_with_seed(7);
+    pixbuf = random_pixbuf(rand, 6000, 4000, TRUE);
+    g_rand_free(rand);
   }
 
   width = gdk_pixbuf_get_width(pixbuf);
@@ -32,6 +291,13 @@ int main(int argc, char *argv[]) {
   printf("scale factors: %f, %f\n", ((double)width) / ((double)DEST_WIDTH),
          ((double)height) / ((double)DEST_HEIGHT));
 
+  t1 = g_get_monotonic_time();
+  scaled = reference_scale_down(pixbuf, DEST_WIDTH, DEST_HEIGHT);
+  t2 = g_get_monotonic_time();
+  g_object_unref(scaled);
+  g_print("Time for the old box filter: %" G_GINT64_FORMAT " usecs\n",
+          t2 - t1);
+
   t1 = g_get_monotonic_time();
   scaled = eel_gdk_pixbuf_scale_down(pixbuf, DEST_WIDTH, DEST_HEIGHT);
   t2 = g_get_monotonic_time();
@@ -39,6 +305,15 @@ int main(int argc, char *argv[]) {
   g_print("Time for eel_gdk_pixbuf_scale_down: %" G_GINT64_FORMAT " usecs\n",
           t2 - t1);
 
+  t1 = g_get_monotonic_time();
+  surface =
+      eel_gdk_pixbuf_scale_down_to_surface(pixbuf, DEST_WIDTH, DEST_HEIGHT);
+  t2 = g_get_monotonic_time();
+  cairo_surface_destroy(surface);
+  g_print("Time for eel_gdk_pixbuf_scale_down_to_surface: %" G_GINT64_FORMAT
+          " usecs\n",
+          t2 - t1);
+
   t1 = g_get_monotonic_time();
   scaled = gdk_pixbuf_scale_simple(pixbuf, DEST_WIDTH, DEST_HEIGHT,
                                    GDK_INTERP_NEAREST);
@@ -67,5 +342,7 @@ int main(int argc, char *argv[]) {
   gdk_pixbuf_save(scaled, "bilinear_scaled.png", "png", NULL, NULL);
   g_object_unref(scaled);
 
-  return 0;
+  g_object_unref(pixbuf);
+
+  return ok ? 0 : 1;
 }